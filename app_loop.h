@@ -0,0 +1,287 @@
+#pragma once
+
+// Application loop with the simulation and the renderer on their own threads.
+//
+// The simulation thread ticks at a fixed timestep. Every tick it drains the
+// input queue, advances the caller's state and writes a snapshot of whatever
+// the renderer needs. Snapshots are handed over through a lock-free triple
+// buffer: the simulation always owns one slot to write, one slot sits in the
+// middle holding the newest published snapshot and the renderer owns the rest.
+// Publishing and picking up are a single atomic exchange of the middle slot,
+// so neither side ever waits on the other. The renderer keeps the snapshot
+// before the newest one as well, which makes four slots, and draws the state
+// interpolated between the two, one tick behind real time.
+//
+// Input comes from whichever thread pumps platform messages, through a single
+// producer single consumer queue. Nothing in here touches windowing or D3D12,
+// so the loop runs headless just the same.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static const int AppLoopSlots = 4;
+static const uint32_t AppSnapshotFresh = 0x100;
+static const uint32_t AppInputCapacity = 256;
+// Events handed to one tick, the rest wait for the next one.
+static const int AppMaxTickEvents = 64;
+
+enum AppInputType {
+    APP_INPUT_KEY_DOWN,
+    APP_INPUT_KEY_UP,
+    APP_INPUT_MOUSE_MOVE,
+};
+
+struct AppInputEvent {
+    AppInputType type;
+    uint32_t key;
+    int32_t x;
+    int32_t y;
+};
+
+// Header in front of every snapshot payload.
+struct AppSnapshot {
+    uint64_t tick;
+    // Simulated time of the state, seconds since the loop started.
+    double time;
+    // When it was published, nanoseconds since the loop started.
+    int64_t publishedNs;
+    uint64_t pad;
+};
+
+// Advances the simulation by dt and writes the new snapshot. The snapshot
+// memory is recycled and holds an older state, it must be written in full.
+typedef void (*AppSimulateFn)(void* user, const AppInputEvent* events, int numEvents, double dt, void* snapshot);
+// Draws the state alpha of the way from previous to current.
+typedef void (*AppRenderFn)(void* user, const void* previous, const void* current, float alpha);
+
+struct AppLoopDesc {
+    double tickSeconds;
+    size_t snapshotSize;
+    AppSimulateFn simulate;
+    AppRenderFn render;
+    void* user;
+    // Minimum time between frames, 0 leaves pacing to the render callback (e.g. vsync).
+    double frameSeconds;
+    // Ticks the simulation may run late before it gives up on catching up.
+    int maxCatchUpTicks;
+};
+
+struct AppLoopStats {
+    uint64_t ticks;
+    // Ticks skipped after falling more than maxCatchUpTicks behind.
+    uint64_t ticksDropped;
+    int64_t jitterSumNs;
+    int64_t jitterMaxNs;
+    uint64_t frames;
+    // Snapshots replaced in the middle slot before the renderer picked them up.
+    uint64_t snapshotsSkipped;
+    uint64_t snapshotsPickedUp;
+    int64_t latencySumNs;
+    int64_t latencyMaxNs;
+    uint64_t inputDropped;
+};
+
+struct AppLoop {
+    AppLoopDesc desc;
+    size_t slotSize;
+    uint8_t* slots;
+    std::chrono::steady_clock::time_point start;
+
+    std::atomic<uint32_t> middle;
+    uint32_t writeSlot;
+    uint32_t readCurrent;
+    uint32_t readPrevious;
+    int snapshotsHeld;
+
+    AppInputEvent input[AppInputCapacity];
+    std::atomic<uint32_t> inputHead;
+    std::atomic<uint32_t> inputTail;
+
+    std::atomic<bool> stopping;
+    std::thread simulationThread;
+    std::thread renderThread;
+
+    // Each half is only written by its own thread; read them after appLoopStop.
+    AppLoopStats stats;
+};
+
+inline int64_t appLoopNow(const AppLoop* loop){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - loop->start).count();
+}
+
+// Sleeps most of the way and yields the rest, OS sleeps overshoot by up to a scheduler quantum.
+inline void appLoopWaitUntil(const AppLoop* loop, int64_t targetNs){
+    for(;;){
+        int64_t remaining = targetNs - appLoopNow(loop);
+        if(remaining <= 0){
+            return;
+        }
+        if(remaining > 2000000){
+            std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - 2000000));
+        }else{
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline AppSnapshot* appLoopSlot(const AppLoop* loop, uint32_t slot){
+    return (AppSnapshot*)(loop->slots + slot * loop->slotSize);
+}
+
+inline bool appLoopPushInput(AppLoop* loop, const AppInputEvent* event){
+    uint32_t tail = loop->inputTail.load(std::memory_order_relaxed);
+    if(tail - loop->inputHead.load(std::memory_order_acquire) == AppInputCapacity){
+        loop->stats.inputDropped++;
+        return false;
+    }
+    loop->input[tail % AppInputCapacity] = *event;
+    loop->inputTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+inline void appLoopPublish(AppLoop* loop){
+    uint32_t previous = loop->middle.exchange(loop->writeSlot | AppSnapshotFresh, std::memory_order_acq_rel);
+    if(previous & AppSnapshotFresh){
+        loop->stats.snapshotsSkipped++;
+    }
+    loop->writeSlot = previous & ~AppSnapshotFresh;
+}
+
+// Takes the newest snapshot if there is one. Returns true if it is new.
+inline bool appLoopPickUp(AppLoop* loop){
+    if(!(loop->middle.load(std::memory_order_relaxed) & AppSnapshotFresh)){
+        return false;
+    }
+    // The oldest slot we hold goes back to the simulation.
+    uint32_t newest = loop->middle.exchange(loop->readPrevious, std::memory_order_acq_rel);
+    loop->readPrevious = loop->readCurrent;
+    loop->readCurrent = newest & ~AppSnapshotFresh;
+    if(loop->snapshotsHeld < 2){
+        loop->snapshotsHeld++;
+    }
+    return true;
+}
+
+inline void appLoopSimulation(AppLoop* loop){
+    const int64_t tickNs = (int64_t)(loop->desc.tickSeconds * 1e9);
+    int64_t base = 0;
+    uint64_t tick = 0;
+    AppInputEvent events[AppMaxTickEvents];
+    while(!loop->stopping.load(std::memory_order_relaxed)){
+        int64_t target = base + (int64_t)(tick + 1) * tickNs;
+        appLoopWaitUntil(loop, target);
+        int64_t now = appLoopNow(loop);
+        int64_t late = now - target;
+        loop->stats.jitterSumNs += late;
+        if(late > loop->stats.jitterMaxNs) loop->stats.jitterMaxNs = late;
+
+        int numEvents = 0;
+        uint32_t head = loop->inputHead.load(std::memory_order_relaxed);
+        uint32_t tail = loop->inputTail.load(std::memory_order_acquire);
+        while(head != tail && numEvents < AppMaxTickEvents){
+            events[numEvents++] = loop->input[head++ % AppInputCapacity];
+        }
+        loop->inputHead.store(head, std::memory_order_release);
+
+        AppSnapshot* snapshot = appLoopSlot(loop, loop->writeSlot);
+        loop->desc.simulate(loop->desc.user, events, numEvents, loop->desc.tickSeconds, snapshot + 1);
+        tick++;
+        snapshot->tick = tick;
+        snapshot->time = (double)(base + (int64_t)tick * tickNs) * 1e-9;
+        snapshot->publishedNs = appLoopNow(loop);
+        appLoopPublish(loop);
+        loop->stats.ticks++;
+
+        // Too far behind, e.g. after a debugger break: drop the backlog
+        // instead of running it all at once.
+        if(late > loop->desc.maxCatchUpTicks * tickNs){
+            int64_t skipped = late / tickNs;
+            loop->stats.ticksDropped += skipped;
+            base += skipped * tickNs;
+        }
+    }
+}
+
+inline void appLoopRender(AppLoop* loop){
+    const int64_t frameNs = (int64_t)(loop->desc.frameSeconds * 1e9);
+    const double tickSeconds = loop->desc.tickSeconds;
+    int64_t nextFrame = 0;
+    while(!loop->stopping.load(std::memory_order_relaxed)){
+        if(appLoopPickUp(loop)){
+            int64_t latency = appLoopNow(loop) - appLoopSlot(loop, loop->readCurrent)->publishedNs;
+            loop->stats.snapshotsPickedUp++;
+            loop->stats.latencySumNs += latency;
+            if(latency > loop->stats.latencyMaxNs) loop->stats.latencyMaxNs = latency;
+        }
+        if(loop->snapshotsHeld == 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const AppSnapshot* current = appLoopSlot(loop, loop->readCurrent);
+        const AppSnapshot* previous = loop->snapshotsHeld > 1 ? appLoopSlot(loop, loop->readPrevious) : current;
+        // Rendering one tick behind keeps a later snapshot to interpolate towards.
+        double renderTime = appLoopNow(loop) * 1e-9 - tickSeconds;
+        double span = current->time - previous->time;
+        float alpha = span > 0.0 ? (float)((renderTime - previous->time) / span) : 1.0f;
+        alpha = alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+        loop->desc.render(loop->desc.user, previous + 1, current + 1, alpha);
+        loop->stats.frames++;
+
+        if(frameNs > 0){
+            nextFrame += frameNs;
+            int64_t now = appLoopNow(loop);
+            if(nextFrame < now) nextFrame = now;
+            appLoopWaitUntil(loop, nextFrame);
+        }
+    }
+}
+
+inline bool appLoopStart(AppLoop* loop, const AppLoopDesc* desc){
+    loop->desc = *desc;
+    if(loop->desc.maxCatchUpTicks < 1){
+        loop->desc.maxCatchUpTicks = 1;
+    }
+    // Payloads start 16 byte aligned behind the header.
+    loop->slotSize = (sizeof(AppSnapshot) + desc->snapshotSize + 15) & ~(size_t)15;
+    loop->slots = (uint8_t*)calloc(AppLoopSlots, loop->slotSize);
+    if(!loop->slots){
+        return false;
+    }
+    loop->writeSlot = 0;
+    loop->middle.store(1, std::memory_order_relaxed);
+    loop->readCurrent = 2;
+    loop->readPrevious = 3;
+    loop->snapshotsHeld = 0;
+    loop->inputHead.store(0, std::memory_order_relaxed);
+    loop->inputTail.store(0, std::memory_order_relaxed);
+    loop->stopping.store(false, std::memory_order_relaxed);
+    loop->stats = {};
+    loop->start = std::chrono::steady_clock::now();
+    loop->simulationThread = std::thread(appLoopSimulation, loop);
+    loop->renderThread = std::thread(appLoopRender, loop);
+    return true;
+}
+
+inline void appLoopStop(AppLoop* loop){
+    loop->stopping.store(true, std::memory_order_relaxed);
+    if(loop->simulationThread.joinable()) loop->simulationThread.join();
+    if(loop->renderThread.joinable()) loop->renderThread.join();
+    free(loop->slots);
+    loop->slots = 0;
+}
+
+inline void appLoopPrintStats(const AppLoop* loop, FILE* out){
+    const AppLoopStats* s = &loop->stats;
+    fprintf(out, "app loop: %llu ticks (%llu dropped), tick jitter avg %.3f ms max %.3f ms, %llu frames, "
+                 "handoff latency avg %.3f ms max %.3f ms, %llu snapshots never rendered, %llu input events dropped\n",
+            (unsigned long long)s->ticks, (unsigned long long)s->ticksDropped,
+            s->ticks ? s->jitterSumNs / 1e6 / s->ticks : 0.0, s->jitterMaxNs / 1e6, (unsigned long long)s->frames,
+            s->snapshotsPickedUp ? s->latencySumNs / 1e6 / s->snapshotsPickedUp : 0.0, s->latencyMaxNs / 1e6,
+            (unsigned long long)s->snapshotsSkipped, (unsigned long long)s->inputDropped);
+}
@@ -1,2 +1,2 @@
 C:\"Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build"\vcvarsall x64 && ^
-cl dx12_textured_quad_demo.cpp /link user32.lib d3d12.lib dxgi.lib d3dcompiler.lib
+cl dx12_textured_quad_demo.cpp /link user32.lib d3d12.lib dxgi.lib d3dcompiler.lib gdi32.lib
@@ -0,0 +1,230 @@
+#pragma once
+
+// Damage tracking: draws report the pixel bounds they touched, the tracker
+// merges them into a few rectangles and the renderer only clears and draws
+// inside those through the scissor rect. Frames without damage are skipped.
+//
+// With a flip model swap chain the back buffer being drawn still holds the
+// frame from bufferCount presents ago, so the region to redraw is the union of
+// the damage of the last bufferCount presented frames, not just the current one. This
+// needs DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL, FLIP_DISCARD throws the contents away.
+
+#include <stdint.h>
+#include <stdio.h>
+
+static const int DamageMaxPending = 64;
+static const int DamageMaxRects = 8;
+static const int DamageMaxBuffers = 4;
+// Redraw regions covering at least this much of the frame become one
+// full-frame rect; the scissored passes over the rest would save little.
+static const float DamageFullFrameFraction = 0.75f;
+
+// Same layout as D3D12_RECT.
+struct DamageRect {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+struct DamageStats {
+    uint64_t framesRendered;
+    uint64_t framesSkipped;
+    uint64_t pixelsShaded;
+    // What the same frames would have shaded with full redraws.
+    uint64_t pixelsFull;
+    uint64_t lastFramePixels;
+};
+
+struct DamageTracker {
+    int32_t width;
+    int32_t height;
+    int bufferCount;
+    int maxRects;
+
+    DamageRect pending[DamageMaxPending];
+    int numPending;
+
+    // Damage of the last bufferCount frames, ring indexed by frame number.
+    DamageRect history[DamageMaxBuffers][DamageMaxRects];
+    int historyCounts[DamageMaxBuffers];
+    uint64_t frame;
+
+    // Damage this frame introduced, for Present1 dirty rects.
+    DamageRect frameRects[DamageMaxRects];
+    int numFrameRects;
+    // Region to redraw in the current back buffer.
+    DamageRect rects[DamageMaxRects];
+    int numRects;
+
+    DamageStats stats;
+};
+
+inline int64_t damageRectArea(const DamageRect* r){
+    return (int64_t)(r->right - r->left) * (r->bottom - r->top);
+}
+
+inline bool damageRectEmpty(const DamageRect* r){
+    return r->right <= r->left || r->bottom <= r->top;
+}
+
+inline DamageRect damageRectUnion(const DamageRect* a, const DamageRect* b){
+    DamageRect r;
+    r.left = a->left < b->left ? a->left : b->left;
+    r.top = a->top < b->top ? a->top : b->top;
+    r.right = a->right > b->right ? a->right : b->right;
+    r.bottom = a->bottom > b->bottom ? a->bottom : b->bottom;
+    return r;
+}
+
+inline int64_t damageRectIntersectionArea(const DamageRect* a, const DamageRect* b){
+    DamageRect r;
+    r.left = a->left > b->left ? a->left : b->left;
+    r.top = a->top > b->top ? a->top : b->top;
+    r.right = a->right < b->right ? a->right : b->right;
+    r.bottom = a->bottom < b->bottom ? a->bottom : b->bottom;
+    return damageRectEmpty(&r) ? 0 : damageRectArea(&r);
+}
+
+// Merges rects in place until at most maxRects are left and none of them
+// overlap, so the areas of the result add up to the pixels it covers.
+// Overlapping pairs go first, then pairs whose bounding box covers no more
+// than the two rects do, then the pair wasting the fewest pixels.
+inline int damageMergeRects(DamageRect* rects, int count, int maxRects){
+    for(;;){
+        int bestI = -1;
+        int bestJ = -1;
+        bool bestOverlaps = false;
+        int64_t bestCost = INT64_MAX;
+        for(int i = 0; i < count; i++){
+            for(int j = i + 1; j < count; j++){
+                DamageRect u = damageRectUnion(&rects[i], &rects[j]);
+                int64_t overlap = damageRectIntersectionArea(&rects[i], &rects[j]);
+                int64_t cost = damageRectArea(&u) - (damageRectArea(&rects[i]) + damageRectArea(&rects[j]) - overlap);
+                bool overlaps = overlap > 0;
+                if(overlaps != bestOverlaps ? overlaps : cost < bestCost){
+                    bestOverlaps = overlaps;
+                    bestCost = cost;
+                    bestI = i;
+                    bestJ = j;
+                }
+            }
+        }
+        if(bestI < 0 || (!bestOverlaps && bestCost > 0 && count <= maxRects)){
+            return count;
+        }
+        rects[bestI] = damageRectUnion(&rects[bestI], &rects[bestJ]);
+        rects[bestJ] = rects[--count];
+    }
+}
+
+inline void damageTrackerInit(DamageTracker* t, int32_t width, int32_t height, int bufferCount, int maxRects = 4){
+    t->width = width;
+    t->height = height;
+    t->bufferCount = bufferCount < 1 ? 1 : (bufferCount > DamageMaxBuffers ? DamageMaxBuffers : bufferCount);
+    t->maxRects = maxRects < 1 ? 1 : (maxRects > DamageMaxRects ? DamageMaxRects : maxRects);
+    t->numPending = 0;
+    for(int i = 0; i < DamageMaxBuffers; i++){
+        t->historyCounts[i] = 0;
+    }
+    t->frame = 0;
+    t->numFrameRects = 0;
+    t->numRects = 0;
+    t->stats = {};
+}
+
+inline void damageTrackerAdd(DamageTracker* t, DamageRect r){
+    if(r.left < 0) r.left = 0;
+    if(r.top < 0) r.top = 0;
+    if(r.right > t->width) r.right = t->width;
+    if(r.bottom > t->height) r.bottom = t->height;
+    if(damageRectEmpty(&r)){
+        return;
+    }
+    if(t->numPending == DamageMaxPending){
+        t->numPending = damageMergeRects(t->pending, t->numPending, t->maxRects);
+    }
+    t->pending[t->numPending++] = r;
+}
+
+inline void damageTrackerAddRect(DamageTracker* t, int32_t left, int32_t top, int32_t right, int32_t bottom){
+    DamageRect r = { left, top, right, bottom };
+    damageTrackerAdd(t, r);
+}
+
+// Bounds given in normalized device coordinates (y up), padded by a pixel to
+// cover rasterization of edges that land between pixels.
+inline void damageTrackerAddNdc(DamageTracker* t, float x0, float y0, float x1, float y1){
+    float left = (x0 < x1 ? x0 : x1) * 0.5f + 0.5f;
+    float right = (x0 < x1 ? x1 : x0) * 0.5f + 0.5f;
+    float top = 0.5f - (y0 < y1 ? y1 : y0) * 0.5f;
+    float bottom = 0.5f - (y0 < y1 ? y0 : y1) * 0.5f;
+    damageTrackerAddRect(t, (int32_t)(left * t->width) - 1, (int32_t)(top * t->height) - 1,
+                         (int32_t)(right * t->width) + 2, (int32_t)(bottom * t->height) + 2);
+}
+
+// Everything changed, e.g. after a resize or on the first frames.
+inline void damageTrackerInvalidateAll(DamageTracker* t){
+    t->numPending = 0;
+    damageTrackerAddRect(t, 0, 0, t->width, t->height);
+}
+
+// Closes the damage of the frame about to be rendered. Returns the number of
+// rects in t->rects to redraw; 0 means nothing changed since the last
+// presented frame and the frame can be skipped entirely, present included.
+inline int damageTrackerBeginFrame(DamageTracker* t){
+    t->numFrameRects = damageMergeRects(t->pending, t->numPending, t->maxRects);
+    for(int i = 0; i < t->numFrameRects; i++){
+        t->frameRects[i] = t->pending[i];
+    }
+    t->numPending = 0;
+    t->stats.pixelsFull += (uint64_t)t->width * t->height;
+
+    if(t->numFrameRects == 0){
+        // Nothing is presented, so the buffer ring doesn't advance either.
+        t->numRects = 0;
+        t->stats.lastFramePixels = 0;
+        t->stats.framesSkipped++;
+        return 0;
+    }
+
+    int slot = (int)(t->frame % t->bufferCount);
+    t->historyCounts[slot] = t->numFrameRects;
+    for(int i = 0; i < t->numFrameRects; i++){
+        t->history[slot][i] = t->frameRects[i];
+    }
+
+    DamageRect gathered[DamageMaxBuffers * DamageMaxRects];
+    int count = 0;
+    for(int b = 0; b < t->bufferCount; b++){
+        for(int i = 0; i < t->historyCounts[b]; i++){
+            gathered[count++] = t->history[b][i];
+        }
+    }
+    t->numRects = damageMergeRects(gathered, count, t->maxRects);
+    uint64_t pixels = 0;
+    for(int i = 0; i < t->numRects; i++){
+        t->rects[i] = gathered[i];
+        pixels += (uint64_t)damageRectArea(&gathered[i]);
+    }
+    uint64_t full = (uint64_t)t->width * t->height;
+    if(t->numRects > 1 && pixels >= (uint64_t)(full * DamageFullFrameFraction)){
+        DamageRect all = { 0, 0, t->width, t->height };
+        t->rects[0] = all;
+        t->numRects = 1;
+        pixels = full;
+    }
+
+    t->frame++;
+    t->stats.framesRendered++;
+    t->stats.pixelsShaded += pixels;
+    t->stats.lastFramePixels = pixels;
+    return t->numRects;
+}
+
+inline void damageTrackerPrintStats(const DamageTracker* t, FILE* out){
+    const DamageStats* s = &t->stats;
+    fprintf(out, "damage: %llu frames rendered, %llu skipped, %llu of %llu pixels shaded (%.1f%%)\n",
+            (unsigned long long)s->framesRendered, (unsigned long long)s->framesSkipped, (unsigned long long)s->pixelsShaded,
+            (unsigned long long)s->pixelsFull, s->pixelsFull ? 100.0 * s->pixelsShaded / s->pixelsFull : 0.0);
+}
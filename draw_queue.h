@@ -0,0 +1,344 @@
+#pragma once
+
+// Draw queue: draws are recorded with a 64 bit sort key holding the state they
+// need, sorted with an LSD radix sort and emitted in key order, so draws sharing
+// a pipeline, root signature or descriptor table end up next to each other and
+// binds matching the current state are skipped.
+//
+// Key layout, most significant first:
+//   pass 4 | pipeline 12 | root signature 8 | descriptor table 16 | depth 24
+// Pipelines, root signatures and tables are ids into whatever tables the caller
+// keeps, the queue only hands them back through the callbacks.
+//
+// The sort splits the keys across the threads of a worker pool: each thread
+// builds a digit histogram of its slice, the histograms are turned into per
+// thread scatter offsets and every thread scatters its slice, once per byte.
+// Bytes that are the same for every key are skipped, so the passes actually
+// run depend on how many distinct states are in use.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "worker_pool.h"
+
+static const int DrawQueueMaxThreads = 8;
+// Below this many draws sorting on one thread is faster than waking others.
+static const uint32_t DrawQueueParallelThreshold = 32 * 1024;
+static const uint32_t DrawQueueNoState = 0xFFFFFFFF;
+
+inline uint64_t drawKeyPack(uint32_t pass, uint32_t pipeline, uint32_t rootSignature, uint32_t descriptorTable, uint32_t depth){
+    return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(pipeline & 0xFFF) << 48) | ((uint64_t)(rootSignature & 0xFF) << 40) |
+           ((uint64_t)(descriptorTable & 0xFFFF) << 24) | (uint64_t)(depth & 0xFFFFFF);
+}
+
+inline uint32_t drawKeyPass(uint64_t key){ return (uint32_t)(key >> 60); }
+inline uint32_t drawKeyPipeline(uint64_t key){ return (uint32_t)(key >> 48) & 0xFFF; }
+inline uint32_t drawKeyRootSignature(uint64_t key){ return (uint32_t)(key >> 40) & 0xFF; }
+inline uint32_t drawKeyDescriptorTable(uint64_t key){ return (uint32_t)(key >> 24) & 0xFFFF; }
+inline uint32_t drawKeyDepth(uint64_t key){ return (uint32_t)key & 0xFFFFFF; }
+
+// Depth in [0, 1] quantized for the key; backToFront flips it for blended passes.
+inline uint32_t drawKeyQuantizeDepth(float depth, bool backToFront = false){
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    uint32_t q = (uint32_t)(depth * 16777215.0f);
+    return backToFront ? 0xFFFFFF - q : q;
+}
+
+struct DrawItem {
+    uint64_t key;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t startVertex;
+    uint32_t startInstance;
+    uint64_t userData;
+};
+
+struct DrawQueueCallbacks {
+    void (*setPipeline)(void* context, uint32_t pipeline);
+    void (*setRootSignature)(void* context, uint32_t rootSignature);
+    void (*setDescriptorTable)(void* context, uint32_t descriptorTable);
+    void (*draw)(void* context, const DrawItem* item);
+    void* context;
+};
+
+struct DrawQueueStats {
+    uint64_t draws;
+    uint64_t pipelineBinds;
+    uint64_t rootSignatureBinds;
+    uint64_t tableBinds;
+    // Binds the same draws would have needed in submission order, redundant ones still skipped.
+    uint64_t bindsUnsorted;
+    // Binds when every draw sets all of its state.
+    uint64_t bindsNaive;
+    uint32_t radixPasses;
+};
+
+struct DrawSortBarrier {
+    std::mutex mutex;
+    std::condition_variable released;
+    int threads;
+    int waiting;
+    uint64_t generation;
+};
+
+inline void drawSortBarrierWait(DrawSortBarrier* b){
+    std::unique_lock<std::mutex> lock(b->mutex);
+    uint64_t generation = b->generation;
+    if(++b->waiting == b->threads){
+        b->waiting = 0;
+        b->generation++;
+        b->released.notify_all();
+        return;
+    }
+    b->released.wait(lock, [&]{ return b->generation != generation; });
+}
+
+// State of one sort, kept in the queue so sorting allocates nothing.
+struct DrawSortShared {
+    uint64_t* keys[2];
+    uint32_t* order[2];
+    uint32_t count;
+    int numThreads;
+    uint32_t histograms[DrawQueueMaxThreads][256];
+    // Digit counts of every byte, for sorts that run on one thread.
+    uint32_t allCounts[8][256];
+    bool skipPass;
+    uint32_t passesRun;
+    DrawSortBarrier barrier;
+};
+
+struct DrawQueue {
+    uint32_t capacity;
+    uint32_t count;
+    DrawItem* items;
+    uint64_t* keys;
+    uint32_t* order;
+    uint64_t* scratchKeys;
+    uint32_t* scratchOrder;
+    WorkerPool* pool;
+    int numThreads;
+    DrawSortShared sort;
+
+    DrawQueueStats stats;
+};
+
+// pool may be null to sort on the calling thread only, and is shared, not owned.
+inline bool drawQueueInit(DrawQueue* q, uint32_t capacity, WorkerPool* pool){
+    q->capacity = capacity;
+    q->count = 0;
+    q->items = (DrawItem*)malloc(capacity * sizeof(DrawItem));
+    q->keys = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    q->order = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    q->scratchKeys = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    q->scratchOrder = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    q->pool = pool;
+    int numThreads = workerPoolThreads(pool);
+    q->numThreads = numThreads > DrawQueueMaxThreads ? DrawQueueMaxThreads : numThreads;
+    q->stats = {};
+    return q->items && q->keys && q->order && q->scratchKeys && q->scratchOrder;
+}
+
+inline void drawQueueDestroy(DrawQueue* q){
+    free(q->items);
+    free(q->keys);
+    free(q->order);
+    free(q->scratchKeys);
+    free(q->scratchOrder);
+    q->items = 0;
+}
+
+inline void drawQueueReset(DrawQueue* q){
+    q->count = 0;
+}
+
+inline bool drawQueueAdd(DrawQueue* q, uint64_t key, uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance, uint64_t userData = 0){
+    if(q->count == q->capacity){
+        return false;
+    }
+    // Until drawQueueSort reorders them draws are submitted as they were added.
+    q->order[q->count] = q->count;
+    DrawItem* item = &q->items[q->count++];
+    item->key = key;
+    item->vertexCount = vertexCount;
+    item->instanceCount = instanceCount;
+    item->startVertex = startVertex;
+    item->startInstance = startInstance;
+    item->userData = userData;
+    return true;
+}
+
+inline void drawSortWorker(void* context, int thread, int numThreads){
+    DrawSortShared* s = (DrawSortShared*)context;
+    uint32_t begin = (uint32_t)((uint64_t)s->count * thread / s->numThreads);
+    uint32_t end = (uint32_t)((uint64_t)s->count * (thread + 1) / s->numThreads);
+    // Alone, the digit counts of every pass can come from one read of the keys.
+    // With more threads each pass reshuffles which keys a thread owns.
+    uint32_t (*allCounts)[256] = 0;
+    if(s->numThreads == 1){
+        allCounts = s->allCounts;
+        memset(allCounts, 0, sizeof(s->allCounts));
+        for(uint32_t i = 0; i < s->count; i++){
+            uint64_t key = s->keys[0][i];
+            for(int b = 0; b < 8; b++){
+                allCounts[b][(key >> (b * 8)) & 0xFF]++;
+            }
+        }
+    }
+    int src = 0;
+    for(int shift = 0; shift < 64; shift += 8){
+        const uint64_t* keys = s->keys[src];
+        const uint32_t* order = s->order[src];
+        uint32_t* histogram = s->histograms[thread];
+        if(allCounts){
+            memcpy(histogram, allCounts[shift / 8], 256 * sizeof(uint32_t));
+        }else{
+            memset(histogram, 0, 256 * sizeof(uint32_t));
+            for(uint32_t i = begin; i < end; i++){
+                histogram[(keys[i] >> shift) & 0xFF]++;
+            }
+        }
+        if(s->numThreads > 1) drawSortBarrierWait(&s->barrier);
+
+        if(thread == 0){
+            // Exclusive prefix sum over digits, then threads, so every thread
+            // scatters behind the earlier threads with the same digit and the sort stays stable.
+            uint32_t running = 0;
+            s->skipPass = false;
+            for(int digit = 0; digit < 256; digit++){
+                uint32_t digitCount = 0;
+                for(int t = 0; t < s->numThreads; t++){
+                    uint32_t n = s->histograms[t][digit];
+                    s->histograms[t][digit] = running;
+                    running += n;
+                    digitCount += n;
+                }
+                if(digitCount == s->count){
+                    s->skipPass = true;
+                }
+            }
+            if(!s->skipPass) s->passesRun++;
+        }
+        if(s->numThreads > 1) drawSortBarrierWait(&s->barrier);
+
+        if(s->skipPass){
+            continue;
+        }
+        uint64_t* dstKeys = s->keys[src ^ 1];
+        uint32_t* dstOrder = s->order[src ^ 1];
+        for(uint32_t i = begin; i < end; i++){
+            uint32_t slot = histogram[(keys[i] >> shift) & 0xFF]++;
+            dstKeys[slot] = keys[i];
+            dstOrder[slot] = order[i];
+        }
+        src ^= 1;
+        // Nobody may start counting the next digit before all scatters are done.
+        if(s->numThreads > 1) drawSortBarrierWait(&s->barrier);
+    }
+    if(thread == 0 && src == 1){
+        memcpy(s->keys[0], s->keys[1], s->count * sizeof(uint64_t));
+        memcpy(s->order[0], s->order[1], s->count * sizeof(uint32_t));
+    }
+}
+
+// Sorts the recorded draws by key. Equal keys keep their submission order.
+inline void drawQueueSort(DrawQueue* q){
+    DrawSortShared* s = &q->sort;
+    s->keys[0] = q->keys;
+    s->keys[1] = q->scratchKeys;
+    s->order[0] = q->order;
+    s->order[1] = q->scratchOrder;
+    s->count = q->count;
+    s->numThreads = q->count >= DrawQueueParallelThreshold ? q->numThreads : 1;
+    s->passesRun = 0;
+    s->barrier.threads = s->numThreads;
+    s->barrier.waiting = 0;
+    s->barrier.generation = 0;
+    for(uint32_t i = 0; i < q->count; i++){
+        q->keys[i] = q->items[i].key;
+        q->order[i] = i;
+    }
+
+    if(q->count > 0){
+        workerPoolRun(q->pool, s->numThreads, drawSortWorker, s);
+    }
+    q->stats.radixPasses = s->passesRun;
+}
+
+// Counts the binds a sequence of keys needs. A new root signature invalidates
+// the bound root arguments, so the table is set again after it.
+inline uint64_t drawQueueCountBinds(const DrawItem* items, const uint32_t* order, uint32_t count){
+    uint32_t pipeline = DrawQueueNoState;
+    uint32_t rootSignature = DrawQueueNoState;
+    uint32_t table = DrawQueueNoState;
+    uint64_t binds = 0;
+    for(uint32_t i = 0; i < count; i++){
+        uint64_t key = items[order ? order[i] : i].key;
+        if(drawKeyPipeline(key) != pipeline){
+            pipeline = drawKeyPipeline(key);
+            binds++;
+        }
+        if(drawKeyRootSignature(key) != rootSignature){
+            rootSignature = drawKeyRootSignature(key);
+            table = DrawQueueNoState;
+            binds++;
+        }
+        if(drawKeyDescriptorTable(key) != table){
+            table = drawKeyDescriptorTable(key);
+            binds++;
+        }
+    }
+    return binds;
+}
+
+// Emits the draws through the callbacks, in key order after drawQueueSort and
+// in the order they were added otherwise, and keeps them queued, so a pass can
+// replay the same sorted draws under several scissor rects.
+inline void drawQueueEmit(DrawQueue* q, const DrawQueueCallbacks* callbacks){
+    uint32_t pipeline = DrawQueueNoState;
+    uint32_t rootSignature = DrawQueueNoState;
+    uint32_t table = DrawQueueNoState;
+    for(uint32_t i = 0; i < q->count; i++){
+        const DrawItem* item = &q->items[q->order[i]];
+        if(drawKeyPipeline(item->key) != pipeline){
+            pipeline = drawKeyPipeline(item->key);
+            callbacks->setPipeline(callbacks->context, pipeline);
+            q->stats.pipelineBinds++;
+        }
+        if(drawKeyRootSignature(item->key) != rootSignature){
+            rootSignature = drawKeyRootSignature(item->key);
+            table = DrawQueueNoState;
+            callbacks->setRootSignature(callbacks->context, rootSignature);
+            q->stats.rootSignatureBinds++;
+        }
+        if(drawKeyDescriptorTable(item->key) != table){
+            table = drawKeyDescriptorTable(item->key);
+            callbacks->setDescriptorTable(callbacks->context, table);
+            q->stats.tableBinds++;
+        }
+        callbacks->draw(callbacks->context, item);
+    }
+    q->stats.draws += q->count;
+    q->stats.bindsUnsorted += drawQueueCountBinds(q->items, 0, q->count);
+    q->stats.bindsNaive += 3 * (uint64_t)q->count;
+}
+
+// drawQueueEmit, then clears the queue.
+inline void drawQueueSubmit(DrawQueue* q, const DrawQueueCallbacks* callbacks){
+    drawQueueEmit(q, callbacks);
+    q->count = 0;
+}
+
+inline void drawQueuePrintStats(const DrawQueue* q, FILE* out){
+    const DrawQueueStats* s = &q->stats;
+    uint64_t binds = s->pipelineBinds + s->rootSignatureBinds + s->tableBinds;
+    fprintf(out, "draw queue: %llu draws, %llu binds (%llu pipeline, %llu root signature, %llu table), "
+                 "%lld saved vs submission order, %lld saved vs binding per draw, %u radix passes last sort\n",
+            (unsigned long long)s->draws, (unsigned long long)binds, (unsigned long long)s->pipelineBinds,
+            (unsigned long long)s->rootSignatureBinds, (unsigned long long)s->tableBinds,
+            (long long)(s->bindsUnsorted - binds), (long long)(s->bindsNaive - binds), s->radixPasses);
+}
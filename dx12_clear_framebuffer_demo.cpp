@@ -5,9 +5,18 @@
 #include <stdio.h>
 
 #include <comdef.h>
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "app_loop.h"
+#include "startup_graph.h"
 
 static const UINT FrameCount = 2;
 
+HWND m_window;
+IDXGIFactory4* m_factory;
 IDXGISwapChain3* m_swapChain;
 ID3D12Device* m_device;
 ID3D12Resource* m_renderTargets[FrameCount];
@@ -23,6 +32,29 @@ HANDLE m_fenceEvent;
 ID3D12Fence* m_fence;
 UINT64 m_fenceValue;
 
+AppLoop m_loop;
+// The first failure on the render thread, reported by main once the loop has stopped.
+std::atomic<bool> m_renderFailed;
+HRESULT m_renderError;
+const char* m_renderErrorCall;
+
+// The device comes up first, then the swap chain and the command objects
+// together. Failures are reported by main once the graph is done.
+StartupGraph m_startup;
+// Time to first present is measured from the top of main.
+std::chrono::steady_clock::time_point m_launched;
+bool m_presented;
+
+// What the renderer gets from each simulation tick.
+struct ClearState {
+    float color[4];
+};
+
+struct ClearSimulation {
+    double phase;
+    bool paused;
+};
+
 void checkError(HRESULT res){
     if(res != S_OK){
         _com_error err(res);
@@ -32,6 +64,151 @@ void checkError(HRESULT res){
     }
 }
 
+// checkError for startup steps. They run on the graph's threads, where a
+// message box would stall a worker and exit would pull the device out from
+// under the others, so the error is recorded and the step fails instead.
+bool stepSucceeded(HRESULT res, const char* call){
+    if(res == S_OK){
+        return true;
+    }
+    _com_error err(res);
+    char message[StartupGraphMaxError];
+    snprintf(message, sizeof(message), "%s: %s", call, err.ErrorMessage());
+    startupGraphSetError(&m_startup, message);
+    return false;
+}
+
+// Shows the first step that failed, back on the window's thread.
+void checkStartup(bool ok){
+    if(ok){
+        return;
+    }
+    startupGraphPrintReport(&m_startup, stdout);
+    char message[StartupGraphMaxError + 64];
+    if(m_startup.firstFailed < 0){
+        snprintf(message, sizeof(message), "The startup steps depend on each other in a cycle.");
+    }else{
+        const StartupStep* step = &m_startup.steps[m_startup.firstFailed];
+        snprintf(message, sizeof(message), "Startup step \"%s\" failed.\n%s", step->name, step->error);
+    }
+    MessageBox(0, message, "Error!", 0);
+    exit(1);
+}
+
+// checkError for the render thread. A message box there would stall the loop
+// and exit would release the device while the simulation thread still runs,
+// so the first failure is recorded and the window's thread is woken to stop
+// the loop and report it. Later frames are skipped.
+bool renderSucceeded(HRESULT res, const char* call){
+    if(res == S_OK){
+        return true;
+    }
+    if(!m_renderFailed.load(std::memory_order_relaxed)){
+        m_renderError = res;
+        m_renderErrorCall = call;
+        m_renderFailed.store(true, std::memory_order_release);
+        PostMessage(m_window, WM_NULL, 0, 0);
+    }
+    return false;
+}
+
+// Called on the simulation thread every tick.
+void simulateClearColor(void* user, const AppInputEvent* events, int numEvents, double dt, void* snapshot){
+    ClearSimulation* sim = (ClearSimulation*)user;
+    for (int i = 0; i < numEvents; i++){
+        if(events[i].type == APP_INPUT_KEY_DOWN && events[i].key == VK_SPACE){
+            sim->paused = !sim->paused;
+        }
+    }
+    if(!sim->paused){
+        sim->phase += dt;
+    }
+    ClearState* state = (ClearState*)snapshot;
+    state->color[0] = 0.1f + 0.1f * (float)sin(sim->phase * 1.3);
+    state->color[1] = 0.2f + 0.1f * (float)sin(sim->phase * 0.7);
+    state->color[2] = 0.4f + 0.2f * (float)sin(sim->phase);
+    state->color[3] = 1.0f;
+}
+
+// Called on the render thread with the last two simulation snapshots.
+void renderFrame(void* user, const void* previous, const void* current, float alpha){
+    const ClearState* p = (const ClearState*)previous;
+    const ClearState* c = (const ClearState*)current;
+    if(m_renderFailed.load(std::memory_order_relaxed)){
+        return;
+    }
+
+    if(!renderSucceeded(m_commandAllocator->Reset(), "Reset allocator") ||
+       !renderSucceeded(m_commandList->Reset(m_commandAllocator, m_pipelineState), "Reset command list")){
+        return;
+    }
+
+    // Indicate that the back buffer will be used as a render target.
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    barrier.Transition.pResource = m_renderTargets[m_frameIndex];
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
+    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex], D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+    m_commandList->ResourceBarrier(1, &barrier);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+    rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
+
+    // Record commands.
+    float clearColor[4];
+    for (int i = 0; i < 4; i++){
+        clearColor[i] = p->color[i] + (c->color[i] - p->color[i]) * alpha;
+    }
+    m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, 0);
+
+    // Indicate that the back buffer will now be used to present.
+    D3D12_RESOURCE_BARRIER barrier2 = {};
+    barrier2.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier2.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    barrier2.Transition.pResource = m_renderTargets[m_frameIndex];
+    barrier2.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    barrier2.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
+    barrier2.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+    m_commandList->ResourceBarrier(1, &barrier2);
+
+    if(!renderSucceeded(m_commandList->Close(), "Close")){
+        return;
+    }
+
+    ID3D12CommandList* ppCommandLists[] = { m_commandList };
+    m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+    // Present the frame.
+    if(!renderSucceeded(m_swapChain->Present(1, 0), "Present")){
+        return;
+    }
+    if(!m_presented){
+        m_presented = true;
+        printf("first present %.2f ms after launch, %.2f ms of it startup steps\n",
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_launched).count(), m_startup.wallSeconds * 1000.0);
+    }
+
+    const UINT64 fence = m_fenceValue;
+    if(!renderSucceeded(m_commandQueue->Signal(m_fence, fence), "Signal")){
+        return;
+    }
+    m_fenceValue++;
+
+    // Wait until the previous frame is finished.
+    if (m_fence->GetCompletedValue() < fence){
+        if(!renderSucceeded(m_fence->SetEventOnCompletion(fence, m_fenceEvent), "SetEventOnCompletion")){
+            return;
+        }
+        WaitForSingleObject(m_fenceEvent, INFINITE);
+    }
+
+    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+}
+
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam){
     return DefWindowProc(hWnd, message, wParam, lParam);
 }
@@ -55,34 +232,27 @@ void GetHardwareAdapter(IDXGIFactory4* pFactory, IDXGIAdapter1** ppAdapter){
     }
 }
 
-int main(int argc, char** argv){
-    HMODULE hwnd = GetModuleHandle(0);
-    WNDCLASSEX windowClass = { 0 };
-    windowClass.cbSize = sizeof(WNDCLASSEX);
-    windowClass.style = CS_HREDRAW | CS_VREDRAW;
-    windowClass.lpfnWndProc = WindowProc;
-    windowClass.hInstance = hwnd;
-    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
-    windowClass.lpszClassName = "DXSampleClass";
-    RegisterClassEx(&windowClass);
-    
-    HWND window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
-
+bool createDeviceStep(void* context){
     UINT dxgiFactoryFlags = 0;
-    IDXGIFactory4* factory;
-    checkError(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    if(!stepSucceeded(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&m_factory)), "CreateDXGIFactory2")){
+        return false;
+    }
 
     IDXGIAdapter1* hardwareAdapter;
-    GetHardwareAdapter(factory, &hardwareAdapter);
+    GetHardwareAdapter(m_factory, &hardwareAdapter);
 
-    checkError(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)));
+    if(!stepSucceeded(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)), "D3D12CreateDevice")){
+        return false;
+    }
 
     D3D12_COMMAND_QUEUE_DESC queueDesc = {};
     queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
     queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 
-    checkError(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
+    return stepSucceeded(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)), "CreateCommandQueue");
+}
 
+bool createSwapChainStep(void* context){
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
     swapChainDesc.BufferCount = FrameCount;
     swapChainDesc.Width = 900;
@@ -93,9 +263,10 @@ int main(int argc, char** argv){
     swapChainDesc.SampleDesc.Count = 1;
 
     IDXGISwapChain1* swapChain;
-    checkError(factory->CreateSwapChainForHwnd(m_commandQueue, window, &swapChainDesc, 0, 0, &swapChain));
-
-    checkError(factory->MakeWindowAssociation(window, DXGI_MWA_NO_ALT_ENTER));
+    if(!stepSucceeded(m_factory->CreateSwapChainForHwnd(m_commandQueue, m_window, &swapChainDesc, 0, 0, &swapChain), "CreateSwapChainForHwnd") ||
+       !stepSucceeded(m_factory->MakeWindowAssociation(m_window, DXGI_MWA_NO_ALT_ENTER), "MakeWindowAssociation")){
+        return false;
+    }
 
     m_swapChain = (IDXGISwapChain3*)swapChain;
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -106,7 +277,9 @@ int main(int argc, char** argv){
         rtvHeapDesc.NumDescriptors = FrameCount;
         rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
         rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-        checkError(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
+        if(!stepSucceeded(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)), "CreateDescriptorHeap")){
+            return false;
+        }
 
         m_rtvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
     }
@@ -116,94 +289,107 @@ int main(int argc, char** argv){
 
         for (UINT n = 0; n < FrameCount; n++)
         {
-            checkError(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
+            if(!stepSucceeded(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])), "GetBuffer")){
+                return false;
+            }
             m_device->CreateRenderTargetView(m_renderTargets[n], 0, rtvHandle);
             rtvHandle.ptr += m_rtvDescriptorSize;
         }
     }
+    return true;
+}
 
-    checkError(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
-    checkError(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, 0, IID_PPV_ARGS(&m_commandList)));
-    checkError(m_commandList->Close());
+// The command allocator and list, and the fence frames wait on.
+bool createCommandsStep(void* context){
+    if(!stepSucceeded(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)), "CreateCommandAllocator") ||
+       !stepSucceeded(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, 0, IID_PPV_ARGS(&m_commandList)), "CreateCommandList") ||
+       !stepSucceeded(m_commandList->Close(), "Close")){
+        return false;
+    }
 
     {
-        checkError(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+        if(!stepSucceeded(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)), "CreateFence")){
+            return false;
+        }
         m_fenceValue = 1;
 
         m_fenceEvent = CreateEvent(0, FALSE, FALSE, 0);
         if (m_fenceEvent == 0)
         {
-            checkError(HRESULT_FROM_WIN32(GetLastError()));
+            return stepSucceeded(HRESULT_FROM_WIN32(GetLastError()), "CreateEvent");
         }
     }
+    return true;
+}
 
-    ShowWindow(window, SW_SHOW);
+int main(int argc, char** argv){
+    m_launched = std::chrono::steady_clock::now();
+    HMODULE hwnd = GetModuleHandle(0);
+    WNDCLASSEX windowClass = { 0 };
+    windowClass.cbSize = sizeof(WNDCLASSEX);
+    windowClass.style = CS_HREDRAW | CS_VREDRAW;
+    windowClass.lpfnWndProc = WindowProc;
+    windowClass.hInstance = hwnd;
+    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
+    windowClass.lpszClassName = "DXSampleClass";
+    RegisterClassEx(&windowClass);
+    
+    m_window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
+
+    startupGraphInit(&m_startup);
+    int deviceStep = startupGraphAdd(&m_startup, "device", createDeviceStep, 0);
+    int swapChainStep = startupGraphAdd(&m_startup, "swap chain", createSwapChainStep, 0);
+    startupGraphDepend(&m_startup, swapChainStep, deviceStep);
+    // DXGI sends messages to the window while creating the swap chain, so it stays on the window's thread.
+    startupGraphPin(&m_startup, swapChainStep);
+    int commandsStep = startupGraphAdd(&m_startup, "commands", createCommandsStep, 0);
+    startupGraphDepend(&m_startup, commandsStep, deviceStep);
+    // After the device only two steps are left, one thread each.
+    checkStartup(startupGraphRun(&m_startup, 2));
+
+    ShowWindow(m_window, SW_SHOW);
+
+    // Simulation and rendering run on their own threads, this one only pumps
+    // messages and forwards input. Space pauses the animation, other keys quit.
+    ClearSimulation simulation = {};
+    AppLoopDesc loopDesc = {};
+    loopDesc.tickSeconds = 1.0 / 60.0;
+    loopDesc.snapshotSize = sizeof(ClearState);
+    loopDesc.simulate = simulateClearColor;
+    loopDesc.render = renderFrame;
+    loopDesc.user = &simulation;
+    loopDesc.maxCatchUpTicks = 5;
+    if(!appLoopStart(&m_loop, &loopDesc)){
+        checkError(E_OUTOFMEMORY);
+    }
 
     MSG msg = {};
-    while (msg.message != WM_QUIT){
-        if (PeekMessage(&msg, 0, 0, 0, PM_REMOVE)){
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+    while (GetMessage(&msg, 0, 0, 0) > 0){
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+
+        if(m_renderFailed.load(std::memory_order_acquire)){
+            break;
         }
 
-        if(msg.message == WM_PAINT){
-            checkError(m_commandAllocator->Reset());
-
-            checkError(m_commandList->Reset(m_commandAllocator, m_pipelineState));
-
-            // Indicate that the back buffer will be used as a render target.
-            D3D12_RESOURCE_BARRIER barrier = {};
-            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            barrier.Transition.pResource = m_renderTargets[m_frameIndex];
-            barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-            barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-            barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex], D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-            m_commandList->ResourceBarrier(1, &barrier);
-
-            D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
-            rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
-
-            // Record commands.
-            const float clearColor[] = { 0.0f, 0.2f, 0.4f, 1.0f };
-            m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, 0);
-
-            // Indicate that the back buffer will now be used to present.
-            D3D12_RESOURCE_BARRIER barrier2 = {};
-            barrier2.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            barrier2.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            barrier2.Transition.pResource = m_renderTargets[m_frameIndex];
-            barrier2.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-            barrier2.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-            barrier2.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
-            m_commandList->ResourceBarrier(1, &barrier2);
-
-            checkError(m_commandList->Close());
-
-            ID3D12CommandList* ppCommandLists[] = { m_commandList };
-            m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-
-            // Present the frame.
-            checkError(m_swapChain->Present(1, 0));
-
-            const UINT64 fence = m_fenceValue;
-            checkError(m_commandQueue->Signal(m_fence, fence));
-            m_fenceValue++;
-
-            // Wait until the previous frame is finished.
-            if (m_fence->GetCompletedValue() < fence){
-                checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-                WaitForSingleObject(m_fenceEvent, INFINITE);
+        if(msg.message == WM_KEYDOWN){
+            if(msg.wParam != VK_SPACE){
+                break;
             }
-
-            m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
-            
-        }else if(msg.message == WM_KEYDOWN){
-            exit(0);
+            AppInputEvent event = { APP_INPUT_KEY_DOWN, (uint32_t)msg.wParam, 0, 0 };
+            appLoopPushInput(&m_loop, &event);
         }
     }
 
+    appLoopStop(&m_loop);
+    startupGraphPrintReport(&m_startup, stdout);
+    appLoopPrintStats(&m_loop, stdout);
+    if(m_renderFailed.load(std::memory_order_acquire)){
+        _com_error err(m_renderError);
+        char message[512];
+        snprintf(message, sizeof(message), "%s: %s", m_renderErrorCall, err.ErrorMessage());
+        MessageBox(0, message, "Error!", 0);
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
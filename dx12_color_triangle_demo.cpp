@@ -7,8 +7,20 @@
 
 #include <comdef.h>
 
+#include <chrono>
+
+#include "particle_system.h"
+#include "dynamic_resolution.h"
+#include "startup_graph.h"
+#include "worker_pool.h"
+
 static const UINT FrameCount = 2;
+static const UINT32 MaxParticles = 1024 * 1024;
+// GPU time per frame the resolution is scaled to, leaving headroom under a 60 Hz vsync.
+static const float FrameBudgetMs = 14.0f;
 
+HWND m_window;
+IDXGIFactory4* m_factory;
 IDXGISwapChain3* m_swapChain;
 ID3D12Device* m_device;
 ID3D12Resource* m_renderTargets[FrameCount];
@@ -28,6 +40,65 @@ ID3D12Resource* m_vertexBuffer;
 D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 ID3D12RootSignature* m_rootSignature;
 
+ParticleSystem m_particles;
+ID3D12PipelineState* m_particlePipelineState;
+ID3D12Resource* m_particleBuffer;
+ParticleInstance* m_particleInstances;
+D3D12_VERTEX_BUFFER_VIEW m_particleBufferView;
+UINT32 m_numParticles;
+WorkerPool m_workers;
+
+// The scene renders into m_sceneTarget at the size m_dynRes picks and is
+// upscaled to the back buffer. GPU time comes from two timestamps per frame.
+DynResController m_dynRes;
+ID3D12Resource* m_sceneTarget;
+ID3D12DescriptorHeap* m_srvHeap;
+ID3D12RootSignature* m_upscaleRootSignature;
+ID3D12PipelineState* m_upscalePipelineState;
+ID3D12QueryHeap* m_timestampHeap;
+ID3D12Resource* m_timestampReadback;
+const UINT64* m_timestamps;
+UINT64 m_timestampFrequency;
+
+// The startup steps run as a dependency graph, so the independent ones
+// overlap. They report failures through m_startup and main shows them once
+// the graph is done.
+StartupGraph m_startup;
+// Time to first present is measured from the top of main.
+std::chrono::steady_clock::time_point m_launched;
+bool m_presented;
+
+static const float ClearColor[] = { 1.0f, 0.2f, 0.4f, 1.0f };
+
+struct ShaderCompileJob {
+    const char* name;
+    const wchar_t* file;
+    const char* entry;
+    const char* target;
+    ID3DBlob* blob;
+};
+
+struct RootSignatureJob {
+    const char* name;
+    const D3D12_ROOT_SIGNATURE_DESC* desc;
+    ID3DBlob* blob;
+};
+
+// A pipeline state built from compiled shaders over a shared description.
+// The first pipeline using a root signature creates it from its blob.
+struct PipelineJob {
+    const char* name;
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC* base;
+    D3D12_INPUT_LAYOUT_DESC inputLayout;
+    RootSignatureJob* rootSignatureJob;
+    ID3D12RootSignature** rootSignature;
+    bool createRootSignature;
+    ShaderCompileJob* vertexShader;
+    ShaderCompileJob* pixelShader;
+    bool additive;
+    ID3D12PipelineState** pipelineState;
+};
+
 void checkError(HRESULT res){
     if(res != S_OK){
         _com_error err(res);
@@ -37,32 +108,52 @@ void checkError(HRESULT res){
     }
 }
 
+// checkError for startup steps. They run on the graph's threads, where a
+// message box would stall a worker and exit would pull the device out from
+// under the others, so the error is recorded and the step fails instead.
+bool stepSucceeded(HRESULT res, const char* call){
+    if(res == S_OK){
+        return true;
+    }
+    _com_error err(res);
+    char message[StartupGraphMaxError];
+    snprintf(message, sizeof(message), "%s: %s", call, err.ErrorMessage());
+    startupGraphSetError(&m_startup, message);
+    return false;
+}
+
+// Shows the first step that failed, back on the window's thread.
+void checkStartup(bool ok){
+    if(ok){
+        return;
+    }
+    startupGraphPrintReport(&m_startup, stdout);
+    char message[StartupGraphMaxError + 64];
+    if(m_startup.firstFailed < 0){
+        snprintf(message, sizeof(message), "The startup steps depend on each other in a cycle.");
+    }else{
+        const StartupStep* step = &m_startup.steps[m_startup.firstFailed];
+        snprintf(message, sizeof(message), "Startup step \"%s\" failed.\n%s", step->name, step->error);
+    }
+    MessageBox(0, message, "Error!", 0);
+    exit(1);
+}
+
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam){
     return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
-int main(int argc, char** argv){
-    HMODULE hwnd = GetModuleHandle(0);
-    WNDCLASSEX windowClass = { 0 };
-    windowClass.cbSize = sizeof(WNDCLASSEX);
-    windowClass.style = CS_HREDRAW | CS_VREDRAW;
-    windowClass.lpfnWndProc = WindowProc;
-    windowClass.hInstance = hwnd;
-    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
-    windowClass.lpszClassName = "DXSampleClass";
-    RegisterClassEx(&windowClass);
-    
-    HWND window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
-
+bool createDeviceStep(void* context){
     UINT dxgiFactoryFlags = 0;
-    IDXGIFactory4* factory;
-    checkError(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    if(!stepSucceeded(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&m_factory)), "CreateDXGIFactory2")){
+        return false;
+    }
 
     IDXGIAdapter1* hardwareAdapter = 0;
 
     for (UINT adapterIndex = 0; ; ++adapterIndex){
         IDXGIAdapter1* pAdapter = 0;
-        if (DXGI_ERROR_NOT_FOUND == factory->EnumAdapters1(adapterIndex, &hardwareAdapter)){
+        if (DXGI_ERROR_NOT_FOUND == m_factory->EnumAdapters1(adapterIndex, &hardwareAdapter)){
             break;
         } 
 
@@ -73,14 +164,19 @@ int main(int argc, char** argv){
         pAdapter->Release();
     }
 
-    checkError(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)));
+    if(!stepSucceeded(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)), "D3D12CreateDevice")){
+        return false;
+    }
 
     D3D12_COMMAND_QUEUE_DESC queueDesc = {};
     queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
     queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 
-    checkError(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
+    return stepSucceeded(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)), "CreateCommandQueue") &&
+           stepSucceeded(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)), "CreateCommandAllocator");
+}
 
+bool createSwapChainStep(void* context){
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
     swapChainDesc.BufferCount = FrameCount;
     swapChainDesc.Width = 900;
@@ -91,19 +187,23 @@ int main(int argc, char** argv){
     swapChainDesc.SampleDesc.Count = 1;
 
     IDXGISwapChain1* swapChain;
-    checkError(factory->CreateSwapChainForHwnd(m_commandQueue, window, &swapChainDesc, 0, 0, &swapChain));
-
-    checkError(factory->MakeWindowAssociation(window, DXGI_MWA_NO_ALT_ENTER));
+    if(!stepSucceeded(m_factory->CreateSwapChainForHwnd(m_commandQueue, m_window, &swapChainDesc, 0, 0, &swapChain), "CreateSwapChainForHwnd") ||
+       !stepSucceeded(m_factory->MakeWindowAssociation(m_window, DXGI_MWA_NO_ALT_ENTER), "MakeWindowAssociation")){
+        return false;
+    }
 
     m_swapChain = (IDXGISwapChain3*)swapChain;
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
     // Describe and create a render target view (RTV) descriptor heap.
     D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-    rtvHeapDesc.NumDescriptors = FrameCount;
+    // The back buffers and the scene target.
+    rtvHeapDesc.NumDescriptors = FrameCount + 1;
     rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    checkError(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
+    if(!stepSucceeded(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)), "CreateDescriptorHeap")){
+        return false;
+    }
 
     m_rtvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
@@ -111,95 +211,113 @@ int main(int argc, char** argv){
 
     for (UINT n = 0; n < FrameCount; n++)
     {
-        checkError(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
+        if(!stepSucceeded(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])), "GetBuffer")){
+            return false;
+        }
         m_device->CreateRenderTargetView(m_renderTargets[n], 0, rtvHandle);
         rtvHandle.ptr += m_rtvDescriptorSize;
     }
-    
-    checkError(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
-    ///////////////////////////////
-    //Make Shader Pipeline
-    ///////////////////////////////
-    D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc;
-    //rootSignatureDesc.Init(0, 0, 0, 0, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-    rootSignatureDesc.NumParameters = 0;
-    rootSignatureDesc.pParameters = 0;
-    rootSignatureDesc.NumStaticSamplers = 0;
-    rootSignatureDesc.pStaticSamplers = 0;
-    rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-
-    ID3DBlob* signature;
-    ID3DBlob* error;
-    checkError(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error));
-    checkError(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
-
-    ID3DBlob* vertexShader;
-    ID3DBlob* pixelShader;
+    return true;
+}
 
-    checkError(D3DCompileFromFile(L"shaders.hlsl", 0, 0, "VSMain", "vs_5_0", 0, 0, &vertexShader, 0));
-    checkError(D3DCompileFromFile(L"shaders.hlsl", 0, 0, "PSMain", "ps_5_0", 0, 0, &pixelShader, 0));
+// Scene target at the largest render size, its RTV after the back buffers'.
+// It sits in the shader resource state between frames.
+bool createSceneTargetStep(void* context){
+    const DynResDesc* dynResDesc = (const DynResDesc*)context;
+    UINT32 sceneWidth, sceneHeight;
+    dynResTargetSize(dynResDesc, &sceneWidth, &sceneHeight);
 
-    D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-    };
-
-    D3D12_SHADER_BYTECODE vsbc;
-    vsbc.pShaderBytecode = vertexShader->GetBufferPointer();
-    vsbc.BytecodeLength = vertexShader->GetBufferSize();
+    D3D12_HEAP_PROPERTIES heapProp = {};
+    heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
+    D3D12_RESOURCE_DESC sceneDesc = {};
+    sceneDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    sceneDesc.Width = sceneWidth;
+    sceneDesc.Height = sceneHeight;
+    sceneDesc.DepthOrArraySize = 1;
+    sceneDesc.MipLevels = 1;
+    sceneDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    sceneDesc.SampleDesc.Count = 1;
+    sceneDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    sceneDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+    D3D12_CLEAR_VALUE sceneClear = {};
+    sceneClear.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    memcpy(sceneClear.Color, ClearColor, sizeof(ClearColor));
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &sceneDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &sceneClear, IID_PPV_ARGS(&m_sceneTarget)), "CreateCommittedResource")){
+        return false;
+    }
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+    rtvHandle.ptr += FrameCount * m_rtvDescriptorSize;
+    m_device->CreateRenderTargetView(m_sceneTarget, 0, rtvHandle);
+
+    D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+    srvHeapDesc.NumDescriptors = 1;
+    srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    if(!stepSucceeded(m_device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&m_srvHeap)), "CreateDescriptorHeap")){
+        return false;
+    }
+    m_device->CreateShaderResourceView(m_sceneTarget, 0, m_srvHeap->GetCPUDescriptorHandleForHeapStart());
+    return true;
+}
 
-    D3D12_SHADER_BYTECODE psbc;
-    psbc.pShaderBytecode = pixelShader->GetBufferPointer();
-    psbc.BytecodeLength = pixelShader->GetBufferSize();
+bool compileShaderStep(void* context){
+    ShaderCompileJob* job = (ShaderCompileJob*)context;
+    ID3DBlob* errors = 0;
+    HRESULT res = D3DCompileFromFile(job->file, 0, 0, job->entry, job->target, 0, 0, &job->blob, &errors);
+    // The compiler's own log says more than the HRESULT.
+    if(errors){
+        if(res != S_OK){
+            startupGraphSetError(&m_startup, (const char*)errors->GetBufferPointer());
+        }
+        errors->Release();
+    }
+    return stepSucceeded(res, "D3DCompileFromFile");
+}
 
-    D3D12_RASTERIZER_DESC rades;
-    rades.FillMode = D3D12_FILL_MODE_SOLID;
-    rades.CullMode = D3D12_CULL_MODE_BACK;
-    rades.FrontCounterClockwise = false;
-    rades.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
-    rades.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
-    rades.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
-    rades.DepthClipEnable = true;
-    rades.MultisampleEnable = false;
-    rades.AntialiasedLineEnable = false;
-    rades.ForcedSampleCount = 0;
-    rades.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+bool serializeRootSignatureStep(void* context){
+    RootSignatureJob* job = (RootSignatureJob*)context;
+    ID3DBlob* errors = 0;
+    HRESULT res = D3D12SerializeRootSignature(job->desc, D3D_ROOT_SIGNATURE_VERSION_1, &job->blob, &errors);
+    if(errors){
+        if(res != S_OK){
+            startupGraphSetError(&m_startup, (const char*)errors->GetBufferPointer());
+        }
+        errors->Release();
+    }
+    return stepSucceeded(res, "D3D12SerializeRootSignature");
+}
 
-    D3D12_BLEND_DESC bledes;
-    bledes.AlphaToCoverageEnable = false;
-    bledes.IndependentBlendEnable = false;
-    const D3D12_RENDER_TARGET_BLEND_DESC defaultRenderTargetBlendDesc = {
-        false,false,
-        D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
-        D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
-        D3D12_LOGIC_OP_NOOP,
-        D3D12_COLOR_WRITE_ENABLE_ALL,
-    };
-    for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++){
-        bledes.RenderTarget[i] = defaultRenderTargetBlendDesc;
+bool createPipelineStep(void* context){
+    PipelineJob* job = (PipelineJob*)context;
+    if(job->createRootSignature){
+        ID3DBlob* signature = job->rootSignatureJob->blob;
+        if(!stepSucceeded(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(job->rootSignature)), "CreateRootSignature")){
+            return false;
+        }
     }
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = *job->base;
+    psoDesc.InputLayout = job->inputLayout;
+    psoDesc.pRootSignature = *job->rootSignature;
+    psoDesc.VS.pShaderBytecode = job->vertexShader->blob->GetBufferPointer();
+    psoDesc.VS.BytecodeLength = job->vertexShader->blob->GetBufferSize();
+    psoDesc.PS.pShaderBytecode = job->pixelShader->blob->GetBufferPointer();
+    psoDesc.PS.BytecodeLength = job->pixelShader->blob->GetBufferSize();
+    if(job->additive){
+        psoDesc.BlendState.RenderTarget[0].BlendEnable = true;
+        psoDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+        psoDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_ONE;
+    }
+    return stepSucceeded(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(job->pipelineState)), "CreateGraphicsPipelineState");
+}
 
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-    psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
-    psoDesc.pRootSignature = m_rootSignature;
-    psoDesc.VS = vsbc;
-    psoDesc.PS = psbc;
-    psoDesc.RasterizerState = rades;
-    psoDesc.BlendState = bledes;
-    psoDesc.DepthStencilState.DepthEnable = FALSE;
-    psoDesc.DepthStencilState.StencilEnable = FALSE;
-    psoDesc.SampleMask = UINT_MAX;
-    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-    psoDesc.NumRenderTargets = 1;
-    psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-    psoDesc.SampleDesc.Count = 1;
-    checkError(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+bool initParticlesStep(void* context){
+    workerPoolInit(&m_workers, (int)std::thread::hardware_concurrency());
+    return stepSucceeded(particleSystemInit(&m_particles, MaxParticles, &m_workers) ? S_OK : E_OUTOFMEMORY, "particleSystemInit");
+}
 
-    checkError(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, 0, IID_PPV_ARGS(&m_commandList)));
-    
-    ///////////////////////////////
-    //Make and Load buffers
-    ///////////////////////////////
+// The triangle, the particle instances and the timestamp readback, all in
+// mapped upload or readback memory.
+bool createBuffersStep(void* context){
     float triangleVertices[] = {
         -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
          0.0f,  0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
@@ -224,13 +342,17 @@ int main(int argc, char** argv){
     resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
     resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-    checkError(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_vertexBuffer)));
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_vertexBuffer)), "CreateCommittedResource")){
+        return false;
+    }
 
     UINT8* pVertexDataBegin;
     D3D12_RANGE readRange = {}; 
     readRange.Begin = 0;
     readRange.End = 0;
-    checkError(m_vertexBuffer->Map(0, &readRange, (void**)(&pVertexDataBegin)));
+    if(!stepSucceeded(m_vertexBuffer->Map(0, &readRange, (void**)(&pVertexDataBegin)), "Map")){
+        return false;
+    }
     memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
     m_vertexBuffer->Unmap(0, 0);
 
@@ -239,28 +361,268 @@ int main(int argc, char** argv){
     m_vertexBufferView.StrideInBytes = 28;
     m_vertexBufferView.SizeInBytes = vertexBufferSize;
 
-    checkError(m_commandList->Close());
+    // Particle instances are written by the simulation straight into this
+    // buffer every frame, so it stays mapped.
+    resDesc.Width = MaxParticles * sizeof(ParticleInstance);
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_particleBuffer)), "CreateCommittedResource") ||
+       !stepSucceeded(m_particleBuffer->Map(0, &readRange, (void**)(&m_particleInstances)), "Map")){
+        return false;
+    }
+    m_particleBufferView.BufferLocation = m_particleBuffer->GetGPUVirtualAddress();
+    m_particleBufferView.StrideInBytes = sizeof(ParticleInstance);
+    m_particleBufferView.SizeInBytes = MaxParticles * sizeof(ParticleInstance);
+
+    // Timestamps at the start and end of every frame, read back after its fence.
+    D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+    queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    queryHeapDesc.Count = 2;
+    if(!stepSucceeded(m_device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_timestampHeap)), "CreateQueryHeap")){
+        return false;
+    }
+    heapProp.Type = D3D12_HEAP_TYPE_READBACK;
+    resDesc.Width = 2 * sizeof(UINT64);
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_COPY_DEST, 0, IID_PPV_ARGS(&m_timestampReadback)), "CreateCommittedResource")){
+        return false;
+    }
+    D3D12_RANGE timestampRange = { 0, 2 * sizeof(UINT64) };
+    return stepSucceeded(m_timestampReadback->Map(0, &timestampRange, (void**)&m_timestamps), "Map") &&
+           stepSucceeded(m_commandQueue->GetTimestampFrequency(&m_timestampFrequency), "GetTimestampFrequency");
+}
 
-    checkError(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+// Runs last: the command list, the fence, and one round trip through the
+// queue once everything the first frame uses exists.
+bool firstFenceWaitStep(void* context){
+    if(!stepSucceeded(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, 0, IID_PPV_ARGS(&m_commandList)), "CreateCommandList") ||
+       !stepSucceeded(m_commandList->Close(), "Close") ||
+       !stepSucceeded(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)), "CreateFence")){
+        return false;
+    }
     m_fenceValue = 1;
 
     m_fenceEvent = CreateEvent(0, FALSE, FALSE, 0);
     if (m_fenceEvent == 0){
-        checkError(HRESULT_FROM_WIN32(GetLastError()));
+        return stepSucceeded(HRESULT_FROM_WIN32(GetLastError()), "CreateEvent");
     }
     
     const UINT64 fence = m_fenceValue;
-    checkError(m_commandQueue->Signal(m_fence, fence));
+    if(!stepSucceeded(m_commandQueue->Signal(m_fence, fence), "Signal")){
+        return false;
+    }
     m_fenceValue++;
 
     if (m_fence->GetCompletedValue() < fence){
-        checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+        if(!stepSucceeded(m_fence->SetEventOnCompletion(fence, m_fenceEvent), "SetEventOnCompletion")){
+            return false;
+        }
         WaitForSingleObject(m_fenceEvent, INFINITE);
     }
+    return true;
+}
+
+int main(int argc, char** argv){
+    m_launched = std::chrono::steady_clock::now();
+    HMODULE hwnd = GetModuleHandle(0);
+    WNDCLASSEX windowClass = { 0 };
+    windowClass.cbSize = sizeof(WNDCLASSEX);
+    windowClass.style = CS_HREDRAW | CS_VREDRAW;
+    windowClass.lpfnWndProc = WindowProc;
+    windowClass.hInstance = hwnd;
+    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
+    windowClass.lpszClassName = "DXSampleClass";
+    RegisterClassEx(&windowClass);
+    
+    m_window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
+
+    D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc;
+    //rootSignatureDesc.Init(0, 0, 0, 0, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+    rootSignatureDesc.NumParameters = 0;
+    rootSignatureDesc.pParameters = 0;
+    rootSignatureDesc.NumStaticSamplers = 0;
+    rootSignatureDesc.pStaticSamplers = 0;
+    rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+    // Upscale: the scene target through a linear clamp sampler, the rendered
+    // region passed as root constants.
+    D3D12_DESCRIPTOR_RANGE sceneRange = {};
+    sceneRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    sceneRange.NumDescriptors = 1;
+    sceneRange.BaseShaderRegister = 0;
+    sceneRange.RegisterSpace = 0;
+    sceneRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+
+    D3D12_ROOT_PARAMETER upscaleParameters[2] = {};
+    upscaleParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    upscaleParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+    upscaleParameters[0].DescriptorTable.pDescriptorRanges = &sceneRange;
+    upscaleParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    upscaleParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    upscaleParameters[1].Constants.ShaderRegister = 0;
+    upscaleParameters[1].Constants.RegisterSpace = 0;
+    upscaleParameters[1].Constants.Num32BitValues = sizeof(DynResUpscaleConstants) / 4;
+    upscaleParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    D3D12_STATIC_SAMPLER_DESC sampler = {};
+    sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+    sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    sampler.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+    sampler.MaxLOD = D3D12_FLOAT32_MAX;
+    sampler.ShaderRegister = 0;
+    sampler.RegisterSpace = 0;
+    sampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    D3D12_ROOT_SIGNATURE_DESC upscaleRootSignatureDesc;
+    upscaleRootSignatureDesc.NumParameters = _countof(upscaleParameters);
+    upscaleRootSignatureDesc.pParameters = upscaleParameters;
+    upscaleRootSignatureDesc.NumStaticSamplers = 1;
+    upscaleRootSignatureDesc.pStaticSamplers = &sampler;
+    upscaleRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+
+    ///////////////////////////////
+    //Make Shader Pipeline
+    ///////////////////////////////
+    D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
+    // Particles draw the triangle once per instance, blended additively.
+    D3D12_INPUT_ELEMENT_DESC particleElementDescs[] = {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "CENTER", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "SIZE", 0, DXGI_FORMAT_R32_FLOAT, 1, 8, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "COLOR", 1, DXGI_FORMAT_R8G8B8A8_UNORM, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+    };
+
+    D3D12_RASTERIZER_DESC rades;
+    rades.FillMode = D3D12_FILL_MODE_SOLID;
+    rades.CullMode = D3D12_CULL_MODE_BACK;
+    rades.FrontCounterClockwise = false;
+    rades.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
+    rades.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
+    rades.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
+    rades.DepthClipEnable = true;
+    rades.MultisampleEnable = false;
+    rades.AntialiasedLineEnable = false;
+    rades.ForcedSampleCount = 0;
+    rades.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+    D3D12_BLEND_DESC bledes;
+    bledes.AlphaToCoverageEnable = false;
+    bledes.IndependentBlendEnable = false;
+    const D3D12_RENDER_TARGET_BLEND_DESC defaultRenderTargetBlendDesc = {
+        false,false,
+        D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
+        D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
+        D3D12_LOGIC_OP_NOOP,
+        D3D12_COLOR_WRITE_ENABLE_ALL,
+    };
+    for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++){
+        bledes.RenderTarget[i] = defaultRenderTargetBlendDesc;
+    }
+
+    // What every pipeline shares; the pipeline steps fill in the rest.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+    psoDesc.RasterizerState = rades;
+    psoDesc.BlendState = bledes;
+    psoDesc.DepthStencilState.DepthEnable = FALSE;
+    psoDesc.DepthStencilState.StencilEnable = FALSE;
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.NumRenderTargets = 1;
+    psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+    psoDesc.SampleDesc.Count = 1;
+
+    DynResDesc dynResDesc;
+    dynResDescInit(&dynResDesc, 900, 500, FrameBudgetMs);
+    // Headroom beyond full resolution goes into supersampling, which the
+    // upscale pass filters back down.
+    dynResDesc.maxScale = 1.5f;
+    dynResInit(&m_dynRes, &dynResDesc);
+    UINT32 sceneWidth, sceneHeight;
+    dynResTargetSize(&dynResDesc, &sceneWidth, &sceneHeight);
+
+    // The device and swap chain come up while the shaders compile and the
+    // root signatures serialize; each pipeline follows as soon as its pieces
+    // are there.
+    ShaderCompileJob shaderJobs[] = {
+        { "shaders.hlsl VSMain", L"shaders.hlsl", "VSMain", "vs_5_0", 0 },
+        { "shaders.hlsl PSMain", L"shaders.hlsl", "PSMain", "ps_5_0", 0 },
+        { "particle_shaders.hlsl VSMain", L"particle_shaders.hlsl", "VSMain", "vs_5_0", 0 },
+        { "particle_shaders.hlsl PSMain", L"particle_shaders.hlsl", "PSMain", "ps_5_0", 0 },
+        { "upscale_shaders.hlsl VSMain", L"upscale_shaders.hlsl", "VSMain", "vs_5_0", 0 },
+        { "upscale_shaders.hlsl PSMain", L"upscale_shaders.hlsl", "PSMain", "ps_5_0", 0 },
+    };
+    RootSignatureJob rootSignatureJobs[] = {
+        { "root signature", &rootSignatureDesc, 0 },
+        { "upscale root signature", &upscaleRootSignatureDesc, 0 },
+    };
+    PipelineJob pipelineJobs[] = {
+        { "pso", &psoDesc, { inputElementDescs, _countof(inputElementDescs) }, &rootSignatureJobs[0], &m_rootSignature, true,
+          &shaderJobs[0], &shaderJobs[1], false, &m_pipelineState },
+        { "particle pso", &psoDesc, { particleElementDescs, _countof(particleElementDescs) }, &rootSignatureJobs[0], &m_rootSignature, false,
+          &shaderJobs[2], &shaderJobs[3], true, &m_particlePipelineState },
+        { "upscale pso", &psoDesc, { 0, 0 }, &rootSignatureJobs[1], &m_upscaleRootSignature, true,
+          &shaderJobs[4], &shaderJobs[5], false, &m_upscalePipelineState },
+    };
+    startupGraphInit(&m_startup);
+    int deviceStep = startupGraphAdd(&m_startup, "device", createDeviceStep, 0);
+    int swapChainStep = startupGraphAdd(&m_startup, "swap chain", createSwapChainStep, 0);
+    startupGraphDepend(&m_startup, swapChainStep, deviceStep);
+    // DXGI sends messages to the window while creating the swap chain, so it stays on the window's thread.
+    startupGraphPin(&m_startup, swapChainStep);
+    int sceneTargetStep = startupGraphAdd(&m_startup, "scene target", createSceneTargetStep, &dynResDesc);
+    startupGraphDepend(&m_startup, sceneTargetStep, deviceStep);
+    startupGraphDepend(&m_startup, sceneTargetStep, swapChainStep);
+    int rootSignatureSteps[_countof(rootSignatureJobs)];
+    for (UINT i = 0; i < _countof(rootSignatureJobs); i++){
+        rootSignatureSteps[i] = startupGraphAdd(&m_startup, rootSignatureJobs[i].name, serializeRootSignatureStep, &rootSignatureJobs[i]);
+    }
+    int shaderSteps[_countof(shaderJobs)];
+    for (UINT i = 0; i < _countof(shaderJobs); i++){
+        shaderSteps[i] = startupGraphAdd(&m_startup, shaderJobs[i].name, compileShaderStep, &shaderJobs[i]);
+    }
+    int pipelineSteps[_countof(pipelineJobs)];
+    for (UINT i = 0; i < _countof(pipelineJobs); i++){
+        pipelineSteps[i] = startupGraphAdd(&m_startup, pipelineJobs[i].name, createPipelineStep, &pipelineJobs[i]);
+        startupGraphDepend(&m_startup, pipelineSteps[i], deviceStep);
+        startupGraphDepend(&m_startup, pipelineSteps[i], rootSignatureSteps[pipelineJobs[i].rootSignatureJob - rootSignatureJobs]);
+        startupGraphDepend(&m_startup, pipelineSteps[i], shaderSteps[pipelineJobs[i].vertexShader - shaderJobs]);
+        startupGraphDepend(&m_startup, pipelineSteps[i], shaderSteps[pipelineJobs[i].pixelShader - shaderJobs]);
+    }
+    // The particles share the root signature the first pipeline creates.
+    startupGraphDepend(&m_startup, pipelineSteps[1], pipelineSteps[0]);
+    startupGraphAdd(&m_startup, "particle init", initParticlesStep, 0);
+    int uploadStep = startupGraphAdd(&m_startup, "upload", createBuffersStep, 0);
+    startupGraphDepend(&m_startup, uploadStep, deviceStep);
+    int fenceStep = startupGraphAdd(&m_startup, "first fence wait", firstFenceWaitStep, 0);
+    startupGraphDepend(&m_startup, fenceStep, sceneTargetStep);
+    startupGraphDepend(&m_startup, fenceStep, uploadStep);
+    for (UINT i = 0; i < _countof(pipelineJobs); i++){
+        startupGraphDepend(&m_startup, fenceStep, pipelineSteps[i]);
+    }
+    // This thread mostly waits for the swap chain, one more keeps every core busy.
+    checkStartup(startupGraphRun(&m_startup, (int)std::thread::hardware_concurrency() + 1));
+
+    ParticleEmitter emitter = {};
+    emitter.x = 0.0f;
+    emitter.y = -0.9f;
+    emitter.rate = 200000.0f;
+    emitter.speedMin = 0.6f;
+    emitter.speedMax = 1.4f;
+    emitter.angle = 1.5708f;
+    emitter.spread = 0.8f;
+    emitter.lifeMin = 1.0f;
+    emitter.lifeMax = 4.0f;
+    emitter.size = 0.01f;
+    emitter.color = 0x40A0FF;
+    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
 
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
-    ShowWindow(window, SW_SHOW);
+    ShowWindow(m_window, SW_SHOW);
 
     MSG msg = {};
     while (msg.message != WM_QUIT){
@@ -270,53 +632,97 @@ int main(int argc, char** argv){
         }
 
         if(msg.message == WM_PAINT){
+            // The GPU is done with last frame's instances, the simulation overwrites them.
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            float dt = std::chrono::duration<float>(now - lastFrame).count();
+            lastFrame = now;
+            m_numParticles = particleSystemUpdate(&m_particles, &emitter, dt < 0.1f ? dt : 0.1f, m_particleInstances);
+
             checkError(m_commandAllocator->Reset());
 
             checkError(m_commandList->Reset(m_commandAllocator, m_pipelineState));
 
+            m_commandList->EndQuery(m_timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+
+            // The scene only covers the top left of its target, as much as the controller allows.
             D3D12_VIEWPORT viewport;
             viewport.TopLeftX = 0;
             viewport.TopLeftY = 0;
-            viewport.Width = 900;
-            viewport.Height = 500;
+            viewport.Width = (float)m_dynRes.renderWidth;
+            viewport.Height = (float)m_dynRes.renderHeight;
             viewport.MinDepth = D3D12_MIN_DEPTH;
             viewport.MaxDepth = D3D12_MAX_DEPTH;
             D3D12_RECT scissorRect;
             scissorRect.left = 0;
             scissorRect.top = 0;
-            scissorRect.right = 900;
-            scissorRect.bottom = 500;
+            scissorRect.right = m_dynRes.renderWidth;
+            scissorRect.bottom = m_dynRes.renderHeight;
             m_commandList->SetGraphicsRootSignature(m_rootSignature);
             m_commandList->RSSetViewports(1, &viewport);
             m_commandList->RSSetScissorRects(1, &scissorRect);
 
-            // Indicate that the back buffer will be used as a render target.
             D3D12_RESOURCE_BARRIER barrier = {};
             barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
             barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            barrier.Transition.pResource = m_renderTargets[m_frameIndex];
-            barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
+            barrier.Transition.pResource = m_sceneTarget;
+            barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
             barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
             barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
             m_commandList->ResourceBarrier(1, &barrier);
 
             D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
-            rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
+            rtvHandle.ptr += FrameCount * m_rtvDescriptorSize;
             m_commandList->OMSetRenderTargets(1, &rtvHandle, false, 0);
 
             // Record commands.
-            const float clearColor[] = { 1.0f, 0.2f, 0.4f, 1.0f };
-            m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, 0);
+            m_commandList->ClearRenderTargetView(rtvHandle, ClearColor, 1, &scissorRect);
             m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
             m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
             m_commandList->DrawInstanced(3, 1, 0, 0);
 
+            D3D12_VERTEX_BUFFER_VIEW particleViews[] = { m_vertexBufferView, m_particleBufferView };
+            m_commandList->SetPipelineState(m_particlePipelineState);
+            m_commandList->IASetVertexBuffers(0, _countof(particleViews), particleViews);
+            m_commandList->DrawInstanced(3, m_numParticles, 0, 0);
+
+            // Upscale the scene into the back buffer.
+            D3D12_RESOURCE_BARRIER upscaleBarriers[2] = { barrier, barrier };
+            upscaleBarriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+            upscaleBarriers[0].Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+            upscaleBarriers[1].Transition.pResource = m_renderTargets[m_frameIndex];
+            upscaleBarriers[1].Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
+            upscaleBarriers[1].Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+            m_commandList->ResourceBarrier(2, upscaleBarriers);
+
+            rtvHandle = m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
+            rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
+            m_commandList->OMSetRenderTargets(1, &rtvHandle, false, 0);
+            viewport.Width = 900;
+            viewport.Height = 500;
+            scissorRect.right = 900;
+            scissorRect.bottom = 500;
+            m_commandList->RSSetViewports(1, &viewport);
+            m_commandList->RSSetScissorRects(1, &scissorRect);
+
+            DynResUpscaleConstants upscaleConstants;
+            dynResUpscaleConstants(m_dynRes.renderWidth, m_dynRes.renderHeight, sceneWidth, sceneHeight, 900, 500, &upscaleConstants);
+            ID3D12DescriptorHeap* ppHeaps[] = { m_srvHeap };
+            m_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+            m_commandList->SetPipelineState(m_upscalePipelineState);
+            m_commandList->SetGraphicsRootSignature(m_upscaleRootSignature);
+            m_commandList->SetGraphicsRootDescriptorTable(0, m_srvHeap->GetGPUDescriptorHandleForHeapStart());
+            m_commandList->SetGraphicsRoot32BitConstants(1, sizeof(upscaleConstants) / 4, &upscaleConstants, 0);
+            m_commandList->DrawInstanced(3, 1, 0, 0);
+
             // Indicate that the back buffer will now be used to present.
-            //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+            barrier.Transition.pResource = m_renderTargets[m_frameIndex];
             barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
             barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
             m_commandList->ResourceBarrier(1, &barrier);
 
+            m_commandList->EndQuery(m_timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+            m_commandList->ResolveQueryData(m_timestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, m_timestampReadback, 0);
+
             checkError(m_commandList->Close());
 
             ID3D12CommandList* ppCommandLists[] = { m_commandList };
@@ -324,22 +730,37 @@ int main(int argc, char** argv){
 
             // Present the frame.
             checkError(m_swapChain->Present(1, 0));
+            if(!m_presented){
+                m_presented = true;
+                printf("first present %.2f ms after launch, %.2f ms of it startup steps\n",
+                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_launched).count(), m_startup.wallSeconds * 1000.0);
+            }
 
-            checkError(m_commandQueue->Signal(m_fence, fence));
+            const UINT64 frameFence = m_fenceValue;
+            checkError(m_commandQueue->Signal(m_fence, frameFence));
             m_fenceValue++;
 
             // Wait until the previous frame is finished.
-            if (m_fence->GetCompletedValue() < fence){
-                checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+            if (m_fence->GetCompletedValue() < frameFence){
+                checkError(m_fence->SetEventOnCompletion(frameFence, m_fenceEvent));
                 WaitForSingleObject(m_fenceEvent, INFINITE);
             }
 
+            // The frame is done, its GPU time picks the size of the next one.
+            dynResUpdate(&m_dynRes, (float)((m_timestamps[1] - m_timestamps[0]) * 1000.0 / m_timestampFrequency));
+
             m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
             
         }else if(msg.message == WM_KEYDOWN){
+            startupGraphPrintReport(&m_startup, stdout);
+            particleSystemPrintStats(&m_particles, stdout);
+            dynResPrintStats(&m_dynRes, stdout);
+            workerPoolPrintStats(&m_workers, stdout);
+            workerPoolDestroy(&m_workers);
             exit(0);
         }
     }
 
+    workerPoolDestroy(&m_workers);
     return 0;
 }
\ No newline at end of file
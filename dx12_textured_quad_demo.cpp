@@ -7,28 +7,177 @@
 
 #include <comdef.h>
 
-static const UINT FrameCount = 2;
+#include <chrono>
+
+#include "frame_graph.h"
+#include "geometry_pool.h"
+#include "damage_tracker.h"
+#include "frame_capture.h"
+#include "pixel_convert.h"
+#include "visibility_grid.h"
+#include "draw_queue.h"
+#include "glyph_atlas.h"
+#include "frame_arena.h"
+#include "transform_hierarchy.h"
+#include "occlusion_buffer.h"
+#include "texture_cache.h"
+#include "startup_graph.h"
+#include "worker_pool.h"
 
+static const UINT FrameCount = 2;
+static const UINT64 GeometryPoolSize = 1024 * 1024;
+static const UINT64 GeometryStagingSize = 64 * 1024;
+// The pool is compacted once its free space is split into more ranges than this.
+static const int GeometryCompactFreeRanges = 64;
+static const uint32_t GeometryState = FG_STATE_VERTEX_AND_CONSTANT_BUFFER | FG_STATE_INDEX_BUFFER;
+static const int CaptureSlots = 3;
+static const UINT32 MaxSprites = 1024;
+static const UINT32 MaxTextInstances = 4096;
+static const int GlyphAtlasSize = 512;
+static const int GlyphCellSize = 32;
+static const int GlyphEmSize = 24;
+static const int GlyphSpread = 4;
+static const int GlyphOversample = 4;
+static const size_t FrameArenaBlockSize = 64 * 1024;
+static const UINT32 MaxTextures = 256;
+static const UINT64 TextureBudget = 256 * 1024 * 1024;
+// Frames after which any heap allocation by the frame arena asserts.
+static const uint64_t FrameArenaWarmupFrames = 16;
+// Upload rows are padded to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+static const UINT GlyphUploadPitch = 256;
+
+// State ids in draw keys; pipelines and root signatures share them.
+enum {
+    SpriteState,
+    TextState,
+};
+
+HWND m_window;
+IDXGIFactory4* m_factory;
 IDXGISwapChain3* m_swapChain;
 ID3D12Device* m_device;
 ID3D12Resource* m_renderTargets[FrameCount];
-ID3D12CommandAllocator* m_commandAllocator;
+// One allocator per back buffer; a frame only waits for the GPU when it gets
+// back to a buffer whose previous frame is still in flight.
+ID3D12CommandAllocator* m_commandAllocators[FrameCount];
 ID3D12CommandQueue* m_commandQueue;
 ID3D12DescriptorHeap* m_rtvHeap;
 ID3D12DescriptorHeap* m_srvHeap;
 ID3D12PipelineState* m_pipelineState;
 ID3D12GraphicsCommandList* m_commandList;
 UINT m_rtvDescriptorSize;
+UINT m_srvDescriptorSize;
 
 UINT m_frameIndex;
 HANDLE m_fenceEvent;
 ID3D12Fence* m_fence;
 UINT64 m_fenceValue;
-
-ID3D12Resource* m_vertexBuffer;
+UINT64 m_frameFenceValues[FrameCount];
+// Frames skipped by damage tracking wait for the vertical blank here instead of in Present.
+IDXGIOutput* m_output;
+
+ID3D12Resource* m_geometryBuffer;
+ID3D12Resource* m_geometryStaging;
+// Compaction moves can overlap, so they go through here.
+ID3D12Resource* m_geometryScratch;
 ID3D12Resource* m_texture;
+TextureCache m_textureCache;
+UINT32 m_quadTexture;
 D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 ID3D12RootSignature* m_rootSignature;
+ID3D12RootSignature* m_textRootSignature;
+ID3D12PipelineState* m_textPipelineState;
+
+FrameGraph m_frameGraph;
+GeometryPool m_geometryPool;
+UINT32 m_quadVertices;
+DamageTracker m_damage;
+VisibilityGrid m_visibility;
+// Sprite transforms, sprite ids index them.
+TransformHierarchy m_transforms;
+UINT32 m_visibleSprites[MaxSprites];
+UINT32 m_numVisibleSprites;
+// Screen bounds and layer of each sprite, for occlusion tests; smaller layers are in front.
+float m_spriteMinX[MaxSprites];
+float m_spriteMinY[MaxSprites];
+float m_spriteMaxX[MaxSprites];
+float m_spriteMaxY[MaxSprites];
+float m_spriteLayer[MaxSprites];
+OcclusionBuffer m_occlusion;
+DrawQueue m_drawQueue;
+// Shared by every module that spreads its work over threads.
+WorkerPool m_workers;
+
+GlyphAtlas m_glyphAtlas;
+HDC m_glyphDC;
+UINT8 m_glyphBits[256 * 256];
+ID3D12Resource* m_glyphTexture;
+ID3D12Resource* m_glyphUpload;
+UINT8* m_glyphUploadPixels;
+ID3D12Resource* m_textInstanceBuffer;
+TextInstance* m_textInstances;
+D3D12_VERTEX_BUFFER_VIEW m_textInstanceView;
+UINT32 m_numTextInstances;
+// The label is only laid out again when its text changes; each back buffer
+// gets a copy of these instances in its part of m_textInstanceBuffer.
+char m_labelText[64];
+TextInstance m_labelInstances[MaxTextInstances];
+UINT32 m_numLabelInstances;
+std::chrono::steady_clock::time_point m_labelUpdated;
+UINT64 m_labelFramesRendered;
+UINT64 m_labelFramesSkipped;
+
+// Per frame scratch memory: barriers, scissor and dirty rects.
+FrameArena m_frameArena;
+
+bool m_captureEnabled;
+FrameCapture m_capture;
+ID3D12Resource* m_readbackBuffers[CaptureSlots];
+D3D12_PLACED_SUBRESOURCE_FOOTPRINT m_captureFootprint;
+int m_captureSlot;
+
+// The startup steps run as a dependency graph, so the independent ones
+// overlap. They report failures through m_startup and main shows them once
+// the graph is done.
+StartupGraph m_startup;
+// Time to first present is measured from the top of main.
+std::chrono::steady_clock::time_point m_launched;
+bool m_presented;
+
+struct ShaderCompileJob {
+    const char* name;
+    const wchar_t* file;
+    const char* entry;
+    const char* target;
+    ID3DBlob* blob;
+};
+
+struct RootSignatureJob {
+    const char* name;
+    const D3D12_VERSIONED_ROOT_SIGNATURE_DESC* desc;
+    ID3DBlob* blob;
+};
+
+// A pipeline state and its root signature, built from compiled shaders over
+// a shared description.
+struct PipelineJob {
+    const char* name;
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC* base;
+    D3D12_INPUT_LAYOUT_DESC inputLayout;
+    RootSignatureJob* rootSignatureJob;
+    ID3D12RootSignature** rootSignature;
+    ShaderCompileJob* vertexShader;
+    ShaderCompileJob* pixelShader;
+    bool blended;
+    ID3D12PipelineState** pipelineState;
+};
+
+// What the texture upload step leaves for the first fence wait to record.
+struct TextureUploadJob {
+    bool created;
+    ID3D12Resource* uploadHeap;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+};
 
 void checkError(HRESULT res){
     if(res != S_OK){
@@ -39,32 +188,311 @@ void checkError(HRESULT res){
     }
 }
 
+// checkError for startup steps. They run on the graph's threads, where a
+// message box would stall a worker and exit would pull the device out from
+// under the others, so the error is recorded and the step fails instead.
+bool stepSucceeded(HRESULT res, const char* call){
+    if(res == S_OK){
+        return true;
+    }
+    _com_error err(res);
+    char message[StartupGraphMaxError];
+    snprintf(message, sizeof(message), "%s: %s", call, err.ErrorMessage());
+    startupGraphSetError(&m_startup, message);
+    return false;
+}
+
+// Shows the first step that failed, back on the window's thread.
+void checkStartup(bool ok){
+    if(ok){
+        return;
+    }
+    startupGraphPrintReport(&m_startup, stdout);
+    char message[StartupGraphMaxError + 64];
+    if(m_startup.firstFailed < 0){
+        snprintf(message, sizeof(message), "The startup steps depend on each other in a cycle.");
+    }else{
+        const StartupStep* step = &m_startup.steps[m_startup.firstFailed];
+        snprintf(message, sizeof(message), "Startup step \"%s\" failed.\n%s", step->name, step->error);
+    }
+    MessageBox(0, message, "Error!", 0);
+    exit(1);
+}
+
+void submitFrameGraphBarriers(const FrameGraph* fg, const FrameGraphBarrier* barriers, int count, void* context){
+    ID3D12GraphicsCommandList* commandList = (ID3D12GraphicsCommandList*)context;
+    D3D12_RESOURCE_BARRIER* resBars = frameArenaNew<D3D12_RESOURCE_BARRIER>(frameArenaThread(&m_frameArena, 0), count);
+    for (int i = 0; i < count; i++){
+        const FrameGraphBarrier* b = &barriers[i];
+        resBars[i] = {};
+        resBars[i].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        if(b->type == FG_BARRIER_ALIASING){
+            resBars[i].Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            resBars[i].Aliasing.pResourceBefore = b->resourceBefore >= 0 ? (ID3D12Resource*)fg->resources[b->resourceBefore].userResource : 0;
+            resBars[i].Aliasing.pResourceAfter = (ID3D12Resource*)fg->resources[b->resource].userResource;
+        }else{
+            resBars[i].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            resBars[i].Transition.pResource = (ID3D12Resource*)fg->resources[b->resource].userResource;
+            resBars[i].Transition.StateBefore = (D3D12_RESOURCE_STATES)b->stateBefore;
+            resBars[i].Transition.StateAfter = (D3D12_RESOURCE_STATES)b->stateAfter;
+            resBars[i].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        }
+    }
+    commandList->ResourceBarrier(count, resBars);
+}
+
+// Draws report the pixels they touch to the damage tracker whenever what
+// they show changes, once for where they were and once for where they are.
+void damageSprite(UINT32 sprite){
+    damageTrackerAddRect(&m_damage, (int32_t)m_spriteMinX[sprite], (int32_t)m_spriteMinY[sprite],
+                         (int32_t)m_spriteMaxX[sprite] + 1, (int32_t)m_spriteMaxY[sprite] + 1);
+}
+
+void damageText(const TextInstance* instances, UINT32 count){
+    if(count == 0){
+        return;
+    }
+    float left = instances[0].left;
+    float top = instances[0].top;
+    float right = instances[0].right;
+    float bottom = instances[0].bottom;
+    for (UINT32 i = 1; i < count; i++){
+        left = instances[i].left < left ? instances[i].left : left;
+        top = instances[i].top > top ? instances[i].top : top;
+        right = instances[i].right > right ? instances[i].right : right;
+        bottom = instances[i].bottom < bottom ? instances[i].bottom : bottom;
+    }
+    damageTrackerAddNdc(&m_damage, left, top, right, bottom);
+}
+
+// Once a second the label shows how many of the frames since were drawn. Only
+// the label's old and new bounds are damaged, the quad is left alone.
+void updateLabel(){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    char text[64];
+    if(m_labelText[0] == 0){
+        snprintf(text, sizeof(text), "DX12 textured quad");
+    }else if(now - m_labelUpdated >= std::chrono::seconds(1)){
+        UINT64 rendered = m_damage.stats.framesRendered - m_labelFramesRendered;
+        UINT64 skipped = m_damage.stats.framesSkipped - m_labelFramesSkipped;
+        snprintf(text, sizeof(text), "DX12 textured quad, %llu of %llu frames drawn", (unsigned long long)rendered, (unsigned long long)(rendered + skipped));
+    }else{
+        return;
+    }
+    m_labelUpdated = now;
+    m_labelFramesRendered = m_damage.stats.framesRendered;
+    m_labelFramesSkipped = m_damage.stats.framesSkipped;
+    if(strcmp(text, m_labelText) == 0){
+        return;
+    }
+    damageText(m_labelInstances, m_numLabelInstances);
+    snprintf(m_labelText, sizeof(m_labelText), "%s", text);
+    // Glyphs that missed the atlas get their distance fields here, the upload pass copies them.
+    glyphAtlasBeginFrame(&m_glyphAtlas);
+    TextStyle labelStyle = { 20.0f, 0xFFFFFFFF, 900.0f, 500.0f };
+    m_numLabelInstances = textLayout(&m_glyphAtlas, m_labelText, 16.0f, 36.0f, &labelStyle, m_labelInstances, MaxTextInstances);
+    glyphAtlasFlush(&m_glyphAtlas);
+    damageText(m_labelInstances, m_numLabelInstances);
+}
+
+// Draw queue callbacks. Pipeline and root signature ids are SpriteState or
+// TextState, descriptor tables index m_srvHeap.
+void setQueuedPipeline(void* context, uint32_t pipeline){
+    if(pipeline == TextState){
+        m_commandList->SetPipelineState(m_textPipelineState);
+        m_commandList->IASetVertexBuffers(0, 1, &m_textInstanceView);
+    }else{
+        m_commandList->SetPipelineState(m_pipelineState);
+        m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
+    }
+}
+
+void setQueuedRootSignature(void* context, uint32_t rootSignature){
+    m_commandList->SetGraphicsRootSignature(rootSignature == TextState ? m_textRootSignature : m_rootSignature);
+}
+
+void setQueuedDescriptorTable(void* context, uint32_t descriptorTable){
+    D3D12_GPU_DESCRIPTOR_HANDLE table = m_srvHeap->GetGPUDescriptorHandleForHeapStart();
+    table.ptr += (UINT64)descriptorTable * m_srvDescriptorSize;
+    m_commandList->SetGraphicsRootDescriptorTable(0, table);
+}
+
+void drawQueued(void* context, const DrawItem* item){
+    m_commandList->DrawInstanced(item->vertexCount, item->instanceCount, item->startVertex, item->startInstance);
+}
+
+void recordSpritePass(void* userData){
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+    rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
+    m_commandList->OMSetRenderTargets(1, &rtvHandle, false, 0);
+
+    // Only the damaged rects of the back buffer are cleared and drawn, the
+    // rest still holds what was presented from it last time.
+    D3D12_RECT* damageRects = frameArenaNew<D3D12_RECT>(frameArenaThread(&m_frameArena, 0), m_damage.numRects);
+    for (int i = 0; i < m_damage.numRects; i++){
+        damageRects[i].left = m_damage.rects[i].left;
+        damageRects[i].top = m_damage.rects[i].top;
+        damageRects[i].right = m_damage.rects[i].right;
+        damageRects[i].bottom = m_damage.rects[i].bottom;
+    }
+
+    // Record commands.
+    const float clearColor[] = { 1.0f, 0.2f, 0.4f, 1.0f };
+    m_commandList->ClearRenderTargetView(rtvHandle, clearColor, m_damage.numRects, damageRects);
+    m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    // Sprite 0 is the quad, the only sprite there is so far.
+    for (UINT32 s = 0; s < m_numVisibleSprites; s++){
+        drawQueueAdd(&m_drawQueue, drawKeyPack(0, SpriteState, SpriteState, 0, 0), 6, 1, geometryPoolBaseVertex(&m_geometryPool, m_quadVertices), 0, m_visibleSprites[s]);
+    }
+    // Text goes on top, all glyphs in one instanced draw.
+    if(m_numTextInstances > 0){
+        drawQueueAdd(&m_drawQueue, drawKeyPack(1, TextState, TextState, 1, 0), 6, m_numTextInstances, 0, 0);
+    }
+    drawQueueSort(&m_drawQueue);
+    // One viewport only uses the first scissor rect, so the sorted draws are
+    // replayed under each damaged rect in turn.
+    DrawQueueCallbacks callbacks = { setQueuedPipeline, setQueuedRootSignature, setQueuedDescriptorTable, drawQueued, 0 };
+    for (int i = 0; i < m_damage.numRects; i++){
+        m_commandList->RSSetScissorRects(1, &damageRects[i]);
+        drawQueueEmit(&m_drawQueue, &callbacks);
+    }
+    drawQueueReset(&m_drawQueue);
+}
+
+// Copies the atlas cells that got new distance fields, one upload region per cell.
+void recordGlyphUploadPass(void* userData){
+    for (UINT32 i = 0; i < m_glyphAtlas.numDirty; i++){
+        UINT32 slot = m_glyphAtlas.dirty[i];
+        int cellX, cellY;
+        glyphAtlasSlotOrigin(&m_glyphAtlas, slot, &cellX, &cellY);
+        // Each back buffer has its own upload space, the previous frame's copies may still be running.
+        UINT64 offset = (UINT64)(m_frameIndex * m_glyphAtlas.numSlots + slot) * GlyphUploadPitch * GlyphCellSize;
+        for (int row = 0; row < GlyphCellSize; row++){
+            memcpy(m_glyphUploadPixels + offset + row * GlyphUploadPitch, m_glyphAtlas.pixels + (size_t)(cellY + row) * GlyphAtlasSize + cellX, GlyphCellSize);
+        }
+
+        D3D12_TEXTURE_COPY_LOCATION Dst = {};
+        Dst.pResource = m_glyphTexture;
+        Dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        Dst.SubresourceIndex = 0;
+        D3D12_TEXTURE_COPY_LOCATION Src = {};
+        Src.pResource = m_glyphUpload;
+        Src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        Src.PlacedFootprint.Offset = offset;
+        Src.PlacedFootprint.Footprint.Format = DXGI_FORMAT_R8_UNORM;
+        Src.PlacedFootprint.Footprint.Width = GlyphCellSize;
+        Src.PlacedFootprint.Footprint.Height = GlyphCellSize;
+        Src.PlacedFootprint.Footprint.Depth = 1;
+        Src.PlacedFootprint.Footprint.RowPitch = GlyphUploadPitch;
+        m_commandList->CopyTextureRegion(&Dst, cellX, cellY, 0, &Src, 0);
+    }
+    glyphAtlasClearDirty(&m_glyphAtlas);
+}
+
+// GDI glyphs for the atlas, rasterized with the font selected into m_glyphDC.
+bool rasterizeGdiGlyph(void* context, uint32_t codepoint, int pixelSize, GlyphBitmap* out){
+    const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+    GLYPHMETRICS metrics;
+    DWORD size = GetGlyphOutlineW(m_glyphDC, codepoint, GGO_GRAY8_BITMAP, &metrics, 0, 0, &identity);
+    if(size == GDI_ERROR || size > sizeof(m_glyphBits)){
+        return false;
+    }
+    out->advance = (float)metrics.gmCellIncX;
+    if(size == 0){
+        // Blank glyphs like the space only advance the pen.
+        out->width = 0;
+        out->height = 0;
+        return true;
+    }
+    if(GetGlyphOutlineW(m_glyphDC, codepoint, GGO_GRAY8_BITMAP, &metrics, size, m_glyphBits, &identity) == GDI_ERROR){
+        return false;
+    }
+    // GGO_GRAY8_BITMAP has 65 coverage levels and DWORD aligned rows.
+    for (DWORD i = 0; i < size; i++){
+        m_glyphBits[i] = (UINT8)(m_glyphBits[i] * 255 / 64);
+    }
+    out->width = metrics.gmBlackBoxX;
+    out->height = metrics.gmBlackBoxY;
+    out->pitch = (metrics.gmBlackBoxX + 3) & ~3;
+    out->coverage = m_glyphBits;
+    out->left = (float)metrics.gmptGlyphOrigin.x;
+    out->top = (float)metrics.gmptGlyphOrigin.y;
+    return true;
+}
+
+void recordCapturePass(void* userData){
+    D3D12_TEXTURE_COPY_LOCATION Dst = {};
+    Dst.pResource = m_readbackBuffers[m_captureSlot];
+    Dst.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    Dst.PlacedFootprint = m_captureFootprint;
+    D3D12_TEXTURE_COPY_LOCATION Src = {};
+    Src.pResource = m_renderTargets[m_frameIndex];
+    Src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    Src.SubresourceIndex = 0;
+    m_commandList->CopyTextureRegion(&Dst, 0, 0, 0, &Src, 0);
+}
+
+void waitForGpu(){
+    const UINT64 fence = m_fenceValue;
+    checkError(m_commandQueue->Signal(m_fence, fence));
+    m_fenceValue++;
+    if (m_fence->GetCompletedValue() < fence){
+        checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+        WaitForSingleObject(m_fenceEvent, INFINITE);
+    }
+}
+
+// Waits for the GPU, hands the last readbacks to the encoders and waits for them.
+void finishCapture(){
+    waitForGpu();
+    if(!m_captureEnabled){
+        return;
+    }
+    frameCapturePoll(&m_capture, m_fenceValue - 1);
+    frameCaptureStop(&m_capture);
+    frameCapturePrintStats(&m_capture, stdout);
+}
+
+void recordGeometryPoolUploads(){
+    for (int i = 0; i < m_geometryPool.numUploads; i++){
+        const GeometryPoolUpload* upload = &m_geometryPool.uploads[i];
+        m_commandList->CopyBufferRegion(m_geometryBuffer, upload->poolOffset, m_geometryStaging, upload->stagingOffset, upload->size);
+    }
+    geometryPoolUploadsRecorded(&m_geometryPool);
+}
+
+// Compaction copies every moved range out to scratch before any comes back,
+// the frame graph puts the barriers between the two passes.
+void recordGeometryToScratchPass(void* userData){
+    for (int i = 0; i < m_geometryPool.numMoves; i++){
+        const GeometryPoolMove* move = &m_geometryPool.moves[i];
+        m_commandList->CopyBufferRegion(m_geometryScratch, move->scratchOffset, m_geometryBuffer, move->srcOffset, move->size);
+    }
+}
+
+void recordScratchToGeometryPass(void* userData){
+    for (int i = 0; i < m_geometryPool.numMoves; i++){
+        const GeometryPoolMove* move = &m_geometryPool.moves[i];
+        m_commandList->CopyBufferRegion(m_geometryBuffer, move->dstOffset, m_geometryScratch, move->scratchOffset, move->size);
+    }
+    geometryPoolMovesRecorded(&m_geometryPool);
+}
+
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam){
     return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
-int main(int argc, char** argv){
-    HMODULE hwnd = GetModuleHandle(0);
-    WNDCLASSEX windowClass = { 0 };
-    windowClass.cbSize = sizeof(WNDCLASSEX);
-    windowClass.style = CS_HREDRAW | CS_VREDRAW;
-    windowClass.lpfnWndProc = WindowProc;
-    windowClass.hInstance = hwnd;
-    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
-    windowClass.lpszClassName = "DXSampleClass";
-    RegisterClassEx(&windowClass);
-    
-    HWND window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
-
+bool createDeviceStep(void* context){
     UINT dxgiFactoryFlags = 0;
-    IDXGIFactory4* factory;
-    checkError(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+    if(!stepSucceeded(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&m_factory)), "CreateDXGIFactory2")){
+        return false;
+    }
 
     IDXGIAdapter1* hardwareAdapter = 0;
 
     for (UINT adapterIndex = 0; ; ++adapterIndex){
         IDXGIAdapter1* pAdapter = 0;
-        if (DXGI_ERROR_NOT_FOUND == factory->EnumAdapters1(adapterIndex, &hardwareAdapter)){
+        if (DXGI_ERROR_NOT_FOUND == m_factory->EnumAdapters1(adapterIndex, &hardwareAdapter)){
             break;
         } 
 
@@ -75,27 +503,53 @@ int main(int argc, char** argv){
         pAdapter->Release();
     }
 
-    checkError(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)));
+    if(!stepSucceeded(D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device)), "D3D12CreateDevice")){
+        return false;
+    }
 
     D3D12_COMMAND_QUEUE_DESC queueDesc = {};
     queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
     queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 
-    checkError(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
+    if(!stepSucceeded(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)), "CreateCommandQueue")){
+        return false;
+    }
 
+    for (UINT n = 0; n < FrameCount; n++){
+        if(!stepSucceeded(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocators[n])), "CreateCommandAllocator")){
+            return false;
+        }
+        m_frameFenceValues[n] = 0;
+    }
+
+    D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+    // The quad texture and the glyph atlas.
+    srvHeapDesc.NumDescriptors = 2;
+    srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    if(!stepSucceeded(m_device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&m_srvHeap)), "CreateDescriptorHeap")){
+        return false;
+    }
+    m_srvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    return true;
+}
+
+bool createSwapChainStep(void* context){
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
     swapChainDesc.BufferCount = FrameCount;
     swapChainDesc.Width = 900;
     swapChainDesc.Height = 500;
     swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
     swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+    // Partial redraws rely on the back buffers keeping their contents.
+    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
     swapChainDesc.SampleDesc.Count = 1;
 
     IDXGISwapChain1* swapChain;
-    checkError(factory->CreateSwapChainForHwnd(m_commandQueue, window, &swapChainDesc, 0, 0, &swapChain));
-
-    checkError(factory->MakeWindowAssociation(window, DXGI_MWA_NO_ALT_ENTER));
+    if(!stepSucceeded(m_factory->CreateSwapChainForHwnd(m_commandQueue, m_window, &swapChainDesc, 0, 0, &swapChain), "CreateSwapChainForHwnd") ||
+       !stepSucceeded(m_factory->MakeWindowAssociation(m_window, DXGI_MWA_NO_ALT_ENTER), "MakeWindowAssociation")){
+        return false;
+    }
 
     m_swapChain = (IDXGISwapChain3*)swapChain;
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -105,32 +559,446 @@ int main(int argc, char** argv){
     rtvHeapDesc.NumDescriptors = FrameCount;
     rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-    checkError(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
-
-    D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-    srvHeapDesc.NumDescriptors = 1;
-    srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    checkError(m_device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&m_srvHeap)));
+    if(!stepSucceeded(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)), "CreateDescriptorHeap")){
+        return false;
+    }
 
     m_rtvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
     D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
 
     for (UINT n = 0; n < FrameCount; n++){
-        checkError(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
+        if(!stepSucceeded(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])), "GetBuffer")){
+            return false;
+        }
         m_device->CreateRenderTargetView(m_renderTargets[n], 0, rtvHandle);
         rtvHandle.ptr += m_rtvDescriptorSize;
     }
+    return stepSucceeded(m_swapChain->GetContainingOutput(&m_output), "GetContainingOutput");
+}
+
+bool compileShaderStep(void* context){
+    ShaderCompileJob* job = (ShaderCompileJob*)context;
+    ID3DBlob* errors = 0;
+    HRESULT res = D3DCompileFromFile(job->file, 0, 0, job->entry, job->target, 0, 0, &job->blob, &errors);
+    // The compiler's own log says more than the HRESULT.
+    if(errors){
+        if(res != S_OK){
+            startupGraphSetError(&m_startup, (const char*)errors->GetBufferPointer());
+        }
+        errors->Release();
+    }
+    return stepSucceeded(res, "D3DCompileFromFile");
+}
+
+bool serializeRootSignatureStep(void* context){
+    RootSignatureJob* job = (RootSignatureJob*)context;
+    ID3DBlob* errors = 0;
+    HRESULT res = D3D12SerializeVersionedRootSignature(job->desc, &job->blob, &errors);
+    if(errors){
+        if(res != S_OK){
+            startupGraphSetError(&m_startup, (const char*)errors->GetBufferPointer());
+        }
+        errors->Release();
+    }
+    return stepSucceeded(res, "D3D12SerializeVersionedRootSignature");
+}
+
+bool createPipelineStep(void* context){
+    PipelineJob* job = (PipelineJob*)context;
+    ID3DBlob* signature = job->rootSignatureJob->blob;
+    if(!stepSucceeded(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(job->rootSignature)), "CreateRootSignature")){
+        return false;
+    }
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = *job->base;
+    psoDesc.InputLayout = job->inputLayout;
+    psoDesc.pRootSignature = *job->rootSignature;
+    psoDesc.VS.pShaderBytecode = job->vertexShader->blob->GetBufferPointer();
+    psoDesc.VS.BytecodeLength = job->vertexShader->blob->GetBufferSize();
+    psoDesc.PS.pShaderBytecode = job->pixelShader->blob->GetBufferPointer();
+    psoDesc.PS.BytecodeLength = job->pixelShader->blob->GetBufferSize();
+    if(job->blended){
+        psoDesc.BlendState.RenderTarget[0].BlendEnable = true;
+        psoDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+        psoDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    }
+    return stepSucceeded(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(job->pipelineState)), "CreateGraphicsPipelineState");
+}
+
+// All geometry lives in one DEFAULT heap buffer and is filled through a
+// persistently mapped staging buffer. The copy is recorded by firstFenceWaitStep.
+bool uploadGeometryStep(void* context){
+    // The quad's vertices come from its transform, an identity one: the unit quad around the origin.
+    if(!transformHierarchyInit(&m_transforms, MaxSprites)){
+        return stepSucceeded(E_OUTOFMEMORY, "transformHierarchyInit");
+    }
+    UINT32 quadTransform = transformCreate(&m_transforms, TransformNoParent);
+    transformUpdate(&m_transforms);
+    TransformVertex triangleVertices[6];
+    transformWriteQuads(&m_transforms, 0, quadTransform, 1, triangleVertices);
+
+    D3D12_HEAP_PROPERTIES heapProp = {};
+    heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
+
+    D3D12_RESOURCE_DESC resDesc = {};
+    resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resDesc.Alignment = 0;
+    resDesc.Width = GeometryPoolSize;
+    resDesc.Height = 1;
+    resDesc.DepthOrArraySize = 1;
+    resDesc.MipLevels = 1;
+    resDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resDesc.SampleDesc.Count = 1;
+    resDesc.SampleDesc.Quality = 0;
+    resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_COMMON, 0, IID_PPV_ARGS(&m_geometryBuffer)), "CreateCommittedResource")){
+        return false;
+    }
+    // Room for every byte the pool can hold plus the padding between moves.
+    resDesc.Width = GeometryPoolSize + 4 * GeometryPoolMaxCopies;
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_COPY_DEST, 0, IID_PPV_ARGS(&m_geometryScratch)), "CreateCommittedResource")){
+        return false;
+    }
+
+    heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
+    resDesc.Width = GeometryStagingSize;
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_geometryStaging)), "CreateCommittedResource")){
+        return false;
+    }
+
+    UINT8* pStagingBegin;
+    D3D12_RANGE readRange = {}; 
+    readRange.Begin = 0;
+    readRange.End = 0;
+    if(!stepSucceeded(m_geometryStaging->Map(0, &readRange, (void**)(&pStagingBegin)), "Map")){
+        return false;
+    }
+
+    geometryPoolInit(&m_geometryPool, GeometryPoolSize, 16, 2, pStagingBegin, GeometryStagingSize);
+    m_quadVertices = geometryPoolAllocateVertices(&m_geometryPool, 6);
+    if(m_quadVertices == GeometryPoolInvalid || !geometryPoolWrite(&m_geometryPool, m_quadVertices, 0, triangleVertices, sizeof(triangleVertices))){
+        return stepSucceeded(E_OUTOFMEMORY, "geometryPoolWrite");
+    }
+
+    // One view over the whole pool, draws pick their range with BaseVertexLocation.
+    m_vertexBufferView.BufferLocation = m_geometryBuffer->GetGPUVirtualAddress();
+    m_vertexBufferView.StrideInBytes = 16;
+    m_vertexBufferView.SizeInBytes = (UINT)GeometryPoolSize;
+    return true;
+}
+
+// The quad's texture, through the residency cache: anything else showing the
+// same pixels shares the resource and SRV. Its pixels go to an upload heap
+// here, the copy out of it is recorded by firstFenceWaitStep.
+bool uploadTextureStep(void* context){
+    TextureUploadJob* job = (TextureUploadJob*)context;
+    unsigned int TextureWidth = 2;
+    unsigned int TextureHeight = 2; 
+    unsigned int TexturePixelSize = 4;
+    
+    UINT8 texturePixels[] = {
+        255, 0, 0, 255, 0, 0, 255, 255,
+        0, 0, 255, 255, 255, 0, 0, 255
+    };
+
+    // Describe and create a Texture2D.
+    D3D12_RESOURCE_DESC textureDesc = {};
+    textureDesc.MipLevels = 1;
+    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    textureDesc.Width = TextureWidth;
+    textureDesc.Height = TextureHeight;
+    textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    textureDesc.DepthOrArraySize = 1;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.SampleDesc.Quality = 0;
+    textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+
+    D3D12_HEAP_PROPERTIES heapProps = {};
+    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProps.CreationNodeMask = 1;
+    heapProps.VisibleNodeMask = 1;
+
+    UINT64 uploadBufferSize = 0;
+    m_device->GetCopyableFootprints(&textureDesc, 0, 1, 0, nullptr, nullptr, nullptr, &uploadBufferSize);
+    D3D12_RESOURCE_ALLOCATION_INFO textureAllocation = m_device->GetResourceAllocationInfo(0, 1, &textureDesc);
+
+    D3D12_RESOURCE_DESC heapDesc = {};
+    heapDesc.MipLevels = 1;
+    heapDesc.Format = DXGI_FORMAT_UNKNOWN;
+    heapDesc.Height = 1;
+    heapDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    heapDesc.DepthOrArraySize = 1;
+    heapDesc.SampleDesc.Count = 1;
+    heapDesc.SampleDesc.Quality = 0;
+    heapDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    heapDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Format = textureDesc.Format;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels = 1;
+
+    if(!textureCacheInit(&m_textureCache, MaxTextures, TextureBudget)){
+        return stepSucceeded(E_OUTOFMEMORY, "textureCacheInit");
+    }
+    TextureCacheDesc quadTextureDesc = { TextureWidth, TextureHeight, (UINT32)textureDesc.Format, textureAllocation.SizeInBytes };
+    m_quadTexture = textureCacheAcquire(&m_textureCache, &quadTextureDesc, texturePixels, TextureWidth * TexturePixelSize, TextureWidth * TexturePixelSize, &job->created);
+    if(m_quadTexture == TextureCacheInvalid){
+        return stepSucceeded(E_OUTOFMEMORY, "textureCacheAcquire");
+    }
+    if(job->created){
+        if(!stepSucceeded(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, 0, IID_PPV_ARGS(&m_texture)), "CreateCommittedResource")){
+            return false;
+        }
+
+        // Create the GPU upload buffer.
+        heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+        heapDesc.Width = uploadBufferSize;
+
+        if(!stepSucceeded(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &heapDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&job->uploadHeap)), "CreateCommittedResource")){
+            return false;
+        }
+
+        D3D12_SUBRESOURCE_DATA textureData = {};
+        textureData.pData = &texturePixels[0];
+        textureData.RowPitch = TextureWidth * TexturePixelSize;
+        textureData.SlicePitch = textureData.RowPitch * TextureHeight;
+
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = {};
+        layout.Offset = 0;
+        layout.Footprint.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        layout.Footprint.Width = 2;
+        layout.Footprint.Height = 2;
+        layout.Footprint.Depth = 1;
+        layout.Footprint.RowPitch = 256;
+        job->layout = layout;
+        BYTE* pData;
+        if(!stepSucceeded(job->uploadHeap->Map(0, 0, (void**)(&pData)), "Map")){
+            return false;
+        }
+        D3D12_MEMCPY_DEST destData = { pData, layout.Footprint.RowPitch,  layout.Footprint.RowPitch * layout.Footprint.Height };
+        BYTE* pDestSlice = (BYTE*)(destData.pData);
+        const BYTE* pSrcSlice = (BYTE*)(textureData.pData);
+        // Source pixels are converted straight into the pitch-aligned upload memory.
+        pixelConvert(PIXEL_FORMAT_RGBA8, pSrcSlice, textureData.RowPitch, PIXEL_FORMAT_RGBA8, pDestSlice, destData.RowPitch, TextureWidth, TextureHeight, 0);
+        job->uploadHeap->Unmap(0, 0);
+
+        // Describe and create a SRV for the texture.
+        m_device->CreateShaderResourceView(m_texture, &srvDesc, m_srvHeap->GetCPUDescriptorHandleForHeapStart());
+        textureCacheSetResource(&m_textureCache, m_quadTexture, m_texture, 0);
+    }
+    m_texture = (ID3D12Resource*)textureCacheGet(&m_textureCache, m_quadTexture)->resource;
+    return true;
+}
+
+// Glyph atlas texture. It starts out as a shader resource; cells are only
+// sampled after their first upload, which the frame graph transitions for.
+bool createGlyphResourcesStep(void* context){
+    D3D12_RESOURCE_DESC glyphDesc = {};
+    glyphDesc.MipLevels = 1;
+    glyphDesc.Format = DXGI_FORMAT_R8_UNORM;
+    glyphDesc.Width = GlyphAtlasSize;
+    glyphDesc.Height = GlyphAtlasSize;
+    glyphDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    glyphDesc.DepthOrArraySize = 1;
+    glyphDesc.SampleDesc.Count = 1;
+    glyphDesc.SampleDesc.Quality = 0;
+    glyphDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+
+    D3D12_HEAP_PROPERTIES heapProps = {};
+    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heapProps.CreationNodeMask = 1;
+    heapProps.VisibleNodeMask = 1;
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &glyphDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 0, IID_PPV_ARGS(&m_glyphTexture)), "CreateCommittedResource")){
+        return false;
+    }
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Format = DXGI_FORMAT_R8_UNORM;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels = 1;
+    D3D12_CPU_DESCRIPTOR_HANDLE glyphSrv = m_srvHeap->GetCPUDescriptorHandleForHeapStart();
+    glyphSrv.ptr += m_srvDescriptorSize;
+    m_device->CreateShaderResourceView(m_glyphTexture, &srvDesc, glyphSrv);
+
+    // Upload space for every cell at once and the glyph instances, both per back
+    // buffer and mapped for good.
+    D3D12_RESOURCE_DESC heapDesc = {};
+    heapDesc.MipLevels = 1;
+    heapDesc.Format = DXGI_FORMAT_UNKNOWN;
+    heapDesc.Height = 1;
+    heapDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    heapDesc.DepthOrArraySize = 1;
+    heapDesc.SampleDesc.Count = 1;
+    heapDesc.SampleDesc.Quality = 0;
+    heapDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    heapDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+    D3D12_RANGE readRange = {};
+    int glyphCells = (GlyphAtlasSize / GlyphCellSize) * (GlyphAtlasSize / GlyphCellSize);
+    heapDesc.Width = (UINT64)FrameCount * glyphCells * GlyphUploadPitch * GlyphCellSize;
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &heapDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_glyphUpload)), "CreateCommittedResource") ||
+       !stepSucceeded(m_glyphUpload->Map(0, &readRange, (void**)&m_glyphUploadPixels), "Map")){
+        return false;
+    }
+    heapDesc.Width = FrameCount * MaxTextInstances * sizeof(TextInstance);
+    if(!stepSucceeded(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &heapDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_textInstanceBuffer)), "CreateCommittedResource") ||
+       !stepSucceeded(m_textInstanceBuffer->Map(0, &readRange, (void**)&m_textInstances), "Map")){
+        return false;
+    }
+    m_textInstanceView.StrideInBytes = sizeof(TextInstance);
+    m_textInstanceView.SizeInBytes = MaxTextInstances * sizeof(TextInstance);
+    return true;
+}
+
+// The worker pool and the glyph atlas rasterizing with GDI.
+bool initGlyphAtlasStep(void* context){
+    workerPoolInit(&m_workers, (int)std::thread::hardware_concurrency());
+
+    m_glyphDC = CreateCompatibleDC(0);
+    HFONT glyphFont = CreateFont(-GlyphEmSize * GlyphOversample, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                                 OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, "Arial");
+    SelectObject(m_glyphDC, glyphFont);
+    if(!glyphAtlasInit(&m_glyphAtlas, GlyphAtlasSize, GlyphAtlasSize, GlyphCellSize, GlyphEmSize, GlyphSpread, GlyphOversample,
+                       rasterizeGdiGlyph, 0, &m_workers)){
+        return stepSucceeded(E_OUTOFMEMORY, "glyphAtlasInit");
+    }
+    return true;
+}
+
+// "-capture" readback buffers, sized for the back buffers.
+bool createCaptureStep(void* context){
+    D3D12_RESOURCE_DESC backBufferDesc = m_renderTargets[0]->GetDesc();
+    UINT64 readbackSize = 0;
+    m_device->GetCopyableFootprints(&backBufferDesc, 0, 1, 0, &m_captureFootprint, 0, 0, &readbackSize);
+
+    D3D12_HEAP_PROPERTIES readbackHeapProps = {};
+    readbackHeapProps.Type = D3D12_HEAP_TYPE_READBACK;
+    D3D12_RESOURCE_DESC readbackDesc = {};
+    readbackDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    readbackDesc.Width = readbackSize;
+    readbackDesc.Height = 1;
+    readbackDesc.DepthOrArraySize = 1;
+    readbackDesc.MipLevels = 1;
+    readbackDesc.Format = DXGI_FORMAT_UNKNOWN;
+    readbackDesc.SampleDesc.Count = 1;
+    readbackDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    // Readback buffers stay mapped, the encoders only read them after the copy's fence.
+    const UINT8* readbackPixels[CaptureSlots];
+    for (int i = 0; i < CaptureSlots; i++){
+        if(!stepSucceeded(m_device->CreateCommittedResource(&readbackHeapProps, D3D12_HEAP_FLAG_NONE, &readbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, 0, IID_PPV_ARGS(&m_readbackBuffers[i])), "CreateCommittedResource")){
+            return false;
+        }
+        D3D12_RANGE mapRange = { 0, (SIZE_T)readbackSize };
+        if(!stepSucceeded(m_readbackBuffers[i]->Map(0, &mapRange, (void**)&readbackPixels[i]), "Map")){
+            return false;
+        }
+    }
+    frameCaptureStart(&m_capture, ".", CAPTURE_FORMAT_PNG, 900, 500, m_captureFootprint.Footprint.RowPitch, readbackPixels, CaptureSlots, 2);
+    return true;
+}
+
+// Runs last: records the geometry and texture copies the upload steps
+// prepared, and waits for the GPU to finish them.
+bool firstFenceWaitStep(void* context){
+    TextureUploadJob* texture = (TextureUploadJob*)context;
+    if(!stepSucceeded(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[0], 0, IID_PPV_ARGS(&m_commandList)), "CreateCommandList")){
+        return false;
+    }
+
+    recordGeometryPoolUploads();
+
+    D3D12_RESOURCE_BARRIER geometryBarrier = {};
+    geometryBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    geometryBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    geometryBarrier.Transition.pResource = m_geometryBuffer;
+    geometryBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+    geometryBarrier.Transition.StateAfter = (D3D12_RESOURCE_STATES)GeometryState;
+    geometryBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    m_commandList->ResourceBarrier(1, &geometryBarrier);
+
+    if(texture->created){
+        D3D12_TEXTURE_COPY_LOCATION Dst = {};
+        Dst.pResource = m_texture;
+        Dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        Dst.SubresourceIndex = 0;
+        D3D12_TEXTURE_COPY_LOCATION Src = {};
+        Src.pResource = texture->uploadHeap;
+        Src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        Src.PlacedFootprint = texture->layout;
+        m_commandList->CopyTextureRegion(&Dst, 0, 0, 0, &Src, 0);
+
+
+        D3D12_RESOURCE_BARRIER resBar = {};
+        resBar.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        resBar.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        resBar.Transition.pResource = m_texture;
+        resBar.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+        resBar.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+        resBar.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        m_commandList->ResourceBarrier(1, &resBar);
+    }
+
+    if(!stepSucceeded(m_commandList->Close(), "Close")){
+        return false;
+    }
+    ID3D12CommandList* ppCommandLists[] = { m_commandList };
+    m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
+
+    if(!stepSucceeded(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)), "CreateFence")){
+        return false;
+    }
+    m_fenceValue = 1;
+
+    m_fenceEvent = CreateEvent(0, FALSE, FALSE, 0);
+    if (m_fenceEvent == 0){
+        return stepSucceeded(HRESULT_FROM_WIN32(GetLastError()), "CreateEvent");
+    }
     
-    checkError(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
+    const UINT64 fence = m_fenceValue;
+    if(!stepSucceeded(m_commandQueue->Signal(m_fence, fence), "Signal")){
+        return false;
+    }
+    m_fenceValue++;
 
+    if (m_fence->GetCompletedValue() < fence){
+        if(!stepSucceeded(m_fence->SetEventOnCompletion(fence, m_fenceEvent), "SetEventOnCompletion")){
+            return false;
+        }
+        WaitForSingleObject(m_fenceEvent, INFINITE);
+    }
 
-    D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
-    featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    geometryPoolUploadsRetired(&m_geometryPool);
+    return true;
+}
+
+int main(int argc, char** argv){
+    m_launched = std::chrono::steady_clock::now();
+    HMODULE hwnd = GetModuleHandle(0);
+    WNDCLASSEX windowClass = { 0 };
+    windowClass.cbSize = sizeof(WNDCLASSEX);
+    windowClass.style = CS_HREDRAW | CS_VREDRAW;
+    windowClass.lpfnWndProc = WindowProc;
+    windowClass.hInstance = hwnd;
+    windowClass.hCursor = LoadCursor(0, IDC_ARROW);
+    windowClass.lpszClassName = "DXSampleClass";
+    RegisterClassEx(&windowClass);
+    
+    m_window = CreateWindow(windowClass.lpszClassName, "dx12", WS_OVERLAPPEDWINDOW, 100, 100, 900, 500, 0, 0, hwnd, 0);
 
-    if (FAILED(m_device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData)))){
-        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+    // "-capture" writes every rendered frame to frame_NNNNNN.png in the working directory.
+    for (int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-capture") == 0){
+            m_captureEnabled = true;
+        }
     }
 
     D3D12_DESCRIPTOR_RANGE1 ranges;
@@ -174,30 +1042,29 @@ int main(int argc, char** argv){
     vRtSigDesc.Desc_1_1.pStaticSamplers = &sampler;
     vRtSigDesc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
 
-
-    ID3DBlob* signature;
-    ID3DBlob* error;
-    checkError(D3D12SerializeVersionedRootSignature(&vRtSigDesc, &signature, &error));
-    checkError(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
-
-    ID3DBlob* vertexShader;
-    ID3DBlob* pixelShader;
-
-    checkError(D3DCompileFromFile(L"sprite_shaders.hlsl", 0, 0, "VSMain", "vs_5_0", 0, 0, &vertexShader, 0));
-    checkError(D3DCompileFromFile(L"sprite_shaders.hlsl", 0, 0, "PSMain", "ps_5_0", 0, 0, &pixelShader, 0));
+    // Text samples its distance field filtered. What keeps neighbouring cells
+    // from bleeding in is the spread: every glyph has GlyphSpread texels of
+    // falloff around it and textLayout keeps its UVs half a texel inside
+    // them. Clamping only decides what the edge of the whole atlas reads.
+    D3D12_STATIC_SAMPLER_DESC textSampler = sampler;
+    textSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+    textSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    textSampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    textSampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC textRtSigDesc = vRtSigDesc;
+    textRtSigDesc.Desc_1_1.pStaticSamplers = &textSampler;
 
     D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = {
         { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 
-    D3D12_SHADER_BYTECODE vsbc;
-    vsbc.pShaderBytecode = vertexShader->GetBufferPointer();
-    vsbc.BytecodeLength = vertexShader->GetBufferSize();
-
-    D3D12_SHADER_BYTECODE psbc;
-    psbc.pShaderBytecode = pixelShader->GetBufferPointer();
-    psbc.BytecodeLength = pixelShader->GetBufferSize();
+    // Text pipeline: one instance per glyph, blended over the sprites.
+    D3D12_INPUT_ELEMENT_DESC textElementDescs[] = {
+        { "RECT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+    };
 
     D3D12_RASTERIZER_DESC rades;
     rades.FillMode = D3D12_FILL_MODE_SOLID;
@@ -226,11 +1093,8 @@ int main(int argc, char** argv){
         bledes.RenderTarget[i] = defaultRenderTargetBlendDesc;
     }
 
+    // What both pipelines share; the pipeline steps fill in the rest.
     D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-    psoDesc.InputLayout = { inputElementDescs, 2 };
-    psoDesc.pRootSignature = m_rootSignature;
-    psoDesc.VS = vsbc;
-    psoDesc.PS = psbc;
     psoDesc.RasterizerState = rades;
     psoDesc.BlendState = bledes;
     psoDesc.DepthStencilState.DepthEnable = FALSE;
@@ -240,179 +1104,96 @@ int main(int argc, char** argv){
     psoDesc.NumRenderTargets = 1;
     psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
     psoDesc.SampleDesc.Count = 1;
-    checkError(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
 
-    checkError(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, m_pipelineState, IID_PPV_ARGS(&m_commandList)));
-    
-    float triangleVertices[] = {
-        -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f,  0.5f,  0.0f, 0.0f,
-         0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f, -0.5f,  1.0f, 1.0f, 
-        -0.5f, -0.5f,  0.0f, 1.0f,
+    // The device and swap chain come up while the shaders compile and the root
+    // signatures serialize; each pipeline follows as soon as its pieces are
+    // there, and the uploads as soon as the device is.
+    ShaderCompileJob shaderJobs[] = {
+        { "sprite_shaders.hlsl VSMain", L"sprite_shaders.hlsl", "VSMain", "vs_5_0", 0 },
+        { "sprite_shaders.hlsl PSMain", L"sprite_shaders.hlsl", "PSMain", "ps_5_0", 0 },
+        { "text_shaders.hlsl VSMain", L"text_shaders.hlsl", "VSMain", "vs_5_0", 0 },
+        { "text_shaders.hlsl PSMain", L"text_shaders.hlsl", "PSMain", "ps_5_0", 0 },
     };
-
-    const UINT vertexBufferSize = sizeof(triangleVertices);
-
-    D3D12_HEAP_PROPERTIES heapProp = {};
-    heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
-
-    D3D12_RESOURCE_DESC resDesc = {};
-    resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    resDesc.Alignment = 0;
-    resDesc.Width = vertexBufferSize;
-    resDesc.Height = 1;
-    resDesc.DepthOrArraySize = 1;
-    resDesc.MipLevels = 1;
-    resDesc.Format = DXGI_FORMAT_UNKNOWN;
-    resDesc.SampleDesc.Count = 1;
-    resDesc.SampleDesc.Quality = 0;
-    resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-    resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-    checkError(m_device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&m_vertexBuffer)));
-
-    UINT8* pVertexDataBegin;
-    D3D12_RANGE readRange = {}; 
-    readRange.Begin = 0;
-    readRange.End = 0;
-    checkError(m_vertexBuffer->Map(0, &readRange, (void**)(&pVertexDataBegin)));
-    memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
-    m_vertexBuffer->Unmap(0, 0);
-
-    // Initialize the vertex buffer view.
-    m_vertexBufferView.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
-    m_vertexBufferView.StrideInBytes = 16;
-    m_vertexBufferView.SizeInBytes = vertexBufferSize;
-
-    ////////////TEXTURE STUFF//////////////////////////////
-    unsigned int TextureWidth = 2;
-    unsigned int TextureHeight = 2; 
-    unsigned int TexturePixelSize = 4;
-    
-    UINT8 texturePixels[] = {
-        255, 0, 0, 255, 0, 0, 255, 255,
-        0, 0, 255, 255, 255, 0, 0, 255
+    RootSignatureJob rootSignatureJobs[] = {
+        { "sprite root signature", &vRtSigDesc, 0 },
+        { "text root signature", &textRtSigDesc, 0 },
     };
+    PipelineJob pipelineJobs[] = {
+        { "sprite pso", &psoDesc, { inputElementDescs, _countof(inputElementDescs) }, &rootSignatureJobs[0], &m_rootSignature,
+          &shaderJobs[0], &shaderJobs[1], false, &m_pipelineState },
+        { "text pso", &psoDesc, { textElementDescs, _countof(textElementDescs) }, &rootSignatureJobs[1], &m_textRootSignature,
+          &shaderJobs[2], &shaderJobs[3], true, &m_textPipelineState },
+    };
+    TextureUploadJob textureUpload = {};
+    startupGraphInit(&m_startup);
+    int deviceStep = startupGraphAdd(&m_startup, "device", createDeviceStep, 0);
+    int swapChainStep = startupGraphAdd(&m_startup, "swap chain", createSwapChainStep, 0);
+    startupGraphDepend(&m_startup, swapChainStep, deviceStep);
+    // DXGI sends messages to the window while creating the swap chain, so it stays on the window's thread.
+    startupGraphPin(&m_startup, swapChainStep);
+    int rootSignatureSteps[_countof(rootSignatureJobs)];
+    for (UINT i = 0; i < _countof(rootSignatureJobs); i++){
+        rootSignatureSteps[i] = startupGraphAdd(&m_startup, rootSignatureJobs[i].name, serializeRootSignatureStep, &rootSignatureJobs[i]);
+    }
+    int shaderSteps[_countof(shaderJobs)];
+    for (UINT i = 0; i < _countof(shaderJobs); i++){
+        shaderSteps[i] = startupGraphAdd(&m_startup, shaderJobs[i].name, compileShaderStep, &shaderJobs[i]);
+    }
+    for (UINT i = 0; i < _countof(pipelineJobs); i++){
+        int pipelineStep = startupGraphAdd(&m_startup, pipelineJobs[i].name, createPipelineStep, &pipelineJobs[i]);
+        startupGraphDepend(&m_startup, pipelineStep, deviceStep);
+        startupGraphDepend(&m_startup, pipelineStep, rootSignatureSteps[pipelineJobs[i].rootSignatureJob - rootSignatureJobs]);
+        startupGraphDepend(&m_startup, pipelineStep, shaderSteps[pipelineJobs[i].vertexShader - shaderJobs]);
+        startupGraphDepend(&m_startup, pipelineStep, shaderSteps[pipelineJobs[i].pixelShader - shaderJobs]);
+    }
+    int geometryStep = startupGraphAdd(&m_startup, "geometry upload", uploadGeometryStep, 0);
+    startupGraphDepend(&m_startup, geometryStep, deviceStep);
+    int textureStep = startupGraphAdd(&m_startup, "texture upload", uploadTextureStep, &textureUpload);
+    startupGraphDepend(&m_startup, textureStep, deviceStep);
+    int glyphResourcesStep = startupGraphAdd(&m_startup, "glyph resources", createGlyphResourcesStep, 0);
+    startupGraphDepend(&m_startup, glyphResourcesStep, deviceStep);
+    // The GDI font and device context are set up on the window's thread, as they always were.
+    startupGraphPin(&m_startup, startupGraphAdd(&m_startup, "glyph atlas", initGlyphAtlasStep, 0));
+    if(m_captureEnabled){
+        int captureStep = startupGraphAdd(&m_startup, "capture", createCaptureStep, 0);
+        startupGraphDepend(&m_startup, captureStep, swapChainStep);
+    }
+    int fenceStep = startupGraphAdd(&m_startup, "first fence wait", firstFenceWaitStep, &textureUpload);
+    startupGraphDepend(&m_startup, fenceStep, geometryStep);
+    startupGraphDepend(&m_startup, fenceStep, textureStep);
+    // This thread mostly waits for the swap chain, one more keeps every core busy.
+    checkStartup(startupGraphRun(&m_startup, (int)std::thread::hardware_concurrency() + 1));
 
+    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
-    ID3D12Resource* textureUploadHeap;
-
-    // Describe and create a Texture2D.
-    D3D12_RESOURCE_DESC textureDesc = {};
-    textureDesc.MipLevels = 1;
-    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    textureDesc.Width = TextureWidth;
-    textureDesc.Height = TextureHeight;
-    textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-    textureDesc.DepthOrArraySize = 1;
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.SampleDesc.Quality = 0;
-    textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-    heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-    heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-    heapProps.CreationNodeMask = 1;
-    heapProps.VisibleNodeMask = 1;
-
-    checkError(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, 0, IID_PPV_ARGS(&m_texture)));
-
-    UINT64 uploadBufferSize = 0;
-    m_device->GetCopyableFootprints(&textureDesc, 0, 1, 0, nullptr, nullptr, nullptr, &uploadBufferSize);
-
-    // Create the GPU upload buffer.
-    heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-    D3D12_RESOURCE_DESC heapDesc = {};
-    heapDesc.MipLevels = 1;
-    heapDesc.Format = DXGI_FORMAT_UNKNOWN;
-    heapDesc.Width = uploadBufferSize;
-    heapDesc.Height = 1;
-    heapDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-    heapDesc.DepthOrArraySize = 1;
-    heapDesc.SampleDesc.Count = 1;
-    heapDesc.SampleDesc.Quality = 0;
-    heapDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    heapDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-
-    checkError(m_device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &heapDesc, D3D12_RESOURCE_STATE_GENERIC_READ, 0, IID_PPV_ARGS(&textureUploadHeap)));
-
-    D3D12_SUBRESOURCE_DATA textureData = {};
-    textureData.pData = &texturePixels[0];
-    textureData.RowPitch = TextureWidth * TexturePixelSize;
-    textureData.SlicePitch = textureData.RowPitch * TextureHeight;
-
-    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = {};
-    layout.Offset = 0;
-    layout.Footprint.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    layout.Footprint.Width = 2;
-    layout.Footprint.Height = 2;
-    layout.Footprint.Depth = 1;
-    layout.Footprint.RowPitch = 256;
-    BYTE* pData;
-    checkError(textureUploadHeap->Map(0, 0, (void**)(&pData)));
-    D3D12_MEMCPY_DEST destData = { pData, layout.Footprint.RowPitch,  layout.Footprint.RowPitch * layout.Footprint.Height };
-    BYTE* pDestSlice = (BYTE*)(destData.pData);
-    const BYTE* pSrcSlice = (BYTE*)(textureData.pData);
-    for (UINT i = 0; i < 2; i++){
-        memcpy(pDestSlice + destData.RowPitch * i, pSrcSlice + textureData.RowPitch * i, 8);
-    }
-    textureUploadHeap->Unmap(0, 0);
-
-    D3D12_TEXTURE_COPY_LOCATION Dst = {};
-    Dst.pResource = m_texture;
-    Dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-    Dst.SubresourceIndex = 0;
-    D3D12_TEXTURE_COPY_LOCATION Src = {};
-    Src.pResource = textureUploadHeap;
-    Src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-    Src.PlacedFootprint = layout;
-    m_commandList->CopyTextureRegion(&Dst, 0, 0, 0, &Src, 0);
-
-
-    D3D12_RESOURCE_BARRIER resBar = {};
-    resBar.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    resBar.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    resBar.Transition.pResource = m_texture;
-    resBar.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-    resBar.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-    resBar.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-    m_commandList->ResourceBarrier(1, &resBar);
-
-    // Describe and create a SRV for the texture.
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = textureDesc.Format;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MipLevels = 1;
-    m_device->CreateShaderResourceView(m_texture, &srvDesc, m_srvHeap->GetCPUDescriptorHandleForHeapStart());
-
-    checkError(m_commandList->Close());
-    ID3D12CommandList* ppCommandLists[] = { m_commandList };
-    m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-
-    checkError(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-    m_fenceValue = 1;
+    // The back buffers start out undefined, so the background is cleared in
+    // full once; after that only the draws that change report damage.
+    damageTrackerInit(&m_damage, 900, 500, FrameCount);
+    damageTrackerInvalidateAll(&m_damage);
 
-    m_fenceEvent = CreateEvent(0, FALSE, FALSE, 0);
-    if (m_fenceEvent == 0){
-        checkError(HRESULT_FROM_WIN32(GetLastError()));
+    // Sprites are culled against the viewport in pixels; the quad spans -0.5..0.5 in NDC.
+    if(!visibilityGridInit(&m_visibility, 0.0f, 0.0f, 900.0f, 500.0f, 64.0f, MaxSprites)){
+        checkError(E_OUTOFMEMORY);
     }
-    
-    const UINT64 fence = m_fenceValue;
-    checkError(m_commandQueue->Signal(m_fence, fence));
-    m_fenceValue++;
-
-    if (m_fence->GetCompletedValue() < fence){
-        checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-        WaitForSingleObject(m_fenceEvent, INFINITE);
+    visibilityGridUpdate(&m_visibility, 0, 225.0f, 125.0f, 675.0f, 375.0f);
+    m_spriteMinX[0] = 225.0f;
+    m_spriteMinY[0] = 125.0f;
+    m_spriteMaxX[0] = 675.0f;
+    m_spriteMaxY[0] = 375.0f;
+    m_spriteLayer[0] = 0.5f;
+    damageSprite(0);
+    // Quarter resolution is plenty for sprites this size.
+    if(!occlusionBufferInit(&m_occlusion, 900.0f, 500.0f, 225, 125, MaxSprites, &m_workers)){
+        checkError(E_OUTOFMEMORY);
+    }
+    if(!drawQueueInit(&m_drawQueue, MaxSprites, &m_workers)){
+        checkError(E_OUTOFMEMORY);
+    }
+    if(!frameArenaInit(&m_frameArena, FrameCount, 1, FrameArenaBlockSize)){
+        checkError(E_OUTOFMEMORY);
     }
 
-    m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
-
-    ShowWindow(window, SW_SHOW);
+    ShowWindow(m_window, SW_SHOW);
 
     MSG msg = {};
     while (msg.message != WM_QUIT){
@@ -422,9 +1203,45 @@ int main(int argc, char** argv){
         }
 
         if(msg.message == WM_PAINT){
-            checkError(m_commandAllocator->Reset());
+            updateLabel();
+            if(damageTrackerBeginFrame(&m_damage) == 0){
+                // Nothing is presented, so pace the loop on the display and
+                // keep the capture going with a repeat of the last frame.
+                m_output->WaitForVBlank();
+                if(m_captureEnabled){
+                    frameCaptureRepeat(&m_capture);
+                }
+                continue;
+            }
+
+            // Only wait if this back buffer's previous frame is still on the GPU;
+            // the arena and the upload space of that frame are free after it too.
+            if (m_fence->GetCompletedValue() < m_frameFenceValues[m_frameIndex]){
+                checkError(m_fence->SetEventOnCompletion(m_frameFenceValues[m_frameIndex], m_fenceEvent));
+                WaitForSingleObject(m_fenceEvent, INFINITE);
+            }
+            if(!frameArenaBeginFrame(&m_frameArena, m_fence->GetCompletedValue())){
+                checkError(E_FAIL);
+            }
+            frameArenaSetStrict(&m_frameArena, m_frameArena.stats.frames > FrameArenaWarmupFrames);
+
+            // Textures released since are only evicted once the GPU is done with them.
+            textureCacheTrim(&m_textureCache, m_fence->GetCompletedValue());
+            for (UINT32 i = 0; i < m_textureCache.numEvicted; i++){
+                ((ID3D12Resource*)m_textureCache.evicted[i].resource)->Release();
+            }
+            textureCacheEvictionsReleased(&m_textureCache);
+
+            m_captureSlot = -1;
+            if(m_captureEnabled){
+                frameCapturePoll(&m_capture, m_fence->GetCompletedValue());
+                m_captureSlot = frameCaptureAcquire(&m_capture);
+            }
+
+            checkError(m_commandAllocators[m_frameIndex]->Reset());
 
-            checkError(m_commandList->Reset(m_commandAllocator, m_pipelineState));
+            // Pipeline, root signature and descriptor table are bound by the draw queue.
+            checkError(m_commandList->Reset(m_commandAllocators[m_frameIndex], 0));
 
             D3D12_VIEWPORT viewport;
             viewport.TopLeftX = 0;
@@ -438,42 +1255,67 @@ int main(int argc, char** argv){
             scissorRect.top = 0;
             scissorRect.right = 900;
             scissorRect.bottom = 500;
-            m_commandList->SetGraphicsRootSignature(m_rootSignature);
-
             ID3D12DescriptorHeap* ppHeaps[] = { m_srvHeap };
 
             m_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
-            m_commandList->SetGraphicsRootDescriptorTable(0, m_srvHeap->GetGPUDescriptorHandleForHeapStart());
-
 
             m_commandList->RSSetViewports(1, &viewport);
             m_commandList->RSSetScissorRects(1, &scissorRect);
 
-            // Indicate that the back buffer will be used as a render target.
-            D3D12_RESOURCE_BARRIER barrier = {};
-            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            barrier.Transition.pResource = m_renderTargets[m_frameIndex];
-            barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-            barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-            barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            m_commandList->ResourceBarrier(1, &barrier);
-
-            D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
-            rtvHandle.ptr += m_frameIndex * m_rtvDescriptorSize;
-            m_commandList->OMSetRenderTargets(1, &rtvHandle, false, 0);
-
-            // Record commands.
-            const float clearColor[] = { 1.0f, 0.2f, 0.4f, 1.0f };
-            m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, 0);
-            m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
-            m_commandList->DrawInstanced(6, 1, 0, 0);
-
-            // Indicate that the back buffer will now be used to present.
-            barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-            barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-            m_commandList->ResourceBarrier(1, &barrier);
+            m_numVisibleSprites = visibilityGridQuery(&m_visibility, 0.0f, 0.0f, 900.0f, 500.0f, m_visibleSprites);
+
+            // The opaque quad is an occluder; it is on its own layer so it never hides itself.
+            occlusionBeginFrame(&m_occlusion);
+            occlusionAddOccluder(&m_occlusion, m_spriteMinX[0], m_spriteMinY[0], m_spriteMaxX[0], m_spriteMaxY[0], m_spriteLayer[0]);
+            occlusionRasterize(&m_occlusion);
+            m_numVisibleSprites = occlusionCullBatch(&m_occlusion, m_visibleSprites, m_numVisibleSprites, m_spriteMinX, m_spriteMinY, m_spriteMaxX, m_spriteMaxY,
+                                                     m_spriteLayer, m_visibleSprites);
+
+            // This back buffer's instance space is free now that its previous frame is done.
+            TextInstance* textInstances = m_textInstances + m_frameIndex * MaxTextInstances;
+            m_textInstanceView.BufferLocation = m_textInstanceBuffer->GetGPUVirtualAddress() + (UINT64)m_frameIndex * MaxTextInstances * sizeof(TextInstance);
+            memcpy(textInstances, m_labelInstances, m_numLabelInstances * sizeof(TextInstance));
+            m_numTextInstances = m_numLabelInstances;
+
+            // Once freed meshes have split the pool up, what's left slides down.
+            // The sprite pass resolves base vertices after this, so its draws
+            // already use the new offsets.
+            if(m_geometryPool.numFreeRanges > GeometryCompactFreeRanges){
+                geometryPoolCompact(&m_geometryPool);
+            }
+
+            // The back buffer transitions to render target and back to present are
+            // derived by the frame graph from the pass declarations.
+            frameGraphReset(&m_frameGraph);
+            int backBuffer = frameGraphImport(&m_frameGraph, "back buffer", m_renderTargets[m_frameIndex], FG_STATE_PRESENT, FG_STATE_PRESENT);
+            int geometry = frameGraphImport(&m_frameGraph, "geometry pool", m_geometryBuffer, GeometryState, GeometryState);
+            if(m_geometryPool.numMoves > 0){
+                int geometryScratch = frameGraphImport(&m_frameGraph, "geometry scratch", m_geometryScratch, FG_STATE_COPY_DEST, FG_STATE_COPY_DEST);
+                int toScratchPass = frameGraphAddPass(&m_frameGraph, "geometry to scratch", recordGeometryToScratchPass, 0);
+                frameGraphRead(&m_frameGraph, toScratchPass, geometry, FG_STATE_COPY_SOURCE);
+                frameGraphWrite(&m_frameGraph, toScratchPass, geometryScratch, FG_STATE_COPY_DEST);
+                int fromScratchPass = frameGraphAddPass(&m_frameGraph, "scratch to geometry", recordScratchToGeometryPass, 0);
+                frameGraphRead(&m_frameGraph, fromScratchPass, geometryScratch, FG_STATE_COPY_SOURCE);
+                frameGraphWrite(&m_frameGraph, fromScratchPass, geometry, FG_STATE_COPY_DEST);
+            }
+            int glyphAtlas = frameGraphImport(&m_frameGraph, "glyph atlas", m_glyphTexture, FG_STATE_PIXEL_SHADER_RESOURCE, FG_STATE_PIXEL_SHADER_RESOURCE);
+            if(m_glyphAtlas.numDirty > 0){
+                int glyphUploadPass = frameGraphAddPass(&m_frameGraph, "glyph upload", recordGlyphUploadPass, 0);
+                frameGraphWrite(&m_frameGraph, glyphUploadPass, glyphAtlas, FG_STATE_COPY_DEST);
+            }
+            int spritePass = frameGraphAddPass(&m_frameGraph, "sprite", recordSpritePass, 0);
+            frameGraphRead(&m_frameGraph, spritePass, glyphAtlas, FG_STATE_PIXEL_SHADER_RESOURCE);
+            frameGraphRead(&m_frameGraph, spritePass, geometry, GeometryState);
+            frameGraphWrite(&m_frameGraph, spritePass, backBuffer, FG_STATE_RENDER_TARGET);
+            if(m_captureSlot >= 0){
+                int capturePass = frameGraphAddPass(&m_frameGraph, "capture", recordCapturePass, 0);
+                frameGraphRead(&m_frameGraph, capturePass, backBuffer, FG_STATE_COPY_SOURCE);
+                frameGraphSetSideEffect(&m_frameGraph, capturePass);
+            }
+            if(!frameGraphCompile(&m_frameGraph)){
+                checkError(E_FAIL);
+            }
+            frameGraphExecute(&m_frameGraph, submitFrameGraphBarriers, m_commandList);
 
             checkError(m_commandList->Close());
 
@@ -481,23 +1323,49 @@ int main(int argc, char** argv){
             m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
             // Present the frame.
-            checkError(m_swapChain->Present(1, 0));
+            RECT* dirtyRects = frameArenaNew<RECT>(frameArenaThread(&m_frameArena, 0), m_damage.numFrameRects);
+            for (int i = 0; i < m_damage.numFrameRects; i++){
+                dirtyRects[i].left = m_damage.frameRects[i].left;
+                dirtyRects[i].top = m_damage.frameRects[i].top;
+                dirtyRects[i].right = m_damage.frameRects[i].right;
+                dirtyRects[i].bottom = m_damage.frameRects[i].bottom;
+            }
+            DXGI_PRESENT_PARAMETERS presentParams = {};
+            presentParams.DirtyRectsCount = m_damage.numFrameRects;
+            presentParams.pDirtyRects = dirtyRects;
+            checkError(m_swapChain->Present1(1, 0, &presentParams));
+            if(!m_presented){
+                m_presented = true;
+                printf("first present %.2f ms after launch, %.2f ms of it startup steps\n",
+                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_launched).count(), m_startup.wallSeconds * 1000.0);
+            }
 
-            checkError(m_commandQueue->Signal(m_fence, fence));
+            const UINT64 frameFence = m_fenceValue;
+            checkError(m_commandQueue->Signal(m_fence, frameFence));
             m_fenceValue++;
-
-            // Wait until the previous frame is finished.
-            if (m_fence->GetCompletedValue() < fence){
-                checkError(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-                WaitForSingleObject(m_fenceEvent, INFINITE);
+            frameArenaEndFrame(&m_frameArena, frameFence);
+            if(m_captureSlot >= 0){
+                frameCaptureSubmit(&m_capture, m_captureSlot, frameFence);
             }
+            m_frameFenceValues[m_frameIndex] = frameFence;
 
             m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
             
         }else if(msg.message == WM_KEYDOWN){
-            exit(0);
+            break;
         }
     }
 
+    startupGraphPrintReport(&m_startup, stdout);
+    transformPrintStats(&m_transforms, stdout);
+    occlusionPrintStats(&m_occlusion, stdout);
+    textureCachePrintStats(&m_textureCache, stdout);
+    drawQueuePrintStats(&m_drawQueue, stdout);
+    damageTrackerPrintStats(&m_damage, stdout);
+    glyphAtlasPrintStats(&m_glyphAtlas, stdout);
+    frameArenaPrintStats(&m_frameArena, stdout);
+    workerPoolPrintStats(&m_workers, stdout);
+    finishCapture();
+    workerPoolDestroy(&m_workers);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,277 @@
+#pragma once
+
+// Dynamic resolution. The scene is rendered into an offscreen target at a
+// fraction of the output resolution and upscaled to the back buffer; the
+// fraction is picked from measured GPU frame times so that load spikes cost
+// sharpness instead of missed frames. The target is allocated once at the
+// largest scale and only the viewport changes, so scaling never reallocates.
+// A maxScale above 1 spends spare GPU time on supersampling: the rendered
+// region is then larger than the output and the same pass filters it down.
+//
+// The controller is a PID loop in velocity form on the relative error between
+// the frame budget and the smoothed frame time. Its output scales the rendered
+// pixel count, which is what GPU time mostly follows, and the render size
+// comes from its square root. Hysteresis keeps the resolution from hunting:
+// headroom inside a dead band under the budget is ignored, the scale only goes
+// up after a run of frames under budget, and sizes snap to a pixel grid so
+// small corrections don't change anything. Frames far over budget skip the
+// loop and cut the pixel count in proportion straight away.
+//
+// Nothing here knows about D3D12. The controller is fed frame times in
+// milliseconds, so recorded traces replay headless through dynResReplay, and
+// dynResUpscale does the same filtering as the upscale shader on the CPU for
+// software rendered or captured frames.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "texture_sampler.h"
+
+struct DynResDesc {
+    uint32_t outputWidth;
+    uint32_t outputHeight;
+    float targetMs;
+    float minScale;
+    float maxScale;
+    // Gains on the relative error, applied to the pixel count.
+    float kp;
+    float ki;
+    float kd;
+    // Frames under budget by less than this fraction count as on target.
+    float deadBand;
+    // Frames in a row under budget before the scale may go up.
+    int raiseDelay;
+    // Frame time over target*panicRatio cuts the scale without waiting for the loop.
+    float panicRatio;
+    // Weight of the newest frame time in the smoothed one.
+    float smoothing;
+    // Render sizes are multiples of this many pixels.
+    uint32_t alignment;
+};
+
+struct DynResStats {
+    uint64_t frames;
+    uint64_t framesOverBudget;
+    uint64_t scaleChanges;
+    uint64_t panics;
+    double scaleSum;
+    float scaleMin;
+    float scaleMax;
+};
+
+struct DynResController {
+    DynResDesc desc;
+    // Unquantized pixel count fraction the loop works on.
+    float area;
+    // Scale of the current render size.
+    float scale;
+    uint32_t renderWidth;
+    uint32_t renderHeight;
+    float filteredMs;
+    float error1;
+    float error2;
+    int framesUnder;
+    DynResStats stats;
+};
+
+inline void dynResDescInit(DynResDesc* desc, uint32_t outputWidth, uint32_t outputHeight, float targetMs){
+    desc->outputWidth = outputWidth;
+    desc->outputHeight = outputHeight;
+    desc->targetMs = targetMs;
+    desc->minScale = 0.5f;
+    desc->maxScale = 1.0f;
+    desc->kp = 0.4f;
+    desc->ki = 0.15f;
+    desc->kd = 0.05f;
+    desc->deadBand = 0.05f;
+    desc->raiseDelay = 8;
+    desc->panicRatio = 1.5f;
+    desc->smoothing = 0.3f;
+    desc->alignment = 8;
+}
+
+// Rounds down to the pixel grid, except at the largest size which is exact.
+inline uint32_t dynResAlign(uint32_t size, float scale, const DynResDesc* desc){
+    uint32_t maxSize = (uint32_t)(size * desc->maxScale + 0.5f);
+    uint32_t aligned = (uint32_t)(size * scale + 0.5f) / desc->alignment * desc->alignment;
+    aligned = aligned < desc->alignment ? desc->alignment : aligned;
+    return aligned + desc->alignment > maxSize ? maxSize : aligned;
+}
+
+// Size of the offscreen target, big enough for the largest scale.
+inline void dynResTargetSize(const DynResDesc* desc, uint32_t* width, uint32_t* height){
+    *width = (uint32_t)(desc->outputWidth * desc->maxScale + 0.5f);
+    *height = (uint32_t)(desc->outputHeight * desc->maxScale + 0.5f);
+}
+
+inline void dynResApply(DynResController* c){
+    const DynResDesc* d = &c->desc;
+    float minArea = d->minScale * d->minScale;
+    float maxArea = d->maxScale * d->maxScale;
+    c->area = c->area < minArea ? minArea : (c->area > maxArea ? maxArea : c->area);
+    float scale = sqrtf(c->area);
+    uint32_t width = dynResAlign(d->outputWidth, scale, d);
+    uint32_t height = dynResAlign(d->outputHeight, scale, d);
+    if(width != c->renderWidth || height != c->renderHeight){
+        c->renderWidth = width;
+        c->renderHeight = height;
+        c->scale = (float)width / d->outputWidth;
+        c->stats.scaleChanges++;
+    }
+}
+
+inline void dynResInit(DynResController* c, const DynResDesc* desc){
+    c->desc = *desc;
+    c->area = desc->maxScale * desc->maxScale;
+    c->renderWidth = 0;
+    c->renderHeight = 0;
+    c->filteredMs = desc->targetMs;
+    c->error1 = 0.0f;
+    c->error2 = 0.0f;
+    c->framesUnder = 0;
+    c->stats = {};
+    c->stats.scaleMin = desc->maxScale;
+    c->stats.scaleMax = 0.0f;
+    dynResApply(c);
+    c->stats.scaleChanges = 0;
+}
+
+// Feeds the GPU time of the frame rendered at the current size and picks the
+// size for the next one. Returns the new scale.
+inline float dynResUpdate(DynResController* c, float frameMs){
+    const DynResDesc* d = &c->desc;
+    DynResStats* s = &c->stats;
+    s->frames++;
+    s->scaleSum += c->scale;
+    s->scaleMin = c->scale < s->scaleMin ? c->scale : s->scaleMin;
+    s->scaleMax = c->scale > s->scaleMax ? c->scale : s->scaleMax;
+    if(frameMs > d->targetMs){
+        s->framesOverBudget++;
+    }
+
+    if(frameMs > d->targetMs * d->panicRatio){
+        // GPU time follows the pixel count, so this lands near the budget in one step.
+        c->area *= d->targetMs / frameMs;
+        c->filteredMs = d->targetMs;
+        c->error1 = 0.0f;
+        c->error2 = 0.0f;
+        c->framesUnder = 0;
+        s->panics++;
+        dynResApply(c);
+        return c->scale;
+    }
+
+    c->filteredMs += (frameMs - c->filteredMs) * d->smoothing;
+    float error = (d->targetMs - c->filteredMs) / d->targetMs;
+    if(error > 0.0f && error < d->deadBand){
+        error = 0.0f;
+    }
+    c->framesUnder = error > 0.0f ? c->framesUnder + 1 : 0;
+
+    float delta = d->kp * (error - c->error1) + d->ki * error + d->kd * (error - 2.0f * c->error1 + c->error2);
+    c->error2 = c->error1;
+    c->error1 = error;
+    // Going down is never held back, going up waits until the headroom has lasted.
+    if(delta < 0.0f || c->framesUnder >= d->raiseDelay){
+        delta = delta < -0.5f ? -0.5f : (delta > 0.5f ? 0.5f : delta);
+        c->area *= 1.0f + delta;
+        dynResApply(c);
+    }
+    return c->scale;
+}
+
+// Replays a trace of frame times recorded at full resolution. pixelShare is
+// the part of a frame's time that scales with the rendered pixel count, the
+// rest is taken as fixed. Each frame is charged at the scale the controller
+// had picked when it started. Writes the scale of every frame to scales
+// unless it is null; the results end up in the controller's stats.
+inline void dynResReplay(DynResController* c, const float* fullResMs, int count, float pixelShare, float* scales){
+    for (int i = 0; i < count; i++){
+        if(scales){
+            scales[i] = c->scale;
+        }
+        float pixels = (float)c->renderWidth * c->renderHeight / ((float)c->desc.outputWidth * c->desc.outputHeight);
+        dynResUpdate(c, fullResMs[i] * (1.0f - pixelShare + pixelShare * pixels));
+    }
+}
+
+// Constants of the upscale pass, laid out like UpscaleConstants in
+// upscale_shaders.hlsl. uvScale maps output uvs to the rendered region of the
+// target and uvMin/uvMax clamp half a texel inside it, so nothing outside the
+// region bleeds in at the edges. tapOffset is zero when the region is no
+// larger than the output; otherwise it is a quarter of an output pixel, and
+// four bilinear taps that far from the pixel centre are averaged, a box over
+// the pixel's footprint for downsampling by up to 2x.
+struct DynResUpscaleConstants {
+    float uvScale[2];
+    float uvMin[2];
+    float uvMax[2];
+    float tapOffset[2];
+};
+
+inline void dynResUpscaleConstants(uint32_t width, uint32_t height, uint32_t targetWidth, uint32_t targetHeight, uint32_t dstWidth, uint32_t dstHeight,
+                                   DynResUpscaleConstants* out){
+    out->uvScale[0] = (float)width / targetWidth;
+    out->uvScale[1] = (float)height / targetHeight;
+    out->uvMin[0] = 0.5f / targetWidth;
+    out->uvMin[1] = 0.5f / targetHeight;
+    out->uvMax[0] = (width - 0.5f) / targetWidth;
+    out->uvMax[1] = (height - 0.5f) / targetHeight;
+    bool downsample = width > dstWidth || height > dstHeight;
+    out->tapOffset[0] = downsample ? 0.25f * out->uvScale[0] / dstWidth : 0.0f;
+    out->tapOffset[1] = downsample ? 0.25f * out->uvScale[1] / dstHeight : 0.0f;
+}
+
+// The upscale pass on the CPU: resamples the top left width x height pixels of
+// src into dst, RGBA8 rows dstPitch bytes apart, with the same taps as the shader.
+inline void dynResUpscale(const SamplerTexture* src, uint32_t width, uint32_t height, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstPitch){
+    SamplerDesc desc;
+    samplerDescInit(&desc, SAMPLER_FILTER_BILINEAR, SAMPLER_ADDRESS_CLAMP, SAMPLER_BORDER_TRANSPARENT_BLACK);
+    DynResUpscaleConstants k;
+    dynResUpscaleConstants(width, height, src->width, src->height, dstWidth, dstHeight, &k);
+    int taps = k.tapOffset[0] > 0.0f ? 4 : 1;
+    for (uint32_t y = 0; y < dstHeight; y++){
+        float v = (y + 0.5f) / dstHeight * k.uvScale[1];
+        uint8_t* row = dst + (size_t)y * dstPitch;
+        for (uint32_t x = 0; x < dstWidth; x += 8){
+            SamplerResult8 sum = {};
+            for (int t = 0; t < taps; t++){
+                float du = taps == 1 ? 0.0f : (t & 1 ? k.tapOffset[0] : -k.tapOffset[0]);
+                float dv = taps == 1 ? 0.0f : (t & 2 ? k.tapOffset[1] : -k.tapOffset[1]);
+                float us[8], vs[8];
+                for (int l = 0; l < 8; l++){
+                    float u = (x + l + 0.5f) / dstWidth * k.uvScale[0] + du;
+                    us[l] = u < k.uvMin[0] ? k.uvMin[0] : (u > k.uvMax[0] ? k.uvMax[0] : u);
+                    vs[l] = v + dv < k.uvMin[1] ? k.uvMin[1] : (v + dv > k.uvMax[1] ? k.uvMax[1] : v + dv);
+                }
+                SamplerResult8 texels;
+                textureSample8(src, &desc, us, vs, 0.0f, &texels);
+                for (int l = 0; l < 8; l++){
+                    sum.r[l] += texels.r[l];
+                    sum.g[l] += texels.g[l];
+                    sum.b[l] += texels.b[l];
+                    sum.a[l] += texels.a[l];
+                }
+            }
+            float scale = 255.0f / taps;
+            uint32_t n = dstWidth - x < 8 ? dstWidth - x : 8;
+            for (uint32_t l = 0; l < n; l++){
+                uint8_t* p = row + (x + l) * 4;
+                p[0] = (uint8_t)(sum.r[l] * scale + 0.5f);
+                p[1] = (uint8_t)(sum.g[l] * scale + 0.5f);
+                p[2] = (uint8_t)(sum.b[l] * scale + 0.5f);
+                p[3] = (uint8_t)(sum.a[l] * scale + 0.5f);
+            }
+        }
+    }
+}
+
+inline void dynResPrintStats(const DynResController* c, FILE* out){
+    const DynResStats* s = &c->stats;
+    fprintf(out, "dynamic resolution: %llu frames, %llu over %.2f ms budget, scale avg %.3f min %.3f max %.3f, "
+                 "%llu size changes, %llu panic cuts, now %ux%u\n",
+            (unsigned long long)s->frames, (unsigned long long)s->framesOverBudget, c->desc.targetMs,
+            s->frames ? s->scaleSum / s->frames : 0.0, s->frames ? s->scaleMin : c->scale, s->frames ? s->scaleMax : c->scale,
+            (unsigned long long)s->scaleChanges, (unsigned long long)s->panics, c->renderWidth, c->renderHeight);
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+// Frame scoped memory for transient CPU side data: draw lists, barrier arrays,
+// instance data rebuilt every frame. Each thread bump allocates from a block
+// of its own, nothing is freed on its own, and all of a frame's blocks are
+// reset together once that frame's fence has passed. There is one set of
+// blocks per frame in flight, so memory the GPU may still read (e.g. when the
+// blocks sit in mapped upload memory) or a capture thread still holds is
+// never handed out again early.
+//
+// Blocks start at a given size. A frame that outgrows its block is served
+// from heap allocated overflow chunks for the rest of the frame, and the next
+// reset regrows the block to what the frame needed. After a few frames the
+// heap isn't touched any more; frameArenaSetStrict makes any later heap
+// allocation assert, and counts it in the stats for builds without asserts.
+//
+// Allocations are raw memory, no constructors or destructors run. Only put
+// trivially copyable types in here.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int FrameArenaMaxFrames = 4;
+static const int FrameArenaMaxThreads = 16;
+// Smallest overflow chunk, so a block that just missed doesn't malloc per allocation.
+static const size_t FrameArenaMinChunk = 64 * 1024;
+
+// Header in front of each overflow chunk.
+struct FrameArenaChunk {
+    FrameArenaChunk* next;
+    size_t size;
+};
+
+// One thread's memory for one frame. Cache line aligned, threads bump their
+// own cursor without sharing a line with anyone else's.
+struct alignas(64) FrameArenaBlock {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    // Newest overflow chunk first, and how far into it we are.
+    FrameArenaChunk* overflow;
+    size_t overflowUsed;
+    // Bytes that went to overflow chunks this frame, padding included.
+    size_t overflowBytes;
+    uint64_t heapAllocations;
+    uint64_t strictViolations;
+    size_t peak;
+    const bool* strict;
+};
+
+struct FrameArenaStats {
+    uint64_t frames;
+    // BeginFrame calls turned away because the GPU still had the frame's memory.
+    uint64_t framesNotReady;
+    uint64_t regrows;
+};
+
+struct FrameArena {
+    FrameArenaBlock blocks[FrameArenaMaxFrames][FrameArenaMaxThreads];
+    // Fence that retires each frame's memory.
+    uint64_t fences[FrameArenaMaxFrames];
+    int numFrames;
+    int numThreads;
+    int frame;
+    bool strict;
+    FrameArenaStats stats;
+};
+
+inline uint8_t* frameArenaAlign(uint8_t* p, size_t alignment){
+    return (uint8_t*)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+inline void frameArenaCountHeap(FrameArenaBlock* b){
+    b->heapAllocations++;
+    if(*b->strict){
+        b->strictViolations++;
+        assert(!"heap allocation in a steady state frame");
+    }
+}
+
+inline void* frameArenaOverflow(FrameArenaBlock* b, size_t size, size_t alignment){
+    FrameArenaChunk* chunk = b->overflow;
+    if(chunk){
+        uint8_t* data = (uint8_t*)(chunk + 1);
+        uint8_t* p = frameArenaAlign(data + b->overflowUsed, alignment);
+        if(p + size <= data + chunk->size){
+            b->overflowBytes += p + size - (data + b->overflowUsed);
+            b->overflowUsed = p + size - data;
+            return p;
+        }
+    }
+    size_t chunkSize = size + alignment;
+    chunkSize = chunkSize < FrameArenaMinChunk ? FrameArenaMinChunk : chunkSize;
+    chunk = (FrameArenaChunk*)malloc(sizeof(FrameArenaChunk) + chunkSize);
+    if(!chunk){
+        return 0;
+    }
+    frameArenaCountHeap(b);
+    chunk->next = b->overflow;
+    chunk->size = chunkSize;
+    b->overflow = chunk;
+    uint8_t* data = (uint8_t*)(chunk + 1);
+    uint8_t* p = frameArenaAlign(data, alignment);
+    b->overflowUsed = p + size - data;
+    b->overflowBytes += b->overflowUsed;
+    return p;
+}
+
+// Returns 0 only if the heap is out of memory as well.
+inline void* frameArenaAlloc(FrameArenaBlock* b, size_t size, size_t alignment = 16){
+    uint8_t* p = frameArenaAlign(b->base + b->used, alignment);
+    if(p + size <= b->base + b->size){
+        b->used = p + size - b->base;
+        return p;
+    }
+    return frameArenaOverflow(b, size, alignment);
+}
+
+template <typename T>
+inline T* frameArenaNew(FrameArenaBlock* b, size_t count){
+    return (T*)frameArenaAlloc(b, sizeof(T) * count, alignof(T));
+}
+
+inline void frameArenaFreeChunks(FrameArenaBlock* b){
+    while(b->overflow){
+        FrameArenaChunk* next = b->overflow->next;
+        free(b->overflow);
+        b->overflow = next;
+    }
+}
+
+// Frees the overflow chunks and grows the block to fit everything the frame used.
+inline void frameArenaResetBlock(FrameArena* a, FrameArenaBlock* b){
+    size_t needed = b->used + b->overflowBytes;
+    b->peak = needed > b->peak ? needed : b->peak;
+    frameArenaFreeChunks(b);
+    if(needed > b->size){
+        size_t size = b->size ? b->size : FrameArenaMinChunk;
+        while(size < needed){
+            size *= 2;
+        }
+        uint8_t* base = (uint8_t*)malloc(size);
+        if(base){
+            frameArenaCountHeap(b);
+            free(b->base);
+            b->base = base;
+            b->size = size;
+            a->stats.regrows++;
+        }
+    }
+    b->used = 0;
+    b->overflowUsed = 0;
+    b->overflowBytes = 0;
+}
+
+inline bool frameArenaInit(FrameArena* a, int numFrames, int numThreads, size_t blockSize){
+    memset(a, 0, sizeof(*a));
+    a->numFrames = numFrames < FrameArenaMaxFrames ? numFrames : FrameArenaMaxFrames;
+    a->numThreads = numThreads < FrameArenaMaxThreads ? numThreads : FrameArenaMaxThreads;
+    a->frame = a->numFrames - 1;
+    for (int f = 0; f < a->numFrames; f++){
+        for (int t = 0; t < a->numThreads; t++){
+            FrameArenaBlock* b = &a->blocks[f][t];
+            b->strict = &a->strict;
+            b->base = (uint8_t*)malloc(blockSize);
+            if(!b->base){
+                return false;
+            }
+            b->size = blockSize;
+        }
+    }
+    return true;
+}
+
+// Moves on to the next frame's memory and resets it. Returns false, changing
+// nothing, if completedFence hasn't reached the fence that frame ended with;
+// wait for it and call again.
+inline bool frameArenaBeginFrame(FrameArena* a, uint64_t completedFence){
+    int next = (a->frame + 1) % a->numFrames;
+    if(a->fences[next] > completedFence){
+        a->stats.framesNotReady++;
+        return false;
+    }
+    for (int t = 0; t < a->numThreads; t++){
+        frameArenaResetBlock(a, &a->blocks[next][t]);
+    }
+    a->frame = next;
+    a->stats.frames++;
+    return true;
+}
+
+// The fence signalled after the last use of this frame's memory.
+inline void frameArenaEndFrame(FrameArena* a, uint64_t fence){
+    a->fences[a->frame] = fence;
+}
+
+// The calling thread's block for the current frame.
+inline FrameArenaBlock* frameArenaThread(FrameArena* a, int thread){
+    return &a->blocks[a->frame][thread];
+}
+
+// Only call between frames, the worker threads read the flag.
+inline void frameArenaSetStrict(FrameArena* a, bool strict){
+    a->strict = strict;
+}
+
+inline void frameArenaDestroy(FrameArena* a){
+    for (int f = 0; f < a->numFrames; f++){
+        for (int t = 0; t < a->numThreads; t++){
+            FrameArenaBlock* b = &a->blocks[f][t];
+            frameArenaFreeChunks(b);
+            free(b->base);
+            b->base = 0;
+        }
+    }
+}
+
+inline void frameArenaPrintStats(const FrameArena* a, FILE* out){
+    uint64_t heapAllocations = 0, strictViolations = 0;
+    size_t peak = 0, reserved = 0;
+    for (int f = 0; f < a->numFrames; f++){
+        for (int t = 0; t < a->numThreads; t++){
+            const FrameArenaBlock* b = &a->blocks[f][t];
+            heapAllocations += b->heapAllocations;
+            strictViolations += b->strictViolations;
+            peak = b->peak > peak ? b->peak : peak;
+            reserved += b->size;
+        }
+    }
+    fprintf(out, "frame arena: %llu frames (%llu waited on the GPU), %llu heap allocations (%llu in steady state), "
+                 "%llu regrows, peak %llu bytes per thread, %llu bytes reserved\n",
+            (unsigned long long)a->stats.frames, (unsigned long long)a->stats.framesNotReady,
+            (unsigned long long)heapAllocations, (unsigned long long)strictViolations, (unsigned long long)a->stats.regrows,
+            (unsigned long long)peak, (unsigned long long)reserved);
+}
+
+// Growable array in frame memory. Growing extends in place while the array is
+// the last thing allocated from its block, otherwise it moves to a copy twice
+// the size and leaves the old one for the reset.
+template <typename T>
+struct FrameArray {
+    FrameArenaBlock* block;
+    T* data;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+template <typename T>
+inline bool frameArrayInit(FrameArray<T>* arr, FrameArenaBlock* block, uint32_t capacity){
+    arr->block = block;
+    arr->count = 0;
+    arr->capacity = capacity;
+    arr->data = capacity ? frameArenaNew<T>(block, capacity) : 0;
+    return arr->data || !capacity;
+}
+
+template <typename T>
+inline bool frameArrayReserve(FrameArray<T>* arr, uint32_t capacity){
+    if(capacity <= arr->capacity){
+        return true;
+    }
+    FrameArenaBlock* b = arr->block;
+    uint8_t* end = (uint8_t*)(arr->data + arr->capacity);
+    size_t extra = (size_t)(capacity - arr->capacity) * sizeof(T);
+    if(arr->data && end == b->base + b->used && b->used + extra <= b->size){
+        b->used += extra;
+        arr->capacity = capacity;
+        return true;
+    }
+    T* data = frameArenaNew<T>(b, capacity);
+    if(!data){
+        return false;
+    }
+    if(arr->count){
+        memcpy(data, arr->data, arr->count * sizeof(T));
+    }
+    arr->data = data;
+    arr->capacity = capacity;
+    return true;
+}
+
+template <typename T>
+inline T* frameArrayPush(FrameArray<T>* arr, const T& value){
+    if(arr->count == arr->capacity && !frameArrayReserve(arr, arr->capacity ? arr->capacity * 2 : 16)){
+        return 0;
+    }
+    T* item = &arr->data[arr->count++];
+    *item = value;
+    return item;
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+// Frame capture: rendered frames are copied into a ring of persistently mapped
+// readback buffers, handed to encoder threads once their fence has completed
+// and written out as a numbered PNG or raw RGBA image sequence.
+// The render thread never waits: if every readback slot is still in flight or
+// queued for encoding the frame is dropped and counted instead. The encoder
+// queue is bounded, a full queue leaves finished slots occupied, which in turn
+// makes the render thread drop frames (backpressure).
+// Frames the renderer skips because nothing changed are written as repeats of
+// the last captured frame, so the numbered sequence has no holes.
+// Nothing in here touches D3D12, the caller does the copies and owns the fence.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const int FrameCaptureMaxSlots = 8;
+static const int FrameCaptureMaxWorkers = 8;
+static const int FrameCaptureMaxQueue = 16;
+
+enum FrameCaptureFormat {
+    CAPTURE_FORMAT_PNG,
+    CAPTURE_FORMAT_RAW,
+};
+
+enum FrameCaptureSlotState : uint32_t {
+    CAPTURE_SLOT_FREE,
+    CAPTURE_SLOT_IN_FLIGHT,
+    CAPTURE_SLOT_ENCODING,
+};
+
+// slot -1 copies the already written file of frame source.
+struct FrameCaptureJob {
+    int32_t slot;
+    uint64_t frame;
+    uint64_t source;
+};
+
+struct FrameCapture {
+    FrameCaptureFormat format;
+    char directory[256];
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+
+    int numSlots;
+    const uint8_t* slotPixels[FrameCaptureMaxSlots];
+    std::atomic<uint32_t> slotState[FrameCaptureMaxSlots];
+    uint64_t slotFence[FrameCaptureMaxSlots];
+    uint64_t slotFrame[FrameCaptureMaxSlots];
+    // Skipped frames following the slot's frame, written by its encoder. Guarded by queueMutex.
+    uint32_t slotRepeats[FrameCaptureMaxSlots];
+    uint64_t nextFrame;
+    // Slot of the last frame, -1 if it was dropped.
+    int lastSlot;
+    uint64_t lastFrame;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    FrameCaptureJob queue[FrameCaptureMaxQueue];
+    int queueCapacity;
+    int queueHead;
+    int queueCount;
+    bool stopping;
+    std::thread workers[FrameCaptureMaxWorkers];
+    int numWorkers;
+
+    std::atomic<uint64_t> framesEncoded;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> writeErrors;
+    uint64_t framesRepeated;
+    uint64_t framesDropped;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+struct CaptureCrcTable {
+    uint32_t entries[256];
+    CaptureCrcTable(){
+        for(uint32_t n = 0; n < 256; n++){
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++){
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+inline uint32_t captureCrc32(uint32_t crc, const uint8_t* data, size_t size){
+    // Function local statics are initialized once even with several encoder threads.
+    static const CaptureCrcTable table;
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++){
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline void captureWriteBE32(uint8_t* out, uint32_t value){
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+inline bool captureWriteChunk(FILE* file, const char* type, const uint8_t* data, uint32_t size, uint64_t* written){
+    uint8_t header[8];
+    captureWriteBE32(header, size);
+    memcpy(header + 4, type, 4);
+    uint8_t crc[4];
+    captureWriteBE32(crc, captureCrc32(captureCrc32(0, header + 4, 4), data, size));
+    *written += 12 + size;
+    return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(crc, 1, 4, file) == 4;
+}
+
+// RGBA8 PNG with the image data in stored (uncompressed) deflate blocks: the
+// encoders are bound by disk bandwidth long before compression would pay off
+// and it keeps the writer dependency free.
+inline bool captureWritePng(FILE* file, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint64_t* written){
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    captureWriteBE32(ihdr, width);
+    captureWriteBE32(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = 6;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    *written += 8;
+    if(fwrite(signature, 1, 8, file) != 8 || !captureWriteChunk(file, "IHDR", ihdr, 13, written)){
+        return false;
+    }
+
+    // Filter byte 0 in front of every row, then split into 65535 byte stored blocks.
+    uint32_t rowBytes = width * 4 + 1;
+    uint64_t rawSize = (uint64_t)rowBytes * height;
+    uint64_t numBlocks = (rawSize + 65534) / 65535;
+    uint64_t idatSize = 2 + rawSize + numBlocks * 5 + 4;
+    uint8_t* idat = (uint8_t*)malloc(idatSize);
+    if(!idat){
+        return false;
+    }
+    uint8_t* out = idat;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    uint64_t remaining = rawSize;
+    uint32_t row = 0;
+    uint32_t column = 0;
+    while(remaining > 0){
+        uint32_t blockSize = remaining > 65535 ? 65535 : (uint32_t)remaining;
+        remaining -= blockSize;
+        *out++ = remaining == 0 ? 1 : 0;
+        *out++ = (uint8_t)blockSize;
+        *out++ = (uint8_t)(blockSize >> 8);
+        *out++ = (uint8_t)~blockSize;
+        *out++ = (uint8_t)(~blockSize >> 8);
+        while(blockSize > 0){
+            uint32_t n;
+            if(column == 0){
+                *out = 0;
+                n = 1;
+            }else{
+                n = rowBytes - column < blockSize ? rowBytes - column : blockSize;
+                memcpy(out, pixels + (uint64_t)row * rowPitch + (column - 1), n);
+            }
+            // 5552 bytes is the most that can be summed before adlerB overflows.
+            for(uint32_t i = 0; i < n; ){
+                uint32_t chunk = n - i < 5552 ? n - i : 5552;
+                for(uint32_t k = 0; k < chunk; k++){
+                    adlerA += out[i + k];
+                    adlerB += adlerA;
+                }
+                adlerA %= 65521;
+                adlerB %= 65521;
+                i += chunk;
+            }
+            out += n;
+            blockSize -= n;
+            column += n;
+            if(column == rowBytes){
+                column = 0;
+                row++;
+            }
+        }
+    }
+    captureWriteBE32(out, (adlerB << 16) | adlerA);
+    bool ok = captureWriteChunk(file, "IDAT", idat, (uint32_t)idatSize, written) && captureWriteChunk(file, "IEND", 0, 0, written);
+    free(idat);
+    return ok;
+}
+
+inline bool captureWriteRaw(FILE* file, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint64_t* written){
+    for(uint32_t y = 0; y < height; y++){
+        if(fwrite(pixels + (uint64_t)y * rowPitch, 1, width * 4, file) != width * 4){
+            return false;
+        }
+        *written += width * 4;
+    }
+    return true;
+}
+
+inline void capturePath(const FrameCapture* cap, uint64_t frame, char* path, size_t size){
+    snprintf(path, size, "%s/frame_%06llu.%s", cap->directory, (unsigned long long)frame, cap->format == CAPTURE_FORMAT_PNG ? "png" : "rgba");
+}
+
+inline void captureCount(FrameCapture* cap, bool ok, uint64_t written){
+    if(ok){
+        cap->framesEncoded.fetch_add(1, std::memory_order_relaxed);
+        cap->bytesWritten.fetch_add(written, std::memory_order_relaxed);
+    }else{
+        cap->writeErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void captureWriteFrame(FrameCapture* cap, int slot, uint64_t frame){
+    char path[320];
+    capturePath(cap, frame, path, sizeof(path));
+    uint64_t written = 0;
+    bool ok = false;
+    FILE* file = fopen(path, "wb");
+    if(file){
+        const uint8_t* pixels = cap->slotPixels[slot];
+        if(cap->format == CAPTURE_FORMAT_PNG){
+            ok = captureWritePng(file, pixels, cap->width, cap->height, cap->rowPitch, &written);
+        }else{
+            ok = captureWriteRaw(file, pixels, cap->width, cap->height, cap->rowPitch, &written);
+        }
+        ok = fclose(file) == 0 && ok;
+    }
+    captureCount(cap, ok, written);
+}
+
+inline void captureCopyFrame(FrameCapture* cap, uint64_t source, uint64_t frame){
+    char path[320];
+    capturePath(cap, source, path, sizeof(path));
+    FILE* in = fopen(path, "rb");
+    capturePath(cap, frame, path, sizeof(path));
+    FILE* out = in ? fopen(path, "wb") : 0;
+    uint64_t written = 0;
+    bool ok = in && out;
+    uint8_t buffer[65536];
+    size_t n;
+    while(ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0){
+        ok = fwrite(buffer, 1, n, out) == n;
+        written += n;
+    }
+    ok = ok && !ferror(in);
+    if(out){
+        ok = fclose(out) == 0 && ok;
+    }
+    if(in){
+        fclose(in);
+    }
+    captureCount(cap, ok, written);
+}
+
+inline void captureEncode(FrameCapture* cap, const FrameCaptureJob* job){
+    if(job->slot < 0){
+        captureCopyFrame(cap, job->source, job->frame);
+        return;
+    }
+    captureWriteFrame(cap, job->slot, job->frame);
+    // Repeats can be added while the frame is written; the slot is only
+    // freed once none are left.
+    uint64_t frame = job->frame;
+    for(;;){
+        uint32_t repeats;
+        {
+            std::lock_guard<std::mutex> lock(cap->queueMutex);
+            repeats = cap->slotRepeats[job->slot];
+            cap->slotRepeats[job->slot] = 0;
+            if(repeats == 0){
+                // The readback memory is not needed any more once the files are written.
+                cap->slotState[job->slot].store(CAPTURE_SLOT_FREE, std::memory_order_release);
+                return;
+            }
+        }
+        for(uint32_t i = 0; i < repeats; i++){
+            captureWriteFrame(cap, job->slot, ++frame);
+        }
+    }
+}
+
+inline void captureWorker(FrameCapture* cap){
+    for(;;){
+        FrameCaptureJob job;
+        {
+            std::unique_lock<std::mutex> lock(cap->queueMutex);
+            cap->queueReady.wait(lock, [cap]{ return cap->queueCount > 0 || cap->stopping; });
+            if(cap->queueCount == 0){
+                return;
+            }
+            job = cap->queue[cap->queueHead];
+            cap->queueHead = (cap->queueHead + 1) % cap->queueCapacity;
+            cap->queueCount--;
+        }
+        captureEncode(cap, &job);
+    }
+}
+
+// slotPixels are the mapped readback buffers, each holding one frame laid out
+// with rowPitch bytes per row (D3D12_TEXTURE_DATA_PITCH_ALIGNMENT aligned).
+inline void frameCaptureStart(FrameCapture* cap, const char* directory, FrameCaptureFormat format, uint32_t width, uint32_t height, uint32_t rowPitch,
+                              const uint8_t* const* slotPixels, int numSlots, int numWorkers, int queueCapacity = 4){
+    cap->format = format;
+    snprintf(cap->directory, sizeof(cap->directory), "%s", directory);
+    cap->width = width;
+    cap->height = height;
+    cap->rowPitch = rowPitch;
+    cap->numSlots = numSlots < FrameCaptureMaxSlots ? numSlots : FrameCaptureMaxSlots;
+    for(int i = 0; i < cap->numSlots; i++){
+        cap->slotPixels[i] = slotPixels[i];
+        cap->slotState[i].store(CAPTURE_SLOT_FREE);
+        cap->slotFence[i] = 0;
+        cap->slotRepeats[i] = 0;
+    }
+    cap->nextFrame = 0;
+    cap->lastSlot = -1;
+    cap->lastFrame = 0;
+    cap->queueCapacity = queueCapacity < 1 ? 1 : (queueCapacity > FrameCaptureMaxQueue ? FrameCaptureMaxQueue : queueCapacity);
+    cap->queueHead = 0;
+    cap->queueCount = 0;
+    cap->stopping = false;
+    cap->framesEncoded.store(0);
+    cap->bytesWritten.store(0);
+    cap->writeErrors.store(0);
+    cap->framesRepeated = 0;
+    cap->framesDropped = 0;
+    cap->startTime = std::chrono::steady_clock::now();
+    cap->numWorkers = numWorkers < 1 ? 1 : (numWorkers > FrameCaptureMaxWorkers ? FrameCaptureMaxWorkers : numWorkers);
+    for(int i = 0; i < cap->numWorkers; i++){
+        cap->workers[i] = std::thread(captureWorker, cap);
+    }
+}
+
+// Render thread: a free readback slot to copy this frame into, or -1 if the
+// frame has to be dropped.
+inline int frameCaptureAcquire(FrameCapture* cap){
+    cap->lastFrame = cap->nextFrame++;
+    cap->lastSlot = -1;
+    for(int i = 0; i < cap->numSlots; i++){
+        if(cap->slotState[i].load(std::memory_order_acquire) == CAPTURE_SLOT_FREE){
+            cap->slotState[i].store(CAPTURE_SLOT_IN_FLIGHT, std::memory_order_relaxed);
+            cap->slotFence[i] = UINT64_MAX;
+            cap->slotFrame[i] = cap->lastFrame;
+            cap->lastSlot = i;
+            return i;
+        }
+    }
+    cap->framesDropped++;
+    return -1;
+}
+
+// Render thread: this frame was skipped because nothing changed since the
+// last one, write that one again under the next number. Its encoder picks the
+// repeat up while it still holds the pixels, otherwise the written file is
+// copied. Never blocks on the encoders; repeats of a dropped frame are dropped.
+inline void frameCaptureRepeat(FrameCapture* cap){
+    uint64_t frame = cap->nextFrame++;
+    if(cap->lastSlot < 0){
+        cap->framesDropped++;
+        return;
+    }
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(cap->queueMutex);
+        int slot = cap->lastSlot;
+        if(cap->slotState[slot].load(std::memory_order_relaxed) != CAPTURE_SLOT_FREE && cap->slotFrame[slot] == cap->lastFrame){
+            cap->slotRepeats[slot]++;
+        }else if(cap->queueCount < cap->queueCapacity){
+            FrameCaptureJob* job = &cap->queue[(cap->queueHead + cap->queueCount) % cap->queueCapacity];
+            job->slot = -1;
+            job->frame = frame;
+            job->source = cap->lastFrame;
+            cap->queueCount++;
+            queued = true;
+        }else{
+            cap->framesDropped++;
+            return;
+        }
+        cap->framesRepeated++;
+    }
+    if(queued){
+        cap->queueReady.notify_one();
+    }
+}
+
+// Render thread: the copy into slot was submitted and completes with fenceValue.
+inline void frameCaptureSubmit(FrameCapture* cap, int slot, uint64_t fenceValue){
+    cap->slotFence[slot] = fenceValue;
+}
+
+// Render thread: hands every slot whose copy finished to the encoders, as far
+// as the queue has room. Never blocks on the encoders.
+inline void frameCapturePoll(FrameCapture* cap, uint64_t completedFence){
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(cap->queueMutex);
+        for(int i = 0; i < cap->numSlots && cap->queueCount < cap->queueCapacity; i++){
+            if(cap->slotState[i].load(std::memory_order_relaxed) != CAPTURE_SLOT_IN_FLIGHT || cap->slotFence[i] > completedFence){
+                continue;
+            }
+            cap->slotState[i].store(CAPTURE_SLOT_ENCODING, std::memory_order_relaxed);
+            FrameCaptureJob* job = &cap->queue[(cap->queueHead + cap->queueCount) % cap->queueCapacity];
+            job->slot = i;
+            job->frame = cap->slotFrame[i];
+            job->source = 0;
+            cap->queueCount++;
+            queued = true;
+        }
+    }
+    if(queued){
+        cap->queueReady.notify_all();
+    }
+}
+
+// Encodes whatever is still queued and joins the workers. Slots still in flight
+// must have been polled with their fence completed before, or they are lost.
+inline void frameCaptureStop(FrameCapture* cap){
+    {
+        std::lock_guard<std::mutex> lock(cap->queueMutex);
+        cap->stopping = true;
+    }
+    cap->queueReady.notify_all();
+    for(int i = 0; i < cap->numWorkers; i++){
+        if(cap->workers[i].joinable()){
+            cap->workers[i].join();
+        }
+    }
+}
+
+inline double frameCaptureFps(const FrameCapture* cap){
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - cap->startTime).count();
+    return seconds > 0.0 ? (double)cap->framesEncoded.load() / seconds : 0.0;
+}
+
+inline void frameCapturePrintStats(const FrameCapture* cap, FILE* out){
+    fprintf(out, "capture %ux%u: %llu frames encoded (%llu repeats), %llu dropped, %llu errors, %.1f MB written, %.1f fps\n",
+            cap->width, cap->height, (unsigned long long)cap->framesEncoded.load(), (unsigned long long)cap->framesRepeated,
+            (unsigned long long)cap->framesDropped,
+            (unsigned long long)cap->writeErrors.load(), cap->bytesWritten.load() / (1024.0 * 1024.0), frameCaptureFps(cap));
+}
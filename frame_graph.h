@@ -0,0 +1,509 @@
+#pragma once
+
+// Frame graph: passes declare the resources they read and write, the graph culls
+// passes whose output nobody consumes, works out resource lifetimes, places
+// transient resources at overlapping offsets of one heap when their lifetimes
+// don't overlap and derives the transition/aliasing barriers between passes.
+// Nothing in here touches D3D12 so the compiler can run headless.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int FrameGraphMaxPasses = 32;
+static const int FrameGraphMaxResources = 64;
+static const int FrameGraphMaxPassAccesses = 8;
+static const int FrameGraphMaxBarriers = 256;
+
+// Same values as D3D12_RESOURCE_STATES so they can be cast straight across.
+enum FrameGraphState : uint32_t {
+    FG_STATE_COMMON = 0,
+    FG_STATE_PRESENT = 0,
+    FG_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1,
+    FG_STATE_INDEX_BUFFER = 0x2,
+    FG_STATE_RENDER_TARGET = 0x4,
+    FG_STATE_UNORDERED_ACCESS = 0x8,
+    FG_STATE_DEPTH_WRITE = 0x10,
+    FG_STATE_DEPTH_READ = 0x20,
+    FG_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
+    FG_STATE_PIXEL_SHADER_RESOURCE = 0x80,
+    FG_STATE_COPY_DEST = 0x400,
+    FG_STATE_COPY_SOURCE = 0x800,
+};
+
+enum FrameGraphBarrierType {
+    FG_BARRIER_TRANSITION,
+    FG_BARRIER_ALIASING,
+};
+
+typedef void (*FrameGraphExecuteFn)(void* userData);
+
+struct FrameGraphResource {
+    const char* name;
+    uint64_t size;
+    uint64_t alignment;
+    bool imported;
+    void* userResource;
+    uint32_t initialState;
+    uint32_t finalState;
+
+    // Filled in by frameGraphCompile.
+    int refCount;
+    int firstPass;
+    int lastPass;
+    uint32_t firstState;
+    uint64_t heapOffset;
+};
+
+struct FrameGraphAccess {
+    int resource;
+    uint32_t state;
+    bool write;
+};
+
+struct FrameGraphPass {
+    const char* name;
+    FrameGraphExecuteFn execute;
+    void* userData;
+    bool sideEffect;
+    FrameGraphAccess accesses[FrameGraphMaxPassAccesses];
+    int numAccesses;
+
+    // Filled in by frameGraphCompile.
+    int refCount;
+    bool culled;
+    int firstBarrier;
+    int numBarriers;
+};
+
+struct FrameGraphBarrier {
+    FrameGraphBarrierType type;
+    int resource;
+    // For aliasing barriers the resource previously living in that memory, -1 if unknown.
+    int resourceBefore;
+    uint32_t stateBefore;
+    uint32_t stateAfter;
+};
+
+struct FrameGraph {
+    FrameGraphResource resources[FrameGraphMaxResources];
+    int numResources;
+    FrameGraphPass passes[FrameGraphMaxPasses];
+    int numPasses;
+
+    FrameGraphBarrier barriers[FrameGraphMaxBarriers];
+    int numBarriers;
+    // Barriers returning imported resources to their final state after the last pass.
+    int firstFinalBarrier;
+    int numFinalBarriers;
+
+    uint64_t heapSize;
+    uint64_t unaliasedSize;
+    uint64_t peakLiveSize;
+    int numCulledPasses;
+};
+
+inline uint64_t frameGraphAlign(uint64_t value, uint64_t alignment){
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Conservative size of a row-major 2D target; real allocations should use
+// GetResourceAllocationInfo and pass the result to frameGraphCreateTransient.
+inline uint64_t frameGraphTextureBytes(uint32_t width, uint32_t height, uint32_t bytesPerPixel){
+    uint64_t rowPitch = frameGraphAlign((uint64_t)width * bytesPerPixel, 256);
+    return frameGraphAlign(rowPitch * height, 65536);
+}
+
+inline void frameGraphReset(FrameGraph* fg){
+    fg->numResources = 0;
+    fg->numPasses = 0;
+    fg->numBarriers = 0;
+    fg->firstFinalBarrier = 0;
+    fg->numFinalBarriers = 0;
+    fg->heapSize = 0;
+    fg->unaliasedSize = 0;
+    fg->peakLiveSize = 0;
+    fg->numCulledPasses = 0;
+}
+
+inline int frameGraphAddResource(FrameGraph* fg, const char* name){
+    if(fg->numResources == FrameGraphMaxResources){
+        return -1;
+    }
+    int index = fg->numResources++;
+    FrameGraphResource* res = &fg->resources[index];
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    res->firstPass = -1;
+    res->lastPass = -1;
+    return index;
+}
+
+// A resource the graph owns for the frame. Memory is only reserved while a
+// surviving pass uses it and may be shared with other transient resources, so
+// the first pass writing it must clear or discard it.
+inline int frameGraphCreateTransient(FrameGraph* fg, const char* name, uint64_t size, uint64_t alignment = 65536){
+    int index = frameGraphAddResource(fg, name);
+    if(index >= 0){
+        fg->resources[index].size = size;
+        fg->resources[index].alignment = alignment;
+    }
+    return index;
+}
+
+// A resource that lives outside the graph, e.g. the swap chain back buffer.
+// Writes to imported resources count as graph outputs and are never culled.
+inline int frameGraphImport(FrameGraph* fg, const char* name, void* userResource, uint32_t initialState, uint32_t finalState){
+    int index = frameGraphAddResource(fg, name);
+    if(index >= 0){
+        FrameGraphResource* res = &fg->resources[index];
+        res->imported = true;
+        res->userResource = userResource;
+        res->initialState = initialState;
+        res->finalState = finalState;
+    }
+    return index;
+}
+
+inline int frameGraphAddPass(FrameGraph* fg, const char* name, FrameGraphExecuteFn execute, void* userData){
+    if(fg->numPasses == FrameGraphMaxPasses){
+        return -1;
+    }
+    int index = fg->numPasses++;
+    FrameGraphPass* pass = &fg->passes[index];
+    memset(pass, 0, sizeof(*pass));
+    pass->name = name;
+    pass->execute = execute;
+    pass->userData = userData;
+    return index;
+}
+
+inline bool frameGraphAccess(FrameGraph* fg, int pass, int resource, uint32_t state, bool write){
+    if(pass < 0 || pass >= fg->numPasses || resource < 0 || resource >= fg->numResources){
+        return false;
+    }
+    FrameGraphPass* p = &fg->passes[pass];
+    if(p->numAccesses == FrameGraphMaxPassAccesses){
+        return false;
+    }
+    FrameGraphAccess* access = &p->accesses[p->numAccesses++];
+    access->resource = resource;
+    access->state = state;
+    access->write = write;
+    return true;
+}
+
+inline bool frameGraphRead(FrameGraph* fg, int pass, int resource, uint32_t state = FG_STATE_PIXEL_SHADER_RESOURCE){
+    return frameGraphAccess(fg, pass, resource, state, false);
+}
+
+inline bool frameGraphWrite(FrameGraph* fg, int pass, int resource, uint32_t state = FG_STATE_RENDER_TARGET){
+    return frameGraphAccess(fg, pass, resource, state, true);
+}
+
+// Keeps a pass alive even if nothing reads what it writes (readbacks, queries...).
+inline void frameGraphSetSideEffect(FrameGraph* fg, int pass){
+    fg->passes[pass].sideEffect = true;
+}
+
+inline bool frameGraphPushBarrier(FrameGraph* fg, FrameGraphBarrierType type, int resource, int resourceBefore, uint32_t before, uint32_t after){
+    if(fg->numBarriers == FrameGraphMaxBarriers){
+        return false;
+    }
+    FrameGraphBarrier* barrier = &fg->barriers[fg->numBarriers++];
+    barrier->type = type;
+    barrier->resource = resource;
+    barrier->resourceBefore = resourceBefore;
+    barrier->stateBefore = before;
+    barrier->stateAfter = after;
+    return true;
+}
+
+inline bool frameGraphLifetimesOverlap(const FrameGraphResource* a, const FrameGraphResource* b){
+    return a->firstPass <= b->lastPass && b->firstPass <= a->lastPass;
+}
+
+inline bool frameGraphMemoryOverlaps(const FrameGraphResource* a, const FrameGraphResource* b){
+    return a->heapOffset < b->heapOffset + b->size && b->heapOffset < a->heapOffset + a->size;
+}
+
+// Combined state of a resource within one pass: a write state wins, read states are or'ed.
+inline uint32_t frameGraphPassState(const FrameGraphPass* pass, int resource, bool* used){
+    uint32_t state = 0;
+    bool written = false;
+    *used = false;
+    for(int i = 0; i < pass->numAccesses; i++){
+        const FrameGraphAccess* access = &pass->accesses[i];
+        if(access->resource != resource){
+            continue;
+        }
+        if(access->write){
+            state = access->state;
+            written = true;
+        }else if(!written){
+            state |= access->state;
+        }
+        *used = true;
+    }
+    return state;
+}
+
+inline bool frameGraphCompile(FrameGraph* fg){
+    // Reference counts: a pass is referenced once per resource it writes, a
+    // resource once per pass reading it. Imported resources are read by the outside world.
+    for(int r = 0; r < fg->numResources; r++){
+        FrameGraphResource* res = &fg->resources[r];
+        res->refCount = res->imported ? 1 : 0;
+        res->firstPass = -1;
+        res->lastPass = -1;
+        res->heapOffset = 0;
+    }
+    for(int p = 0; p < fg->numPasses; p++){
+        FrameGraphPass* pass = &fg->passes[p];
+        pass->refCount = 0;
+        pass->culled = false;
+        for(int i = 0; i < pass->numAccesses; i++){
+            if(pass->accesses[i].write){
+                pass->refCount++;
+            }else{
+                fg->resources[pass->accesses[i].resource].refCount++;
+            }
+        }
+    }
+
+    // A pass that writes nothing has no output to keep it alive.
+    for(int p = 0; p < fg->numPasses; p++){
+        FrameGraphPass* pass = &fg->passes[p];
+        if(pass->refCount > 0 || pass->sideEffect){
+            continue;
+        }
+        pass->culled = true;
+        for(int i = 0; i < pass->numAccesses; i++){
+            fg->resources[pass->accesses[i].resource].refCount--;
+        }
+    }
+
+    // Cull: flood backwards from every unreferenced resource.
+    int stack[FrameGraphMaxResources];
+    int stackSize = 0;
+    for(int r = 0; r < fg->numResources; r++){
+        if(fg->resources[r].refCount == 0){
+            stack[stackSize++] = r;
+        }
+    }
+    while(stackSize > 0){
+        int r = stack[--stackSize];
+        for(int p = 0; p < fg->numPasses; p++){
+            FrameGraphPass* pass = &fg->passes[p];
+            if(pass->culled || pass->sideEffect){
+                continue;
+            }
+            for(int i = 0; i < pass->numAccesses; i++){
+                if(pass->accesses[i].resource != r || !pass->accesses[i].write){
+                    continue;
+                }
+                if(--pass->refCount == 0){
+                    pass->culled = true;
+                    for(int j = 0; j < pass->numAccesses; j++){
+                        if(pass->accesses[j].write){
+                            continue;
+                        }
+                        FrameGraphResource* read = &fg->resources[pass->accesses[j].resource];
+                        if(--read->refCount == 0){
+                            stack[stackSize++] = pass->accesses[j].resource;
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    // Lifetimes over the surviving passes.
+    fg->numCulledPasses = 0;
+    for(int p = 0; p < fg->numPasses; p++){
+        FrameGraphPass* pass = &fg->passes[p];
+        if(pass->culled){
+            fg->numCulledPasses++;
+            continue;
+        }
+        for(int i = 0; i < pass->numAccesses; i++){
+            FrameGraphResource* res = &fg->resources[pass->accesses[i].resource];
+            if(res->firstPass < 0){
+                res->firstPass = p;
+                bool used;
+                res->firstState = frameGraphPassState(pass, pass->accesses[i].resource, &used);
+            }
+            res->lastPass = p;
+        }
+    }
+
+    // Place transient resources, largest first, at the lowest offset that doesn't
+    // collide with an already placed resource whose lifetime overlaps.
+    int order[FrameGraphMaxResources];
+    int numPlaced = 0;
+    fg->heapSize = 0;
+    fg->unaliasedSize = 0;
+    for(int r = 0; r < fg->numResources; r++){
+        FrameGraphResource* res = &fg->resources[r];
+        if(res->imported || res->firstPass < 0){
+            continue;
+        }
+        fg->unaliasedSize += frameGraphAlign(res->size, res->alignment);
+        int at = numPlaced++;
+        while(at > 0 && fg->resources[order[at - 1]].size < res->size){
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = r;
+    }
+    for(int i = 0; i < numPlaced; i++){
+        FrameGraphResource* res = &fg->resources[order[i]];
+        uint64_t best = UINT64_MAX;
+        // Candidate offsets: the heap start and the end of every conflicting resource.
+        for(int c = -1; c < i; c++){
+            uint64_t offset = 0;
+            if(c >= 0){
+                const FrameGraphResource* other = &fg->resources[order[c]];
+                if(!frameGraphLifetimesOverlap(res, other)){
+                    continue;
+                }
+                offset = other->heapOffset + other->size;
+            }
+            offset = frameGraphAlign(offset, res->alignment);
+            if(offset >= best){
+                continue;
+            }
+            res->heapOffset = offset;
+            bool fits = true;
+            for(int j = 0; j < i && fits; j++){
+                const FrameGraphResource* other = &fg->resources[order[j]];
+                fits = !frameGraphLifetimesOverlap(res, other) || !frameGraphMemoryOverlaps(res, other);
+            }
+            if(fits){
+                best = offset;
+            }
+        }
+        res->heapOffset = best;
+        if(best + res->size > fg->heapSize){
+            fg->heapSize = best + res->size;
+        }
+    }
+
+    fg->peakLiveSize = 0;
+    for(int p = 0; p < fg->numPasses; p++){
+        uint64_t live = 0;
+        for(int r = 0; r < fg->numResources; r++){
+            const FrameGraphResource* res = &fg->resources[r];
+            if(!res->imported && res->firstPass >= 0 && res->firstPass <= p && p <= res->lastPass){
+                live += res->size;
+            }
+        }
+        if(live > fg->peakLiveSize){
+            fg->peakLiveSize = live;
+        }
+    }
+
+    // Barriers. Transient resources are created in the state of their first use,
+    // imported ones start in their initial state.
+    uint32_t current[FrameGraphMaxResources];
+    for(int r = 0; r < fg->numResources; r++){
+        const FrameGraphResource* res = &fg->resources[r];
+        current[r] = res->imported ? res->initialState : res->firstState;
+    }
+    fg->numBarriers = 0;
+    for(int p = 0; p < fg->numPasses; p++){
+        FrameGraphPass* pass = &fg->passes[p];
+        pass->firstBarrier = fg->numBarriers;
+        pass->numBarriers = 0;
+        if(pass->culled){
+            continue;
+        }
+        for(int r = 0; r < fg->numResources; r++){
+            bool used;
+            uint32_t state = frameGraphPassState(pass, r, &used);
+            if(!used){
+                continue;
+            }
+            const FrameGraphResource* res = &fg->resources[r];
+            if(!res->imported && res->firstPass == p){
+                // Activating memory another resource was using earlier in the frame.
+                int before = -1;
+                bool aliased = false;
+                for(int o = 0; o < fg->numResources; o++){
+                    const FrameGraphResource* other = &fg->resources[o];
+                    if(o == r || other->imported || other->firstPass < 0 || other->lastPass >= p){
+                        continue;
+                    }
+                    if(frameGraphMemoryOverlaps(res, other)){
+                        before = aliased ? -1 : o;
+                        aliased = true;
+                    }
+                }
+                if(aliased && !frameGraphPushBarrier(fg, FG_BARRIER_ALIASING, r, before, 0, 0)){
+                    return false;
+                }
+            }
+            if(current[r] != state){
+                if(!frameGraphPushBarrier(fg, FG_BARRIER_TRANSITION, r, -1, current[r], state)){
+                    return false;
+                }
+                current[r] = state;
+            }
+        }
+        pass->numBarriers = fg->numBarriers - pass->firstBarrier;
+    }
+    fg->firstFinalBarrier = fg->numBarriers;
+    for(int r = 0; r < fg->numResources; r++){
+        const FrameGraphResource* res = &fg->resources[r];
+        if(res->imported && current[r] != res->finalState){
+            if(!frameGraphPushBarrier(fg, FG_BARRIER_TRANSITION, r, -1, current[r], res->finalState)){
+                return false;
+            }
+        }
+    }
+    fg->numFinalBarriers = fg->numBarriers - fg->firstFinalBarrier;
+    return true;
+}
+
+typedef void (*FrameGraphBarrierFn)(const FrameGraph* fg, const FrameGraphBarrier* barriers, int count, void* context);
+
+// Runs the surviving passes in declaration order, handing each pass's barriers
+// to submitBarriers right before it.
+inline void frameGraphExecute(const FrameGraph* fg, FrameGraphBarrierFn submitBarriers, void* context){
+    for(int p = 0; p < fg->numPasses; p++){
+        const FrameGraphPass* pass = &fg->passes[p];
+        if(pass->culled){
+            continue;
+        }
+        if(pass->numBarriers > 0){
+            submitBarriers(fg, &fg->barriers[pass->firstBarrier], pass->numBarriers, context);
+        }
+        if(pass->execute){
+            pass->execute(pass->userData);
+        }
+    }
+    if(fg->numFinalBarriers > 0){
+        submitBarriers(fg, &fg->barriers[fg->firstFinalBarrier], fg->numFinalBarriers, context);
+    }
+}
+
+inline void frameGraphPrintReport(const FrameGraph* fg, FILE* out){
+    fprintf(out, "frame graph: %d passes (%d culled), %d resources, %d barriers\n",
+            fg->numPasses, fg->numCulledPasses, fg->numResources, fg->numBarriers);
+    for(int r = 0; r < fg->numResources; r++){
+        const FrameGraphResource* res = &fg->resources[r];
+        if(res->imported){
+            fprintf(out, "  %-20s imported  passes %d..%d\n", res->name, res->firstPass, res->lastPass);
+        }else if(res->firstPass < 0){
+            fprintf(out, "  %-20s unused\n", res->name);
+        }else{
+            fprintf(out, "  %-20s %8llu KB @ %8llu KB  passes %d..%d\n", res->name,
+                    (unsigned long long)(res->size / 1024), (unsigned long long)(res->heapOffset / 1024),
+                    res->firstPass, res->lastPass);
+        }
+    }
+    fprintf(out, "  transient heap %llu KB, peak live %llu KB, unaliased %llu KB\n",
+            (unsigned long long)(fg->heapSize / 1024), (unsigned long long)(fg->peakLiveSize / 1024),
+            (unsigned long long)(fg->unaliasedSize / 1024));
+}
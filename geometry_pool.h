@@ -0,0 +1,339 @@
+#pragma once
+
+// Geometry pool: one big DEFAULT heap buffer holding the vertices and indices of
+// every mesh. Meshes get sub-ranges of it, uploads are packed into a staging
+// buffer and copied over in batches, and compaction slides live ranges down
+// when meshes unload. All meshes share one vertex stride and one index size so
+// a single vertex buffer view and index buffer view cover the whole scene and
+// draws only differ by BaseVertexLocation / StartIndexLocation.
+// Only bookkeeping lives here, the D3D12 side just replays the copy lists.
+
+#include <stdint.h>
+#include <string.h>
+
+static const int GeometryPoolMaxAllocations = 4096;
+// Free ranges sit between allocations, so one more than there are allocations
+// is as many as the list can ever need.
+static const int GeometryPoolMaxFreeRanges = GeometryPoolMaxAllocations + 1;
+static const int GeometryPoolMaxCopies = 1024;
+
+static const uint32_t GeometryPoolInvalid = 0xFFFFFFFF;
+
+struct GeometryPoolRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct GeometryPoolAllocation {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t alignment;
+    bool live;
+};
+
+// Staging -> pool copy, one CopyBufferRegion each.
+struct GeometryPoolUpload {
+    uint64_t stagingOffset;
+    uint64_t poolOffset;
+    uint64_t size;
+};
+
+// Compaction copy. Source and destination can overlap, so every move goes
+// pool -> scratch first and scratch -> pool after a barrier.
+struct GeometryPoolMove {
+    uint64_t srcOffset;
+    uint64_t dstOffset;
+    uint64_t scratchOffset;
+    uint64_t size;
+};
+
+struct GeometryPool {
+    uint64_t capacity;
+    uint32_t vertexStride;
+    uint32_t indexSize;
+
+    GeometryPoolAllocation allocations[GeometryPoolMaxAllocations];
+    uint32_t numAllocations;
+    uint32_t freeHandles[GeometryPoolMaxAllocations];
+    uint32_t numFreeHandles;
+
+    // Sorted by offset, never adjacent to each other.
+    GeometryPoolRange freeRanges[GeometryPoolMaxFreeRanges];
+    int numFreeRanges;
+    uint64_t usedBytes;
+
+    // Persistently mapped upload buffer the caller owns.
+    uint8_t* staging;
+    uint64_t stagingCapacity;
+    uint64_t stagingHead;
+    GeometryPoolUpload uploads[GeometryPoolMaxCopies];
+    int numUploads;
+
+    GeometryPoolMove moves[GeometryPoolMaxCopies];
+    int numMoves;
+    uint64_t scratchSize;
+};
+
+inline uint64_t geometryPoolAlign(uint64_t value, uint64_t alignment){
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+inline void geometryPoolInit(GeometryPool* pool, uint64_t capacity, uint32_t vertexStride, uint32_t indexSize, void* staging, uint64_t stagingCapacity){
+    pool->capacity = capacity;
+    pool->vertexStride = vertexStride;
+    pool->indexSize = indexSize;
+    pool->numAllocations = 0;
+    pool->numFreeHandles = 0;
+    pool->freeRanges[0].offset = 0;
+    pool->freeRanges[0].size = capacity;
+    pool->numFreeRanges = 1;
+    pool->usedBytes = 0;
+    pool->staging = (uint8_t*)staging;
+    pool->stagingCapacity = stagingCapacity;
+    pool->stagingHead = 0;
+    pool->numUploads = 0;
+    pool->numMoves = 0;
+    pool->scratchSize = 0;
+}
+
+inline void geometryPoolRemoveFreeRange(GeometryPool* pool, int index){
+    memmove(&pool->freeRanges[index], &pool->freeRanges[index + 1], (pool->numFreeRanges - index - 1) * sizeof(GeometryPoolRange));
+    pool->numFreeRanges--;
+}
+
+inline bool geometryPoolInsertFreeRange(GeometryPool* pool, int index, uint64_t offset, uint64_t size){
+    if(pool->numFreeRanges == GeometryPoolMaxFreeRanges){
+        return false;
+    }
+    memmove(&pool->freeRanges[index + 1], &pool->freeRanges[index], (pool->numFreeRanges - index) * sizeof(GeometryPoolRange));
+    pool->freeRanges[index].offset = offset;
+    pool->freeRanges[index].size = size;
+    pool->numFreeRanges++;
+    return true;
+}
+
+// First fit. Returns a handle or GeometryPoolInvalid when no free range is big
+// enough, in which case compacting may help if geometryPoolFreeBytes is large.
+inline uint32_t geometryPoolAllocate(GeometryPool* pool, uint64_t size, uint32_t alignment){
+    if(size == 0 || (pool->numFreeHandles == 0 && pool->numAllocations == GeometryPoolMaxAllocations)){
+        return GeometryPoolInvalid;
+    }
+    for(int i = 0; i < pool->numFreeRanges; i++){
+        GeometryPoolRange range = pool->freeRanges[i];
+        uint64_t offset = geometryPoolAlign(range.offset, alignment);
+        uint64_t padding = offset - range.offset;
+        if(padding + size > range.size){
+            continue;
+        }
+        uint64_t tail = range.size - padding - size;
+        // Padding in front stays free, so the range may split in two.
+        if(padding > 0 && tail > 0){
+            if(!geometryPoolInsertFreeRange(pool, i + 1, offset + size, tail)){
+                return GeometryPoolInvalid;
+            }
+            pool->freeRanges[i].size = padding;
+        }else if(padding > 0){
+            pool->freeRanges[i].size = padding;
+        }else if(tail > 0){
+            pool->freeRanges[i].offset = offset + size;
+            pool->freeRanges[i].size = tail;
+        }else{
+            geometryPoolRemoveFreeRange(pool, i);
+        }
+
+        uint32_t handle = pool->numFreeHandles > 0 ? pool->freeHandles[--pool->numFreeHandles] : pool->numAllocations++;
+        GeometryPoolAllocation* alloc = &pool->allocations[handle];
+        alloc->offset = offset;
+        alloc->size = size;
+        alloc->alignment = alignment;
+        alloc->live = true;
+        pool->usedBytes += size;
+        return handle;
+    }
+    return GeometryPoolInvalid;
+}
+
+inline uint32_t geometryPoolAllocateVertices(GeometryPool* pool, uint32_t vertexCount){
+    return geometryPoolAllocate(pool, (uint64_t)vertexCount * pool->vertexStride, pool->vertexStride);
+}
+
+inline uint32_t geometryPoolAllocateIndices(GeometryPool* pool, uint32_t indexCount){
+    return geometryPoolAllocate(pool, (uint64_t)indexCount * pool->indexSize, pool->indexSize);
+}
+
+// Returns false for a handle that isn't live. The free list can't run out of
+// slots, but if it did the allocation would stay live rather than leak.
+inline bool geometryPoolFree(GeometryPool* pool, uint32_t handle){
+    if(handle >= pool->numAllocations || !pool->allocations[handle].live){
+        return false;
+    }
+    GeometryPoolAllocation* alloc = &pool->allocations[handle];
+
+    int i = 0;
+    while(i < pool->numFreeRanges && pool->freeRanges[i].offset < alloc->offset){
+        i++;
+    }
+    bool mergePrev = i > 0 && pool->freeRanges[i - 1].offset + pool->freeRanges[i - 1].size == alloc->offset;
+    bool mergeNext = i < pool->numFreeRanges && alloc->offset + alloc->size == pool->freeRanges[i].offset;
+    if(mergePrev && mergeNext){
+        pool->freeRanges[i - 1].size += alloc->size + pool->freeRanges[i].size;
+        geometryPoolRemoveFreeRange(pool, i);
+    }else if(mergePrev){
+        pool->freeRanges[i - 1].size += alloc->size;
+    }else if(mergeNext){
+        pool->freeRanges[i].offset = alloc->offset;
+        pool->freeRanges[i].size += alloc->size;
+    }else if(!geometryPoolInsertFreeRange(pool, i, alloc->offset, alloc->size)){
+        return false;
+    }
+    alloc->live = false;
+    pool->usedBytes -= alloc->size;
+    pool->freeHandles[pool->numFreeHandles++] = handle;
+    return true;
+}
+
+// Offsets are only stable until the next compaction, so resolve them when recording.
+inline uint64_t geometryPoolOffset(const GeometryPool* pool, uint32_t handle){
+    return pool->allocations[handle].offset;
+}
+
+inline uint32_t geometryPoolBaseVertex(const GeometryPool* pool, uint32_t handle){
+    return (uint32_t)(pool->allocations[handle].offset / pool->vertexStride);
+}
+
+inline uint32_t geometryPoolStartIndex(const GeometryPool* pool, uint32_t handle){
+    return (uint32_t)(pool->allocations[handle].offset / pool->indexSize);
+}
+
+// Copies data into staging memory and queues the copy into the pool. Returns
+// false when staging or the copy list is full; record and submit the pending
+// uploads, wait for their fence, call geometryPoolUploadsRetired and retry.
+inline bool geometryPoolWrite(GeometryPool* pool, uint32_t handle, uint64_t offsetInAllocation, const void* data, uint64_t size){
+    const GeometryPoolAllocation* alloc = &pool->allocations[handle];
+    if(!alloc->live || offsetInAllocation + size > alloc->size){
+        return false;
+    }
+    uint64_t stagingOffset = geometryPoolAlign(pool->stagingHead, 4);
+    if(stagingOffset + size > pool->stagingCapacity){
+        return false;
+    }
+    uint64_t poolOffset = alloc->offset + offsetInAllocation;
+
+    // Back to back writes to neighbouring ranges become one copy. Anything
+    // else needs a free copy slot before staging is touched, so a failed
+    // write leaves nothing behind.
+    GeometryPoolUpload* last = pool->numUploads > 0 ? &pool->uploads[pool->numUploads - 1] : 0;
+    bool merge = last && last->stagingOffset + last->size == stagingOffset && last->poolOffset + last->size == poolOffset;
+    if(!merge && pool->numUploads == GeometryPoolMaxCopies){
+        return false;
+    }
+    memcpy(pool->staging + stagingOffset, data, size);
+    pool->stagingHead = stagingOffset + size;
+    if(merge){
+        last->size += size;
+        return true;
+    }
+    GeometryPoolUpload* upload = &pool->uploads[pool->numUploads++];
+    upload->stagingOffset = stagingOffset;
+    upload->poolOffset = poolOffset;
+    upload->size = size;
+    return true;
+}
+
+// Call once the command list holding the pending uploads has been recorded.
+inline void geometryPoolUploadsRecorded(GeometryPool* pool){
+    pool->numUploads = 0;
+}
+
+// Call once the fence of the last recorded uploads has completed; the staging memory can be reused.
+inline void geometryPoolUploadsRetired(GeometryPool* pool){
+    pool->numUploads = 0;
+    pool->stagingHead = 0;
+}
+
+inline uint64_t geometryPoolFreeBytes(const GeometryPool* pool){
+    return pool->capacity - pool->usedBytes;
+}
+
+inline uint64_t geometryPoolLargestFreeRange(const GeometryPool* pool){
+    uint64_t largest = 0;
+    for(int i = 0; i < pool->numFreeRanges; i++){
+        if(pool->freeRanges[i].size > largest){
+            largest = pool->freeRanges[i].size;
+        }
+    }
+    return largest;
+}
+
+// Slides every live allocation down as far as its alignment allows and fills
+// pool->moves with the copies that realize it on the GPU; call
+// geometryPoolMovesRecorded once they are recorded. Pending uploads
+// must be recorded first since they target the old offsets. Returns false if
+// there are more moves than fit the move list; nothing is changed then.
+inline bool geometryPoolCompact(GeometryPool* pool){
+    pool->numMoves = 0;
+    pool->scratchSize = 0;
+    if(pool->numUploads > 0){
+        return false;
+    }
+
+    uint32_t order[GeometryPoolMaxAllocations];
+    uint32_t numLive = 0;
+    for(uint32_t h = 0; h < pool->numAllocations; h++){
+        if(!pool->allocations[h].live){
+            continue;
+        }
+        uint32_t at = numLive++;
+        while(at > 0 && pool->allocations[order[at - 1]].offset > pool->allocations[h].offset){
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = h;
+    }
+
+    uint64_t head = 0;
+    int numMoves = 0;
+    for(uint32_t i = 0; i < numLive; i++){
+        const GeometryPoolAllocation* alloc = &pool->allocations[order[i]];
+        uint64_t offset = geometryPoolAlign(head, alloc->alignment);
+        if(offset != alloc->offset && ++numMoves > GeometryPoolMaxCopies){
+            return false;
+        }
+        head = offset + alloc->size;
+    }
+
+    head = 0;
+    pool->numFreeRanges = 0;
+    for(uint32_t i = 0; i < numLive; i++){
+        GeometryPoolAllocation* alloc = &pool->allocations[order[i]];
+        uint64_t offset = geometryPoolAlign(head, alloc->alignment);
+        // Alignment padding between ranges stays allocatable.
+        if(offset > head){
+            pool->freeRanges[pool->numFreeRanges].offset = head;
+            pool->freeRanges[pool->numFreeRanges].size = offset - head;
+            pool->numFreeRanges++;
+        }
+        if(offset != alloc->offset){
+            GeometryPoolMove* move = &pool->moves[pool->numMoves++];
+            move->srcOffset = alloc->offset;
+            move->dstOffset = offset;
+            move->scratchOffset = pool->scratchSize;
+            move->size = alloc->size;
+            pool->scratchSize += geometryPoolAlign(alloc->size, 4);
+            alloc->offset = offset;
+        }
+        head = offset + alloc->size;
+    }
+    if(head < pool->capacity){
+        pool->freeRanges[pool->numFreeRanges].offset = head;
+        pool->freeRanges[pool->numFreeRanges].size = pool->capacity - head;
+        pool->numFreeRanges++;
+    }
+    return true;
+}
+
+// Call once the command list holding the moves has been recorded.
+inline void geometryPoolMovesRecorded(GeometryPool* pool){
+    pool->numMoves = 0;
+    pool->scratchSize = 0;
+}
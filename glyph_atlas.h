@@ -0,0 +1,551 @@
+#pragma once
+
+// Glyph atlas: glyphs are rasterized once, turned into signed distance fields
+// and cached in fixed size cells of a single channel atlas texture. One SDF
+// serves every text size, the pixel shader turns distance into coverage.
+// Cells are recycled least recently used first, glyphs used in the current
+// frame are never evicted.
+//
+// Rasterization goes through a callback on the calling thread, since platform
+// rasterizers (GDI, DirectWrite, FreeType faces) usually aren't thread safe.
+// Distance fields of the glyphs that missed are generated in glyphAtlasFlush,
+// spread across the threads of a worker pool. The caller uploads the dirty
+// cells afterwards.
+//
+// A frame looks like:
+//   glyphAtlasBeginFrame, textLayout for every label, glyphAtlasFlush,
+//   upload atlas->dirty cells, draw the instances.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "worker_pool.h"
+
+static const int GlyphAtlasMaxThreads = 8;
+static const uint32_t GlyphAtlasNoSlot = 0xFFFFFFFF;
+
+// Coverage of one glyph as produced by the rasterizer, in its pixels. left and
+// top place the bitmap relative to the pen on the baseline, y up.
+struct GlyphBitmap {
+    int width;
+    int height;
+    int pitch;
+    const uint8_t* coverage;
+    float left;
+    float top;
+    float advance;
+};
+
+// Must rasterize codepoint with an em of pixelSize pixels into out. The
+// bitmap only has to stay valid until the callback is called again.
+typedef bool (*GlyphRasterizeFn)(void* context, uint32_t codepoint, int pixelSize, GlyphBitmap* out);
+
+// One glyph quad, laid out for an instanced draw of 6 vertices per glyph.
+struct TextInstance {
+    // Normalized device coordinates, y up.
+    float left;
+    float top;
+    float right;
+    float bottom;
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+    uint32_t color;
+};
+
+struct TextStyle {
+    float pixelSize;
+    // RGBA8, red in the low byte.
+    uint32_t color;
+    float targetWidth;
+    float targetHeight;
+};
+
+struct GlyphSlot {
+    uint32_t codepoint;
+    // 0 for slots never used, frames count from 1.
+    uint64_t lastUsedFrame;
+    uint32_t prev;
+    uint32_t next;
+    // Quad relative to the pen, in atlas pixels (y up), and the pen advance.
+    float left;
+    float top;
+    uint16_t width;
+    uint16_t height;
+    float advance;
+};
+
+struct GlyphSdfJob {
+    uint32_t slot;
+    int width;
+    int height;
+    uint8_t* coverage;
+};
+
+struct GlyphAtlasStats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // Glyphs left out because every cell was taken by glyphs of the current frame.
+    uint64_t dropped;
+    uint64_t glyphsLaidOut;
+    uint64_t sdfGenerated;
+    double sdfSeconds;
+    double layoutSeconds;
+};
+
+struct GlyphAtlas {
+    int width;
+    int height;
+    int cellSize;
+    int cellsPerRow;
+    int emSize;
+    int spread;
+    int oversample;
+    uint8_t* pixels;
+
+    GlyphRasterizeFn rasterize;
+    void* rasterizeContext;
+    WorkerPool* pool;
+    int numThreads;
+
+    uint32_t numSlots;
+    GlyphSlot* slots;
+    // Most and least recently used slot.
+    uint32_t head;
+    uint32_t tail;
+    // Open addressing codepoint -> slot + 1, 0 is empty.
+    uint32_t* table;
+    uint32_t tableMask;
+
+    GlyphSdfJob* jobs;
+    uint32_t numJobs;
+    std::atomic<uint32_t> nextJob;
+    uint32_t* dirty;
+    uint32_t numDirty;
+
+    uint64_t frame;
+    GlyphAtlasStats stats;
+};
+
+inline uint32_t glyphHash(uint32_t codepoint){
+    codepoint ^= codepoint >> 16;
+    codepoint *= 0x7FEB352D;
+    codepoint ^= codepoint >> 15;
+    return codepoint;
+}
+
+// The atlas is width x height pixels of cellSize cells. Glyphs are rendered
+// with an em of emSize atlas pixels and spread pixels of distance on either
+// side of the outline, from a rasterization oversample times larger. pool may
+// be null to generate distance fields on the calling thread only.
+inline bool glyphAtlasInit(GlyphAtlas* a, int width, int height, int cellSize, int emSize, int spread, int oversample,
+                           GlyphRasterizeFn rasterize, void* context, WorkerPool* pool){
+    a->width = width;
+    a->height = height;
+    a->cellSize = cellSize;
+    a->cellsPerRow = width / cellSize;
+    a->emSize = emSize;
+    a->spread = spread;
+    a->oversample = oversample < 1 ? 1 : oversample;
+    a->rasterize = rasterize;
+    a->rasterizeContext = context;
+    a->pool = pool;
+    int numThreads = workerPoolThreads(pool);
+    a->numThreads = numThreads > GlyphAtlasMaxThreads ? GlyphAtlasMaxThreads : numThreads;
+    a->numSlots = (uint32_t)(a->cellsPerRow * (height / cellSize));
+    uint32_t tableSize = 16;
+    while(tableSize < a->numSlots * 2){
+        tableSize *= 2;
+    }
+    a->tableMask = tableSize - 1;
+    a->pixels = (uint8_t*)calloc((size_t)width * height, 1);
+    a->slots = (GlyphSlot*)malloc(a->numSlots * sizeof(GlyphSlot));
+    a->table = (uint32_t*)calloc(tableSize, sizeof(uint32_t));
+    a->jobs = (GlyphSdfJob*)malloc(a->numSlots * sizeof(GlyphSdfJob));
+    a->dirty = (uint32_t*)malloc(a->numSlots * sizeof(uint32_t));
+    a->numJobs = 0;
+    a->numDirty = 0;
+    // Glyphs acquired before the first glyphAtlasBeginFrame are protected too.
+    a->frame = 1;
+    a->stats = {};
+    if(!a->pixels || !a->slots || !a->table || !a->jobs || !a->dirty || a->numSlots == 0){
+        return false;
+    }
+    // All slots start out free, chained so slot 0 is the first to be taken.
+    // next points towards the least recently used end.
+    for(uint32_t i = 0; i < a->numSlots; i++){
+        a->slots[i].codepoint = GlyphAtlasNoSlot;
+        a->slots[i].lastUsedFrame = 0;
+        a->slots[i].prev = i + 1 == a->numSlots ? GlyphAtlasNoSlot : i + 1;
+        a->slots[i].next = i == 0 ? GlyphAtlasNoSlot : i - 1;
+    }
+    a->head = a->numSlots - 1;
+    a->tail = 0;
+    return true;
+}
+
+inline void glyphAtlasDestroy(GlyphAtlas* a){
+    for(uint32_t i = 0; i < a->numJobs; i++){
+        free(a->jobs[i].coverage);
+    }
+    free(a->pixels);
+    free(a->slots);
+    free(a->table);
+    free(a->jobs);
+    free(a->dirty);
+    a->pixels = 0;
+}
+
+inline void glyphAtlasSlotOrigin(const GlyphAtlas* a, uint32_t slot, int* x, int* y){
+    *x = (int)(slot % a->cellsPerRow) * a->cellSize;
+    *y = (int)(slot / a->cellsPerRow) * a->cellSize;
+}
+
+inline void glyphAtlasUnlink(GlyphAtlas* a, uint32_t slot){
+    GlyphSlot* s = &a->slots[slot];
+    if(s->prev != GlyphAtlasNoSlot) a->slots[s->prev].next = s->next; else a->head = s->next;
+    if(s->next != GlyphAtlasNoSlot) a->slots[s->next].prev = s->prev; else a->tail = s->prev;
+}
+
+// Moves slot to the most recently used end.
+inline void glyphAtlasTouch(GlyphAtlas* a, uint32_t slot){
+    a->slots[slot].lastUsedFrame = a->frame;
+    if(a->head == slot){
+        return;
+    }
+    glyphAtlasUnlink(a, slot);
+    GlyphSlot* s = &a->slots[slot];
+    s->prev = GlyphAtlasNoSlot;
+    s->next = a->head;
+    a->slots[a->head].prev = slot;
+    a->head = slot;
+}
+
+inline uint32_t glyphAtlasFind(const GlyphAtlas* a, uint32_t codepoint){
+    for(uint32_t i = glyphHash(codepoint) & a->tableMask;; i = (i + 1) & a->tableMask){
+        uint32_t entry = a->table[i];
+        if(entry == 0){
+            return GlyphAtlasNoSlot;
+        }
+        if(a->slots[entry - 1].codepoint == codepoint){
+            return entry - 1;
+        }
+    }
+}
+
+inline void glyphAtlasTableInsert(GlyphAtlas* a, uint32_t codepoint, uint32_t slot){
+    uint32_t i = glyphHash(codepoint) & a->tableMask;
+    while(a->table[i] != 0){
+        i = (i + 1) & a->tableMask;
+    }
+    a->table[i] = slot + 1;
+}
+
+// Backward shift deletion keeps probe chains intact without tombstones.
+inline void glyphAtlasTableRemove(GlyphAtlas* a, uint32_t codepoint){
+    uint32_t i = glyphHash(codepoint) & a->tableMask;
+    while(a->table[i] != 0 && a->slots[a->table[i] - 1].codepoint != codepoint){
+        i = (i + 1) & a->tableMask;
+    }
+    if(a->table[i] == 0){
+        return;
+    }
+    for(uint32_t j = (i + 1) & a->tableMask; a->table[j] != 0; j = (j + 1) & a->tableMask){
+        uint32_t home = glyphHash(a->slots[a->table[j] - 1].codepoint) & a->tableMask;
+        // Entry j may fill the hole at i if its home isn't cyclically in (i, j].
+        if(((j - home) & a->tableMask) >= ((j - i) & a->tableMask)){
+            a->table[i] = a->table[j];
+            i = j;
+        }
+    }
+    a->table[i] = 0;
+}
+
+inline void glyphAtlasFlush(GlyphAtlas* a);
+
+inline void glyphAtlasBeginFrame(GlyphAtlas* a){
+    // Cells with pending jobs are only safe from eviction within their frame.
+    glyphAtlasFlush(a);
+    a->frame++;
+}
+
+// Rasterizes a glyph that missed into the least recently used cell and queues its distance field.
+inline uint32_t glyphAtlasInsert(GlyphAtlas* a, uint32_t codepoint){
+    uint32_t slot = a->tail;
+    if(a->slots[slot].lastUsedFrame == a->frame){
+        a->stats.dropped++;
+        return GlyphAtlasNoSlot;
+    }
+    GlyphBitmap bitmap;
+    if(!a->rasterize(a->rasterizeContext, codepoint, a->emSize * a->oversample, &bitmap)){
+        a->stats.dropped++;
+        return GlyphAtlasNoSlot;
+    }
+    GlyphSlot* s = &a->slots[slot];
+    if(s->codepoint != GlyphAtlasNoSlot){
+        glyphAtlasTableRemove(a, s->codepoint);
+        a->stats.evictions++;
+    }
+    s->codepoint = codepoint;
+    glyphAtlasTableInsert(a, codepoint, slot);
+    glyphAtlasTouch(a, slot);
+
+    // The cell holds the glyph plus spread pixels of falloff around it, cropped to the cell.
+    int os = a->oversample;
+    int width = bitmap.width > 0 ? (bitmap.width + os - 1) / os + 2 * a->spread : 0;
+    int height = bitmap.height > 0 ? (bitmap.height + os - 1) / os + 2 * a->spread : 0;
+    s->width = (uint16_t)(width < a->cellSize ? width : a->cellSize);
+    s->height = (uint16_t)(height < a->cellSize ? height : a->cellSize);
+    s->left = bitmap.left / os - a->spread;
+    s->top = bitmap.top / os + a->spread;
+    s->advance = bitmap.advance / os;
+    if(s->width == 0 || s->height == 0){
+        return slot;
+    }
+
+    GlyphSdfJob* job = &a->jobs[a->numJobs];
+    job->slot = slot;
+    job->width = s->width * os;
+    job->height = s->height * os;
+    job->coverage = (uint8_t*)calloc((size_t)job->width * job->height, 1);
+    if(!job->coverage){
+        s->width = 0;
+        return slot;
+    }
+    int pad = a->spread * os;
+    for(int y = 0; y < bitmap.height && y + pad < job->height && pad < job->width; y++){
+        int copy = bitmap.width < job->width - pad ? bitmap.width : job->width - pad;
+        memcpy(job->coverage + (size_t)(y + pad) * job->width + pad, bitmap.coverage + (size_t)y * bitmap.pitch, copy);
+    }
+    a->numJobs++;
+    return slot;
+}
+
+// Returns the slot holding codepoint, rasterizing it on a miss, or GlyphAtlasNoSlot.
+inline uint32_t glyphAtlasAcquire(GlyphAtlas* a, uint32_t codepoint){
+    a->stats.lookups++;
+    uint32_t slot = glyphAtlasFind(a, codepoint);
+    if(slot != GlyphAtlasNoSlot){
+        a->stats.hits++;
+        glyphAtlasTouch(a, slot);
+        return slot;
+    }
+    a->stats.misses++;
+    return glyphAtlasInsert(a, codepoint);
+}
+
+// 1D squared Euclidean distance transform of f (Felzenszwalb and Huttenlocher).
+inline void glyphDistance1d(const float* f, int n, float* d, int* v, float* z){
+    int k = 0;
+    v[0] = 0;
+    z[0] = -1e20f;
+    z[1] = 1e20f;
+    for(int q = 1; q < n; q++){
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while(s <= z[k]){
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = 1e20f;
+    }
+    k = 0;
+    for(int q = 0; q < n; q++){
+        while(z[k + 1] < q){
+            k++;
+        }
+        float dq = (float)(q - v[k]);
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// Squared distance of every pixel to the nearest pixel whose coverage is on the given side of 50%.
+inline void glyphDistance2d(const uint8_t* coverage, int width, int height, bool inside, float* out, float* scratch, int* v, float* z){
+    float* column = scratch;
+    float* result = scratch + (width > height ? width : height);
+    for(int i = 0; i < width * height; i++){
+        out[i] = (coverage[i] >= 128) == inside ? 0.0f : 1e20f;
+    }
+    for(int x = 0; x < width; x++){
+        for(int y = 0; y < height; y++) column[y] = out[y * width + x];
+        glyphDistance1d(column, height, result, v, z);
+        for(int y = 0; y < height; y++) out[y * width + x] = result[y];
+    }
+    for(int y = 0; y < height; y++){
+        memcpy(column, out + (size_t)y * width, width * sizeof(float));
+        glyphDistance1d(column, width, out + (size_t)y * width, v, z);
+    }
+}
+
+// Builds the distance field of one queued glyph into its atlas cell. 0.5 is
+// the outline, values above it are inside.
+inline void glyphAtlasGenerateSdf(GlyphAtlas* a, const GlyphSdfJob* job){
+    int w = job->width;
+    int h = job->height;
+    int n = w > h ? w : h;
+    float* toInside = (float*)malloc((size_t)w * h * sizeof(float));
+    float* toOutside = (float*)malloc((size_t)w * h * sizeof(float));
+    float* scratch = (float*)malloc(2 * n * sizeof(float) + (n + 1) * sizeof(float));
+    int* v = (int*)malloc(n * sizeof(int));
+    if(toInside && toOutside && scratch && v){
+        float* z = scratch + 2 * n;
+        glyphDistance2d(job->coverage, w, h, true, toInside, scratch, v, z);
+        glyphDistance2d(job->coverage, w, h, false, toOutside, scratch, v, z);
+
+        // Each cell pixel averages the signed distance of its os x os block.
+        int os = a->oversample;
+        float scale = 0.5f / (a->spread * os) / (os * os);
+        int cellX, cellY;
+        glyphAtlasSlotOrigin(a, job->slot, &cellX, &cellY);
+        for(int y = 0; y < h / os; y++){
+            uint8_t* row = a->pixels + (size_t)(cellY + y) * a->width + cellX;
+            for(int x = 0; x < w / os; x++){
+                float sum = 0.0f;
+                for(int by = 0; by < os; by++){
+                    for(int bx = 0; bx < os; bx++){
+                        size_t i = (size_t)(y * os + by) * w + x * os + bx;
+                        // Pixel centers sit half a pixel off the outline at best.
+                        sum += toInside[i] > 0.0f ? 0.5f - sqrtf(toInside[i]) : sqrtf(toOutside[i]) - 0.5f;
+                    }
+                }
+                float value = 0.5f + sum * scale;
+                value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+                row[x] = (uint8_t)(value * 255.0f + 0.5f);
+            }
+        }
+    }
+    free(toInside);
+    free(toOutside);
+    free(scratch);
+    free(v);
+}
+
+inline void glyphAtlasSdfWorker(void* context, int thread, int numThreads){
+    GlyphAtlas* a = (GlyphAtlas*)context;
+    for(;;){
+        uint32_t i = a->nextJob.fetch_add(1, std::memory_order_relaxed);
+        if(i >= a->numJobs){
+            return;
+        }
+        glyphAtlasGenerateSdf(a, &a->jobs[i]);
+    }
+}
+
+// Generates the distance fields of every glyph that missed since the last
+// flush and appends their cells to the dirty list.
+inline void glyphAtlasFlush(GlyphAtlas* a){
+    if(a->numJobs == 0){
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // Cells of evicted glyphs may hold leftovers outside the new glyph's extent.
+    for(uint32_t i = 0; i < a->numJobs; i++){
+        int x, y;
+        glyphAtlasSlotOrigin(a, a->jobs[i].slot, &x, &y);
+        for(int row = 0; row < a->cellSize; row++){
+            memset(a->pixels + (size_t)(y + row) * a->width + x, 0, a->cellSize);
+        }
+    }
+    a->nextJob.store(0, std::memory_order_relaxed);
+    int threads = (int)a->numJobs < a->numThreads ? (int)a->numJobs : a->numThreads;
+    workerPoolRun(a->pool, threads, glyphAtlasSdfWorker, a);
+    for(uint32_t i = 0; i < a->numJobs; i++){
+        free(a->jobs[i].coverage);
+        a->dirty[a->numDirty++] = a->jobs[i].slot;
+    }
+    a->stats.sdfGenerated += a->numJobs;
+    a->numJobs = 0;
+    a->stats.sdfSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Call once the dirty cells have been uploaded.
+inline void glyphAtlasClearDirty(GlyphAtlas* a){
+    a->numDirty = 0;
+}
+
+inline uint32_t textDecodeUtf8(const char** text){
+    const uint8_t* s = (const uint8_t*)*text;
+    uint32_t c = *s++;
+    int extra = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : (c >= 0xC0 ? 1 : 0));
+    if(extra){
+        c &= 0x3F >> extra;
+    }
+    for(int i = 0; i < extra && (*s & 0xC0) == 0x80; i++){
+        c = (c << 6) | (*s++ & 0x3F);
+    }
+    *text = (const char*)s;
+    return c;
+}
+
+// Lays out a UTF-8 string with its first baseline at (x, y), in pixels of the
+// render target from its top left. '\n' starts a new line. Writes up to
+// maxInstances quads and returns how many were written.
+inline int textLayout(GlyphAtlas* a, const char* text, float x, float y, const TextStyle* style, TextInstance* out, int maxInstances){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float scale = style->pixelSize / a->emSize;
+    float toNdcX = 2.0f / style->targetWidth;
+    float toNdcY = 2.0f / style->targetHeight;
+    float invWidth = 1.0f / a->width;
+    float invHeight = 1.0f / a->height;
+    float penX = x;
+    int count = 0;
+    while(*text && count < maxInstances){
+        uint32_t codepoint = textDecodeUtf8(&text);
+        if(codepoint == '\n'){
+            penX = x;
+            y += style->pixelSize * 1.2f;
+            continue;
+        }
+        uint32_t slot = glyphAtlasAcquire(a, codepoint);
+        if(slot == GlyphAtlasNoSlot){
+            continue;
+        }
+        const GlyphSlot* s = &a->slots[slot];
+        if(s->width > 0){
+            int cellX, cellY;
+            glyphAtlasSlotOrigin(a, slot, &cellX, &cellY);
+            // The quad stops half a texel inside the glyph's extent, so a
+            // linear filter at its edge reads the glyph's own falloff and
+            // never the texels of the next cell. That half texel is empty
+            // spread anyway.
+            float left = penX + (s->left + 0.5f) * scale;
+            float top = y - (s->top - 0.5f) * scale;
+            float width = (s->width - 1.0f) * scale;
+            float height = (s->height - 1.0f) * scale;
+            TextInstance* instance = &out[count++];
+            instance->left = left * toNdcX - 1.0f;
+            instance->top = 1.0f - top * toNdcY;
+            instance->right = (left + width) * toNdcX - 1.0f;
+            instance->bottom = 1.0f - (top + height) * toNdcY;
+            instance->u0 = (cellX + 0.5f) * invWidth;
+            instance->v0 = (cellY + 0.5f) * invHeight;
+            instance->u1 = (cellX + s->width - 0.5f) * invWidth;
+            instance->v1 = (cellY + s->height - 0.5f) * invHeight;
+            instance->color = style->color;
+        }
+        penX += s->advance * scale;
+    }
+    a->stats.glyphsLaidOut += count;
+    a->stats.layoutSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return count;
+}
+
+inline void glyphAtlasPrintStats(const GlyphAtlas* a, FILE* out){
+    const GlyphAtlasStats* s = &a->stats;
+    double hitRate = s->lookups ? 100.0 * s->hits / s->lookups : 0.0;
+    double glyphsPerSecond = s->layoutSeconds > 0.0 ? s->glyphsLaidOut / s->layoutSeconds : 0.0;
+    fprintf(out, "glyph atlas: %.1f%% hit rate (%llu lookups), %llu evictions, %llu dropped, %llu SDFs in %.1f ms, %.2f M glyphs laid out/s\n",
+            hitRate, (unsigned long long)s->lookups, (unsigned long long)s->evictions, (unsigned long long)s->dropped,
+            (unsigned long long)s->sdfGenerated, s->sdfSeconds * 1000.0, glyphsPerSecond / 1000000.0);
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+// Software occlusion culling for layered 2D scenes. Opaque sprites and panels
+// marked as occluders are rasterized into a low resolution depth buffer; the
+// bounds of the other draws are tested against it before any commands are
+// recorded, and draws hidden behind occluders everywhere they touch are
+// dropped. Depth is the draw's layer, smaller is nearer.
+//
+// The buffer is split into 8x8 tiles, each row of a tile one register: 8
+// lanes on AVX2, two halves of 4 on SSE2 and NEON. Every tile also keeps the
+// farthest depth in it, which answers most tests without looking at pixels:
+// a tile whose farthest occluder is nearer than the draw hides all of the draw
+// that falls into it, and a tile the draw covers completely whose farthest
+// occluder isn't decides the draw is visible.
+//
+// Rasterization is conservative both ways: occluders only fill buffer pixels
+// they cover completely, draws are tested over every pixel they touch. Before
+// rasterizing, occluders are binned by the rows of tiles they overlap, and the
+// bins are spread over the threads of a worker pool; each row of tiles is only
+// ever written by the thread that took its bin.
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "worker_pool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const int OcclusionTileSize = 8;
+static const int OcclusionMaxThreads = 8;
+// Below this many occluders one thread rasterizes faster than waking others.
+static const uint32_t OcclusionParallelMin = 256;
+// Depth of buffer pixels no occluder covers.
+static const float OcclusionEmpty = FLT_MAX;
+
+struct OcclusionRect {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    float depth;
+};
+
+struct OcclusionStats {
+    uint64_t frames;
+    uint64_t occluders;
+    uint64_t tested;
+    uint64_t culled;
+    double rasterSeconds;
+    double testSeconds;
+};
+
+struct OcclusionBuffer {
+    // Buffer pixels, padded to whole tiles.
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    // Screen to buffer pixels.
+    float scaleX;
+    float scaleY;
+    float* depth;
+    float* tileMax;
+
+    OcclusionRect* occluders;
+    uint32_t numOccluders;
+    uint32_t occluderCapacity;
+    // Occluder indices grouped by row of tiles, binStart[row] to binStart[row + 1].
+    uint32_t* bins;
+    uint32_t binCapacity;
+    uint32_t* binStart;
+    WorkerPool* pool;
+    int numThreads;
+    // Next row of tiles for the pool's threads to take.
+    std::atomic<uint32_t> nextRow;
+
+    OcclusionStats stats;
+};
+
+// Lowers the lanes lo <= lane < hi of rows 8 pixel rows, stride floats apart,
+// to depth where it is nearer.
+inline void occlusionFillRows(float* row, uint32_t stride, int rows, float depth, int lo, int hi){
+#if defined(__AVX2__)
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    __m256 inside = _mm256_and_ps(_mm256_cmp_ps(lanes, _mm256_set1_ps((float)lo), _CMP_GE_OQ), _mm256_cmp_ps(lanes, _mm256_set1_ps((float)hi), _CMP_LT_OQ));
+    __m256 fill = _mm256_blendv_ps(_mm256_set1_ps(OcclusionEmpty), _mm256_set1_ps(depth), inside);
+    for (int y = 0; y < rows; y++, row += stride){
+        _mm256_storeu_ps(row, _mm256_min_ps(_mm256_loadu_ps(row), fill));
+    }
+#elif defined(OCCLUSION_SSE2)
+    __m128 fill[2];
+    const __m128 lanes[2] = { _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f) };
+    for (int h = 0; h < 2; h++){
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(lanes[h], _mm_set1_ps((float)lo)), _mm_cmplt_ps(lanes[h], _mm_set1_ps((float)hi)));
+        fill[h] = _mm_or_ps(_mm_and_ps(inside, _mm_set1_ps(depth)), _mm_andnot_ps(inside, _mm_set1_ps(OcclusionEmpty)));
+    }
+    for (int y = 0; y < rows; y++, row += stride){
+        _mm_storeu_ps(row, _mm_min_ps(_mm_loadu_ps(row), fill[0]));
+        _mm_storeu_ps(row + 4, _mm_min_ps(_mm_loadu_ps(row + 4), fill[1]));
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t fill[2];
+    const float32x4_t lanes[2] = { { 0.0f, 1.0f, 2.0f, 3.0f }, { 4.0f, 5.0f, 6.0f, 7.0f } };
+    for (int h = 0; h < 2; h++){
+        uint32x4_t inside = vandq_u32(vcgeq_f32(lanes[h], vdupq_n_f32((float)lo)), vcltq_f32(lanes[h], vdupq_n_f32((float)hi)));
+        fill[h] = vbslq_f32(inside, vdupq_n_f32(depth), vdupq_n_f32(OcclusionEmpty));
+    }
+    for (int y = 0; y < rows; y++, row += stride){
+        vst1q_f32(row, vminq_f32(vld1q_f32(row), fill[0]));
+        vst1q_f32(row + 4, vminq_f32(vld1q_f32(row + 4), fill[1]));
+    }
+#else
+    for (int y = 0; y < rows; y++, row += stride){
+        for (int l = lo; l < hi; l++){
+            row[l] = depth < row[l] ? depth : row[l];
+        }
+    }
+#endif
+}
+
+// True if the lanes lo <= lane < hi of an 8 pixel row are all nearer than depth.
+inline bool occlusionRowHides(const float* row, float depth, int lo, int hi){
+#if defined(__AVX2__)
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    __m256 outside = _mm256_or_ps(_mm256_cmp_ps(lanes, _mm256_set1_ps((float)lo), _CMP_LT_OQ), _mm256_cmp_ps(lanes, _mm256_set1_ps((float)hi), _CMP_GE_OQ));
+    __m256 hidden = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_loadu_ps(row), _mm256_set1_ps(depth), _CMP_LT_OQ));
+    return _mm256_movemask_ps(hidden) == 0xFF;
+#elif defined(OCCLUSION_SSE2)
+    const __m128 lanes[2] = { _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f) };
+    int mask = 0;
+    for (int h = 0; h < 2; h++){
+        __m128 outside = _mm_or_ps(_mm_cmplt_ps(lanes[h], _mm_set1_ps((float)lo)), _mm_cmpge_ps(lanes[h], _mm_set1_ps((float)hi)));
+        mask |= _mm_movemask_ps(_mm_or_ps(outside, _mm_cmplt_ps(_mm_loadu_ps(row + h * 4), _mm_set1_ps(depth)))) << (h * 4);
+    }
+    return mask == 0xFF;
+#elif defined(__ARM_NEON)
+    const float32x4_t lanes[2] = { { 0.0f, 1.0f, 2.0f, 3.0f }, { 4.0f, 5.0f, 6.0f, 7.0f } };
+    uint32x4_t hidden = vdupq_n_u32(0xFFFFFFFF);
+    for (int h = 0; h < 2; h++){
+        uint32x4_t outside = vorrq_u32(vcltq_f32(lanes[h], vdupq_n_f32((float)lo)), vcgeq_f32(lanes[h], vdupq_n_f32((float)hi)));
+        hidden = vandq_u32(hidden, vorrq_u32(outside, vcltq_f32(vld1q_f32(row + h * 4), vdupq_n_f32(depth))));
+    }
+    return vminvq_u32(hidden) != 0;
+#else
+    for (int l = lo; l < hi; l++){
+        if(!(row[l] < depth)){
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+inline float occlusionTileFarthest(const float* tile, uint32_t stride){
+#if defined(__AVX2__)
+    __m256 m = _mm256_loadu_ps(tile);
+    for (int y = 1; y < OcclusionTileSize; y++){
+        m = _mm256_max_ps(m, _mm256_loadu_ps(tile + y * stride));
+    }
+    __m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+    h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+    return _mm_cvtss_f32(h);
+#elif defined(OCCLUSION_SSE2)
+    __m128 m = _mm_max_ps(_mm_loadu_ps(tile), _mm_loadu_ps(tile + 4));
+    for (int y = 1; y < OcclusionTileSize; y++){
+        m = _mm_max_ps(m, _mm_max_ps(_mm_loadu_ps(tile + y * stride), _mm_loadu_ps(tile + y * stride + 4)));
+    }
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+#elif defined(__ARM_NEON)
+    float32x4_t m = vmaxq_f32(vld1q_f32(tile), vld1q_f32(tile + 4));
+    for (int y = 1; y < OcclusionTileSize; y++){
+        m = vmaxq_f32(m, vmaxq_f32(vld1q_f32(tile + y * stride), vld1q_f32(tile + y * stride + 4)));
+    }
+    return vmaxvq_f32(m);
+#else
+    float m = tile[0];
+    for (int y = 0; y < OcclusionTileSize; y++){
+        for (int x = 0; x < OcclusionTileSize; x++){
+            m = tile[y * stride + x] > m ? tile[y * stride + x] : m;
+        }
+    }
+    return m;
+#endif
+}
+
+// bufferWidth x bufferHeight pixels stand for the screenWidth x screenHeight
+// the bounds are given in. pool may be null to rasterize on the calling thread only.
+inline bool occlusionBufferInit(OcclusionBuffer* ob, float screenWidth, float screenHeight, uint32_t bufferWidth, uint32_t bufferHeight,
+                                uint32_t occluderCapacity, WorkerPool* pool){
+    ob->tilesX = (bufferWidth + OcclusionTileSize - 1) / OcclusionTileSize;
+    ob->tilesY = (bufferHeight + OcclusionTileSize - 1) / OcclusionTileSize;
+    ob->width = ob->tilesX * OcclusionTileSize;
+    ob->height = ob->tilesY * OcclusionTileSize;
+    ob->scaleX = bufferWidth / screenWidth;
+    ob->scaleY = bufferHeight / screenHeight;
+    ob->pool = pool;
+    int numThreads = workerPoolThreads(pool);
+    ob->numThreads = numThreads > OcclusionMaxThreads ? OcclusionMaxThreads : numThreads;
+    ob->numOccluders = 0;
+    ob->occluderCapacity = occluderCapacity;
+    ob->binCapacity = occluderCapacity;
+    ob->stats = {};
+    ob->depth = (float*)malloc((size_t)ob->width * ob->height * sizeof(float));
+    ob->tileMax = (float*)malloc((size_t)ob->tilesX * ob->tilesY * sizeof(float));
+    ob->occluders = (OcclusionRect*)malloc(occluderCapacity * sizeof(OcclusionRect));
+    ob->bins = (uint32_t*)malloc(ob->binCapacity * sizeof(uint32_t));
+    ob->binStart = (uint32_t*)malloc((ob->tilesY + 1) * sizeof(uint32_t));
+    if(!ob->depth || !ob->tileMax || !ob->occluders || !ob->bins || !ob->binStart){
+        return false;
+    }
+    for (size_t i = 0; i < (size_t)ob->width * ob->height; i++){
+        ob->depth[i] = OcclusionEmpty;
+    }
+    for (uint32_t i = 0; i < ob->tilesX * ob->tilesY; i++){
+        ob->tileMax[i] = OcclusionEmpty;
+    }
+    return true;
+}
+
+inline void occlusionBufferDestroy(OcclusionBuffer* ob){
+    free(ob->depth);
+    free(ob->tileMax);
+    free(ob->occluders);
+    free(ob->bins);
+    free(ob->binStart);
+    ob->depth = 0;
+    ob->tileMax = 0;
+    ob->occluders = 0;
+    ob->bins = 0;
+    ob->binStart = 0;
+    ob->numOccluders = 0;
+    ob->occluderCapacity = 0;
+}
+
+inline void occlusionBeginFrame(OcclusionBuffer* ob){
+    ob->numOccluders = 0;
+}
+
+// Bounds in screen pixels. Returns false when the frame's occluders are full;
+// the draw then just doesn't hide anything.
+inline bool occlusionAddOccluder(OcclusionBuffer* ob, float minX, float minY, float maxX, float maxY, float depth){
+    if(ob->numOccluders == ob->occluderCapacity){
+        return false;
+    }
+    OcclusionRect r = { minX * ob->scaleX, minY * ob->scaleY, maxX * ob->scaleX, maxY * ob->scaleY, depth };
+    ob->occluders[ob->numOccluders++] = r;
+    return true;
+}
+
+// Buffer pixels an occluder covers completely, as [x0, x1) x [y0, y1).
+inline bool occlusionInnerPixels(const OcclusionBuffer* ob, const OcclusionRect* r, int* x0, int* y0, int* x1, int* y1){
+    *x0 = r->minX <= 0.0f ? 0 : (int)ceilf(r->minX);
+    *y0 = r->minY <= 0.0f ? 0 : (int)ceilf(r->minY);
+    *x1 = r->maxX >= ob->width ? (int)ob->width : (r->maxX <= 0.0f ? 0 : (int)r->maxX);
+    *y1 = r->maxY >= ob->height ? (int)ob->height : (r->maxY <= 0.0f ? 0 : (int)r->maxY);
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+// Clears one row of tiles, fills in the occluders binned to it and updates its tile depths.
+inline void occlusionRasterizeRow(OcclusionBuffer* ob, uint32_t tileY){
+    float* rows = ob->depth + (size_t)tileY * OcclusionTileSize * ob->width;
+    for (size_t i = 0; i < (size_t)OcclusionTileSize * ob->width; i++){
+        rows[i] = OcclusionEmpty;
+    }
+    int rowTop = (int)tileY * OcclusionTileSize;
+    for (uint32_t k = ob->binStart[tileY]; k < ob->binStart[tileY + 1]; k++){
+        const OcclusionRect* r = &ob->occluders[ob->bins[k]];
+        int x0, y0, x1, y1;
+        occlusionInnerPixels(ob, r, &x0, &y0, &x1, &y1);
+        y0 = y0 > rowTop ? y0 : rowTop;
+        y1 = y1 < rowTop + OcclusionTileSize ? y1 : rowTop + OcclusionTileSize;
+        for (int tx = x0 / OcclusionTileSize; tx * OcclusionTileSize < x1; tx++){
+            int left = tx * OcclusionTileSize;
+            int lo = x0 > left ? x0 - left : 0;
+            int hi = x1 - left < OcclusionTileSize ? x1 - left : OcclusionTileSize;
+            occlusionFillRows(ob->depth + (size_t)y0 * ob->width + left, ob->width, y1 - y0, r->depth, lo, hi);
+        }
+    }
+    for (uint32_t tx = 0; tx < ob->tilesX; tx++){
+        ob->tileMax[tileY * ob->tilesX + tx] = occlusionTileFarthest(rows + tx * OcclusionTileSize, ob->width);
+    }
+}
+
+inline void occlusionRasterizeWorker(void* context, int thread, int numThreads){
+    OcclusionBuffer* ob = (OcclusionBuffer*)context;
+    for (;;){
+        uint32_t tileY = ob->nextRow.fetch_add(1, std::memory_order_relaxed);
+        if(tileY >= ob->tilesY){
+            return;
+        }
+        occlusionRasterizeRow(ob, tileY);
+    }
+}
+
+// Bins this frame's occluders and rasterizes them. Returns false if the bins
+// couldn't grow; the buffer is then left empty and hides nothing.
+inline bool occlusionRasterize(OcclusionBuffer* ob){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ob->stats.frames++;
+    ob->stats.occluders += ob->numOccluders;
+
+    // Count the occluders per row of tiles, turn the counts into bin starts
+    // and place every occluder in each row it overlaps.
+    memset(ob->binStart, 0, (ob->tilesY + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < ob->numOccluders; i++){
+        int x0, y0, x1, y1;
+        if(occlusionInnerPixels(ob, &ob->occluders[i], &x0, &y0, &x1, &y1)){
+            for (int ty = y0 / OcclusionTileSize; ty * OcclusionTileSize < y1; ty++){
+                ob->binStart[ty + 1]++;
+            }
+        }
+    }
+    for (uint32_t ty = 0; ty < ob->tilesY; ty++){
+        ob->binStart[ty + 1] += ob->binStart[ty];
+    }
+    uint32_t total = ob->binStart[ob->tilesY];
+    bool binned = true;
+    if(total > ob->binCapacity){
+        uint32_t* bins = (uint32_t*)realloc(ob->bins, total * sizeof(uint32_t));
+        if(!bins){
+            memset(ob->binStart, 0, (ob->tilesY + 1) * sizeof(uint32_t));
+            total = 0;
+            binned = false;
+        }else{
+            ob->bins = bins;
+            ob->binCapacity = total;
+        }
+    }
+    // binStart[ty] doubles as the write cursor and ends up one row ahead; shift back after.
+    for (uint32_t i = 0; i < ob->numOccluders && total > 0; i++){
+        int x0, y0, x1, y1;
+        if(occlusionInnerPixels(ob, &ob->occluders[i], &x0, &y0, &x1, &y1)){
+            for (int ty = y0 / OcclusionTileSize; ty * OcclusionTileSize < y1; ty++){
+                ob->bins[ob->binStart[ty]++] = i;
+            }
+        }
+    }
+    for (uint32_t ty = ob->tilesY; ty > 0; ty--){
+        ob->binStart[ty] = ob->binStart[ty - 1];
+    }
+    ob->binStart[0] = 0;
+
+    ob->nextRow.store(0, std::memory_order_relaxed);
+    int threads = ob->numOccluders >= OcclusionParallelMin ? ob->numThreads : 1;
+    workerPoolRun(ob->pool, threads, occlusionRasterizeWorker, ob);
+    ob->stats.rasterSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return binned;
+}
+
+// True if a draw with these screen bounds and depth shows anywhere.
+inline bool occlusionTest(const OcclusionBuffer* ob, float minX, float minY, float maxX, float maxY, float depth){
+    // Every buffer pixel the bounds touch.
+    float fx0 = minX * ob->scaleX, fy0 = minY * ob->scaleY;
+    float fx1 = maxX * ob->scaleX, fy1 = maxY * ob->scaleY;
+    int x0 = fx0 <= 0.0f ? 0 : (int)fx0;
+    int y0 = fy0 <= 0.0f ? 0 : (int)fy0;
+    int x1 = fx1 >= ob->width ? (int)ob->width : (fx1 <= 0.0f ? 0 : (int)ceilf(fx1));
+    int y1 = fy1 >= ob->height ? (int)ob->height : (fy1 <= 0.0f ? 0 : (int)ceilf(fy1));
+    if(x0 >= x1 || y0 >= y1){
+        // Off the buffer, leave it to viewport culling.
+        return true;
+    }
+    for (int ty = y0 / OcclusionTileSize; ty * OcclusionTileSize < y1; ty++){
+        int top = ty * OcclusionTileSize;
+        int rowLo = y0 > top ? y0 : top;
+        int rowHi = y1 < top + OcclusionTileSize ? y1 : top + OcclusionTileSize;
+        for (int tx = x0 / OcclusionTileSize; tx * OcclusionTileSize < x1; tx++){
+            if(ob->tileMax[ty * ob->tilesX + tx] < depth){
+                continue;
+            }
+            int left = tx * OcclusionTileSize;
+            int lo = x0 > left ? x0 - left : 0;
+            int hi = x1 - left < OcclusionTileSize ? x1 - left : OcclusionTileSize;
+            if(lo == 0 && hi == OcclusionTileSize && rowLo == top && rowHi == top + OcclusionTileSize){
+                // The farthest pixel of the tile is inside the bounds and not in front.
+                return true;
+            }
+            for (int y = rowLo; y < rowHi; y++){
+                if(!occlusionRowHides(ob->depth + (size_t)y * ob->width + left, depth, lo, hi)){
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Tests the count draws in ids, typically what the visibility grid returned,
+// and writes the ones that show to visible, which may be ids itself. Bounds
+// and depths are indexed by id. Returns how many were written.
+inline uint32_t occlusionCullBatch(OcclusionBuffer* ob, const uint32_t* ids, uint32_t count, const float* minX, const float* minY, const float* maxX, const float* maxY,
+                                   const float* depth, uint32_t* visible){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i++){
+        uint32_t id = ids[i];
+        if(ob->numOccluders == 0 || occlusionTest(ob, minX[id], minY[id], maxX[id], maxY[id], depth[id])){
+            visible[written++] = id;
+        }
+    }
+    ob->stats.tested += count;
+    ob->stats.culled += count - written;
+    ob->stats.testSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return written;
+}
+
+inline void occlusionPrintStats(const OcclusionBuffer* ob, FILE* out){
+    const OcclusionStats* s = &ob->stats;
+    double frames = s->frames ? (double)s->frames : 1.0;
+    fprintf(out, "occlusion: %llu frames, %.1f occluders/frame, %llu of %llu draws culled (%.1f%%), "
+                 "%.3f ms/frame rasterizing, %.3f ms/frame testing\n",
+            (unsigned long long)s->frames, s->occluders / frames, (unsigned long long)s->culled, (unsigned long long)s->tested,
+            s->tested ? 100.0 * s->culled / s->tested : 0.0, s->rasterSeconds * 1000.0 / frames, s->testSeconds * 1000.0 / frames);
+}
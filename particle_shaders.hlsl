@@ -0,0 +1,18 @@
+struct PSInput{
+    float4 position : SV_POSITION;
+    float4 color : COLOR;
+};
+
+// The triangle's vertices, scaled and moved to every particle instance.
+PSInput VSMain(float3 position : POSITION, float4 vertexColor : COLOR0, float2 center : CENTER, float size : SIZE, float4 color : COLOR1){
+    PSInput result;
+
+    result.position = float4(center + position.xy * size, 0.0, 1.0);
+    result.color = float4(lerp(color.rgb, vertexColor.rgb, 0.25), color.a);
+
+    return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET {
+    return input.color;
+}
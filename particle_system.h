@@ -0,0 +1,431 @@
+#pragma once
+
+// CPU particle system. Particle state is kept as structure of arrays with live
+// particles packed at the front, so integration runs 8 (AVX2) or 4 (NEON)
+// particles at a time. An update emits new particles, integrates gravity and
+// drag, ages everything and writes the survivors straight into the caller's
+// instance buffer, typically persistently mapped upload memory. The instance
+// buffer is only ever written front to back, which write combined memory needs.
+//
+// An update is two passes over slices of the particles, run on the threads of
+// a worker pool: the first counts what survives each slice, the second
+// integrates and compacts each slice into the other set of arrays and the
+// instance buffer, at offsets given by the counts of the slices before it.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "worker_pool.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+inline int particleBitScan(uint32_t mask){ unsigned long index; _BitScanForward(&index, mask); return (int)index; }
+#else
+inline int particleBitScan(uint32_t mask){ return __builtin_ctz(mask); }
+#endif
+
+inline uint32_t particlePopCount(uint32_t mask){
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static const int ParticleMaxThreads = 8;
+// Slices are multiples of this, so only the last one has a partial SIMD block.
+static const uint32_t ParticleSliceAlign = 8;
+
+// Per particle instance data: center in NDC, size in NDC and RGBA8 color,
+// alpha fading out over the particle's life.
+struct ParticleInstance {
+    float x;
+    float y;
+    float size;
+    uint32_t color;
+};
+
+struct ParticleEmitter {
+    float x;
+    float y;
+    // Particles per second.
+    float rate;
+    float speedMin;
+    float speedMax;
+    // Direction and full opening of the emission cone, in radians.
+    float angle;
+    float spread;
+    float lifeMin;
+    float lifeMax;
+    float size;
+    // RGB of new particles, alpha is replaced by the fade.
+    uint32_t color;
+};
+
+struct ParticleArrays {
+    float* posX;
+    float* posY;
+    float* velX;
+    float* velY;
+    float* age;
+    float* life;
+    float* size;
+    uint32_t* color;
+};
+
+struct ParticleStats {
+    uint64_t updates;
+    uint64_t particlesUpdated;
+    uint64_t emitted;
+    uint64_t expired;
+    // Emissions that didn't fit into the capacity.
+    uint64_t dropped;
+    double seconds;
+};
+
+struct ParticleSystem {
+    uint32_t capacity;
+    uint32_t count;
+    ParticleArrays arrays[2];
+    int current;
+
+    float gravityX;
+    float gravityY;
+    float drag;
+
+    float emitAccumulator;
+    uint32_t rng;
+    WorkerPool* pool;
+    int numThreads;
+    uint32_t sliceLive[ParticleMaxThreads];
+    // Arguments of the update the pool is running.
+    float sliceDt;
+    uint32_t sliceOffset[ParticleMaxThreads];
+    ParticleInstance* sliceOut;
+
+    ParticleStats stats;
+};
+
+inline bool particleArraysAlloc(ParticleArrays* a, uint32_t capacity){
+    float** floats[7] = { &a->posX, &a->posY, &a->velX, &a->velY, &a->age, &a->life, &a->size };
+    bool ok = true;
+    for(int i = 0; i < 7; i++){
+        *floats[i] = (float*)malloc(capacity * sizeof(float));
+        ok = ok && *floats[i];
+    }
+    a->color = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    return ok && a->color;
+}
+
+inline void particleArraysFree(ParticleArrays* a){
+    free(a->posX);
+    free(a->posY);
+    free(a->velX);
+    free(a->velY);
+    free(a->age);
+    free(a->life);
+    free(a->size);
+    free(a->color);
+}
+
+// pool may be null to update on the calling thread only.
+inline bool particleSystemInit(ParticleSystem* ps, uint32_t capacity, WorkerPool* pool){
+    ps->capacity = capacity;
+    ps->count = 0;
+    ps->current = 0;
+    ps->gravityX = 0.0f;
+    ps->gravityY = -0.5f;
+    ps->drag = 0.2f;
+    ps->emitAccumulator = 0.0f;
+    ps->rng = 0x9E3779B9;
+    ps->pool = pool;
+    int numThreads = workerPoolThreads(pool);
+    ps->numThreads = numThreads > ParticleMaxThreads ? ParticleMaxThreads : numThreads;
+    ps->stats = {};
+    bool ok = particleArraysAlloc(&ps->arrays[0], capacity);
+    return particleArraysAlloc(&ps->arrays[1], capacity) && ok;
+}
+
+inline void particleSystemDestroy(ParticleSystem* ps){
+    particleArraysFree(&ps->arrays[0]);
+    particleArraysFree(&ps->arrays[1]);
+}
+
+inline float particleRandom(ParticleSystem* ps, float lo, float hi){
+    ps->rng ^= ps->rng << 13;
+    ps->rng ^= ps->rng >> 17;
+    ps->rng ^= ps->rng << 5;
+    return lo + (hi - lo) * (ps->rng >> 8) * (1.0f / 16777216.0f);
+}
+
+// Appends the particles the emitter produced over dt behind the live ones.
+inline void particleEmit(ParticleSystem* ps, const ParticleEmitter* e, float dt){
+    ps->emitAccumulator += e->rate * dt;
+    uint32_t n = (uint32_t)ps->emitAccumulator;
+    ps->emitAccumulator -= (float)n;
+    if(n > ps->capacity - ps->count){
+        ps->stats.dropped += n - (ps->capacity - ps->count);
+        n = ps->capacity - ps->count;
+    }
+    ParticleArrays* a = &ps->arrays[ps->current];
+    for(uint32_t i = ps->count; i < ps->count + n; i++){
+        float angle = e->angle + particleRandom(ps, -0.5f, 0.5f) * e->spread;
+        float speed = particleRandom(ps, e->speedMin, e->speedMax);
+        a->posX[i] = e->x;
+        a->posY[i] = e->y;
+        a->velX[i] = cosf(angle) * speed;
+        a->velY[i] = sinf(angle) * speed;
+        a->age[i] = 0.0f;
+        a->life[i] = particleRandom(ps, e->lifeMin, e->lifeMax);
+        a->size[i] = e->size;
+        a->color[i] = e->color & 0xFFFFFF;
+    }
+    ps->count += n;
+    ps->stats.emitted += n;
+}
+
+inline void particleSliceRange(const ParticleSystem* ps, int slice, int slices, uint32_t* begin, uint32_t* end){
+    uint32_t blocks = (ps->count + ParticleSliceAlign - 1) / ParticleSliceAlign;
+    *begin = (uint32_t)((uint64_t)blocks * slice / slices) * ParticleSliceAlign;
+    *end = (uint32_t)((uint64_t)blocks * (slice + 1) / slices) * ParticleSliceAlign;
+    if(*begin > ps->count) *begin = ps->count;
+    if(*end > ps->count) *end = ps->count;
+}
+
+// Pass one: how many particles of the slice outlive this update. Must agree
+// exactly with the test in particleIntegrateSlice.
+inline void particleCountSlice(ParticleSystem* ps, int slice, int slices, float dt){
+    uint32_t begin, end;
+    particleSliceRange(ps, slice, slices, &begin, &end);
+    const ParticleArrays* a = &ps->arrays[ps->current];
+    uint32_t live = 0;
+    uint32_t i = begin;
+#if defined(__AVX2__)
+    const __m256 vdt = _mm256_set1_ps(dt);
+    for(; i + 8 <= end; i += 8){
+        __m256 alive = _mm256_cmp_ps(_mm256_add_ps(_mm256_loadu_ps(a->age + i), vdt), _mm256_loadu_ps(a->life + i), _CMP_LT_OQ);
+        live += particlePopCount((uint32_t)_mm256_movemask_ps(alive));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    for(; i + 4 <= end; i += 4){
+        uint32x4_t alive = vcltq_f32(vaddq_f32(vld1q_f32(a->age + i), vdt), vld1q_f32(a->life + i));
+        live += vaddvq_u32(vshrq_n_u32(alive, 31));
+    }
+#endif
+    for(; i < end; i++){
+        live += a->age[i] + dt < a->life[i];
+    }
+    ps->sliceLive[slice] = live;
+}
+
+inline void particleWriteOne(const ParticleArrays* dst, uint32_t o, ParticleInstance* out,
+                             float x, float y, float vx, float vy, float age, float life, float size, uint32_t color, uint32_t alpha){
+    dst->posX[o] = x;
+    dst->posY[o] = y;
+    dst->velX[o] = vx;
+    dst->velY[o] = vy;
+    dst->age[o] = age;
+    dst->life[o] = life;
+    dst->size[o] = size;
+    dst->color[o] = color;
+    out[o].x = x;
+    out[o].y = y;
+    out[o].size = size;
+    out[o].color = color | alpha << 24;
+}
+
+// Pass two: integrates the slice and writes its survivors, in order, to the
+// other arrays and the instances starting at offset.
+inline void particleIntegrateSlice(ParticleSystem* ps, int slice, int slices, float dt, uint32_t offset, ParticleInstance* out){
+    uint32_t begin, end;
+    particleSliceRange(ps, slice, slices, &begin, &end);
+    const ParticleArrays* src = &ps->arrays[ps->current];
+    const ParticleArrays* dst = &ps->arrays[ps->current ^ 1];
+    const float gx = ps->gravityX * dt;
+    const float gy = ps->gravityY * dt;
+    const float damping = 1.0f - ps->drag * dt;
+    uint32_t o = offset;
+    uint32_t i = begin;
+#if defined(__AVX2__)
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 vgx = _mm256_set1_ps(gx);
+    const __m256 vgy = _mm256_set1_ps(gy);
+    const __m256 vdamping = _mm256_set1_ps(damping);
+    const __m256 v255 = _mm256_set1_ps(255.0f);
+    for(; i + 8 <= end; i += 8){
+        __m256 vx = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src->velX + i), vdamping), vgx);
+        __m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src->velY + i), vdamping), vgy);
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(src->posX + i), _mm256_mul_ps(vx, vdt));
+        __m256 y = _mm256_add_ps(_mm256_loadu_ps(src->posY + i), _mm256_mul_ps(vy, vdt));
+        __m256 age = _mm256_add_ps(_mm256_loadu_ps(src->age + i), vdt);
+        __m256 life = _mm256_loadu_ps(src->life + i);
+        __m256 size = _mm256_loadu_ps(src->size + i);
+        __m256i color = _mm256_loadu_si256((const __m256i*)(src->color + i));
+        __m256i alpha = _mm256_cvttps_epi32(_mm256_sub_ps(v255, _mm256_mul_ps(_mm256_div_ps(age, life), v255)));
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(age, life, _CMP_LT_OQ));
+        if(mask == 0xFF){
+            // Whole block survives: contiguous stores, and a 4x4 transpose per
+            // 128 bit lane turns the arrays into eight instances.
+            _mm256_storeu_ps(dst->posX + o, x);
+            _mm256_storeu_ps(dst->posY + o, y);
+            _mm256_storeu_ps(dst->velX + o, vx);
+            _mm256_storeu_ps(dst->velY + o, vy);
+            _mm256_storeu_ps(dst->age + o, age);
+            _mm256_storeu_ps(dst->life + o, life);
+            _mm256_storeu_ps(dst->size + o, size);
+            _mm256_storeu_si256((__m256i*)(dst->color + o), color);
+            __m256 c = _mm256_castsi256_ps(_mm256_or_si256(color, _mm256_slli_epi32(alpha, 24)));
+            __m256 t0 = _mm256_unpacklo_ps(x, y);
+            __m256 t1 = _mm256_unpackhi_ps(x, y);
+            __m256 t2 = _mm256_unpacklo_ps(size, c);
+            __m256 t3 = _mm256_unpackhi_ps(size, c);
+            __m256 r0 = _mm256_shuffle_ps(t0, t2, 0x44);
+            __m256 r1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+            __m256 r2 = _mm256_shuffle_ps(t1, t3, 0x44);
+            __m256 r3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+            float* instances = (float*)(out + o);
+            _mm256_storeu_ps(instances, _mm256_permute2f128_ps(r0, r1, 0x20));
+            _mm256_storeu_ps(instances + 8, _mm256_permute2f128_ps(r2, r3, 0x20));
+            _mm256_storeu_ps(instances + 16, _mm256_permute2f128_ps(r0, r1, 0x31));
+            _mm256_storeu_ps(instances + 24, _mm256_permute2f128_ps(r2, r3, 0x31));
+            o += 8;
+            continue;
+        }
+        alignas(32) float lanes[7][8];
+        alignas(32) uint32_t lanesColor[8];
+        alignas(32) uint32_t lanesAlpha[8];
+        _mm256_store_ps(lanes[0], x);
+        _mm256_store_ps(lanes[1], y);
+        _mm256_store_ps(lanes[2], vx);
+        _mm256_store_ps(lanes[3], vy);
+        _mm256_store_ps(lanes[4], age);
+        _mm256_store_ps(lanes[5], life);
+        _mm256_store_ps(lanes[6], size);
+        _mm256_store_si256((__m256i*)lanesColor, color);
+        _mm256_store_si256((__m256i*)lanesAlpha, alpha);
+        while(mask){
+            int l = particleBitScan(mask);
+            particleWriteOne(dst, o++, out, lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l], lanes[4][l], lanes[5][l], lanes[6][l], lanesColor[l], lanesAlpha[l]);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    const float32x4_t vgx = vdupq_n_f32(gx);
+    const float32x4_t vgy = vdupq_n_f32(gy);
+    const float32x4_t vdamping = vdupq_n_f32(damping);
+    const float32x4_t v255 = vdupq_n_f32(255.0f);
+    for(; i + 4 <= end; i += 4){
+        float32x4_t vx = vaddq_f32(vmulq_f32(vld1q_f32(src->velX + i), vdamping), vgx);
+        float32x4_t vy = vaddq_f32(vmulq_f32(vld1q_f32(src->velY + i), vdamping), vgy);
+        float32x4_t x = vaddq_f32(vld1q_f32(src->posX + i), vmulq_f32(vx, vdt));
+        float32x4_t y = vaddq_f32(vld1q_f32(src->posY + i), vmulq_f32(vy, vdt));
+        float32x4_t age = vaddq_f32(vld1q_f32(src->age + i), vdt);
+        float32x4_t life = vld1q_f32(src->life + i);
+        float32x4_t size = vld1q_f32(src->size + i);
+        uint32x4_t color = vld1q_u32(src->color + i);
+        uint32x4_t alpha = vcvtq_u32_f32(vsubq_f32(v255, vmulq_f32(vdivq_f32(age, life), v255)));
+        uint32x4_t alive = vcltq_f32(age, life);
+        if(vminvq_u32(alive) != 0){
+            vst1q_f32(dst->posX + o, x);
+            vst1q_f32(dst->posY + o, y);
+            vst1q_f32(dst->velX + o, vx);
+            vst1q_f32(dst->velY + o, vy);
+            vst1q_f32(dst->age + o, age);
+            vst1q_f32(dst->life + o, life);
+            vst1q_f32(dst->size + o, size);
+            vst1q_u32(dst->color + o, color);
+            float32x4x4_t instances = { { x, y, size, vreinterpretq_f32_u32(vorrq_u32(color, vshlq_n_u32(alpha, 24))) } };
+            vst4q_f32((float*)(out + o), instances);
+            o += 4;
+            continue;
+        }
+        float lanes[7][4];
+        uint32_t lanesColor[4];
+        uint32_t lanesAlpha[4];
+        uint32_t lanesAlive[4];
+        vst1q_f32(lanes[0], x);
+        vst1q_f32(lanes[1], y);
+        vst1q_f32(lanes[2], vx);
+        vst1q_f32(lanes[3], vy);
+        vst1q_f32(lanes[4], age);
+        vst1q_f32(lanes[5], life);
+        vst1q_f32(lanes[6], size);
+        vst1q_u32(lanesColor, color);
+        vst1q_u32(lanesAlpha, alpha);
+        vst1q_u32(lanesAlive, alive);
+        for(int l = 0; l < 4; l++){
+            if(lanesAlive[l]){
+                particleWriteOne(dst, o++, out, lanes[0][l], lanes[1][l], lanes[2][l], lanes[3][l], lanes[4][l], lanes[5][l], lanes[6][l], lanesColor[l], lanesAlpha[l]);
+            }
+        }
+    }
+#endif
+    for(; i < end; i++){
+        float vx = src->velX[i] * damping + gx;
+        float vy = src->velY[i] * damping + gy;
+        float age = src->age[i] + dt;
+        float life = src->life[i];
+        if(age < life){
+            uint32_t alpha = (uint32_t)(255.0f - age / life * 255.0f);
+            particleWriteOne(dst, o++, out, src->posX[i] + vx * dt, src->posY[i] + vy * dt, vx, vy, age, life, src->size[i], src->color[i], alpha);
+        }
+    }
+}
+
+inline void particleCountWorker(void* context, int thread, int numThreads){
+    ParticleSystem* ps = (ParticleSystem*)context;
+    particleCountSlice(ps, thread, numThreads, ps->sliceDt);
+}
+
+inline void particleIntegrateWorker(void* context, int thread, int numThreads){
+    ParticleSystem* ps = (ParticleSystem*)context;
+    particleIntegrateSlice(ps, thread, numThreads, ps->sliceDt, ps->sliceOffset[thread], ps->sliceOut);
+}
+
+// Advances the simulation by dt and writes every live particle to out, which
+// needs room for capacity instances. Returns the number written.
+inline uint32_t particleSystemUpdate(ParticleSystem* ps, const ParticleEmitter* emitter, float dt, ParticleInstance* out){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    particleEmit(ps, emitter, dt);
+    uint32_t updated = ps->count;
+
+    // Small systems aren't worth waking threads for.
+    int slices = ps->count >= 64 * 1024 ? ps->numThreads : 1;
+    ps->sliceDt = dt;
+    ps->sliceOut = out;
+    workerPoolRun(ps->pool, slices, particleCountWorker, ps);
+
+    uint32_t live = 0;
+    for(int t = 0; t < slices; t++){
+        ps->sliceOffset[t] = live;
+        live += ps->sliceLive[t];
+    }
+    workerPoolRun(ps->pool, slices, particleIntegrateWorker, ps);
+
+    ps->current ^= 1;
+    ps->stats.expired += ps->count - live;
+    ps->count = live;
+    ps->stats.updates++;
+    ps->stats.particlesUpdated += updated;
+    ps->stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return live;
+}
+
+inline void particleSystemPrintStats(const ParticleSystem* ps, FILE* out){
+    const ParticleStats* s = &ps->stats;
+    double ms = s->seconds * 1000.0;
+    fprintf(out, "particles: %u live, %llu updates, %.0f particles/ms (%.3f ms/update), %llu emitted, %llu expired, %llu dropped\n",
+            ps->count, (unsigned long long)s->updates, ms > 0.0 ? s->particlesUpdated / ms : 0.0, s->updates ? ms / s->updates : 0.0,
+            (unsigned long long)s->emitted, (unsigned long long)s->expired, (unsigned long long)s->dropped);
+}
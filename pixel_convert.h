@@ -0,0 +1,526 @@
+#pragma once
+
+// Pixel format conversion for texture ingest: swizzle, RGB <-> RGBA expand and
+// pack, 16-bit and float to 8-bit unorm, unorm to float, sRGB encode/decode and
+// alpha premultiply. pixelConvert writes row by row straight into the
+// destination, so dst can be a mapped upload buffer with a
+// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT aligned pitch.
+// Row kernels have AVX2, SSE2/SSSE3 and NEON versions where they pay off and
+// finish the tail of every row in scalar code, which is also the fallback.
+// Defining PIXEL_NO_SIMD builds the scalar code only, to compare against.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if !defined(PIXEL_NO_SIMD)
+#if defined(__AVX2__)
+#define PIXEL_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(PIXEL_AVX2)
+#define PIXEL_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(PIXEL_AVX2)
+#define PIXEL_SSSE3 1
+#include <tmmintrin.h>
+#endif
+#if defined(PIXEL_AVX2)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#define PIXEL_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+enum PixelFormat {
+    PIXEL_FORMAT_RGBA8,
+    PIXEL_FORMAT_BGRA8,
+    PIXEL_FORMAT_RGB8,
+    PIXEL_FORMAT_RGBA16,
+    PIXEL_FORMAT_RGBA32F,
+};
+
+enum PixelConvertFlags {
+    // Multiply color by alpha on the way in (straight -> premultiplied).
+    PIXEL_CONVERT_PREMULTIPLY = 1,
+    // The 8-bit side is sRGB encoded: float and 16-bit -> 8-bit encode, 8-bit ->
+    // float decodes, and premultiplying happens on the decoded, linear color.
+    PIXEL_CONVERT_SRGB = 2,
+};
+
+inline uint32_t pixelFormatSize(PixelFormat format){
+    switch(format){
+        case PIXEL_FORMAT_RGB8: return 3;
+        case PIXEL_FORMAT_RGBA16: return 8;
+        case PIXEL_FORMAT_RGBA32F: return 16;
+        default: return 4;
+    }
+}
+
+// sRGB tables, built once on first use.
+struct PixelSrgbTables {
+    float toLinear[256];
+    // Smallest linear value encoding to code k, for k = 1..255.
+    float thresholds[256];
+    static float decode(float c){
+        return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    PixelSrgbTables(){
+        for(int k = 0; k < 256; k++){
+            toLinear[k] = decode(k / 255.0f);
+            thresholds[k] = k == 0 ? 0.0f : decode((k - 0.5f) / 255.0f);
+        }
+    }
+};
+
+inline const PixelSrgbTables* pixelSrgbTables(){
+    static const PixelSrgbTables tables;
+    return &tables;
+}
+
+inline uint8_t pixelLinearToSrgb8(float v, const PixelSrgbTables* tables){
+    // Binary search over the code boundaries, exact to the rounding of the curve.
+    int code = 0;
+    for(int step = 128; step > 0; step >>= 1){
+        if(v >= tables->thresholds[code + step]){
+            code += step;
+        }
+    }
+    return (uint8_t)code;
+}
+
+inline uint8_t pixelFloatToUnorm8(float v){
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t)lrintf(v * 255.0f);
+}
+
+// BGRA8 <-> RGBA8, in place allowed.
+inline void pixelSwizzleRB(const uint8_t* src, uint8_t* dst, uint32_t count){
+    uint32_t i = 0;
+#if defined(PIXEL_AVX2)
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for(; i + 8 <= count; i += 8){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(v, mask));
+    }
+#endif
+#if defined(PIXEL_SSE2)
+    const __m128i rbMask = _mm_set1_epi32(0x00FF00FF);
+    for(; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i rb = _mm_and_si128(v, rbMask);
+        __m128i ga = _mm_andnot_si128(rbMask, v);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(ga, rb));
+    }
+#elif defined(PIXEL_NEON)
+    for(; i + 16 <= count; i += 16){
+        uint8x16x4_t v = vld4q_u8(src + i * 4);
+        uint8x16_t r = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = r;
+        vst4q_u8(dst + i * 4, v);
+    }
+#endif
+    for(; i < count; i++){
+        uint8_t r = src[i * 4];
+        dst[i * 4] = src[i * 4 + 2];
+        dst[i * 4 + 1] = src[i * 4 + 1];
+        dst[i * 4 + 2] = r;
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+// RGB8 -> RGBA8 with opaque alpha.
+inline void pixelExpandRgb(const uint8_t* src, uint8_t* dst, uint32_t count){
+    uint32_t i = 0;
+#if defined(PIXEL_SSSE3)
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    // Each 16 byte load uses 12 bytes, so keep 2 pixels of slack at the row end.
+    for(; i + 6 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 3));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+    }
+#elif defined(PIXEL_NEON)
+    for(; i + 16 <= count; i += 16){
+        uint8x16x3_t v = vld3q_u8(src + i * 3);
+        uint8x16x4_t out;
+        out.val[0] = v.val[0];
+        out.val[1] = v.val[1];
+        out.val[2] = v.val[2];
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + i * 4, out);
+    }
+#endif
+    for(; i < count; i++){
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 255;
+    }
+}
+
+// RGBA8 -> RGB8, alpha dropped.
+inline void pixelPackRgb(const uint8_t* src, uint8_t* dst, uint32_t count){
+    uint32_t i = 0;
+#if defined(PIXEL_SSSE3)
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    // Each 16 byte store only advances 12 bytes, keep 2 pixels of slack.
+    for(; i + 6 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        _mm_storeu_si128((__m128i*)(dst + i * 3), _mm_shuffle_epi8(v, mask));
+    }
+#elif defined(PIXEL_NEON)
+    for(; i + 16 <= count; i += 16){
+        uint8x16x4_t v = vld4q_u8(src + i * 4);
+        uint8x16x3_t out;
+        out.val[0] = v.val[0];
+        out.val[1] = v.val[1];
+        out.val[2] = v.val[2];
+        vst3q_u8(dst + i * 3, out);
+    }
+#endif
+    for(; i < count; i++){
+        dst[i * 3] = src[i * 4];
+        dst[i * 3 + 1] = src[i * 4 + 1];
+        dst[i * 3 + 2] = src[i * 4 + 2];
+    }
+}
+
+// 16-bit unorm -> 8-bit unorm per channel, round(x * 255 / 65535) exactly.
+inline void pixelUnorm16To8(const uint16_t* src, uint8_t* dst, uint32_t channels){
+    uint32_t i = 0;
+#if defined(PIXEL_SSE2)
+    // (x * 255 + 32895) >> 16 from the 16-bit halves of the product: the high
+    // half plus the carry out of low half + 32895.
+    const __m128i k255 = _mm_set1_epi16(255);
+    const __m128i carryLimit = _mm_set1_epi16(32640);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= channels; i += 16){
+        __m128i result[2];
+        for(int h = 0; h < 2; h++){
+            __m128i x = _mm_loadu_si128((const __m128i*)(src + i + h * 8));
+            __m128i hi = _mm_mulhi_epu16(x, k255);
+            __m128i lo = _mm_mullo_epi16(x, k255);
+            __m128i noCarry = _mm_cmpeq_epi16(_mm_subs_epu16(lo, carryLimit), zero);
+            result[h] = _mm_add_epi16(_mm_add_epi16(hi, one), noCarry);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(result[0], result[1]));
+    }
+#elif defined(PIXEL_NEON)
+    const uint32x4_t bias = vdupq_n_u32(32895);
+    for(; i + 8 <= channels; i += 8){
+        uint16x8_t x = vld1q_u16(src + i);
+        uint16x4_t lo = vshrn_n_u32(vmlal_n_u16(bias, vget_low_u16(x), 255), 16);
+        uint16x4_t hi = vshrn_n_u32(vmlal_n_u16(bias, vget_high_u16(x), 255), 16);
+        vst1_u8(dst + i, vmovn_u16(vcombine_u16(lo, hi)));
+    }
+#endif
+    for(; i < channels; i++){
+        dst[i] = (uint8_t)(((uint32_t)src[i] * 255 + 32895) >> 16);
+    }
+}
+
+// Float -> 8-bit unorm per channel: clamp to 0..1, scale, round to nearest even.
+inline void pixelFloatToUnorm8Row(const float* src, uint8_t* dst, uint32_t channels){
+    uint32_t i = 0;
+#if defined(PIXEL_AVX2)
+    const __m256 zero8 = _mm256_setzero_ps();
+    const __m256 one8 = _mm256_set1_ps(1.0f);
+    const __m256 scale8 = _mm256_set1_ps(255.0f);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for(; i + 32 <= channels; i += 32){
+        __m256i v[4];
+        for(int k = 0; k < 4; k++){
+            __m256 f = _mm256_loadu_ps(src + i + k * 8);
+            f = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(f, zero8), one8), scale8);
+            v[k] = _mm256_cvtps_epi32(f);
+        }
+        // The packs work per 128-bit lane, the permute puts the dwords back in order.
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+#endif
+#if defined(PIXEL_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for(; i + 16 <= channels; i += 16){
+        __m128i v[4];
+        for(int k = 0; k < 4; k++){
+            __m128 f = _mm_loadu_ps(src + i + k * 4);
+            f = _mm_mul_ps(_mm_min_ps(_mm_max_ps(f, zero), one), scale);
+            v[k] = _mm_cvtps_epi32(f);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+#elif defined(PIXEL_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for(; i + 8 <= channels; i += 8){
+        uint32x4_t a = vcvtnq_u32_f32(vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i), zero), one), 255.0f));
+        uint32x4_t b = vcvtnq_u32_f32(vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), zero), one), 255.0f));
+        vst1_u8(dst + i, vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))));
+    }
+#endif
+    for(; i < channels; i++){
+        dst[i] = pixelFloatToUnorm8(src[i]);
+    }
+}
+
+// 8-bit unorm -> float per channel.
+inline void pixelUnorm8ToFloatRow(const uint8_t* src, float* dst, uint32_t channels){
+    uint32_t i = 0;
+#if defined(PIXEL_SSE2)
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= channels; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+#elif defined(PIXEL_NEON)
+    for(; i + 8 <= channels; i += 8){
+        uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), 1.0f / 255.0f));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), 1.0f / 255.0f));
+    }
+#endif
+    for(; i < channels; i++){
+        dst[i] = src[i] * (1.0f / 255.0f);
+    }
+}
+
+// Straight -> premultiplied alpha on RGBA8, in place allowed. Exact
+// round(c * a / 255), alpha itself untouched.
+inline void pixelPremultiply(const uint8_t* src, uint8_t* dst, uint32_t count){
+    uint32_t i = 0;
+#if defined(PIXEL_AVX2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i keepRgb = _mm256_set1_epi64x(0x0000FFFFFFFFFFFFll);
+        const __m256i alphaOne = _mm256_set1_epi64x(0x00FF000000000000ll);
+        const __m256i half = _mm256_set1_epi16(128);
+        for(; i + 8 <= count; i += 8){
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+            __m256i halves[2] = { _mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero) };
+            for(int h = 0; h < 2; h++){
+                __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+                a = _mm256_or_si256(_mm256_and_si256(a, keepRgb), alphaOne);
+                __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(halves[h], a), half);
+                halves[h] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+            }
+            _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_packus_epi16(halves[0], halves[1]));
+        }
+    }
+#endif
+#if defined(PIXEL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keepRgb = _mm_set1_epi64x(0x0000FFFFFFFFFFFFll);
+    const __m128i alphaOne = _mm_set1_epi64x(0x00FF000000000000ll);
+    const __m128i half = _mm_set1_epi16(128);
+    for(; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+        for(int h = 0; h < 2; h++){
+            // Alpha broadcast to its pixel's four channels, 255 in the alpha slot.
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+            a = _mm_or_si128(_mm_and_si128(a, keepRgb), alphaOne);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h], a), half);
+            halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#elif defined(PIXEL_NEON)
+    for(; i + 16 <= count; i += 16){
+        uint8x16x4_t v = vld4q_u8(src + i * 4);
+        for(int c = 0; c < 3; c++){
+            uint16x8_t lo = vmull_u8(vget_low_u8(v.val[c]), vget_low_u8(v.val[3]));
+            uint16x8_t hi = vmull_u8(vget_high_u8(v.val[c]), vget_high_u8(v.val[3]));
+            v.val[c] = vcombine_u8(vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8), vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8));
+        }
+        vst4q_u8(dst + i * 4, v);
+    }
+#endif
+    for(; i < count; i++){
+        uint32_t a = src[i * 4 + 3];
+        for(int c = 0; c < 3; c++){
+            uint32_t t = src[i * 4 + c] * a + 128;
+            dst[i * 4 + c] = (uint8_t)((t + (t >> 8)) >> 8);
+        }
+        dst[i * 4 + 3] = (uint8_t)a;
+    }
+}
+
+// Straight -> premultiplied alpha on sRGB encoded RGBA8, in place allowed. The
+// color is decoded, multiplied in linear space and encoded again.
+inline void pixelPremultiplySrgb(const uint8_t* src, uint8_t* dst, uint32_t count, const PixelSrgbTables* tables){
+    for(uint32_t i = 0; i < count; i++){
+        float a = src[i * 4 + 3] * (1.0f / 255.0f);
+        for(int c = 0; c < 3; c++){
+            dst[i * 4 + c] = pixelLinearToSrgb8(tables->toLinear[src[i * 4 + c]] * a, tables);
+        }
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+// RGBA32F -> RGBA8 with linear alpha. Premultiplying happens on the linear
+// floats, before the color is encoded, the same as for float destinations.
+inline void pixelFloatRgbaTo8(const float* src, uint8_t* dst, uint32_t count, const PixelSrgbTables* srgb, bool premultiply){
+    if(!srgb && !premultiply){
+        pixelFloatToUnorm8Row(src, dst, count * 4);
+        return;
+    }
+    static const uint32_t Chunk = 64;
+    float scratch[Chunk * 4];
+    for(uint32_t start = 0; start < count; start += Chunk){
+        uint32_t n = count - start < Chunk ? count - start : Chunk;
+        const float* f = src + start * 4;
+        uint8_t* d = dst + start * 4;
+        if(premultiply){
+            for(uint32_t x = 0; x < n; x++){
+                float a = f[x * 4 + 3];
+                a = a < 0.0f ? 0.0f : (a > 1.0f ? 1.0f : a);
+                for(int c = 0; c < 3; c++){
+                    scratch[x * 4 + c] = f[x * 4 + c] * a;
+                }
+                scratch[x * 4 + 3] = f[x * 4 + 3];
+            }
+            f = scratch;
+        }
+        if(srgb){
+            for(uint32_t x = 0; x < n; x++){
+                for(int c = 0; c < 3; c++){
+                    d[x * 4 + c] = pixelLinearToSrgb8(f[x * 4 + c], srgb);
+                }
+                d[x * 4 + 3] = pixelFloatToUnorm8(f[x * 4 + 3]);
+            }
+        }else{
+            pixelFloatToUnorm8Row(f, d, n * 4);
+        }
+    }
+}
+
+// RGBA16 -> RGBA8 through linear floats, for sRGB encoding. Premultiplying
+// happens before the color is encoded, the same as for float sources.
+inline void pixelUnorm16RgbaTo8(const uint16_t* src, uint8_t* dst, uint32_t count, const PixelSrgbTables* srgb, bool premultiply){
+    static const uint32_t Chunk = 64;
+    float scratch[Chunk * 4];
+    for(uint32_t start = 0; start < count; start += Chunk){
+        uint32_t n = count - start < Chunk ? count - start : Chunk;
+        for(uint32_t i = 0; i < n * 4; i++){
+            scratch[i] = src[start * 4 + i] * (1.0f / 65535.0f);
+        }
+        pixelFloatRgbaTo8(scratch, dst + start * 4, n, srgb, premultiply);
+    }
+}
+
+// Converts width x height pixels between formats. Supported: every format to
+// RGBA8 or BGRA8, RGBA8 to RGB8 without flags, and RGBA8/BGRA8 to RGBA32F.
+// Returns false for other pairs. Pitches are in bytes; src and dst must not overlap.
+inline bool pixelConvert(PixelFormat srcFormat, const void* src, size_t srcPitch, PixelFormat dstFormat, void* dst, size_t dstPitch,
+                         uint32_t width, uint32_t height, uint32_t flags){
+    bool srgb = (flags & PIXEL_CONVERT_SRGB) != 0;
+    bool premultiply = (flags & PIXEL_CONVERT_PREMULTIPLY) != 0;
+    bool to8 = dstFormat == PIXEL_FORMAT_RGBA8 || dstFormat == PIXEL_FORMAT_BGRA8;
+    // Dropping alpha leaves nothing to premultiply against or decode for.
+    bool toRgb = dstFormat == PIXEL_FORMAT_RGB8 && srcFormat == PIXEL_FORMAT_RGBA8 && flags == 0;
+    bool toFloat = dstFormat == PIXEL_FORMAT_RGBA32F && (srcFormat == PIXEL_FORMAT_RGBA8 || srcFormat == PIXEL_FORMAT_BGRA8);
+    if(!to8 && !toRgb && !toFloat){
+        return false;
+    }
+    const PixelSrgbTables* tables = srgb ? pixelSrgbTables() : 0;
+
+    for(uint32_t y = 0; y < height; y++){
+        const uint8_t* s = (const uint8_t*)src + y * srcPitch;
+        uint8_t* d = (uint8_t*)dst + y * dstPitch;
+
+        if(toRgb){
+            pixelPackRgb(s, d, width);
+            continue;
+        }
+
+        if(toFloat){
+            float* f = (float*)d;
+            if(srgb){
+                for(uint32_t x = 0; x < width; x++){
+                    for(int c = 0; c < 3; c++){
+                        f[x * 4 + c] = tables->toLinear[s[x * 4 + c]];
+                    }
+                    f[x * 4 + 3] = s[x * 4 + 3] * (1.0f / 255.0f);
+                }
+            }else{
+                pixelUnorm8ToFloatRow(s, f, width * 4);
+            }
+            if(srcFormat == PIXEL_FORMAT_BGRA8){
+                for(uint32_t x = 0; x < width; x++){
+                    float r = f[x * 4 + 2];
+                    f[x * 4 + 2] = f[x * 4];
+                    f[x * 4] = r;
+                }
+            }
+            if(premultiply){
+                for(uint32_t x = 0; x < width; x++){
+                    for(int c = 0; c < 3; c++){
+                        f[x * 4 + c] *= f[x * 4 + 3];
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Everything else lands in dst as RGBA8 first and is fixed up in place.
+        bool swapped = false;
+        bool premultiplied = false;
+        switch(srcFormat){
+            case PIXEL_FORMAT_RGBA8:
+                memcpy(d, s, width * 4);
+                break;
+            case PIXEL_FORMAT_BGRA8:
+                if(dstFormat == PIXEL_FORMAT_BGRA8){
+                    memcpy(d, s, width * 4);
+                    swapped = true;
+                }else{
+                    pixelSwizzleRB(s, d, width);
+                }
+                break;
+            case PIXEL_FORMAT_RGB8:
+                pixelExpandRgb(s, d, width);
+                break;
+            case PIXEL_FORMAT_RGBA16:
+                if(srgb){
+                    pixelUnorm16RgbaTo8((const uint16_t*)s, d, width, tables, premultiply);
+                    premultiplied = true;
+                }else{
+                    pixelUnorm16To8((const uint16_t*)s, d, width * 4);
+                }
+                break;
+            case PIXEL_FORMAT_RGBA32F:
+                pixelFloatRgbaTo8((const float*)s, d, width, tables, premultiply);
+                premultiplied = true;
+                break;
+        }
+        if(premultiply && !premultiplied){
+            if(srgb){
+                pixelPremultiplySrgb(d, d, width, tables);
+            }else{
+                pixelPremultiply(d, d, width);
+            }
+        }
+        if(dstFormat == PIXEL_FORMAT_BGRA8 && !swapped){
+            pixelSwizzleRB(d, d, width);
+        }
+    }
+    return true;
+}
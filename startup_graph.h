@@ -0,0 +1,355 @@
+#pragma once
+
+// Startup as a dependency graph. Initialization steps (device creation,
+// shader compiles, root signature serialization, asset decoding, uploads)
+// are added with the steps they need to run after, and startupGraphRun runs
+// every step whose dependencies are done on whichever thread is free, so
+// independent work overlaps instead of queueing up behind the slowest call.
+// Steps that have to stay on the calling thread, such as anything that sends
+// messages to a window that thread owns, can be pinned to it.
+//
+// Ready steps are taken in order of how long a chain of steps still hangs
+// off them, so the chain that decides when startup finishes gets going
+// first. Every step is timed; startupGraphPrintReport lists them and the
+// critical path, the chain of dependent steps whose durations add up to the
+// most, which is as fast as startup can get with any number of threads.
+//
+// A failing step returns false after recording why with startupGraphSetError.
+// Steps run on worker threads, so they don't show errors or exit themselves;
+// the caller reports the first failure once startupGraphRun has returned.
+//
+// Nothing here knows about D3D12, steps are plain callbacks, so the graph
+// runs with stubbed steps anywhere to try out orderings and thread counts.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const int StartupGraphMaxSteps = 64;
+static const int StartupGraphMaxDeps = 8;
+static const int StartupGraphMaxThreads = 16;
+static const int StartupGraphMaxError = 256;
+
+// Returns false if the step failed; steps that depend on it are skipped.
+typedef bool (*StartupStepFn)(void* context);
+
+enum StartupStepState {
+    STARTUP_STEP_WAITING,
+    STARTUP_STEP_READY,
+    STARTUP_STEP_RUNNING,
+    STARTUP_STEP_DONE,
+    STARTUP_STEP_FAILED,
+    STARTUP_STEP_SKIPPED,
+};
+
+struct StartupStep {
+    const char* name;
+    StartupStepFn fn;
+    void* context;
+    int deps[StartupGraphMaxDeps];
+    int numDeps;
+    bool pinned;
+
+    // Filled in by startupGraphRun.
+    StartupStepState state;
+    int depsLeft;
+    // Steps in the longest chain starting here, this one included.
+    int height;
+    int thread;
+    // Seconds since the run started.
+    double start;
+    double end;
+    // Why the step failed, empty if it didn't say.
+    char error[StartupGraphMaxError];
+};
+
+struct StartupGraph {
+    StartupStep steps[StartupGraphMaxSteps];
+    int numSteps;
+    int numThreads;
+    double wallSeconds;
+    // The step that failed first, or -1.
+    int firstFailed;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    int finished;
+    int pinnedLeft;
+    std::chrono::steady_clock::time_point began;
+    // Which thread is which, for startupGraphSetError to find the step calling it.
+    std::thread::id threadIds[StartupGraphMaxThreads];
+};
+
+inline void startupGraphInit(StartupGraph* g){
+    g->numSteps = 0;
+    g->numThreads = 0;
+    g->wallSeconds = 0.0;
+    g->firstFailed = -1;
+}
+
+// Returns the step's id, or -1 if the graph is full.
+inline int startupGraphAdd(StartupGraph* g, const char* name, StartupStepFn fn, void* context){
+    if(g->numSteps == StartupGraphMaxSteps){
+        return -1;
+    }
+    StartupStep* s = &g->steps[g->numSteps];
+    s->name = name;
+    s->fn = fn;
+    s->context = context;
+    s->numDeps = 0;
+    s->pinned = false;
+    s->error[0] = 0;
+    return g->numSteps++;
+}
+
+// step runs only after dependency has finished.
+inline bool startupGraphDepend(StartupGraph* g, int step, int dependency){
+    if(step < 0 || dependency < 0 || g->steps[step].numDeps == StartupGraphMaxDeps){
+        return false;
+    }
+    StartupStep* s = &g->steps[step];
+    s->deps[s->numDeps++] = dependency;
+    return true;
+}
+
+// Runs step on the thread that calls startupGraphRun.
+inline void startupGraphPin(StartupGraph* g, int step){
+    g->steps[step].pinned = true;
+}
+
+// Records why the step running on the calling thread is about to fail. Only
+// the first message a step records is kept, the rest usually follow from it.
+inline void startupGraphSetError(StartupGraph* g, const char* message){
+    std::lock_guard<std::mutex> lock(g->mutex);
+    std::thread::id self = std::this_thread::get_id();
+    for (int i = 0; i < g->numSteps; i++){
+        StartupStep* s = &g->steps[i];
+        if(s->state == STARTUP_STEP_RUNNING && g->threadIds[s->thread] == self && s->error[0] == 0){
+            snprintf(s->error, sizeof(s->error), "%s", message);
+        }
+    }
+}
+
+inline double startupGraphNow(const StartupGraph* g){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - g->began).count();
+}
+
+// Next ready step this thread may take, tallest chain first, or -1. While
+// pinned steps are left the calling thread keeps itself free for them, so
+// they don't queue behind a long step it picked up in the meantime.
+inline int startupGraphPick(StartupGraph* g, bool caller){
+    bool pinnedOnly = caller && g->pinnedLeft > 0 && g->numThreads > 1;
+    int best = -1;
+    for (int i = 0; i < g->numSteps; i++){
+        StartupStep* s = &g->steps[i];
+        bool allowed = caller ? s->pinned || !pinnedOnly : !s->pinned;
+        if(s->state == STARTUP_STEP_READY && allowed && (best < 0 || s->height > g->steps[best].height)){
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Marks step finished and releases the steps waiting on it. Called with the lock held.
+inline void startupGraphFinish(StartupGraph* g, int step, StartupStepState state){
+    g->steps[step].state = state;
+    g->finished++;
+    g->pinnedLeft -= g->steps[step].pinned ? 1 : 0;
+    for (int i = 0; i < g->numSteps; i++){
+        StartupStep* s = &g->steps[i];
+        for (int d = 0; d < s->numDeps; d++){
+            if(s->deps[d] != step){
+                continue;
+            }
+            if(state != STARTUP_STEP_DONE && s->state == STARTUP_STEP_WAITING){
+                s->state = STARTUP_STEP_SKIPPED;
+                s->start = s->end = startupGraphNow(g);
+                startupGraphFinish(g, i, STARTUP_STEP_SKIPPED);
+            }else if(--s->depsLeft == 0 && s->state == STARTUP_STEP_WAITING){
+                s->state = STARTUP_STEP_READY;
+            }
+        }
+    }
+}
+
+inline void startupGraphWorker(StartupGraph* g, int thread){
+    std::unique_lock<std::mutex> lock(g->mutex);
+    g->threadIds[thread] = std::this_thread::get_id();
+    for (;;){
+        int step;
+        while((step = startupGraphPick(g, thread == 0)) < 0 && g->finished < g->numSteps){
+            g->changed.wait(lock);
+        }
+        if(step < 0){
+            return;
+        }
+        StartupStep* s = &g->steps[step];
+        s->state = STARTUP_STEP_RUNNING;
+        s->thread = thread;
+        s->start = startupGraphNow(g);
+        lock.unlock();
+        bool ok = s->fn(s->context);
+        lock.lock();
+        s->end = startupGraphNow(g);
+        if(!ok && g->firstFailed < 0){
+            g->firstFailed = step;
+        }
+        startupGraphFinish(g, step, ok ? STARTUP_STEP_DONE : STARTUP_STEP_FAILED);
+        g->changed.notify_all();
+    }
+}
+
+// Runs every step on numThreads threads, the calling thread being one of
+// them; 1 runs them one after another in dependency order. Returns false if
+// a step failed or was skipped, firstFailed telling which failed first, or
+// if the dependencies have a cycle, in which case nothing runs and
+// firstFailed stays -1.
+inline bool startupGraphRun(StartupGraph* g, int numThreads){
+    numThreads = numThreads < 1 ? 1 : (numThreads > StartupGraphMaxThreads ? StartupGraphMaxThreads : numThreads);
+    g->numThreads = numThreads;
+    g->firstFailed = -1;
+
+    // Heights in reverse topological order; a round without progress means a cycle.
+    for (int i = 0; i < g->numSteps; i++){
+        g->steps[i].height = 0;
+    }
+    int resolved = 0;
+    while(resolved < g->numSteps){
+        int progress = 0;
+        for (int i = 0; i < g->numSteps; i++){
+            StartupStep* s = &g->steps[i];
+            if(s->height > 0){
+                continue;
+            }
+            // Height is known once every step depending on this one has its own.
+            int height = 1;
+            bool known = true;
+            for (int j = 0; j < g->numSteps && known; j++){
+                for (int d = 0; d < g->steps[j].numDeps; d++){
+                    if(g->steps[j].deps[d] == i){
+                        known = g->steps[j].height > 0;
+                        height = known && g->steps[j].height + 1 > height ? g->steps[j].height + 1 : height;
+                    }
+                }
+            }
+            if(known){
+                s->height = height;
+                progress++;
+            }
+        }
+        if(progress == 0){
+            return false;
+        }
+        resolved += progress;
+    }
+
+    for (int i = 0; i < g->numSteps; i++){
+        StartupStep* s = &g->steps[i];
+        s->depsLeft = s->numDeps;
+        s->state = s->numDeps == 0 ? STARTUP_STEP_READY : STARTUP_STEP_WAITING;
+        s->thread = -1;
+        s->start = 0.0;
+        s->end = 0.0;
+        s->error[0] = 0;
+    }
+    g->finished = 0;
+    g->pinnedLeft = 0;
+    for (int i = 0; i < g->numSteps; i++){
+        g->pinnedLeft += g->steps[i].pinned ? 1 : 0;
+    }
+    g->began = std::chrono::steady_clock::now();
+
+    std::thread workers[StartupGraphMaxThreads];
+    for (int t = 1; t < numThreads; t++){
+        workers[t] = std::thread(startupGraphWorker, g, t);
+    }
+    startupGraphWorker(g, 0);
+    for (int t = 1; t < numThreads; t++){
+        workers[t].join();
+    }
+    g->wallSeconds = startupGraphNow(g);
+
+    for (int i = 0; i < g->numSteps; i++){
+        if(g->steps[i].state != STARTUP_STEP_DONE){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes the steps of the critical path to path, first step first, and
+// returns how many there are; *seconds gets the sum of their durations.
+inline int startupGraphCriticalPath(const StartupGraph* g, int* path, double* seconds){
+    // Longest chain of durations ending at each step, and the dependency it came through.
+    double chain[StartupGraphMaxSteps];
+    int from[StartupGraphMaxSteps];
+    bool known[StartupGraphMaxSteps] = {};
+    int last = -1;
+    for (int resolved = 0; resolved < g->numSteps;){
+        int progress = 0;
+        for (int i = 0; i < g->numSteps; i++){
+            const StartupStep* s = &g->steps[i];
+            bool ready = !known[i];
+            double longest = 0.0;
+            int through = -1;
+            for (int d = 0; d < s->numDeps && ready; d++){
+                ready = known[s->deps[d]];
+                if(ready && chain[s->deps[d]] >= longest){
+                    longest = chain[s->deps[d]];
+                    through = s->deps[d];
+                }
+            }
+            if(ready){
+                chain[i] = longest + (s->end - s->start);
+                from[i] = through;
+                known[i] = true;
+                last = last < 0 || chain[i] > chain[last] ? i : last;
+                progress++;
+            }
+        }
+        if(progress == 0){
+            break;
+        }
+        resolved += progress;
+    }
+    int count = 0;
+    for (int i = last; i >= 0; i = from[i]){
+        path[count++] = i;
+    }
+    for (int i = 0; i < count / 2; i++){
+        int t = path[i];
+        path[i] = path[count - 1 - i];
+        path[count - 1 - i] = t;
+    }
+    *seconds = last >= 0 ? chain[last] : 0.0;
+    return count;
+}
+
+inline void startupGraphPrintReport(const StartupGraph* g, FILE* out){
+    static const char* stateNames[] = { "waiting", "ready", "running", "done", "failed", "skipped" };
+    double work = 0.0;
+    for (int i = 0; i < g->numSteps; i++){
+        work += g->steps[i].end - g->steps[i].start;
+    }
+    int path[StartupGraphMaxSteps];
+    double critical;
+    int length = startupGraphCriticalPath(g, path, &critical);
+    fprintf(out, "startup: %d steps on %d threads, %.2f ms wall, %.2f ms of work (%.2fx), critical path %.2f ms\n",
+            g->numSteps, g->numThreads, g->wallSeconds * 1000.0, work * 1000.0, g->wallSeconds > 0.0 ? work / g->wallSeconds : 0.0,
+            critical * 1000.0);
+    fprintf(out, "  critical path:");
+    for (int i = 0; i < length; i++){
+        const StartupStep* s = &g->steps[path[i]];
+        fprintf(out, "%s %s (%.2f ms)", i ? " ->" : "", s->name, (s->end - s->start) * 1000.0);
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i < g->numSteps; i++){
+        const StartupStep* s = &g->steps[i];
+        fprintf(out, "  %-28s thread %2d  %8.2f .. %8.2f ms  %8.2f ms  %s%s%s\n", s->name, s->thread, s->start * 1000.0, s->end * 1000.0,
+                (s->end - s->start) * 1000.0, stateNames[s->state], s->error[0] ? ": " : "", s->error);
+    }
+}
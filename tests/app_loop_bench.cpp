@@ -0,0 +1,96 @@
+// Tick jitter and snapshot handoff latency of app_loop.h, headless, for the
+// pacings the demos use: a 60 Hz tick with the render callback blocking like
+// a vsynced Present, and loops paced by frameSeconds with faster ticks or a
+// simulation that takes most of its tick. Each runs for 3 seconds with a 1 KB
+// snapshot and an input event every few milliseconds.
+
+#include "app_loop.h"
+
+#include <stdio.h>
+
+static const int Seconds = 3;
+
+struct BenchState {
+    uint64_t tick;
+    uint8_t payload[1016];
+};
+
+struct BenchUser {
+    uint64_t tick;
+    // Busy time per tick and per frame, nanoseconds.
+    int64_t simulateNs;
+    int64_t renderNs;
+    // Render callback waits for the next multiple of this, like vsync; 0 for none.
+    int64_t vsyncNs;
+    std::chrono::steady_clock::time_point start;
+};
+
+static int64_t sinceStart(const BenchUser* u){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - u->start).count();
+}
+
+static void busy(const BenchUser* u, int64_t ns){
+    int64_t until = sinceStart(u) + ns;
+    while(sinceStart(u) < until){
+    }
+}
+
+static void simulate(void* user, const AppInputEvent* events, int numEvents, double dt, void* snapshot){
+    BenchUser* u = (BenchUser*)user;
+    busy(u, u->simulateNs);
+    BenchState* s = (BenchState*)snapshot;
+    s->tick = ++u->tick;
+    memset(s->payload, (int)s->tick, sizeof(s->payload));
+}
+
+static void render(void* user, const void* previous, const void* current, float alpha){
+    BenchUser* u = (BenchUser*)user;
+    busy(u, u->renderNs);
+    if(u->vsyncNs > 0){
+        int64_t now = sinceStart(u);
+        int64_t next = (now / u->vsyncNs + 1) * u->vsyncNs;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+    }
+}
+
+static void run(const char* name, double tickHz, double frameHz, double vsyncHz, int64_t simulateNs, int64_t renderNs){
+    static AppLoop loop;
+    BenchUser user = {};
+    user.simulateNs = simulateNs;
+    user.renderNs = renderNs;
+    user.vsyncNs = vsyncHz > 0.0 ? (int64_t)(1e9 / vsyncHz) : 0;
+    user.start = std::chrono::steady_clock::now();
+    AppLoopDesc desc = {};
+    desc.tickSeconds = 1.0 / tickHz;
+    desc.snapshotSize = sizeof(BenchState);
+    desc.simulate = simulate;
+    desc.render = render;
+    desc.user = &user;
+    desc.frameSeconds = frameHz > 0.0 ? 1.0 / frameHz : 0.0;
+    desc.maxCatchUpTicks = 5;
+    if(!appLoopStart(&loop, &desc)){
+        return;
+    }
+    for(int i = 0; i < Seconds * 200; i++){
+        AppInputEvent event = { APP_INPUT_MOUSE_MOVE, 0, i, i };
+        appLoopPushInput(&loop, &event);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    appLoopStop(&loop);
+    const AppLoopStats* s = &loop.stats;
+    printf("  %-34s %5llu ticks (%llu dropped), jitter avg %6.3f max %6.3f ms, %5llu frames, "
+           "handoff avg %6.3f max %6.3f ms, %4llu skipped\n",
+           name, (unsigned long long)s->ticks, (unsigned long long)s->ticksDropped, s->ticks ? s->jitterSumNs / 1e6 / s->ticks : 0.0,
+           s->jitterMaxNs / 1e6, (unsigned long long)s->frames, s->snapshotsPickedUp ? s->latencySumNs / 1e6 / s->snapshotsPickedUp : 0.0,
+           s->latencyMaxNs / 1e6, (unsigned long long)s->snapshotsSkipped);
+}
+
+int main(){
+    printf("app_loop_bench: %d s per row, %u thread(s) of hardware\n", Seconds, std::thread::hardware_concurrency());
+    run("60 Hz tick, vsync 60 Hz", 60.0, 0.0, 60.0, 0, 1000000);
+    run("60 Hz tick, vsync 144 Hz", 60.0, 0.0, 144.0, 0, 1000000);
+    run("120 Hz tick, paced 240 Hz", 120.0, 240.0, 0.0, 0, 500000);
+    run("60 Hz tick of 12 ms, vsync 60 Hz", 60.0, 0.0, 60.0, 12000000, 1000000);
+    run("240 Hz tick, paced 60 Hz", 240.0, 60.0, 0.0, 200000, 4000000);
+    return 0;
+}
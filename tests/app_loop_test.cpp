@@ -0,0 +1,122 @@
+// app_loop.h run headless: snapshots are never torn, the interpolated state
+// the renderer sees never goes backwards, every input event reaches a tick,
+// and a simulation stall drops its backlog instead of running it in a burst.
+
+#include "app_loop.h"
+
+#include "check.h"
+
+struct TestState {
+    uint64_t tick;
+    uint64_t keys;
+    // Every word holds tick, a torn read shows up as a mismatch.
+    uint64_t fill[62];
+};
+
+struct TestUser {
+    uint64_t tick;
+    uint64_t keys;
+    // Ticks to sleep through at stallTick, 0 for none.
+    uint64_t stallTick;
+    int stallMs;
+
+    // Renderer side.
+    double lastRendered;
+    uint64_t torn;
+    uint64_t backwards;
+    uint64_t lastKeys;
+    uint64_t keysBackwards;
+};
+
+static void simulate(void* user, const AppInputEvent* events, int numEvents, double dt, void* snapshot){
+    TestUser* u = (TestUser*)user;
+    u->tick++;
+    u->keys += numEvents;
+    if(u->stallMs > 0 && u->tick == u->stallTick){
+        std::this_thread::sleep_for(std::chrono::milliseconds(u->stallMs));
+    }
+    TestState* s = (TestState*)snapshot;
+    s->tick = u->tick;
+    s->keys = u->keys;
+    for(int i = 0; i < 62; i++){
+        s->fill[i] = u->tick;
+    }
+}
+
+static void render(void* user, const void* previous, const void* current, float alpha){
+    TestUser* u = (TestUser*)user;
+    const TestState* p = (const TestState*)previous;
+    const TestState* c = (const TestState*)current;
+    for(int i = 0; i < 62; i++){
+        u->torn += p->fill[i] != p->tick || c->fill[i] != c->tick;
+    }
+    double x = p->tick + (double)(c->tick - p->tick) * alpha;
+    u->backwards += x < u->lastRendered - 1e-6;
+    u->lastRendered = x;
+    u->keysBackwards += c->keys < u->lastKeys;
+    u->lastKeys = c->keys;
+}
+
+static void testSteady(){
+    static AppLoop loop;
+    TestUser user = {};
+    AppLoopDesc desc = {};
+    desc.tickSeconds = 1.0 / 120.0;
+    desc.snapshotSize = sizeof(TestState);
+    desc.simulate = simulate;
+    desc.render = render;
+    desc.user = &user;
+    desc.frameSeconds = 1.0 / 240.0;
+    desc.maxCatchUpTicks = 5;
+    CHECK(appLoopStart(&loop, &desc));
+    uint64_t pushed = 0;
+    for(int i = 0; i < 300; i++){
+        AppInputEvent event = { APP_INPUT_KEY_DOWN, 32, 0, 0 };
+        pushed += appLoopPushInput(&loop, &event);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    // Let the last events reach a tick.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    appLoopStop(&loop);
+    appLoopPrintStats(&loop, stdout);
+    CHECK(pushed == 300 && loop.stats.inputDropped == 0);
+    CHECK(user.keys == pushed);
+    CHECK(user.torn == 0);
+    CHECK(user.backwards == 0);
+    CHECK(user.keysBackwards == 0);
+    CHECK(loop.stats.ticks == user.tick && loop.stats.ticks > 0);
+    CHECK(loop.stats.frames > 0 && loop.stats.snapshotsPickedUp > 0);
+    CHECK(loop.stats.snapshotsPickedUp + loop.stats.snapshotsSkipped <= loop.stats.ticks);
+}
+
+// A 300 ms stall at 120 Hz is 36 ticks, far more than the 5 the loop may catch up.
+static void testStall(){
+    static AppLoop loop;
+    TestUser user = {};
+    user.stallTick = 20;
+    user.stallMs = 300;
+    AppLoopDesc desc = {};
+    desc.tickSeconds = 1.0 / 120.0;
+    desc.snapshotSize = sizeof(TestState);
+    desc.simulate = simulate;
+    desc.render = render;
+    desc.user = &user;
+    desc.frameSeconds = 1.0 / 240.0;
+    desc.maxCatchUpTicks = 5;
+    CHECK(appLoopStart(&loop, &desc));
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    appLoopStop(&loop);
+    appLoopPrintStats(&loop, stdout);
+    CHECK(loop.stats.ticksDropped >= 25);
+    // Without the drop the loop would run all 72 ticks of 600 ms; with it,
+    // the ticks run plus dropped still account for the time that passed.
+    CHECK(loop.stats.ticks < 72 - 20);
+    CHECK(loop.stats.ticks + loop.stats.ticksDropped >= 60);
+    CHECK(user.torn == 0 && user.backwards == 0);
+}
+
+int main(){
+    testSteady();
+    testStall();
+    return checkReport("app_loop_test");
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Checks for the headless tests. A failing CHECK prints where it failed and
+// the test carries on; checkReport makes the process exit non-zero if any did.
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) \
+    do{ \
+        if(!(condition)){ \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            checkFailures++; \
+        } \
+    }while(0)
+
+inline int checkReport(const char* name){
+    if(checkFailures){
+        printf("%s: %d checks failed\n", name, checkFailures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Merging, rect cap, full-frame fallback and buffer history checks for damage_tracker.h.
+
+#include "damage_tracker.h"
+
+#include <stdlib.h>
+
+#include "check.h"
+
+static DamageTracker t;
+
+static bool covers(const DamageRect* rects, int count, const DamageRect* r){
+    // Every pixel of r lies in at least one of rects.
+    for(int y = r->top; y < r->bottom; y++){
+        for(int x = r->left; x < r->right; x++){
+            bool inside = false;
+            for(int i = 0; i < count && !inside; i++){
+                inside = x >= rects[i].left && x < rects[i].right && y >= rects[i].top && y < rects[i].bottom;
+            }
+            if(!inside){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool disjoint(const DamageRect* rects, int count){
+    for(int i = 0; i < count; i++){
+        for(int j = i + 1; j < count; j++){
+            if(damageRectIntersectionArea(&rects[i], &rects[j]) > 0){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void testMerging(){
+    // Touching and contained rects cost nothing to merge, distant ones stay apart.
+    DamageRect rects[4] = { { 0, 0, 10, 10 }, { 10, 0, 20, 10 }, { 2, 2, 5, 5 }, { 100, 100, 110, 110 } };
+    int count = damageMergeRects(rects, 4, 4);
+    CHECK(count == 2);
+    DamageRect a = { 0, 0, 20, 10 };
+    DamageRect b = { 100, 100, 110, 110 };
+    CHECK(covers(rects, count, &a) && covers(rects, count, &b));
+    int64_t area = 0;
+    for(int i = 0; i < count; i++){
+        area += damageRectArea(&rects[i]);
+    }
+    CHECK(area == 300);
+
+    // Overlapping rects are merged even when there is room to keep them, so
+    // the shaded pixels aren't counted twice.
+    DamageRect overlapping[3] = { { 0, 0, 10, 10 }, { 5, 5, 15, 15 }, { 100, 0, 110, 10 } };
+    count = damageMergeRects(overlapping, 3, 4);
+    CHECK(count == 2);
+    CHECK(disjoint(overlapping, count));
+    damageTrackerInit(&t, 900, 500, 1);
+    damageTrackerAddRect(&t, 0, 0, 10, 10);
+    damageTrackerAddRect(&t, 5, 5, 15, 15);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.stats.lastFramePixels == 15 * 15);
+
+    // Clamped to the screen, empty rects are dropped.
+    damageTrackerInit(&t, 900, 500, 2);
+    damageTrackerAddRect(&t, -10, -10, 20, 20);
+    damageTrackerAddRect(&t, 50, 50, 50, 60);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.rects[0].left == 0 && t.rects[0].top == 0 && t.rects[0].right == 20 && t.rects[0].bottom == 20);
+    CHECK(t.stats.lastFramePixels == 400);
+}
+
+static void testRectCap(){
+    srand(3);
+    for(int maxRects = 1; maxRects <= DamageMaxRects; maxRects++){
+        damageTrackerInit(&t, 900, 500, 1, maxRects);
+        // More than DamageMaxPending small rects spread over a corner, forcing
+        // merges both in Add and BeginFrame.
+        DamageRect added[200];
+        for(int i = 0; i < 200; i++){
+            int32_t x = rand() % 200;
+            int32_t y = rand() % 200;
+            DamageRect r = { x, y, x + 1 + rand() % 8, y + 1 + rand() % 8 };
+            added[i] = r;
+            damageTrackerAdd(&t, r);
+        }
+        int count = damageTrackerBeginFrame(&t);
+        CHECK(count >= 1 && count <= maxRects);
+        for(int i = 0; i < 200; i++){
+            CHECK(covers(t.rects, count, &added[i]));
+        }
+        CHECK(t.numFrameRects <= maxRects);
+        CHECK(disjoint(t.rects, count) && disjoint(t.frameRects, t.numFrameRects));
+        uint64_t pixels = 0;
+        for(int i = 0; i < count; i++){
+            pixels += (uint64_t)damageRectArea(&t.rects[i]);
+        }
+        CHECK(pixels == t.stats.lastFramePixels);
+    }
+}
+
+static void testFullFrameFallback(){
+    damageTrackerInit(&t, 900, 500, 1);
+    // Two bands covering 80% of the frame with a gap between them.
+    damageTrackerAddRect(&t, 0, 0, 900, 200);
+    damageTrackerAddRect(&t, 0, 300, 900, 500);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.rects[0].left == 0 && t.rects[0].top == 0 && t.rects[0].right == 900 && t.rects[0].bottom == 500);
+    CHECK(t.stats.lastFramePixels == 900 * 500);
+    // The dirty rects handed to Present1 stay exact.
+    CHECK(t.numFrameRects == 2);
+
+    // Below the threshold the two bands are kept apart.
+    damageTrackerAddRect(&t, 0, 0, 900, 100);
+    damageTrackerAddRect(&t, 0, 400, 900, 500);
+    CHECK(damageTrackerBeginFrame(&t) == 2);
+    CHECK(t.stats.lastFramePixels == 2 * 900 * 100);
+}
+
+static void testSkipAndHistory(){
+    damageTrackerInit(&t, 900, 500, 3);
+    damageTrackerInvalidateAll(&t);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    // The full-frame damage of the first frame stays in the history until
+    // every buffer has been redrawn.
+    damageTrackerAddRect(&t, 10, 10, 20, 20);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.stats.lastFramePixels == 900 * 500);
+    damageTrackerAddRect(&t, 10, 10, 20, 20);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.stats.lastFramePixels == 900 * 500);
+    damageTrackerAddRect(&t, 10, 10, 20, 20);
+    CHECK(damageTrackerBeginFrame(&t) == 1);
+    CHECK(t.stats.lastFramePixels == 100);
+
+    // No damage: skipped, and the ring doesn't advance.
+    uint64_t frame = t.frame;
+    CHECK(damageTrackerBeginFrame(&t) == 0);
+    CHECK(t.frame == frame);
+    CHECK(t.stats.framesSkipped == 1);
+    CHECK(t.stats.framesRendered == 4);
+    CHECK(t.stats.pixelsFull == 5ull * 900 * 500);
+    CHECK(t.stats.pixelsShaded == 3ull * 900 * 500 + 100);
+}
+
+int main(){
+    testMerging();
+    testRectCap();
+    testFullFrameFallback();
+    testSkipAndHistory();
+    return checkReport("damage_tracker_test");
+}
@@ -0,0 +1,139 @@
+// draw_queue.h sorts against std::stable_sort on one thread and on a pool,
+// below and above the parallel threshold, the binds Submit issues and Emit
+// replaying the same draws.
+
+#include "draw_queue.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "check.h"
+
+struct Recorder {
+    std::vector<uint32_t> drawn;
+    uint32_t pipeline, rootSignature, table;
+    uint64_t binds;
+    bool stateMatches;
+};
+
+static void setPipeline(void* context, uint32_t pipeline){
+    Recorder* r = (Recorder*)context;
+    r->pipeline = pipeline;
+    r->binds++;
+}
+
+static void setRootSignature(void* context, uint32_t rootSignature){
+    Recorder* r = (Recorder*)context;
+    r->rootSignature = rootSignature;
+    r->table = DrawQueueNoState;
+    r->binds++;
+}
+
+static void setDescriptorTable(void* context, uint32_t table){
+    Recorder* r = (Recorder*)context;
+    r->table = table;
+    r->binds++;
+}
+
+static void draw(void* context, const DrawItem* item){
+    Recorder* r = (Recorder*)context;
+    r->drawn.push_back((uint32_t)item->userData);
+    r->stateMatches = r->stateMatches && r->pipeline == drawKeyPipeline(item->key) &&
+                      r->rootSignature == drawKeyRootSignature(item->key) && r->table == drawKeyDescriptorTable(item->key);
+}
+
+static void submit(DrawQueue* q, Recorder* r, bool keep = false){
+    r->drawn.clear();
+    r->pipeline = r->rootSignature = r->table = DrawQueueNoState;
+    r->binds = 0;
+    r->stateMatches = true;
+    DrawQueueCallbacks callbacks = { setPipeline, setRootSignature, setDescriptorTable, draw, r };
+    if(keep){
+        drawQueueEmit(q, &callbacks);
+    }else{
+        drawQueueSubmit(q, &callbacks);
+    }
+}
+
+// Few pipelines and tables with random depths, so some radix passes are skipped and others not.
+static void testSort(WorkerPool* pool, uint32_t count){
+    DrawQueue q;
+    CHECK(drawQueueInit(&q, count, pool));
+    Recorder r;
+    for(int round = 0; round < 3; round++){
+        std::vector<uint64_t> keys(count);
+        for(uint32_t i = 0; i < count; i++){
+            keys[i] = drawKeyPack(rand() % 3, rand() % 20, rand() % 2, rand() % (round + 1), rand() % 64);
+            CHECK(drawQueueAdd(&q, keys[i], 6, 1, 0, 0, i));
+        }
+        drawQueueSort(&q);
+        std::vector<uint32_t> expected(count);
+        for(uint32_t i = 0; i < count; i++){
+            expected[i] = i;
+        }
+        std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b){ return keys[a] < keys[b]; });
+        for(uint32_t i = 0; i < count; i++){
+            CHECK(q.keys[i] == keys[expected[i]]);
+        }
+        uint64_t bindsSorted = drawQueueCountBinds(q.items, q.order, count);
+        // Emitting once per scissor rect replays the same sorted draws.
+        for(int scissor = 0; scissor < 2; scissor++){
+            submit(&q, &r, true);
+            CHECK(r.drawn == expected);
+            CHECK(r.binds == bindsSorted);
+            CHECK(q.count == count);
+        }
+        submit(&q, &r);
+        CHECK(r.drawn == expected);
+        CHECK(r.stateMatches);
+        CHECK(r.binds == bindsSorted);
+        CHECK(q.count == 0);
+    }
+    drawQueueDestroy(&q);
+}
+
+// Without a sort draws go out in the order they were added; draws added after
+// a sort follow the sorted ones.
+static void testSubmitUnsorted(){
+    DrawQueue q;
+    CHECK(drawQueueInit(&q, 16, 0));
+    Recorder r;
+    for(uint32_t i = 0; i < 8; i++){
+        drawQueueAdd(&q, drawKeyPack(0, 7 - i, 0, 0, 0), 3, 1, 0, 0, i);
+    }
+    submit(&q, &r);
+    CHECK(r.drawn.size() == 8);
+    for(uint32_t i = 0; i < r.drawn.size(); i++){
+        CHECK(r.drawn[i] == i);
+    }
+    CHECK(r.stateMatches);
+
+    for(uint32_t i = 0; i < 8; i++){
+        drawQueueAdd(&q, drawKeyPack(0, 7 - i, 0, 0, 0), 3, 1, 0, 0, i);
+    }
+    drawQueueSort(&q);
+    for(uint32_t i = 8; i < 12; i++){
+        drawQueueAdd(&q, drawKeyPack(0, 0, 0, 0, 0), 3, 1, 0, 0, i);
+    }
+    submit(&q, &r);
+    CHECK(r.drawn.size() == 12);
+    for(uint32_t i = 0; i < r.drawn.size(); i++){
+        CHECK(r.drawn[i] == (i < 8 ? 7 - i : i));
+    }
+    CHECK(r.stateMatches);
+    drawQueueDestroy(&q);
+}
+
+int main(){
+    srand(1);
+    testSubmitUnsorted();
+    testSort(0, 1000);
+    testSort(0, DrawQueueParallelThreshold * 2);
+    WorkerPool pool;
+    workerPoolInit(&pool, 4);
+    testSort(&pool, 1000);
+    testSort(&pool, DrawQueueParallelThreshold * 2 + 7);
+    CHECK(pool.runs == 3);
+    workerPoolDestroy(&pool);
+    return checkReport("draw_queue_test");
+}
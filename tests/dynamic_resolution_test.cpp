@@ -0,0 +1,277 @@
+// dynResReplay on synthetic frame time traces: the controller settles where
+// the budget is met and stays there, a spike far over budget is cut in one
+// frame, the scale only goes up after raiseDelay frames under budget, and
+// headroom is spent above full resolution when maxScale allows it.
+// dynResUpscale is checked against the upscale shader's formula evaluated in
+// double precision: identity at scale 1, no bleeding past the rendered region,
+// and the four tap downsample.
+
+#include "dynamic_resolution.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "check.h"
+
+static const float TargetMs = 14.0f;
+
+static float noise(){
+    return 0.97f + 0.06f * rand() / (float)RAND_MAX;
+}
+
+// 20 ms at full resolution with 90% of it following the pixel count meets
+// 14 ms at an area of (14 / 20 - 0.1) / 0.9 = 2/3, a scale of 0.816.
+static void testConvergence(){
+    DynResDesc desc;
+    dynResDescInit(&desc, 900, 500, TargetMs);
+    DynResController c;
+    dynResInit(&c, &desc);
+    std::vector<float> trace(600);
+    for(size_t i = 0; i < trace.size(); i++){
+        trace[i] = 20.0f * noise();
+    }
+    std::vector<float> scales(trace.size());
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.9f, scales.data());
+    CHECK(scales[0] == 1.0f);
+    float settled = sqrtf((TargetMs / 20.0f - 0.1f) / 0.9f);
+    // Within a couple of 8 pixel steps of 900 pixels.
+    for(size_t i = 200; i < scales.size(); i++){
+        CHECK(fabsf(scales[i] - settled) < 0.03f);
+    }
+    // Settled means no hunting: the last 400 frames change size a handful of times at most.
+    DynResController first;
+    dynResInit(&first, &desc);
+    dynResReplay(&first, trace.data(), 200, 0.9f, 0);
+    CHECK(c.stats.scaleChanges - first.stats.scaleChanges <= 4);
+    CHECK(c.stats.panics == 0);
+    dynResPrintStats(&c, stdout);
+
+    // Under budget at full resolution: nothing to do.
+    dynResInit(&c, &desc);
+    for(size_t i = 0; i < trace.size(); i++){
+        trace[i] = 10.0f * noise();
+    }
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.9f, scales.data());
+    CHECK(c.stats.scaleChanges == 0 && c.scale == 1.0f);
+    CHECK(c.stats.framesOverBudget == 0);
+}
+
+// With pixelShare 0 the trace is exactly what the controller is fed.
+static void testPanic(){
+    DynResDesc desc;
+    dynResDescInit(&desc, 900, 500, TargetMs);
+    DynResController c;
+    dynResInit(&c, &desc);
+    std::vector<float> trace(100, 10.0f);
+    trace[50] = 35.0f;
+    std::vector<float> scales(trace.size());
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, scales.data());
+    CHECK(c.stats.panics == 1);
+    CHECK(scales[50] == 1.0f);
+    // The pixel count drops to 14 / 35 of what it was, within the pixel grid.
+    float expected = sqrtf(TargetMs / 35.0f);
+    CHECK(fabsf(scales[51] - expected) < 8.0f / 500.0f + 0.01f);
+    // The cut is not undone before raiseDelay frames under budget have passed.
+    for(int i = 51; i < 51 + desc.raiseDelay; i++){
+        CHECK(scales[i] <= scales[51]);
+    }
+    CHECK(scales[99] > scales[51]);
+}
+
+static void testRaiseDelay(){
+    DynResDesc desc;
+    dynResDescInit(&desc, 900, 500, TargetMs);
+    DynResController c;
+    dynResInit(&c, &desc);
+    // Heavy load first, so there is room to go up.
+    std::vector<float> trace(60, 20.0f);
+    std::vector<float> scales(400);
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, scales.data());
+    float low = c.scale;
+    CHECK(low < 1.0f);
+
+    // raiseDelay - 2 frames well under budget, then two that pull the
+    // smoothed time back over it, again and again: the scale must never go up.
+    trace.clear();
+    for(int i = 0; i < 40 * desc.raiseDelay; i++){
+        trace.push_back(i % desc.raiseDelay >= desc.raiseDelay - 2 ? 20.0f : 8.0f);
+    }
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, scales.data());
+    for(size_t i = 1; i < trace.size(); i++){
+        CHECK(scales[i] <= scales[i - 1]);
+    }
+    CHECK(c.scale <= low);
+
+    // Steady headroom, starting right after the heavy frames: the first raise
+    // comes after at least raiseDelay frames.
+    float held = c.scale;
+    trace.assign(200, 8.0f);
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, scales.data());
+    int firstRaise = -1;
+    for(size_t i = 0; i < trace.size() && firstRaise < 0; i++){
+        firstRaise = scales[i] > held ? (int)i : -1;
+    }
+    CHECK(firstRaise >= desc.raiseDelay);
+    CHECK(c.scale == desc.maxScale);
+
+    // Headroom inside the dead band is on target: no raise at all.
+    dynResInit(&c, &desc);
+    trace.assign(60, 20.0f);
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, 0);
+    float settled = c.scale;
+    trace.assign(200, TargetMs * (1.0f - desc.deadBand * 0.5f));
+    dynResReplay(&c, trace.data(), (int)trace.size(), 0.0f, scales.data());
+    CHECK(c.scale == settled);
+}
+
+static void testSupersample(){
+    DynResDesc desc;
+    dynResDescInit(&desc, 900, 500, TargetMs);
+    desc.maxScale = 1.5f;
+    DynResController c;
+    dynResInit(&c, &desc);
+    uint32_t targetWidth, targetHeight;
+    dynResTargetSize(&desc, &targetWidth, &targetHeight);
+    CHECK(targetWidth == 1350 && targetHeight == 750);
+    CHECK(c.renderWidth == targetWidth && c.renderHeight == targetHeight);
+
+    // Too heavy at 1.5: settles below it, above full resolution. 8 ms at full
+    // resolution meets 14 ms at an area of 14 / 8 = 1.75.
+    std::vector<float> trace(600);
+    for(size_t i = 0; i < trace.size(); i++){
+        trace[i] = 8.0f * noise();
+    }
+    dynResReplay(&c, trace.data(), (int)trace.size(), 1.0f, 0);
+    CHECK(fabsf(c.scale - sqrtf(TargetMs / 8.0f)) < 0.03f);
+    CHECK(c.renderWidth <= targetWidth && c.renderHeight <= targetHeight);
+
+    // Light load climbs back to the largest size.
+    trace.assign(600, 4.0f);
+    dynResReplay(&c, trace.data(), (int)trace.size(), 1.0f, 0);
+    CHECK(c.scale == desc.maxScale);
+    CHECK(c.renderWidth == targetWidth && c.renderHeight == targetHeight);
+}
+
+// upscale_shaders.hlsl PSMain for one output pixel, in double precision with
+// its own bilinear clamp sampler.
+static void shaderPixel(const uint8_t* pixels, uint32_t targetWidth, uint32_t targetHeight, uint32_t width, uint32_t height,
+                        uint32_t dstWidth, uint32_t dstHeight, uint32_t x, uint32_t y, double* rgba){
+    double uvScale[2] = { (double)width / targetWidth, (double)height / targetHeight };
+    double uvMin[2] = { 0.5 / targetWidth, 0.5 / targetHeight };
+    double uvMax[2] = { (width - 0.5) / targetWidth, (height - 0.5) / targetHeight };
+    bool downsample = width > dstWidth || height > dstHeight;
+    double tap[2] = { downsample ? 0.25 * uvScale[0] / dstWidth : 0.0, downsample ? 0.25 * uvScale[1] / dstHeight : 0.0 };
+    double uv[2] = { (x + 0.5) / dstWidth * uvScale[0], (y + 0.5) / dstHeight * uvScale[1] };
+    int taps = downsample ? 4 : 1;
+    for(int c = 0; c < 4; c++){
+        rgba[c] = 0.0;
+    }
+    for(int t = 0; t < taps; t++){
+        double u = uv[0] + (taps == 1 ? 0.0 : (t & 1 ? tap[0] : -tap[0]));
+        double v = uv[1] + (taps == 1 ? 0.0 : (t & 2 ? tap[1] : -tap[1]));
+        u = u < uvMin[0] ? uvMin[0] : (u > uvMax[0] ? uvMax[0] : u);
+        v = v < uvMin[1] ? uvMin[1] : (v > uvMax[1] ? uvMax[1] : v);
+        double tx = u * targetWidth - 0.5;
+        double ty = v * targetHeight - 0.5;
+        int x0 = (int)floor(tx);
+        int y0 = (int)floor(ty);
+        double fx = tx - x0;
+        double fy = ty - y0;
+        for(int c = 0; c < 4; c++){
+            double texel[4];
+            for(int i = 0; i < 4; i++){
+                int sx = x0 + (i & 1);
+                int sy = y0 + (i >> 1);
+                sx = sx < 0 ? 0 : (sx >= (int)targetWidth ? (int)targetWidth - 1 : sx);
+                sy = sy < 0 ? 0 : (sy >= (int)targetHeight ? (int)targetHeight - 1 : sy);
+                texel[i] = pixels[((size_t)sy * targetWidth + sx) * 4 + c] / 255.0;
+            }
+            double top = texel[0] + (texel[1] - texel[0]) * fx;
+            double bottom = texel[2] + (texel[3] - texel[2]) * fx;
+            rgba[c] += (top + (bottom - top) * fy) / taps;
+        }
+    }
+}
+
+// Upscales the width x height corner of a random target and compares every
+// pixel with the shader. Returns the largest difference in 8-bit steps.
+static int checkUpscale(uint32_t targetWidth, uint32_t targetHeight, uint32_t width, uint32_t height, uint32_t dstWidth, uint32_t dstHeight,
+                        std::vector<uint8_t>* pixels, std::vector<uint8_t>* dst){
+    pixels->resize((size_t)targetWidth * targetHeight * 4);
+    for(uint32_t y = 0; y < targetHeight; y++){
+        for(uint32_t x = 0; x < targetWidth; x++){
+            // Outside the rendered region is white, inside is below half, so any bleeding shows.
+            bool inside = x < width && y < height;
+            for(int c = 0; c < 4; c++){
+                (*pixels)[((size_t)y * targetWidth + x) * 4 + c] = inside ? (uint8_t)(rand() % 128) : 255;
+            }
+        }
+    }
+    SamplerTexture tex;
+    CHECK(samplerTextureCreate(&tex, targetWidth, targetHeight, pixels->data(), targetWidth * 4, SAMPLER_LAYOUT_LINEAR, false));
+    dst->assign((size_t)dstWidth * dstHeight * 4, 0);
+    dynResUpscale(&tex, width, height, dst->data(), dstWidth, dstHeight, dstWidth * 4);
+    samplerTextureDestroy(&tex);
+
+    int maxDiff = 0;
+    for(uint32_t y = 0; y < dstHeight; y++){
+        for(uint32_t x = 0; x < dstWidth; x++){
+            double expected[4];
+            shaderPixel(pixels->data(), targetWidth, targetHeight, width, height, dstWidth, dstHeight, x, y, expected);
+            for(int c = 0; c < 4; c++){
+                int got = (*dst)[((size_t)y * dstWidth + x) * 4 + c];
+                int diff = abs(got - (int)floor(expected[c] * 255.0 + 0.5));
+                maxDiff = diff > maxDiff ? diff : maxDiff;
+                CHECK(got < 128);
+            }
+        }
+    }
+    return maxDiff;
+}
+
+static void testUpscale(){
+    std::vector<uint8_t> pixels, dst;
+    // Scale 1 is a copy of the rendered region.
+    CHECK(checkUpscale(64, 32, 37, 23, 37, 23, &pixels, &dst) == 0);
+    bool same = true;
+    for(uint32_t y = 0; y < 23; y++){
+        same = same && memcmp(&dst[(size_t)y * 37 * 4], &pixels[(size_t)y * 64 * 4], 37 * 4) == 0;
+    }
+    CHECK(same);
+
+    // Upscaling: the corners land on the corner texels, clamped half a texel in.
+    CHECK(checkUpscale(64, 32, 40, 20, 90, 50, &pixels, &dst) <= 1);
+    CHECK(memcmp(&dst[0], &pixels[0], 4) == 0);
+    CHECK(memcmp(&dst[((size_t)49 * 90 + 89) * 4], &pixels[((size_t)19 * 64 + 39) * 4], 4) == 0);
+    // The whole target, and odd output sizes that end partway through a batch of 8.
+    CHECK(checkUpscale(40, 20, 40, 20, 93, 51, &pixels, &dst) <= 1);
+
+    // Downsampling by 1.5 and by exactly 2, where the taps are a 2x2 box.
+    CHECK(checkUpscale(64, 32, 60, 30, 40, 20, &pixels, &dst) <= 1);
+    CHECK(checkUpscale(100, 50, 80, 40, 40, 20, &pixels, &dst) <= 1);
+    bool box = true;
+    for(uint32_t y = 0; y < 20; y++){
+        for(uint32_t x = 0; x < 40; x++){
+            for(int c = 0; c < 4; c++){
+                int sum = 0;
+                for(int i = 0; i < 4; i++){
+                    sum += pixels[((size_t)(y * 2 + (i >> 1)) * 100 + x * 2 + (i & 1)) * 4 + c];
+                }
+                box = box && abs(dst[((size_t)y * 40 + x) * 4 + c] * 4 - sum) <= 4;
+            }
+        }
+    }
+    CHECK(box);
+}
+
+int main(){
+    srand(5);
+    testConvergence();
+    testPanic();
+    testRaiseDelay();
+    testSupersample();
+    testUpscale();
+    return checkReport("dynamic_resolution_test");
+}
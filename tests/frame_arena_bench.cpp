@@ -0,0 +1,143 @@
+// Transient per frame data in frame_arena.h against std::vector: each frame
+// builds 64 draw lists of 50 to 150 draws, a 40 entry barrier array and 4000
+// sprite instances, every list grown one push at a time from empty. Runs on
+// one thread, then on a pool of four threads building a frame's worth each,
+// which is where the vectors also contend on the heap. The arena is in strict mode
+// after warm up, so any heap allocation it still makes shows in the stats.
+
+#include "frame_arena.h"
+#include "worker_pool.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+static const int Frames = 2000;
+
+struct Draw {
+    uint64_t key;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t startVertex;
+    uint32_t startInstance;
+};
+
+struct Barrier {
+    void* resource;
+    uint32_t before;
+    uint32_t after;
+    uint32_t type;
+    uint32_t pad;
+};
+
+struct Sprite {
+    float x, y, w, h;
+    uint32_t color;
+    uint32_t pad[3];
+};
+
+static std::atomic<uint64_t> sink;
+
+static void vectorFrame(int frame){
+    uint64_t acc = 0;
+    for(int list = 0; list < 64; list++){
+        std::vector<Draw> draws;
+        int count = 50 + (list * 7 + frame) % 100;
+        for(int i = 0; i < count; i++){
+            draws.push_back(Draw{ (uint64_t)i * list, 6, 1, 0, (uint32_t)i });
+        }
+        acc += draws.back().key;
+    }
+    std::vector<Barrier> barriers;
+    for(int i = 0; i < 40; i++){
+        barriers.push_back(Barrier{ 0, 1, 2, 3, 0 });
+    }
+    std::vector<Sprite> sprites;
+    for(int i = 0; i < 4000; i++){
+        sprites.push_back(Sprite{ 1.0f, 2.0f, 3.0f, 4.0f, (uint32_t)i, {} });
+    }
+    acc += barriers.size() + sprites[frame % 4000].color;
+    sink += acc;
+}
+
+static void arenaFrame(FrameArenaBlock* b, int frame){
+    uint64_t acc = 0;
+    for(int list = 0; list < 64; list++){
+        FrameArray<Draw> draws;
+        frameArrayInit(&draws, b, 0);
+        int count = 50 + (list * 7 + frame) % 100;
+        for(int i = 0; i < count; i++){
+            frameArrayPush(&draws, Draw{ (uint64_t)i * list, 6, 1, 0, (uint32_t)i });
+        }
+        acc += draws.data[draws.count - 1].key;
+    }
+    FrameArray<Barrier> barriers;
+    frameArrayInit(&barriers, b, 0);
+    for(int i = 0; i < 40; i++){
+        frameArrayPush(&barriers, Barrier{ 0, 1, 2, 3, 0 });
+    }
+    FrameArray<Sprite> sprites;
+    frameArrayInit(&sprites, b, 0);
+    for(int i = 0; i < 4000; i++){
+        frameArrayPush(&sprites, Sprite{ 1.0f, 2.0f, 3.0f, 4.0f, (uint32_t)i, {} });
+    }
+    acc += barriers.count + sprites.data[frame % 4000].color;
+    sink += acc;
+}
+
+struct FrameJob {
+    FrameArena* arena;
+    int frame;
+};
+
+static void vectorWorker(void* context, int thread, int numThreads){
+    vectorFrame(((FrameJob*)context)->frame + thread);
+}
+
+static void arenaWorker(void* context, int thread, int numThreads){
+    FrameJob* job = (FrameJob*)context;
+    arenaFrame(frameArenaThread(job->arena, thread), job->frame + thread);
+}
+
+static double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run(int threads){
+    WorkerPool pool;
+    workerPoolInit(&pool, threads);
+    FrameArena arena;
+    FrameJob job = { &arena, 0 };
+    double start = now();
+    for(job.frame = 0; job.frame < Frames; job.frame++){
+        workerPoolRun(&pool, threads, vectorWorker, &job);
+    }
+    double vectorMs = (now() - start) * 1e3 / Frames;
+
+    frameArenaInit(&arena, 2, threads, 16 * 1024);
+    uint64_t fence = 0;
+    start = now();
+    for(job.frame = 0; job.frame < Frames; job.frame++){
+        // Two full cycles of list sizes on both frames in flight.
+        if(job.frame == 400){
+            frameArenaSetStrict(&arena, true);
+        }
+        frameArenaBeginFrame(&arena, fence);
+        workerPoolRun(&pool, threads, arenaWorker, &job);
+        frameArenaEndFrame(&arena, ++fence);
+    }
+    double arenaMs = (now() - start) * 1e3 / Frames;
+    printf("  %d thread(s): std::vector %.4f ms/frame, frame arena %.4f ms/frame (%.1fx)\n  ", threads, vectorMs, arenaMs, vectorMs / arenaMs);
+    frameArenaPrintStats(&arena, stdout);
+    frameArenaDestroy(&arena);
+    workerPoolDestroy(&pool);
+}
+
+int main(){
+    printf("frame_arena_bench: %d frames\n", Frames);
+    run(1);
+    run(4);
+    return 0;
+}
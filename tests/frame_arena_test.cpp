@@ -0,0 +1,142 @@
+// frame_arena.h: frames wait for their fence, allocations are aligned and
+// FrameArray keeps its contents as it grows, and once every block has grown
+// to what its frames need, a strict run on several threads touches the heap
+// zero times.
+
+#include "frame_arena.h"
+
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+struct Draw {
+    uint64_t key;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t startVertex;
+    uint32_t startInstance;
+};
+
+struct Instance {
+    float x, y, w, h;
+    uint32_t color;
+    uint32_t pad[3];
+};
+
+static void testFences(){
+    FrameArena a;
+    CHECK(frameArenaInit(&a, 2, 1, 256));
+    CHECK(frameArenaBeginFrame(&a, 0));
+    uint8_t* first = (uint8_t*)frameArenaAlloc(frameArenaThread(&a, 0), 64);
+    frameArenaEndFrame(&a, 1);
+    CHECK(frameArenaBeginFrame(&a, 0));
+    uint8_t* second = (uint8_t*)frameArenaAlloc(frameArenaThread(&a, 0), 64);
+    CHECK(first != second);
+    frameArenaEndFrame(&a, 2);
+    // The first frame's memory comes back only once fence 1 has passed.
+    CHECK(!frameArenaBeginFrame(&a, 0));
+    CHECK(a.stats.framesNotReady == 1);
+    CHECK(frameArenaBeginFrame(&a, 1));
+    CHECK(frameArenaAlloc(frameArenaThread(&a, 0), 64) == first);
+    frameArenaDestroy(&a);
+}
+
+static void testAlignmentAndArrays(){
+    FrameArena a;
+    CHECK(frameArenaInit(&a, 1, 1, 1024));
+    CHECK(frameArenaBeginFrame(&a, 0));
+    FrameArenaBlock* b = frameArenaThread(&a, 0);
+    size_t alignments[] = { 1, 4, 16, 64, 256 };
+    for(int i = 0; i < 200; i++){
+        size_t alignment = alignments[i % 5];
+        uint8_t* p = (uint8_t*)frameArenaAlloc(b, 1 + i * 13 % 300, alignment);
+        CHECK(p && (uintptr_t)p % alignment == 0);
+        memset(p, i, 1 + i * 13 % 300);
+    }
+    CHECK(b->overflow != 0);
+
+    // Two arrays growing in turn: one extends in place, the other keeps moving.
+    FrameArray<Draw> draws;
+    FrameArray<uint32_t> ids;
+    CHECK(frameArrayInit(&draws, b, 0));
+    CHECK(frameArrayInit(&ids, b, 4));
+    for(uint32_t i = 0; i < 5000; i++){
+        Draw d = { i * 3ull, i, 1, 0, 0 };
+        CHECK(frameArrayPush(&draws, d) != 0);
+        if(i % 3 == 0){
+            CHECK(frameArrayPush(&ids, i) != 0);
+        }
+    }
+    bool intact = draws.count == 5000 && ids.count == 1667;
+    for(uint32_t i = 0; i < draws.count && intact; i++){
+        intact = draws.data[i].key == i * 3ull && draws.data[i].vertexCount == i;
+    }
+    for(uint32_t i = 0; i < ids.count && intact; i++){
+        intact = ids.data[i] == i * 3;
+    }
+    CHECK(intact);
+    frameArenaEndFrame(&a, 1);
+    // Everything the frame used fits in the regrown block.
+    CHECK(frameArenaBeginFrame(&a, 1));
+    CHECK(a.stats.regrows == 1 && b->overflow == 0 && b->size >= b->peak);
+    frameArenaDestroy(&a);
+}
+
+// A frame's worth of transient lists; which thread and frame decide how big.
+static void buildFrame(FrameArenaBlock* b, int thread, int frame){
+    for(int list = 0; list < 16; list++){
+        FrameArray<Draw> draws;
+        frameArrayInit(&draws, b, 0);
+        int count = 50 + (list * 7 + frame + thread) % 100;
+        for(int i = 0; i < count; i++){
+            Draw d = { (uint64_t)i * list, 6, 1, 0, (uint32_t)i };
+            frameArrayPush(&draws, d);
+        }
+    }
+    Instance* instances = frameArenaNew<Instance>(b, 1000 + 500 * thread);
+    memset(instances, 0, (1000 + 500 * thread) * sizeof(Instance));
+}
+
+static void testStrict(){
+    static const int Threads = 4;
+    static const int Frames = 3;
+    FrameArena a;
+    // Blocks start far too small, warm up has to grow every one of them.
+    CHECK(frameArenaInit(&a, Frames, Threads, 1024));
+    uint64_t fence = 0;
+    // Sizes repeat every 100 frames and every block sees each of them within 300.
+    for(int frame = 0; frame < 700; frame++){
+        if(frame == 400){
+            frameArenaSetStrict(&a, true);
+        }
+        CHECK(frameArenaBeginFrame(&a, fence));
+        std::thread workers[Threads];
+        for(int t = 1; t < Threads; t++){
+            workers[t] = std::thread(buildFrame, frameArenaThread(&a, t), t, frame);
+        }
+        buildFrame(frameArenaThread(&a, 0), 0, frame);
+        for(int t = 1; t < Threads; t++){
+            workers[t].join();
+        }
+        frameArenaEndFrame(&a, ++fence);
+    }
+    uint64_t violations = 0, heapAllocations = 0;
+    for(int f = 0; f < Frames; f++){
+        for(int t = 0; t < Threads; t++){
+            violations += a.blocks[f][t].strictViolations;
+            heapAllocations += a.blocks[f][t].heapAllocations;
+        }
+    }
+    frameArenaPrintStats(&a, stdout);
+    CHECK(violations == 0);
+    CHECK(heapAllocations > 0);
+    frameArenaDestroy(&a);
+}
+
+int main(){
+    testFences();
+    testAlignmentAndArrays();
+    testStrict();
+    return checkReport("frame_arena_test");
+}
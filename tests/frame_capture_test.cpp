@@ -0,0 +1,84 @@
+// Gap-free sequence check for frame_capture.h: rendered and skipped frames,
+// with the GPU copies completing two frames late, must come out as one file
+// per frame, skipped ones holding the last rendered image.
+
+#include "frame_capture.h"
+
+#include <unistd.h>
+
+#include "check.h"
+
+static const uint32_t Width = 16;
+static const uint32_t Height = 8;
+static const uint32_t RowPitch = 256;
+static const int Slots = 3;
+static const int Latency = 2;
+
+static FrameCapture cap;
+static uint8_t slotMemory[Slots][RowPitch * Height];
+
+int main(){
+    char directory[] = "/tmp/frame_capture_testXXXXXX";
+    if(!mkdtemp(directory)){
+        return 1;
+    }
+    const uint8_t* slotPixels[Slots];
+    for(int i = 0; i < Slots; i++){
+        slotPixels[i] = slotMemory[i];
+    }
+    frameCaptureStart(&cap, directory, CAPTURE_FORMAT_RAW, Width, Height, RowPitch, slotPixels, Slots, 2);
+
+    // 1 renders, 0 is skipped by damage tracking. The long runs of skips
+    // outlast the encoders, so both the in-slot repeats and the file copies happen.
+    static const char pattern[] = "1001101110000000001010000000000110";
+    int numFrames = (int)sizeof(pattern) - 1;
+    uint8_t expected[64];
+    // Fence signalled by the end of each frame; the GPU is Latency frames behind.
+    uint64_t fenceAt[64];
+    uint64_t fence = 0;
+    uint8_t image = 0;
+    for(int f = 0; f < numFrames; f++){
+        frameCapturePoll(&cap, f >= Latency ? fenceAt[f - Latency] : 0);
+        if(pattern[f] == '1'){
+            image = (uint8_t)(f + 1);
+            int slot = frameCaptureAcquire(&cap);
+            CHECK(slot >= 0);
+            if(slot >= 0){
+                memset(slotMemory[slot], image, sizeof(slotMemory[slot]));
+                frameCaptureSubmit(&cap, slot, ++fence);
+            }
+        }else{
+            frameCaptureRepeat(&cap);
+        }
+        expected[f] = image;
+        fenceAt[f] = fence;
+        usleep(pattern[f + 1] == '0' && pattern[f] == '0' ? 3000 : 500);
+    }
+    frameCapturePoll(&cap, fence);
+    frameCaptureStop(&cap);
+
+    CHECK(cap.framesDropped == 0);
+    CHECK(cap.writeErrors.load() == 0);
+    CHECK(cap.framesEncoded.load() == (uint64_t)numFrames);
+    for(int f = 0; f < numFrames; f++){
+        char path[320];
+        capturePath(&cap, f, path, sizeof(path));
+        FILE* file = fopen(path, "rb");
+        CHECK(file != 0);
+        if(!file){
+            continue;
+        }
+        uint8_t pixels[Width * Height * 4];
+        CHECK(fread(pixels, 1, sizeof(pixels), file) == sizeof(pixels));
+        bool same = true;
+        for(size_t i = 0; i < sizeof(pixels); i++){
+            same = same && pixels[i] == expected[f];
+        }
+        CHECK(same);
+        fclose(file);
+        remove(path);
+    }
+    rmdir(directory);
+    frameCapturePrintStats(&cap, stdout);
+    return checkReport("frame_capture_test");
+}
@@ -0,0 +1,221 @@
+// Culling, transient placement and barrier checks for frame_graph.h.
+
+#include "frame_graph.h"
+
+#include "check.h"
+
+static FrameGraph fg;
+
+// scene -> brightpass -> blur -> composite -> back buffer, plus a debug pass
+// reading the scene into a texture nothing reads.
+static void bloomGraph(int* debugPass){
+    frameGraphReset(&fg);
+    uint64_t size = frameGraphTextureBytes(900, 500, 4);
+    int backBuffer = frameGraphImport(&fg, "back buffer", 0, FG_STATE_PRESENT, FG_STATE_PRESENT);
+    int scene = frameGraphCreateTransient(&fg, "scene", size);
+    int bloomA = frameGraphCreateTransient(&fg, "bloom a", size);
+    int bloomB = frameGraphCreateTransient(&fg, "bloom b", size);
+    int debug = frameGraphCreateTransient(&fg, "debug", size);
+
+    int p = frameGraphAddPass(&fg, "scene", 0, 0);
+    frameGraphWrite(&fg, p, scene);
+    p = frameGraphAddPass(&fg, "brightpass", 0, 0);
+    frameGraphRead(&fg, p, scene);
+    frameGraphWrite(&fg, p, bloomA);
+    p = frameGraphAddPass(&fg, "blur", 0, 0);
+    frameGraphRead(&fg, p, bloomA);
+    frameGraphWrite(&fg, p, bloomB);
+    *debugPass = frameGraphAddPass(&fg, "debug", 0, 0);
+    frameGraphRead(&fg, *debugPass, scene);
+    frameGraphWrite(&fg, *debugPass, debug);
+    p = frameGraphAddPass(&fg, "composite", 0, 0);
+    frameGraphRead(&fg, p, bloomB);
+    frameGraphWrite(&fg, p, backBuffer);
+}
+
+static void testUnreadOutputCulled(){
+    int debugPass;
+    bloomGraph(&debugPass);
+    CHECK(frameGraphCompile(&fg));
+    CHECK(fg.numCulledPasses == 1);
+    CHECK(fg.passes[debugPass].culled);
+    CHECK(fg.resources[4].firstPass < 0);
+}
+
+static void testWritelessPassCulled(){
+    frameGraphReset(&fg);
+    uint64_t size = frameGraphTextureBytes(256, 256, 4);
+    int backBuffer = frameGraphImport(&fg, "back buffer", 0, FG_STATE_PRESENT, FG_STATE_PRESENT);
+    int shadow = frameGraphCreateTransient(&fg, "shadow", size);
+    int scene = frameGraphCreateTransient(&fg, "scene", size);
+
+    int shadowPass = frameGraphAddPass(&fg, "shadow", 0, 0);
+    frameGraphWrite(&fg, shadowPass, shadow);
+    int scenePass = frameGraphAddPass(&fg, "scene", 0, 0);
+    frameGraphWrite(&fg, scenePass, scene);
+    // Reads the shadow map and writes nothing: it and the shadow pass go.
+    int probe = frameGraphAddPass(&fg, "probe", 0, 0);
+    frameGraphRead(&fg, probe, shadow);
+    int composite = frameGraphAddPass(&fg, "composite", 0, 0);
+    frameGraphRead(&fg, composite, scene);
+    frameGraphWrite(&fg, composite, backBuffer);
+
+    CHECK(frameGraphCompile(&fg));
+    CHECK(fg.passes[probe].culled);
+    CHECK(fg.passes[shadowPass].culled);
+    CHECK(!fg.passes[scenePass].culled);
+    CHECK(!fg.passes[composite].culled);
+    CHECK(fg.numCulledPasses == 2);
+    CHECK(fg.resources[shadow].firstPass < 0);
+    CHECK(fg.heapSize == frameGraphAlign(size, 65536));
+
+    // A side effect keeps the same pass, and with it the shadow pass.
+    frameGraphSetSideEffect(&fg, probe);
+    CHECK(frameGraphCompile(&fg));
+    CHECK(!fg.passes[probe].culled);
+    CHECK(!fg.passes[shadowPass].culled);
+    CHECK(fg.numCulledPasses == 0);
+    CHECK(fg.resources[shadow].lastPass == probe);
+}
+
+static void testWritelessPassSharedInput(){
+    // The write-less pass reads the scene, but so does the composite; the
+    // scene pass has to survive.
+    frameGraphReset(&fg);
+    uint64_t size = frameGraphTextureBytes(256, 256, 4);
+    int backBuffer = frameGraphImport(&fg, "back buffer", 0, FG_STATE_PRESENT, FG_STATE_PRESENT);
+    int scene = frameGraphCreateTransient(&fg, "scene", size);
+    int scenePass = frameGraphAddPass(&fg, "scene", 0, 0);
+    frameGraphWrite(&fg, scenePass, scene);
+    int probe = frameGraphAddPass(&fg, "probe", 0, 0);
+    frameGraphRead(&fg, probe, scene);
+    int composite = frameGraphAddPass(&fg, "composite", 0, 0);
+    frameGraphRead(&fg, composite, scene);
+    frameGraphWrite(&fg, composite, backBuffer);
+
+    CHECK(frameGraphCompile(&fg));
+    CHECK(fg.passes[probe].culled);
+    CHECK(!fg.passes[scenePass].culled);
+    CHECK(!fg.passes[composite].culled);
+    CHECK(fg.passes[probe].numBarriers == 0);
+    CHECK(fg.resources[scene].lastPass == composite);
+}
+
+// What frameGraphExecute handed out, barriers and passes in the order they came.
+struct Recorded {
+    char kind;
+    int index;
+    int resourceBefore;
+    uint32_t stateBefore;
+    uint32_t stateAfter;
+};
+static Recorded recorded[64];
+static int numRecorded;
+
+static void recordBarriers(const FrameGraph* graph, const FrameGraphBarrier* barriers, int count, void* context){
+    for(int i = 0; i < count; i++){
+        const FrameGraphBarrier* b = &barriers[i];
+        Recorded r = { b->type == FG_BARRIER_ALIASING ? 'A' : 'T', b->resource, b->resourceBefore, b->stateBefore, b->stateAfter };
+        recorded[numRecorded++] = r;
+    }
+}
+
+static void recordPass(void* userData){
+    Recorded r = { 'P', (int)(intptr_t)userData, -1, 0, 0 };
+    recorded[numRecorded++] = r;
+}
+
+static void testAliasing(){
+    int debugPass;
+    bloomGraph(&debugPass);
+    for(int p = 0; p < fg.numPasses; p++){
+        fg.passes[p].execute = recordPass;
+        fg.passes[p].userData = (void*)(intptr_t)p;
+    }
+    CHECK(frameGraphCompile(&fg));
+    const int backBuffer = 0, scene = 1, bloomA = 2, bloomB = 3;
+    uint64_t size = frameGraphAlign(frameGraphTextureBytes(900, 500, 4), 65536);
+
+    // scene lives in passes 0..1, bloom a 1..2, bloom b 2..4: bloom b takes
+    // the scene's memory, bloom a can't share with either.
+    CHECK(fg.resources[scene].heapOffset == 0);
+    CHECK(fg.resources[bloomA].heapOffset == size);
+    CHECK(fg.resources[bloomB].heapOffset == 0);
+    CHECK(fg.heapSize == 2 * size);
+    CHECK(fg.peakLiveSize == 2 * size);
+    CHECK(fg.unaliasedSize == 3 * size);
+    CHECK(fg.heapSize < fg.unaliasedSize);
+
+    numRecorded = 0;
+    frameGraphExecute(&fg, recordBarriers, 0);
+    const uint32_t RT = FG_STATE_RENDER_TARGET, SRV = FG_STATE_PIXEL_SHADER_RESOURCE, PRESENT = FG_STATE_PRESENT;
+    const Recorded expected[] = {
+        { 'P', 0, -1, 0, 0 },
+        { 'T', scene, -1, RT, SRV },
+        { 'P', 1, -1, 0, 0 },
+        { 'T', bloomA, -1, RT, SRV },
+        { 'A', bloomB, scene, 0, 0 },
+        { 'P', 2, -1, 0, 0 },
+        { 'T', backBuffer, -1, PRESENT, RT },
+        { 'T', bloomB, -1, RT, SRV },
+        { 'P', 4, -1, 0, 0 },
+        { 'T', backBuffer, -1, RT, PRESENT },
+    };
+    const int numExpected = sizeof(expected) / sizeof(expected[0]);
+    CHECK(numRecorded == numExpected);
+    int mismatches = 0;
+    for(int i = 0; i < numRecorded && i < numExpected; i++){
+        const Recorded* a = &recorded[i];
+        const Recorded* e = &expected[i];
+        mismatches += a->kind != e->kind || a->index != e->index || a->resourceBefore != e->resourceBefore ||
+                      a->stateBefore != e->stateBefore || a->stateAfter != e->stateAfter;
+    }
+    CHECK(mismatches == 0);
+    CHECK(fg.numBarriers == numExpected - 4);
+}
+
+static void testAliasingUnknownPredecessor(){
+    // Two small targets die before a large one takes over the memory under
+    // both: the aliasing barrier can't name a single resource before it.
+    frameGraphReset(&fg);
+    uint64_t small = 65536, large = 2 * 65536;
+    int backBuffer = frameGraphImport(&fg, "back buffer", 0, FG_STATE_PRESENT, FG_STATE_PRESENT);
+    int a = frameGraphCreateTransient(&fg, "a", small);
+    int b = frameGraphCreateTransient(&fg, "b", small);
+    int big = frameGraphCreateTransient(&fg, "big", large);
+    int p0 = frameGraphAddPass(&fg, "a and b", 0, 0);
+    frameGraphWrite(&fg, p0, a);
+    frameGraphWrite(&fg, p0, b);
+    int p1 = frameGraphAddPass(&fg, "resolve", 0, 0);
+    frameGraphRead(&fg, p1, a);
+    frameGraphRead(&fg, p1, b);
+    frameGraphWrite(&fg, p1, backBuffer);
+    int p2 = frameGraphAddPass(&fg, "big", 0, 0);
+    frameGraphWrite(&fg, p2, big);
+    int p3 = frameGraphAddPass(&fg, "composite", 0, 0);
+    frameGraphRead(&fg, p3, big);
+    frameGraphWrite(&fg, p3, backBuffer);
+
+    CHECK(frameGraphCompile(&fg));
+    CHECK(fg.heapSize == large);
+    CHECK(fg.unaliasedSize == large + 2 * small);
+    CHECK(fg.resources[a].heapOffset == 0 && fg.resources[b].heapOffset == small && fg.resources[big].heapOffset == 0);
+    int aliasing = 0;
+    for(int i = 0; i < fg.numBarriers; i++){
+        const FrameGraphBarrier* barrier = &fg.barriers[i];
+        if(barrier->type == FG_BARRIER_ALIASING){
+            aliasing++;
+            CHECK(barrier->resource == big && barrier->resourceBefore == -1);
+        }
+    }
+    CHECK(aliasing == 1);
+}
+
+int main(){
+    testUnreadOutputCulled();
+    testWritelessPassCulled();
+    testWritelessPassSharedInput();
+    testAliasing();
+    testAliasingUnknownPredecessor();
+    return checkReport("frame_graph_test");
+}
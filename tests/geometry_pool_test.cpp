@@ -0,0 +1,201 @@
+// Allocation, upload batching and compaction checks for geometry_pool.h.
+
+#include "geometry_pool.h"
+
+#include <stdlib.h>
+
+#include "check.h"
+
+static GeometryPool pool;
+static uint8_t staging[1 << 20];
+
+static void testUploadMerging(){
+    geometryPoolInit(&pool, 1 << 20, 16, 4, staging, sizeof(staging));
+    uint32_t vb = geometryPoolAllocateVertices(&pool, 64);
+    CHECK(vb != GeometryPoolInvalid);
+    uint8_t data[512];
+    for(int i = 0; i < 512; i++){
+        data[i] = (uint8_t)i;
+    }
+    CHECK(geometryPoolWrite(&pool, vb, 0, data, 256));
+    CHECK(geometryPoolWrite(&pool, vb, 256, data + 256, 256));
+    CHECK(pool.numUploads == 1);
+    CHECK(pool.uploads[0].size == 512);
+    CHECK(memcmp(staging, data, 512) == 0);
+    // Out of bounds writes are refused.
+    CHECK(!geometryPoolWrite(&pool, vb, 1000, data, 100));
+}
+
+// A full copy list refuses a write that can't merge without touching staging,
+// and one that can merge still goes through.
+static void testFullCopyList(){
+    geometryPoolInit(&pool, 1 << 20, 16, 4, staging, sizeof(staging));
+    uint32_t handle = geometryPoolAllocate(&pool, 64 * GeometryPoolMaxCopies, 16);
+    CHECK(handle != GeometryPoolInvalid);
+    uint32_t value = 0xAABBCCDD;
+    // Every other 16-byte slot so no two writes merge.
+    for(int i = 0; i < GeometryPoolMaxCopies; i++){
+        CHECK(geometryPoolWrite(&pool, handle, (uint64_t)i * 64, &value, 4));
+    }
+    CHECK(pool.numUploads == GeometryPoolMaxCopies);
+    uint64_t head = pool.stagingHead;
+    uint8_t before[64];
+    memcpy(before, staging + head, sizeof(before));
+
+    uint32_t other = 0x11223344;
+    CHECK(!geometryPoolWrite(&pool, handle, 32, &other, 4));
+    CHECK(pool.stagingHead == head);
+    CHECK(memcmp(before, staging + head, sizeof(before)) == 0);
+
+    // Continues the last upload in both staging and the pool.
+    uint64_t lastEnd = (uint64_t)(GeometryPoolMaxCopies - 1) * 64 + 4;
+    CHECK(geometryPoolWrite(&pool, handle, lastEnd, &other, 4));
+    CHECK(pool.numUploads == GeometryPoolMaxCopies);
+    CHECK(pool.uploads[GeometryPoolMaxCopies - 1].size == 8);
+    CHECK(pool.stagingHead == head + 4);
+
+    geometryPoolUploadsRetired(&pool);
+    CHECK(geometryPoolWrite(&pool, handle, 32, &other, 4));
+    CHECK(pool.numUploads == 1 && pool.stagingHead == 4);
+}
+
+static void testFullStaging(){
+    static uint8_t small[256];
+    geometryPoolInit(&pool, 1 << 20, 16, 4, small, sizeof(small));
+    uint32_t handle = geometryPoolAllocate(&pool, 1024, 16);
+    uint8_t data[200] = {};
+    CHECK(geometryPoolWrite(&pool, handle, 0, data, 200));
+    CHECK(!geometryPoolWrite(&pool, handle, 512, data, 100));
+    CHECK(pool.stagingHead == 200 && pool.numUploads == 1);
+}
+
+// Random allocate/free keeps the free list sorted, disjoint and accounting
+// for every byte; compaction leaves a single free range at the end.
+static void testAllocateFreeCompact(){
+    geometryPoolInit(&pool, 1 << 24, 16, 4, staging, sizeof(staging));
+    uint32_t handles[512];
+    int count = 0;
+    srand(7);
+    for(int step = 0; step < 20000; step++){
+        if(count < 512 && (count == 0 || rand() % 3 != 0)){
+            uint32_t h = geometryPoolAllocate(&pool, 16 + rand() % 8192, rand() % 2 ? 16 : 256);
+            if(h != GeometryPoolInvalid){
+                handles[count++] = h;
+            }
+        }else{
+            int i = rand() % count;
+            CHECK(geometryPoolFree(&pool, handles[i]));
+            CHECK(pool.numFreeRanges <= count);
+            handles[i] = handles[--count];
+        }
+    }
+    uint64_t freeBytes = 0;
+    for(int i = 0; i < pool.numFreeRanges; i++){
+        freeBytes += pool.freeRanges[i].size;
+        if(i > 0){
+            CHECK(pool.freeRanges[i - 1].offset + pool.freeRanges[i - 1].size < pool.freeRanges[i].offset);
+        }
+    }
+    // Alignment padding stays in the free list, so every unused byte is in it.
+    CHECK(freeBytes == geometryPoolFreeBytes(&pool));
+    CHECK(!geometryPoolFree(&pool, GeometryPoolMaxAllocations));
+
+    CHECK(geometryPoolCompact(&pool));
+    for(int i = 0; i < count; i++){
+        const GeometryPoolAllocation* a = &pool.allocations[handles[i]];
+        CHECK(a->offset % a->alignment == 0);
+        for(int j = i + 1; j < count; j++){
+            const GeometryPoolAllocation* b = &pool.allocations[handles[j]];
+            CHECK(a->offset + a->size <= b->offset || b->offset + b->size <= a->offset);
+        }
+    }
+    CHECK(pool.freeRanges[pool.numFreeRanges - 1].offset + pool.freeRanges[pool.numFreeRanges - 1].size == pool.capacity);
+}
+
+// Plays the uploads and then the moves into gpu the way the demo records them:
+// every move's pool -> scratch copy before any scratch -> pool copy.
+static void replay(uint8_t* gpu, uint8_t* scratch){
+    for(int i = 0; i < pool.numUploads; i++){
+        const GeometryPoolUpload* u = &pool.uploads[i];
+        memcpy(gpu + u->poolOffset, staging + u->stagingOffset, u->size);
+    }
+    geometryPoolUploadsRecorded(&pool);
+    geometryPoolUploadsRetired(&pool);
+    for(int i = 0; i < pool.numMoves; i++){
+        const GeometryPoolMove* m = &pool.moves[i];
+        memcpy(scratch + m->scratchOffset, gpu + m->srcOffset, m->size);
+    }
+    for(int i = 0; i < pool.numMoves; i++){
+        const GeometryPoolMove* m = &pool.moves[i];
+        memcpy(gpu + m->dstOffset, scratch + m->scratchOffset, m->size);
+    }
+}
+
+// Every live allocation still holds what was written to it after compactions
+// that move ranges onto memory other moved ranges came from.
+static void testCompactionKeepsContents(){
+    static uint8_t gpu[1 << 20];
+    static uint8_t scratch[1 << 20];
+    geometryPoolInit(&pool, sizeof(gpu), 16, 4, staging, sizeof(staging));
+    uint32_t handles[256];
+    uint8_t seeds[256];
+    int count = 0;
+    int mismatches = 0;
+    int moves = 0;
+    srand(11);
+    for(int round = 0; round < 20; round++){
+        while(count < 256){
+            uint64_t size = 16 + rand() % 2048;
+            uint32_t h = geometryPoolAllocate(&pool, size, rand() % 2 ? 16 : 256);
+            if(h == GeometryPoolInvalid){
+                break;
+            }
+            uint8_t seed = (uint8_t)rand();
+            uint8_t data[2064];
+            for(uint64_t b = 0; b < size; b++){
+                data[b] = (uint8_t)(seed + b * 7);
+            }
+            if(!geometryPoolWrite(&pool, h, 0, data, size)){
+                replay(gpu, scratch);
+                CHECK(geometryPoolWrite(&pool, h, 0, data, size));
+            }
+            handles[count] = h;
+            seeds[count++] = seed;
+        }
+        replay(gpu, scratch);
+        for(int k = 0; k < count / 2; k++){
+            int i = rand() % count;
+            CHECK(geometryPoolFree(&pool, handles[i]));
+            handles[i] = handles[--count];
+            seeds[i] = seeds[count];
+        }
+        CHECK(geometryPoolCompact(&pool));
+        moves += pool.numMoves;
+        uint64_t scratchEnd = 0;
+        for(int i = 0; i < pool.numMoves; i++){
+            CHECK(pool.moves[i].scratchOffset >= scratchEnd);
+            scratchEnd = pool.moves[i].scratchOffset + pool.moves[i].size;
+        }
+        CHECK(scratchEnd <= pool.scratchSize);
+        replay(gpu, scratch);
+        geometryPoolMovesRecorded(&pool);
+        CHECK(pool.numMoves == 0 && pool.scratchSize == 0);
+        for(int i = 0; i < count; i++){
+            const GeometryPoolAllocation* a = &pool.allocations[handles[i]];
+            for(uint64_t b = 0; b < a->size; b++){
+                mismatches += gpu[a->offset + b] != (uint8_t)(seeds[i] + b * 7);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(moves > 100);
+}
+
+int main(){
+    testUploadMerging();
+    testFullCopyList();
+    testFullStaging();
+    testAllocateFreeCompact();
+    testCompactionKeepsContents();
+    return checkReport("geometry_pool_test");
+}
@@ -0,0 +1,105 @@
+// Layout throughput and hit rate of glyph_atlas.h with the demo's atlas: 512x512
+// of 32 pixel cells (256 glyphs), 24 pixel em, 4 pixels of spread rasterized
+// at 4x. Each frame lays out 40 labels of 32 glyphs drawn from a Zipf
+// distribution over an alphabet of 96 (ASCII), 400 or 3000 codepoints (CJK
+// text), so the working set goes from fitting to thrashing. Glyphs are discs
+// from a stub rasterizer; SDF time is the part of the frame spent in
+// glyphAtlasFlush, with the distance fields on one thread or on a pool.
+
+#include "glyph_atlas.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int Frames = 120;
+static const int Labels = 40;
+static const int LabelLength = 32;
+
+static uint8_t glyphPixels[256 * 256];
+
+static bool rasterizeDisc(void* context, uint32_t codepoint, int pixelSize, GlyphBitmap* out){
+    int r = pixelSize / 4 + (int)(codepoint % 7);
+    int w = 2 * r + 1;
+    for(int y = 0; y < w; y++){
+        for(int x = 0; x < w; x++){
+            float dx = (float)(x - r), dy = (float)(y - r);
+            glyphPixels[y * w + x] = sqrtf(dx * dx + dy * dy) < r ? 255 : 0;
+        }
+    }
+    out->width = w;
+    out->height = w;
+    out->pitch = w;
+    out->coverage = glyphPixels;
+    out->left = 0.0f;
+    out->top = (float)w;
+    out->advance = w + 4.0f;
+    return true;
+}
+
+static double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run(WorkerPool* pool, uint32_t alphabet){
+    GlyphAtlas a;
+    if(!glyphAtlasInit(&a, 512, 512, 32, 24, 4, 4, rasterizeDisc, 0, pool)){
+        return;
+    }
+    // Zipf: the k-th most common codepoint is used with weight 1/k.
+    std::vector<double> cumulative(alphabet);
+    double total = 0.0;
+    for(uint32_t k = 0; k < alphabet; k++){
+        total += 1.0 / (k + 1);
+        cumulative[k] = total;
+    }
+    srand(4);
+    TextStyle style = { 16.0f, 0xFFFFFFFF, 1920.0f, 1080.0f };
+    TextInstance instances[LabelLength];
+    char text[LabelLength * 4 + 1];
+    double layoutSeconds = 0.0;
+    uint64_t glyphs = 0;
+    for(int frame = 0; frame < Frames; frame++){
+        glyphAtlasBeginFrame(&a);
+        for(int label = 0; label < Labels; label++){
+            char* p = text;
+            for(int i = 0; i < LabelLength; i++){
+                double r = total * rand() / RAND_MAX;
+                uint32_t k = (uint32_t)(std::lower_bound(cumulative.begin(), cumulative.end(), r) - cumulative.begin());
+                uint32_t c = 0x4E00 + (k < alphabet ? k : alphabet - 1);
+                // Three byte UTF-8, decoded by textLayout.
+                *p++ = (char)(0xE0 | (c >> 12));
+                *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *p++ = (char)(0x80 | (c & 0x3F));
+            }
+            *p = 0;
+            double start = now();
+            glyphs += textLayout(&a, text, 10.0f, 20.0f + label * 24.0f, &style, instances, LabelLength);
+            layoutSeconds += now() - start;
+        }
+        glyphAtlasFlush(&a);
+        glyphAtlasClearDirty(&a);
+    }
+    const GlyphAtlasStats* s = &a.stats;
+    printf("  %4u codepoints, %2d threads: %5.1f%% hit, %6llu evictions, %5llu dropped, layout %6.2f Mglyphs/s, "
+           "%6.3f ms layout + %7.3f ms SDF per frame\n",
+           alphabet, a.numThreads, 100.0 * s->hits / s->lookups, (unsigned long long)s->evictions, (unsigned long long)s->dropped,
+           glyphs / layoutSeconds * 1e-6, layoutSeconds / Frames * 1e3, s->sdfSeconds / Frames * 1e3);
+    glyphAtlasDestroy(&a);
+}
+
+int main(){
+    WorkerPool pool;
+    workerPoolInit(&pool, (int)std::thread::hardware_concurrency());
+    printf("glyph_atlas_bench: %d frames of %d labels x %d glyphs, pool of %d threads\n", Frames, Labels, LabelLength, pool.numThreads);
+    uint32_t alphabets[] = { 96, 400, 3000 };
+    for(uint32_t alphabet : alphabets){
+        run(0, alphabet);
+        run(&pool, alphabet);
+    }
+    workerPoolDestroy(&pool);
+    return 0;
+}
@@ -0,0 +1,123 @@
+// glyph_atlas.h: LRU residency against a reference list, glyphs of the
+// current frame (the first one included) never being evicted, distance
+// fields matching with and without a worker pool, and quad UVs staying half
+// a texel inside the glyph's cell.
+
+#include "glyph_atlas.h"
+
+#include <list>
+#include <vector>
+
+#include "check.h"
+
+static uint8_t glyphPixels[256 * 256];
+
+// Every glyph is a disc whose radius depends on the codepoint; space is empty.
+static bool rasterizeDisc(void* context, uint32_t codepoint, int pixelSize, GlyphBitmap* out){
+    int r = pixelSize / 4 + (int)(codepoint % 7);
+    int w = 2 * r + 1;
+    for(int y = 0; y < w; y++){
+        for(int x = 0; x < w; x++){
+            float dx = (float)(x - r), dy = (float)(y - r);
+            glyphPixels[y * w + x] = sqrtf(dx * dx + dy * dy) < r ? 255 : 0;
+        }
+    }
+    out->width = codepoint == ' ' ? 0 : w;
+    out->height = codepoint == ' ' ? 0 : w;
+    out->pitch = w;
+    out->coverage = glyphPixels;
+    out->left = 2.0f;
+    out->top = (float)w;
+    out->advance = w + 4.0f;
+    return true;
+}
+
+// Four cells, filled before any glyphAtlasBeginFrame and then once more.
+static void testCurrentFrameKept(){
+    GlyphAtlas a;
+    CHECK(glyphAtlasInit(&a, 64, 64, 32, 12, 2, 2, rasterizeDisc, 0, 0));
+    for(uint32_t c = 'a'; c < 'e'; c++){
+        CHECK(glyphAtlasAcquire(&a, c) != GlyphAtlasNoSlot);
+    }
+    CHECK(glyphAtlasAcquire(&a, 'e') == GlyphAtlasNoSlot);
+    CHECK(a.stats.dropped == 1 && a.stats.evictions == 0);
+    for(uint32_t c = 'a'; c < 'e'; c++){
+        CHECK(glyphAtlasFind(&a, c) != GlyphAtlasNoSlot);
+    }
+    glyphAtlasBeginFrame(&a);
+    CHECK(glyphAtlasAcquire(&a, 'e') != GlyphAtlasNoSlot);
+    CHECK(glyphAtlasFind(&a, 'a') == GlyphAtlasNoSlot);
+    CHECK(a.stats.evictions == 1);
+    glyphAtlasDestroy(&a);
+}
+
+static void runFrames(WorkerPool* pool, std::vector<uint8_t>* pixels){
+    GlyphAtlas a;
+    CHECK(glyphAtlasInit(&a, 256, 256, 32, 20, 4, 4, rasterizeDisc, 0, pool));
+    TextStyle style = { 20.0f, 0xFFFFFFFF, 900.0f, 500.0f };
+    TextInstance instances[64];
+    std::list<uint32_t> lru;
+    srand(3);
+    for(int frame = 0; frame < 2000; frame++){
+        glyphAtlasBeginFrame(&a);
+        char text[40];
+        int length = rand() % 30;
+        for(int i = 0; i < length; i++){
+            text[i] = (char)(33 + rand() % (frame < 1000 ? 60 : 90));
+        }
+        text[length] = 0;
+        int n = textLayout(&a, text, 0.0f, 20.0f, &style, instances, 64);
+        CHECK(n == length);
+        for(int i = 0; i < length; i++){
+            lru.remove((uint8_t)text[i]);
+            lru.push_front((uint8_t)text[i]);
+        }
+        while(lru.size() > a.numSlots){
+            lru.pop_back();
+        }
+        for(uint32_t c : lru){
+            CHECK(glyphAtlasFind(&a, c) != GlyphAtlasNoSlot);
+        }
+        // The quad samples between texel centers of its own cell.
+        for(int i = 0; i < n; i++){
+            const TextInstance* t = &instances[i];
+            float u0 = t->u0 * a.width, v0 = t->v0 * a.height, u1 = t->u1 * a.width, v1 = t->v1 * a.height;
+            int cellX = (int)(u0 / a.cellSize) * a.cellSize;
+            int cellY = (int)(v0 / a.cellSize) * a.cellSize;
+            CHECK(u0 >= cellX + 0.5f && v0 >= cellY + 0.5f);
+            CHECK(u1 <= cellX + a.cellSize - 0.5f && v1 <= cellY + a.cellSize - 0.5f);
+            CHECK(u1 > u0 && v1 > v0);
+        }
+        glyphAtlasFlush(&a);
+        glyphAtlasClearDirty(&a);
+    }
+    CHECK(a.stats.dropped == 0);
+    for(uint32_t i = 0; i < a.numSlots; i++){
+        if(a.slots[i].codepoint != GlyphAtlasNoSlot){
+            CHECK(glyphAtlasFind(&a, a.slots[i].codepoint) == i);
+        }
+    }
+    // A disc is inside at its center, and its outermost ring of spread is empty.
+    uint32_t slot = glyphAtlasFind(&a, lru.front());
+    int cellX, cellY;
+    glyphAtlasSlotOrigin(&a, slot, &cellX, &cellY);
+    const GlyphSlot* s = &a.slots[slot];
+    const uint8_t* row = a.pixels + (size_t)(cellY + s->height / 2) * a.width + cellX;
+    CHECK(row[s->width / 2] > 128);
+    CHECK(row[0] < 16 && row[s->width - 1] < 16);
+    pixels->assign(a.pixels, a.pixels + (size_t)a.width * a.height);
+    glyphAtlasDestroy(&a);
+}
+
+int main(){
+    testCurrentFrameKept();
+    std::vector<uint8_t> alone, pooled;
+    runFrames(0, &alone);
+    WorkerPool pool;
+    workerPoolInit(&pool, 4);
+    runFrames(&pool, &pooled);
+    CHECK(pool.runs > 0);
+    workerPoolDestroy(&pool);
+    CHECK(alone == pooled);
+    return checkReport("glyph_atlas_test");
+}
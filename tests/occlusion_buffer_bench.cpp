@@ -0,0 +1,87 @@
+// Share of draws occlusion_buffer.h culls and what it costs per frame, for
+// 20000 draws of 8 to 72 pixels over a 1920x1080 screen on a 480x270 buffer:
+// a few HUD panels covering much of the screen, 512 medium occluders, and
+// 4096 of them. Each scene runs on the calling thread alone and on a pool
+// with every core; below 256 occluders rasterizing stays on one thread.
+// The first scene has no occluders at all, the floor every frame pays.
+
+#include "occlusion_buffer.h"
+
+#include <stdio.h>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+static const int Frames = 200;
+static const int Draws = 20000;
+
+struct Scene {
+    const char* name;
+    int occluders;
+    float minSize;
+    float maxSize;
+};
+
+static void run(WorkerPool* pool, const Scene* scene){
+    OcclusionBuffer ob;
+    if(!occlusionBufferInit(&ob, 1920.0f, 1080.0f, 480, 270, scene->occluders + 1, pool)){
+        return;
+    }
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<OcclusionRect> occluders(scene->occluders);
+    for(OcclusionRect& r : occluders){
+        float w = scene->minSize + uniform(rng) * (scene->maxSize - scene->minSize);
+        float h = (scene->minSize + uniform(rng) * (scene->maxSize - scene->minSize)) * 0.6f;
+        r.minX = uniform(rng) * 1920.0f - w / 2.0f;
+        r.minY = uniform(rng) * 1080.0f - h / 2.0f;
+        r.maxX = r.minX + w;
+        r.maxY = r.minY + h;
+        // Occluders sit in the front half of the layers.
+        r.depth = uniform(rng) * 0.5f;
+    }
+    std::vector<float> minX(Draws), minY(Draws), maxX(Draws), maxY(Draws), depth(Draws);
+    std::vector<uint32_t> ids(Draws), visible(Draws);
+    for(int i = 0; i < Draws; i++){
+        float w = uniform(rng) * 64.0f + 8.0f, h = uniform(rng) * 64.0f + 8.0f;
+        minX[i] = uniform(rng) * 1920.0f;
+        minY[i] = uniform(rng) * 1080.0f;
+        maxX[i] = minX[i] + w;
+        maxY[i] = minY[i] + h;
+        depth[i] = uniform(rng);
+        ids[i] = i;
+    }
+    for(int frame = 0; frame < Frames; frame++){
+        occlusionBeginFrame(&ob);
+        for(const OcclusionRect& r : occluders){
+            occlusionAddOccluder(&ob, r.minX, r.minY, r.maxX, r.maxY, r.depth);
+        }
+        occlusionRasterize(&ob);
+        occlusionCullBatch(&ob, ids.data(), Draws, minX.data(), minY.data(), maxX.data(), maxY.data(), depth.data(), visible.data());
+    }
+    const OcclusionStats* s = &ob.stats;
+    printf("  %-5s %4d occluders, %d threads: %5.1f%% culled, %6.3f ms rasterizing, %6.3f ms testing, %6.1f ns/draw\n", scene->name,
+           scene->occluders, scene->occluders >= (int)OcclusionParallelMin ? ob.numThreads : 1, 100.0 * s->culled / s->tested,
+           s->rasterSeconds * 1000.0 / s->frames, s->testSeconds * 1000.0 / s->frames,
+           (s->rasterSeconds + s->testSeconds) * 1e9 / s->tested);
+    occlusionBufferDestroy(&ob);
+}
+
+int main(){
+    WorkerPool pool;
+    workerPoolInit(&pool, (int)std::thread::hardware_concurrency());
+    printf("occlusion_buffer_bench: %d draws, %d frames, pool of %d threads\n", Draws, Frames, pool.numThreads);
+    Scene scenes[] = {
+        { "none", 0, 0.0f, 0.0f },
+        { "hud", 6, 400.0f, 900.0f },
+        { "some", 512, 40.0f, 340.0f },
+        { "many", 4096, 40.0f, 340.0f },
+    };
+    for(const Scene& scene : scenes){
+        run(0, &scene);
+        run(&pool, &scene);
+    }
+    workerPoolDestroy(&pool);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// occlusion_buffer.h: the buffer and the cull results of random scenes against
+// a brute force reference, per pixel, with occluder counts below and above the
+// point where rasterization goes to the worker pool, and the conservative
+// edges of a single occluder.
+
+#include "occlusion_buffer.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "check.h"
+
+static const float ScreenWidth = 1280.0f;
+static const float ScreenHeight = 720.0f;
+static const int Draws = 5000;
+
+static void testEdges(){
+    // One buffer pixel per screen pixel.
+    OcclusionBuffer ob;
+    CHECK(occlusionBufferInit(&ob, 64.0f, 64.0f, 64, 64, 4, 0));
+    occlusionBeginFrame(&ob);
+    CHECK(occlusionAddOccluder(&ob, 7.5f, 8.0f, 24.0f, 24.0f, 1.0f));
+    CHECK(occlusionRasterize(&ob));
+    // Only pixels covered completely are filled: column 7 is half covered.
+    CHECK(ob.depth[10 * ob.width + 7] == OcclusionEmpty);
+    CHECK(ob.depth[10 * ob.width + 8] == 1.0f);
+    CHECK(ob.depth[23 * ob.width + 23] == 1.0f);
+    CHECK(ob.depth[24 * ob.width + 23] == OcclusionEmpty);
+    CHECK(ob.tileMax[1 * ob.tilesX + 1] == 1.0f);
+    CHECK(ob.tileMax[1 * ob.tilesX + 0] == OcclusionEmpty);
+
+    CHECK(!occlusionTest(&ob, 8.0f, 8.0f, 24.0f, 24.0f, 2.0f));
+    CHECK(!occlusionTest(&ob, 9.5f, 9.5f, 10.5f, 10.5f, 2.0f));
+    // In front of the occluder, or at its depth.
+    CHECK(occlusionTest(&ob, 8.0f, 8.0f, 24.0f, 24.0f, 0.5f));
+    CHECK(occlusionTest(&ob, 8.0f, 8.0f, 24.0f, 24.0f, 1.0f));
+    // Touching an uncovered pixel by a fraction of it.
+    CHECK(occlusionTest(&ob, 8.0f, 8.0f, 24.1f, 24.0f, 2.0f));
+    CHECK(occlusionTest(&ob, 7.9f, 8.0f, 24.0f, 24.0f, 2.0f));
+    // Off the buffer is left to viewport culling.
+    CHECK(occlusionTest(&ob, -20.0f, -20.0f, -10.0f, -10.0f, 2.0f));
+
+    uint32_t ids[3] = { 0, 1, 2 };
+    float minX[3] = { 8.0f, 0.0f, 12.0f }, minY[3] = { 8.0f, 0.0f, 12.0f };
+    float maxX[3] = { 24.0f, 4.0f, 16.0f }, maxY[3] = { 24.0f, 4.0f, 16.0f };
+    float depth[3] = { 2.0f, 2.0f, 0.0f };
+    uint32_t visible[3];
+    CHECK(occlusionCullBatch(&ob, ids, 3, minX, minY, maxX, maxY, depth, visible) == 2);
+    CHECK(visible[0] == 1 && visible[1] == 2);
+    CHECK(ob.stats.tested == 3 && ob.stats.culled == 1);
+
+    // With no occluders nothing is culled.
+    occlusionBeginFrame(&ob);
+    CHECK(occlusionRasterize(&ob));
+    CHECK(occlusionCullBatch(&ob, ids, 3, minX, minY, maxX, maxY, depth, ids) == 3);
+    CHECK(ob.tileMax[1 * ob.tilesX + 1] == OcclusionEmpty);
+    occlusionBufferDestroy(&ob);
+}
+
+// Runs the same 40 random scenes every call; results gets whether each draw showed.
+static void testScenes(WorkerPool* pool, std::vector<char>* results){
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    int bufferMismatches = 0;
+    int drawMismatches = 0;
+    uint64_t culled = 0;
+    for(int scene = 0; scene < 40; scene++){
+        OcclusionBuffer ob;
+        // Starts with room for fewer bins than the big scenes need, so they grow.
+        CHECK(occlusionBufferInit(&ob, ScreenWidth, ScreenHeight, 320, 180, 1000, pool));
+        int numOccluders = scene % 2 ? 1000 : 40;
+        occlusionBeginFrame(&ob);
+        std::vector<OcclusionRect> occluders;
+        for(int i = 0; i < numOccluders; i++){
+            // Some hang over the edges of the screen.
+            float w = uniform(rng) * 400.0f + 10.0f, h = uniform(rng) * 300.0f + 10.0f;
+            float x = uniform(rng) * (ScreenWidth + 200.0f) - 100.0f - w / 2.0f;
+            float y = uniform(rng) * (ScreenHeight + 200.0f) - 100.0f - h / 2.0f;
+            float d = uniform(rng);
+            CHECK(occlusionAddOccluder(&ob, x, y, x + w, y + h, d));
+            OcclusionRect r = { x * ob.scaleX, y * ob.scaleY, (x + w) * ob.scaleX, (y + h) * ob.scaleY, d };
+            occluders.push_back(r);
+        }
+        CHECK(occlusionRasterize(&ob));
+
+        // Every pixel takes the nearest occluder covering it completely.
+        std::vector<float> reference((size_t)ob.width * ob.height, OcclusionEmpty);
+        for(const OcclusionRect& r : occluders){
+            int x0 = std::max(0, (int)ceilf(r.minX)), y0 = std::max(0, (int)ceilf(r.minY));
+            int x1 = std::min((int)ob.width, (int)floorf(r.maxX)), y1 = std::min((int)ob.height, (int)floorf(r.maxY));
+            for(int y = y0; y < y1; y++){
+                for(int x = x0; x < x1; x++){
+                    float* p = &reference[(size_t)y * ob.width + x];
+                    *p = std::min(*p, r.depth);
+                }
+            }
+        }
+        bufferMismatches += memcmp(reference.data(), ob.depth, reference.size() * sizeof(float)) != 0;
+
+        // A draw shows if any pixel it touches has nothing nearer than it.
+        std::vector<float> minX(Draws), minY(Draws), maxX(Draws), maxY(Draws), depth(Draws);
+        std::vector<uint32_t> ids(Draws), visible(Draws);
+        for(int i = 0; i < Draws; i++){
+            float w = uniform(rng) * 100.0f + 1.0f, h = uniform(rng) * 100.0f + 1.0f;
+            minX[i] = uniform(rng) * ScreenWidth - w / 2.0f;
+            minY[i] = uniform(rng) * ScreenHeight - h / 2.0f;
+            maxX[i] = minX[i] + w;
+            maxY[i] = minY[i] + h;
+            depth[i] = uniform(rng);
+            ids[i] = i;
+        }
+        uint32_t n = occlusionCullBatch(&ob, ids.data(), Draws, minX.data(), minY.data(), maxX.data(), maxY.data(), depth.data(), visible.data());
+        std::vector<char> shown(Draws, 0);
+        for(uint32_t i = 0; i < n; i++){
+            shown[visible[i]] = 1;
+        }
+        for(int i = 0; i < Draws; i++){
+            int x0 = std::max(0, (int)floorf(minX[i] * ob.scaleX)), y0 = std::max(0, (int)floorf(minY[i] * ob.scaleY));
+            int x1 = std::min((int)ob.width, (int)ceilf(maxX[i] * ob.scaleX)), y1 = std::min((int)ob.height, (int)ceilf(maxY[i] * ob.scaleY));
+            bool expected = x0 >= x1 || y0 >= y1;
+            for(int y = y0; y < y1 && !expected; y++){
+                for(int x = x0; x < x1 && !expected; x++){
+                    expected = !(reference[(size_t)y * ob.width + x] < depth[i]);
+                }
+            }
+            drawMismatches += expected != (shown[i] != 0);
+        }
+        results->insert(results->end(), shown.begin(), shown.end());
+        culled += Draws - n;
+        occlusionBufferDestroy(&ob);
+    }
+    CHECK(bufferMismatches == 0);
+    CHECK(drawMismatches == 0);
+    // The scenes have to cull something for the comparison to mean anything.
+    CHECK(culled > 40 * Draws / 10);
+}
+
+int main(){
+    testEdges();
+    std::vector<char> alone, pooled;
+    testScenes(0, &alone);
+    WorkerPool pool;
+    workerPoolInit(&pool, 4);
+    testScenes(&pool, &pooled);
+    CHECK(pool.runs > 0);
+    workerPoolDestroy(&pool);
+    CHECK(alone == pooled);
+    return checkReport("occlusion_buffer_test");
+}
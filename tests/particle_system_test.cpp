@@ -0,0 +1,81 @@
+// particle_system.h: every update against a scalar reference of the
+// particles alive before it, and identical output with and without a worker
+// pool, above the size where updates are split into slices.
+
+#include "particle_system.h"
+
+#include <vector>
+
+#include "check.h"
+
+static const uint32_t Capacity = 300000;
+
+static bool near(float a, float b){
+    return fabsf(a - b) <= 1e-5f * (1.0f + fabsf(b));
+}
+
+static void run(WorkerPool* pool, std::vector<ParticleInstance>* last){
+    ParticleSystem ps;
+    CHECK(particleSystemInit(&ps, Capacity, pool));
+    std::vector<ParticleInstance> out(Capacity);
+    // Fills up to the capacity by the middle of the run, so some emissions are dropped.
+    ParticleEmitter emitter = { 0.0f, -0.8f, 4000000.0f, 0.5f, 1.2f, 1.5708f, 0.6f, 0.02f, 0.5f, 0.01f, 0x3080FF };
+    std::vector<float> posX, posY, velX, velY, age, life, size;
+    std::vector<uint32_t> color;
+    for(int frame = 0; frame < 60; frame++){
+        float dt = frame % 7 == 0 ? 1.0f / 30.0f : 1.0f / 60.0f;
+        const ParticleArrays* a = &ps.arrays[ps.current];
+        uint32_t before = ps.count;
+        posX.assign(a->posX, a->posX + before);
+        posY.assign(a->posY, a->posY + before);
+        velX.assign(a->velX, a->velX + before);
+        velY.assign(a->velY, a->velY + before);
+        age.assign(a->age, a->age + before);
+        life.assign(a->life, a->life + before);
+        size.assign(a->size, a->size + before);
+        color.assign(a->color, a->color + before);
+
+        uint32_t n = particleSystemUpdate(&ps, &emitter, dt, out.data());
+        CHECK(n == ps.count && n <= Capacity);
+
+        // Particles that were alive before the update come first, in order.
+        float damping = 1.0f - ps.drag * dt;
+        uint32_t o = 0;
+        bool match = true;
+        for(uint32_t i = 0; i < before; i++){
+            float vx = velX[i] * damping + ps.gravityX * dt;
+            float vy = velY[i] * damping + ps.gravityY * dt;
+            float newAge = age[i] + dt;
+            if(newAge >= life[i]){
+                continue;
+            }
+            uint32_t alpha = (uint32_t)(255.0f - newAge / life[i] * 255.0f);
+            const ParticleInstance* p = &out[o];
+            match = match && near(p->x, posX[i] + vx * dt) && near(p->y, posY[i] + vy * dt) && p->size == size[i];
+            uint32_t gotAlpha = p->color >> 24;
+            match = match && (p->color & 0xFFFFFF) == color[i] && (gotAlpha + 1 >= alpha && gotAlpha <= alpha + 1);
+            o++;
+        }
+        CHECK(match);
+        CHECK(o <= n);
+        if(frame == 59){
+            last->assign(out.begin(), out.begin() + n);
+        }
+    }
+    CHECK(ps.stats.dropped > 0);
+    CHECK(ps.stats.emitted == ps.stats.expired + ps.count);
+    particleSystemDestroy(&ps);
+}
+
+int main(){
+    std::vector<ParticleInstance> alone, pooled;
+    run(0, &alone);
+    WorkerPool pool;
+    workerPoolInit(&pool, 4);
+    run(&pool, &pooled);
+    CHECK(pool.runs > 0);
+    workerPoolDestroy(&pool);
+    CHECK(alone.size() == pooled.size() && alone.size() > 64 * 1024);
+    CHECK(memcmp(alone.data(), pooled.data(), alone.size() * sizeof(ParticleInstance)) == 0);
+    return checkReport("particle_system_test");
+}
@@ -0,0 +1,98 @@
+// Throughput of every pixelConvert path on 1920x1080 images; pixel_convert_test
+// checks their output. The Makefile builds it once per kernel set: AVX2
+// (native), SSSE3, SSE2 and scalar (PIXEL_NO_SIMD).
+
+#include "pixel_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+static const uint32_t Width = 1920;
+static const uint32_t Height = 1080;
+
+struct ConvertPath {
+    const char* name;
+    PixelFormat src;
+    PixelFormat dst;
+    uint32_t flags;
+};
+
+static const ConvertPath paths[] = {
+    { "rgba8 -> rgba8", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, 0 },
+    { "bgra8 -> rgba8", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgb8 -> rgba8", PIXEL_FORMAT_RGB8, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgb8 -> bgra8", PIXEL_FORMAT_RGB8, PIXEL_FORMAT_BGRA8, 0 },
+    { "rgba8 -> rgb8", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGB8, 0 },
+    { "rgba16 -> rgba8", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgba16 -> rgba8 srgb", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB },
+    { "rgba32f -> rgba8", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgba32f -> rgba8 srgb", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB },
+    { "rgba32f -> rgba8 premul", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba32f -> rgba8 srgb premul", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba8 premul", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "bgra8 -> bgra8 premul", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_BGRA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba8 srgb premul", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba32f", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA32F, 0 },
+    { "bgra8 -> rgba32f srgb premul", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_RGBA32F, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+};
+
+int main(){
+#if defined(PIXEL_AVX2)
+    const char* kernels = "AVX2";
+#elif defined(PIXEL_SSSE3)
+    const char* kernels = "SSSE3";
+#elif defined(PIXEL_SSE2)
+    const char* kernels = "SSE2";
+#elif defined(PIXEL_NEON)
+    const char* kernels = "NEON";
+#else
+    const char* kernels = "scalar";
+#endif
+    printf("pixel_convert_bench: %s kernels, %ux%u\n", kernels, Width, Height);
+
+    size_t maxPitch = (size_t)Width * 16;
+    uint8_t* src = (uint8_t*)malloc(maxPitch * Height);
+    uint8_t* dst = (uint8_t*)malloc(maxPitch * Height);
+    int failures = 0;
+    srand(5);
+    for(const ConvertPath& path : paths){
+        size_t srcSize = pixelFormatSize(path.src);
+        size_t dstSize = pixelFormatSize(path.dst);
+        size_t srcPitch = Width * srcSize;
+        // Upload buffer style pitch with padding after each row.
+        size_t dstPitch = (Width * dstSize + 255) & ~(size_t)255;
+        if(path.src == PIXEL_FORMAT_RGBA32F){
+            // Out of range values too, so the clamps are exercised.
+            float* f = (float*)src;
+            for(size_t i = 0; i < (size_t)Width * Height * 4; i++){
+                f[i] = (rand() % 1400 - 200) / 1000.0f;
+            }
+        }else{
+            for(size_t i = 0; i < srcPitch * Height; i++){
+                src[i] = (uint8_t)rand();
+            }
+        }
+
+        if(!pixelConvert(path.src, src, srcPitch, path.dst, dst, dstPitch, Width, Height, path.flags)){
+            printf("  %-30s unsupported\n", path.name);
+            failures++;
+            continue;
+        }
+        int runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0.0;
+        while(seconds < 0.25){
+            pixelConvert(path.src, src, srcPitch, path.dst, dst, dstPitch, Width, Height, path.flags);
+            runs++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double pixels = (double)Width * Height * runs;
+        printf("  %-30s %8.1f Mpixels/s  %6.2f GB/s\n", path.name, pixels / seconds * 1e-6,
+               pixels * (srcSize + dstSize) / seconds * 1e-9);
+    }
+    free(src);
+    free(dst);
+    return failures ? 1 : 0;
+}
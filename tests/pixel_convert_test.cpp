@@ -0,0 +1,188 @@
+// Every pixelConvert path checked byte for byte against a per-pixel reference
+// written from the scalar definitions. Widths run from 1 to past the widest
+// vector step, so each kernel's scalar tail loop handles every remainder. The
+// Makefile builds it once per kernel set: AVX2 (native), SSSE3, SSE2 and
+// scalar (PIXEL_NO_SIMD).
+
+#include "pixel_convert.h"
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "check.h"
+
+static const uint32_t Height = 3;
+
+struct ConvertPath {
+    const char* name;
+    PixelFormat src;
+    PixelFormat dst;
+    uint32_t flags;
+};
+
+static const ConvertPath paths[] = {
+    { "rgba8 -> rgba8", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, 0 },
+    { "bgra8 -> rgba8", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgb8 -> rgba8", PIXEL_FORMAT_RGB8, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgb8 -> bgra8", PIXEL_FORMAT_RGB8, PIXEL_FORMAT_BGRA8, 0 },
+    { "rgba8 -> rgb8", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGB8, 0 },
+    { "rgba16 -> rgba8", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgba16 -> bgra8 premul", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_BGRA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba16 -> rgba8 srgb", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB },
+    { "rgba16 -> rgba8 srgb premul", PIXEL_FORMAT_RGBA16, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba32f -> rgba8", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, 0 },
+    { "rgba32f -> rgba8 srgb", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB },
+    { "rgba32f -> rgba8 premul", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba32f -> bgra8 srgb premul", PIXEL_FORMAT_RGBA32F, PIXEL_FORMAT_BGRA8, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba8 premul", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "bgra8 -> bgra8 premul", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_BGRA8, PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba8 srgb premul", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA8, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+    { "rgba8 -> rgba32f", PIXEL_FORMAT_RGBA8, PIXEL_FORMAT_RGBA32F, 0 },
+    { "bgra8 -> rgba32f srgb premul", PIXEL_FORMAT_BGRA8, PIXEL_FORMAT_RGBA32F, PIXEL_CONVERT_SRGB | PIXEL_CONVERT_PREMULTIPLY },
+};
+
+static uint8_t unorm8(float v){
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t)lrintf(v * 255.0f);
+}
+
+static uint8_t premultiply8(uint8_t c, uint8_t a){
+    uint32_t t = c * a + 128;
+    return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+// One pixel of pixelConvert, straight from the definitions.
+static void referencePixel(const ConvertPath* path, const uint8_t* src, uint8_t* dst){
+    const PixelSrgbTables* tables = pixelSrgbTables();
+    bool srgb = (path->flags & PIXEL_CONVERT_SRGB) != 0;
+    bool premultiply = (path->flags & PIXEL_CONVERT_PREMULTIPLY) != 0;
+    uint8_t rgba[4];
+    // Sources with more than 8 bits are encoded from linear floats.
+    bool fromFloat = path->src == PIXEL_FORMAT_RGBA32F || (path->src == PIXEL_FORMAT_RGBA16 && srgb);
+    if(fromFloat){
+        float f[4];
+        for(int c = 0; c < 4; c++){
+            f[c] = path->src == PIXEL_FORMAT_RGBA32F ? ((const float*)src)[c] : ((const uint16_t*)src)[c] * (1.0f / 65535.0f);
+        }
+        float a = f[3] < 0.0f ? 0.0f : (f[3] > 1.0f ? 1.0f : f[3]);
+        for(int c = 0; c < 3; c++){
+            float v = premultiply ? f[c] * a : f[c];
+            rgba[c] = srgb ? pixelLinearToSrgb8(v, tables) : unorm8(v);
+        }
+        rgba[3] = unorm8(f[3]);
+    }else{
+        for(int c = 0; c < 4; c++){
+            switch(path->src){
+                case PIXEL_FORMAT_RGBA8: rgba[c] = src[c]; break;
+                case PIXEL_FORMAT_BGRA8: rgba[c] = src[c == 3 ? 3 : 2 - c]; break;
+                case PIXEL_FORMAT_RGB8: rgba[c] = c == 3 ? 255 : src[c]; break;
+                default: rgba[c] = (uint8_t)floor(((const uint16_t*)src)[c] * 255.0 / 65535.0 + 0.5); break;
+            }
+        }
+        if(path->dst == PIXEL_FORMAT_RGBA32F){
+            float* f = (float*)dst;
+            for(int c = 0; c < 4; c++){
+                f[c] = srgb && c < 3 ? tables->toLinear[rgba[c]] : rgba[c] * (1.0f / 255.0f);
+            }
+            for(int c = 0; c < 3 && premultiply; c++){
+                f[c] *= f[3];
+            }
+            return;
+        }
+        for(int c = 0; c < 3 && premultiply; c++){
+            rgba[c] = srgb ? pixelLinearToSrgb8(tables->toLinear[rgba[c]] * (rgba[3] * (1.0f / 255.0f)), tables) : premultiply8(rgba[c], rgba[3]);
+        }
+    }
+    switch(path->dst){
+        case PIXEL_FORMAT_BGRA8: dst[0] = rgba[2]; dst[1] = rgba[1]; dst[2] = rgba[0]; dst[3] = rgba[3]; break;
+        case PIXEL_FORMAT_RGB8: memcpy(dst, rgba, 3); break;
+        default: memcpy(dst, rgba, 4); break;
+    }
+}
+
+static void fillSource(const ConvertPath* path, uint8_t* src, size_t size){
+    if(path->src == PIXEL_FORMAT_RGBA32F){
+        // Out of range values too, to check the clamping.
+        float* f = (float*)src;
+        for(size_t i = 0; i < size / 4; i++){
+            f[i] = (rand() % 1400 - 200) / 1000.0f;
+        }
+    }else{
+        for(size_t i = 0; i < size; i++){
+            src[i] = (uint8_t)rand();
+        }
+    }
+}
+
+static void testPath(const ConvertPath* path, uint32_t width){
+    size_t srcSize = pixelFormatSize(path->src);
+    size_t dstSize = pixelFormatSize(path->dst);
+    size_t srcPitch = width * srcSize;
+    // Upload buffer style pitch with padding after each row, which must stay untouched.
+    size_t dstPitch = (width * dstSize + 255) & ~(size_t)255;
+    std::vector<uint8_t> src(srcPitch * Height);
+    std::vector<uint8_t> dst(dstPitch * Height, 0xCD);
+    fillSource(path, src.data(), src.size());
+
+    CHECK(pixelConvert(path->src, src.data(), srcPitch, path->dst, dst.data(), dstPitch, width, Height, path->flags));
+    int bad = 0;
+    for(uint32_t y = 0; y < Height; y++){
+        for(uint32_t x = 0; x < width; x++){
+            uint8_t expected[16];
+            referencePixel(path, src.data() + y * srcPitch + x * srcSize, expected);
+            bad += memcmp(expected, dst.data() + y * dstPitch + x * dstSize, dstSize) != 0;
+        }
+        for(size_t i = width * dstSize; i < dstPitch; i++){
+            bad += dst[y * dstPitch + i] != 0xCD;
+        }
+    }
+    if(bad){
+        fprintf(stderr, "%s, width %u: %d bytes or pixels differ\n", path->name, width, bad);
+    }
+    CHECK(bad == 0);
+}
+
+static void testRefused(){
+    uint8_t src[64] = {};
+    uint8_t dst[64];
+    // Alpha has to be there to premultiply against.
+    CHECK(!pixelConvert(PIXEL_FORMAT_RGBA8, src, 16, PIXEL_FORMAT_RGB8, dst, 12, 4, 1, PIXEL_CONVERT_PREMULTIPLY));
+    CHECK(!pixelConvert(PIXEL_FORMAT_RGBA8, src, 16, PIXEL_FORMAT_RGB8, dst, 12, 4, 1, PIXEL_CONVERT_SRGB));
+    CHECK(!pixelConvert(PIXEL_FORMAT_RGBA16, src, 32, PIXEL_FORMAT_RGBA32F, dst, 64, 4, 1, 0));
+    CHECK(!pixelConvert(PIXEL_FORMAT_RGB8, src, 12, PIXEL_FORMAT_RGBA16, dst, 32, 4, 1, 0));
+}
+
+static void testRgba16Srgb(){
+    // Mid grey in linear 16-bit encodes to sRGB 188, not to the 128 the
+    // plain unorm conversion gives; alpha stays linear.
+    uint16_t src[4] = { 32768, 32768, 32768, 32768 };
+    uint8_t dst[4];
+    CHECK(pixelConvert(PIXEL_FORMAT_RGBA16, src, 8, PIXEL_FORMAT_RGBA8, dst, 4, 1, 1, PIXEL_CONVERT_SRGB));
+    CHECK(dst[0] == 188 && dst[1] == 188 && dst[2] == 188 && dst[3] == 128);
+    CHECK(pixelConvert(PIXEL_FORMAT_RGBA16, src, 8, PIXEL_FORMAT_RGBA8, dst, 4, 1, 1, 0));
+    CHECK(dst[0] == 128 && dst[3] == 128);
+}
+
+int main(){
+    srand(5);
+    for(const ConvertPath& path : paths){
+        for(uint32_t width = 1; width <= 72; width++){
+            testPath(&path, width);
+        }
+        testPath(&path, 1027);
+    }
+    testRefused();
+    testRgba16Srgb();
+#if defined(PIXEL_AVX2)
+    return checkReport("pixel_convert_test (AVX2)");
+#elif defined(PIXEL_SSSE3)
+    return checkReport("pixel_convert_test (SSSE3)");
+#elif defined(PIXEL_SSE2)
+    return checkReport("pixel_convert_test (SSE2)");
+#elif defined(PIXEL_NEON)
+    return checkReport("pixel_convert_test (NEON)");
+#else
+    return checkReport("pixel_convert_test (scalar)");
+#endif
+}
@@ -0,0 +1,196 @@
+// startup_graph.h on a stubbed copy of the color triangle demo's 17 startup
+// steps, each sleeping for a duration typical of a cold D3D12 start: the
+// dependency order on 1, 2, 4 and 8 threads, the pinned swap chain staying on
+// the calling thread, failing shader compiles skipping what depends on them
+// and reporting why, and a cycle refusing to run.
+
+#include "startup_graph.h"
+
+#include <string.h>
+
+#include <thread>
+
+#include "check.h"
+
+struct Stub {
+    StartupGraph* graph;
+    int ms;
+    // Recorded before failing, 0 for a step that succeeds.
+    const char* error;
+    bool ran;
+    std::thread::id ranOn;
+};
+
+static bool stubStep(void* context){
+    Stub* stub = (Stub*)context;
+    stub->ran = true;
+    stub->ranOn = std::this_thread::get_id();
+    std::this_thread::sleep_for(std::chrono::milliseconds(stub->ms));
+    if(stub->error){
+        startupGraphSetError(stub->graph, stub->error);
+        return false;
+    }
+    return true;
+}
+
+// The demo's steps, in the order it adds them.
+struct DemoSteps {
+    int device, swapChain, sceneTarget;
+    int rootSignature, upscaleRootSignature;
+    int vs, ps, particleVs, particlePs, upscaleVs, upscalePs;
+    int pso, particlePso, upscalePso;
+    int particleInit, upload, firstFence;
+};
+
+static void buildDemo(StartupGraph* g, Stub* stubs, DemoSteps* d){
+    startupGraphInit(g);
+    int n = 0;
+    struct { int* id; const char* name; int ms; } steps[] = {
+        { &d->device, "device", 60 },
+        { &d->swapChain, "swap chain", 25 },
+        { &d->sceneTarget, "scene target", 2 },
+        { &d->rootSignature, "root signature", 3 },
+        { &d->upscaleRootSignature, "upscale root signature", 3 },
+        { &d->vs, "shaders.hlsl VSMain", 45 },
+        { &d->ps, "shaders.hlsl PSMain", 35 },
+        { &d->particleVs, "particle_shaders.hlsl VSMain", 50 },
+        { &d->particlePs, "particle_shaders.hlsl PSMain", 40 },
+        { &d->upscaleVs, "upscale_shaders.hlsl VSMain", 30 },
+        { &d->upscalePs, "upscale_shaders.hlsl PSMain", 35 },
+        { &d->pso, "pso", 15 },
+        { &d->particlePso, "particle pso", 15 },
+        { &d->upscalePso, "upscale pso", 12 },
+        { &d->particleInit, "particle init", 20 },
+        { &d->upload, "upload", 8 },
+        { &d->firstFence, "first fence wait", 10 },
+    };
+    for(auto& step : steps){
+        Stub stub = { g, step.ms, 0, false, std::thread::id() };
+        stubs[n] = stub;
+        *step.id = startupGraphAdd(g, step.name, stubStep, &stubs[n++]);
+    }
+    startupGraphDepend(g, d->swapChain, d->device);
+    startupGraphPin(g, d->swapChain);
+    startupGraphDepend(g, d->sceneTarget, d->device);
+    startupGraphDepend(g, d->sceneTarget, d->swapChain);
+    int psoDeps[] = { d->device, d->rootSignature, d->vs, d->ps };
+    int particlePsoDeps[] = { d->pso, d->particleVs, d->particlePs };
+    int upscalePsoDeps[] = { d->device, d->upscaleRootSignature, d->upscaleVs, d->upscalePs };
+    int firstFenceDeps[] = { d->sceneTarget, d->pso, d->particlePso, d->upscalePso, d->upload };
+    for(int dep : psoDeps){
+        startupGraphDepend(g, d->pso, dep);
+    }
+    for(int dep : particlePsoDeps){
+        startupGraphDepend(g, d->particlePso, dep);
+    }
+    for(int dep : upscalePsoDeps){
+        startupGraphDepend(g, d->upscalePso, dep);
+    }
+    startupGraphDepend(g, d->upload, d->device);
+    for(int dep : firstFenceDeps){
+        startupGraphDepend(g, d->firstFence, dep);
+    }
+}
+
+// Every step ran once and after everything it depends on.
+static void checkOrder(const StartupGraph* g, const Stub* stubs){
+    int early = 0;
+    for(int i = 0; i < g->numSteps; i++){
+        const StartupStep* s = &g->steps[i];
+        CHECK(s->state == STARTUP_STEP_DONE && stubs[i].ran);
+        for(int d = 0; d < s->numDeps; d++){
+            early += s->start < g->steps[s->deps[d]].end;
+        }
+    }
+    CHECK(early == 0);
+}
+
+static void testThreads(){
+    static StartupGraph g;
+    static Stub stubs[StartupGraphMaxSteps];
+    DemoSteps d;
+    std::thread::id self = std::this_thread::get_id();
+    double serial = 0.0;
+    int threadCounts[] = { 1, 2, 4, 8 };
+    for(int threads : threadCounts){
+        buildDemo(&g, stubs, &d);
+        CHECK(g.numSteps == 17);
+        CHECK(startupGraphRun(&g, threads));
+        CHECK(g.firstFailed == -1);
+        checkOrder(&g, stubs);
+        CHECK(g.steps[d.swapChain].thread == 0 && stubs[d.swapChain].ranOn == self);
+
+        int path[StartupGraphMaxSteps];
+        double critical;
+        int length = startupGraphCriticalPath(&g, path, &critical);
+        CHECK(length >= 3 && path[0] == d.device && path[length - 1] == d.firstFence);
+        CHECK(g.wallSeconds >= critical);
+        if(threads == 1){
+            serial = g.wallSeconds;
+        }else{
+            printf("  %d threads: %.1f ms wall, %.1f ms serial, %.1f ms critical path\n", threads, g.wallSeconds * 1000.0,
+                   serial * 1000.0, critical * 1000.0);
+        }
+    }
+    // 408 ms of sleeps against a 100 ms critical path; sleeps overlap on any number of cores.
+    CHECK(g.wallSeconds < serial / 2.0);
+    startupGraphPrintReport(&g, stdout);
+}
+
+static void testFailure(){
+    static StartupGraph g;
+    static Stub stubs[StartupGraphMaxSteps];
+    DemoSteps d;
+    buildDemo(&g, stubs, &d);
+    stubs[d.ps].error = "shaders.hlsl(12,5): error X3004: undeclared identifier 'color'";
+    stubs[d.upscaleVs].error = "upscale_shaders.hlsl: file not found";
+    CHECK(!startupGraphRun(&g, 4));
+    CHECK(g.steps[d.ps].state == STARTUP_STEP_FAILED && g.steps[d.upscaleVs].state == STARTUP_STEP_FAILED);
+    // Each failure keeps its own message, and the one that finished first is reported.
+    CHECK(strcmp(g.steps[d.ps].error, stubs[d.ps].error) == 0);
+    CHECK(strcmp(g.steps[d.upscaleVs].error, stubs[d.upscaleVs].error) == 0);
+    CHECK(g.firstFailed == d.ps || g.firstFailed == d.upscaleVs);
+    CHECK(g.firstFailed >= 0 && g.steps[g.firstFailed].end <= g.steps[d.ps].end && g.steps[g.firstFailed].end <= g.steps[d.upscaleVs].end);
+
+    // Whatever depends on a failure, directly or not, is skipped without running.
+    int skipped[] = { d.pso, d.particlePso, d.upscalePso, d.firstFence };
+    for(int step : skipped){
+        CHECK(g.steps[step].state == STARTUP_STEP_SKIPPED && !stubs[step].ran && g.steps[step].error[0] == 0);
+    }
+    int done[] = { d.device, d.swapChain, d.sceneTarget, d.particleVs, d.particlePs, d.particleInit, d.upload };
+    for(int step : done){
+        CHECK(g.steps[step].state == STARTUP_STEP_DONE && g.steps[step].error[0] == 0);
+    }
+    startupGraphPrintReport(&g, stdout);
+
+    // Outside a run there is no step to blame.
+    startupGraphSetError(&g, "late");
+    CHECK(strcmp(g.steps[d.ps].error, stubs[d.ps].error) == 0);
+
+    // Running the same graph again starts from clean errors.
+    stubs[d.ps].error = 0;
+    stubs[d.upscaleVs].error = 0;
+    CHECK(startupGraphRun(&g, 4));
+    CHECK(g.firstFailed == -1 && g.steps[d.ps].error[0] == 0);
+}
+
+static void testCycle(){
+    static StartupGraph g;
+    startupGraphInit(&g);
+    Stub stub = { &g, 1, 0, false, std::thread::id() };
+    int a = startupGraphAdd(&g, "a", stubStep, &stub);
+    int b = startupGraphAdd(&g, "b", stubStep, &stub);
+    int c = startupGraphAdd(&g, "c", stubStep, &stub);
+    startupGraphDepend(&g, b, a);
+    startupGraphDepend(&g, c, b);
+    startupGraphDepend(&g, b, c);
+    CHECK(!startupGraphRun(&g, 2));
+    CHECK(!stub.ran && g.firstFailed == -1);
+}
+
+int main(){
+    testThreads();
+    testFailure();
+    testCycle();
+    return checkReport("startup_graph_test");
+}
@@ -0,0 +1,77 @@
+// Costs of texture_cache.h: hashing a 2048x2048 RGBA texture, and the
+// bookkeeping of an acquire and its release with path keys, so no pixels are
+// hashed. Each frame acquires 200 of 20000 keys, popular ones far more often
+// (geometric, p = 0.001), releases them all and trims, with a 4096 entry cache
+// whose budget holds 2048 of the 256 KB textures.
+
+#include "texture_cache.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+static const int Frames = 2000;
+static const int AcquiresPerFrame = 200;
+
+int main(){
+    std::mt19937 rng(3);
+
+    std::vector<uint8_t> pixels(2048 * 2048 * 4);
+    for(uint8_t& b : pixels){
+        b = (uint8_t)rng();
+    }
+    TextureCacheDesc big = { 2048, 2048, 28, pixels.size() };
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    uint64_t h = 0;
+    for(int i = 0; i < 20; i++){
+        h += textureCacheHashPixels(&big, pixels.data(), 2048 * 4, 2048 * 4);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    printf("texture_cache_bench\n  hash: %.2f GB/s (%016llx)\n", 20.0 * pixels.size() / seconds / 1e9, (unsigned long long)h);
+
+    TextureCache c;
+    TextureCacheDesc desc = { 256, 256, 28, 256 * 256 * 4 };
+    if(!textureCacheInit(&c, 4096, desc.bytes * 2048)){
+        return 1;
+    }
+    std::vector<uint64_t> keys(20000);
+    for(uint64_t& k : keys){
+        k = (uint64_t)rng() << 32 | rng();
+    }
+    // Drawn up front so the timing is the cache's alone.
+    std::geometric_distribution<int> popularity(0.001);
+    std::vector<uint32_t> picks((size_t)Frames * AcquiresPerFrame);
+    for(uint32_t& p : picks){
+        p = popularity(rng) % keys.size();
+    }
+    std::vector<uint32_t> held;
+    held.reserve(AcquiresPerFrame);
+    began = std::chrono::steady_clock::now();
+    for(int frame = 0; frame < Frames; frame++){
+        for(int k = 0; k < AcquiresPerFrame; k++){
+            uint64_t key = keys[picks[(size_t)frame * AcquiresPerFrame + k]];
+            uint32_t entry = textureCacheFind(&c, key, &desc);
+            if(entry == TextureCacheInvalid){
+                entry = textureCacheInsert(&c, key, &desc);
+            }
+            if(entry != TextureCacheInvalid){
+                held.push_back(entry);
+            }
+        }
+        for(uint32_t entry : held){
+            textureCacheRelease(&c, entry, frame + 1);
+        }
+        held.clear();
+        // The GPU two frames behind.
+        textureCacheTrim(&c, frame > 1 ? frame - 1 : 0);
+        textureCacheEvictionsReleased(&c);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    printf("  acquire + release: %.1f ns, %.1f%% hits\n", seconds * 1e9 / picks.size(), 100.0 * c.stats.hits / c.stats.acquires);
+    printf("  ");
+    textureCachePrintStats(&c, stdout);
+    textureCacheDestroy(&c);
+    return 0;
+}
@@ -0,0 +1,218 @@
+// texture_cache.h: eviction order, fences, budget overruns and refusals on a
+// small cache, then a long random acquire and release workload checked against
+// a shadow of every reference held. Resources are heap blocks freed when
+// evicted, so running under ASan (make SANITIZE=address test) also catches a
+// resource released twice, used after eviction, or never released.
+
+#include "texture_cache.h"
+
+#include <random>
+#include <vector>
+
+#include "check.h"
+
+static const uint32_t Format = 28;
+
+static TextureCacheDesc square(uint32_t size){
+    TextureCacheDesc d = { size, size, Format, (uint64_t)size * size * 4 };
+    return d;
+}
+
+static void testPolicy(){
+    TextureCache c;
+    // Room for three 1 KB textures in the budget, four entries.
+    CHECK(textureCacheInit(&c, 4, 3 * 1024));
+    TextureCacheDesc d = square(16);
+    uint32_t e[4];
+    for(int i = 0; i < 3; i++){
+        e[i] = textureCacheInsert(&c, 100 + i, &d);
+        CHECK(e[i] == (uint32_t)i);
+    }
+    CHECK(textureCacheFind(&c, 101, &d) == e[1]);
+    CHECK(textureCacheGet(&c, e[1])->refCount == 2);
+    // A different size under the same hash is a different texture.
+    TextureCacheDesc other = square(8);
+    CHECK(textureCacheFind(&c, 101, &other) == TextureCacheInvalid);
+
+    // Released in the order 2, 0, 1: 2 goes first, 1 last.
+    textureCacheRelease(&c, e[2], 5);
+    textureCacheRelease(&c, e[0], 6);
+    textureCacheRelease(&c, e[1], 6);
+    textureCacheRelease(&c, e[1], 7);
+    CHECK(c.tail == e[2] && c.head == e[1]);
+
+    // Over budget, but the GPU hasn't finished frame 5 yet.
+    e[3] = textureCacheInsert(&c, 103, &d);
+    CHECK(e[3] == 3 && c.stats.evictions == 0 && c.stats.overBudget == 1);
+    textureCacheTrim(&c, 4);
+    CHECK(c.numEvicted == 0 && c.residentBytes == 4 * 1024);
+    textureCacheTrim(&c, 5);
+    CHECK(c.numEvicted == 1 && c.evicted[0].descriptor == TextureCacheInvalid);
+    CHECK(textureCacheLookup(&c, 102, 0) == TextureCacheInvalid);
+    CHECK(c.residentBytes == 3 * 1024);
+    textureCacheEvictionsReleased(&c);
+
+    // Reviving an unreferenced texture takes it off the eviction list.
+    CHECK(textureCacheFind(&c, 100, 0) == e[0]);
+    CHECK(c.stats.revived == 1);
+    CHECK(c.tail == e[1] && c.head == e[1]);
+
+    // Everything referenced and the budget full: the next insert still gets
+    // the free entry, the one after is refused.
+    CHECK(textureCacheFind(&c, 101, 0) == e[1]);
+    uint32_t extra = textureCacheInsert(&c, 104, &d);
+    CHECK(extra != TextureCacheInvalid);
+    CHECK(textureCacheInsert(&c, 105, &d) == TextureCacheInvalid);
+    CHECK(c.stats.full == 1);
+    textureCacheDestroy(&c);
+}
+
+static void testHash(){
+    std::mt19937 rng(5);
+    TextureCacheDesc d = { 13, 7, Format, 13 * 7 * 4 };
+    // The same pixels with and without padding at the end of rows.
+    std::vector<uint8_t> tight(13 * 7 * 4), padded(64 * 7, 0xCD);
+    for(uint32_t y = 0; y < 7; y++){
+        for(uint32_t x = 0; x < 13 * 4; x++){
+            tight[y * 52 + x] = padded[y * 64 + x] = (uint8_t)rng();
+        }
+    }
+    uint64_t h = textureCacheHashPixels(&d, tight.data(), 52, 52);
+    CHECK(textureCacheHashPixels(&d, padded.data(), 52, 64) == h);
+    tight[3 * 52 + 51] ^= 1;
+    CHECK(textureCacheHashPixels(&d, tight.data(), 52, 52) != h);
+    tight[3 * 52 + 51] ^= 1;
+    TextureCacheDesc wide = { 7, 13, Format, 13 * 7 * 4 };
+    CHECK(textureCacheHashPixels(&wide, tight.data(), 28, 28) != h);
+    CHECK(textureCacheHashKey("a.png", "x", 1) != textureCacheHashKey("a.png", "y", 1));
+}
+
+// What the test knows about every entry, from its own bookkeeping.
+struct Shadow {
+    std::vector<uint32_t> refs;
+    std::vector<uint64_t> lastUse;
+    // Evicted list entries already looked at.
+    uint32_t checked;
+    int live;
+    int evictedHeld;
+    int evictedEarly;
+};
+
+// Checks and frees what was evicted since the last call. Inserts evict too,
+// so this runs before an inserted entry, possibly a reused one, is counted.
+static void collectEvicted(TextureCache* c, Shadow* s){
+    for(; s->checked < c->numEvicted; s->checked++){
+        uint32_t entry = c->evicted[s->checked].descriptor;
+        s->evictedHeld += s->refs[entry] != 0;
+        s->evictedEarly += s->lastUse[entry] > c->completedFence;
+        delete (int*)c->evicted[s->checked].resource;
+        s->live--;
+    }
+}
+
+static void testRandom(){
+    std::mt19937 rng(3);
+    TextureCache c;
+    CHECK(textureCacheInit(&c, 256, 12ull << 20));
+    // 400 images of 16 to 256 pixels square; every fourth repeats the one before.
+    const int Images = 400;
+    std::vector<std::vector<uint8_t> > pixels(Images);
+    std::vector<TextureCacheDesc> descs(Images);
+    for(int i = 0; i < Images; i++){
+        if(i % 4 == 3){
+            pixels[i] = pixels[i - 1];
+            descs[i] = descs[i - 1];
+            continue;
+        }
+        descs[i] = square(16u << (rng() % 5));
+        pixels[i].resize(descs[i].bytes);
+        for(uint8_t& b : pixels[i]){
+            b = (uint8_t)rng();
+        }
+    }
+
+    std::vector<uint32_t> held;
+    Shadow shadow = { std::vector<uint32_t>(c.capacity, 0), std::vector<uint64_t>(c.capacity, 0), 0, 0, 0, 0 };
+    int wrongImage = 0, refMismatches = 0, byteMismatches = 0, lost = 0;
+    uint64_t refused = 0;
+    for(uint64_t fence = 1; fence <= 20000; fence++){
+        for(int k = 0; k < 4; k++){
+            int image = rng() % Images;
+            const TextureCacheDesc* d = &descs[image];
+            bool created;
+            uint32_t entry = textureCacheAcquire(&c, d, pixels[image].data(), d->width * 4, d->width * 4, &created);
+            collectEvicted(&c, &shadow);
+            if(entry == TextureCacheInvalid){
+                refused++;
+                continue;
+            }
+            if(created){
+                CHECK(shadow.refs[entry] == 0);
+                textureCacheSetResource(&c, entry, new int(image), entry);
+                shadow.live++;
+            }else{
+                int owner = *(int*)textureCacheGet(&c, entry)->resource;
+                wrongImage += owner != image && pixels[owner] != pixels[image];
+            }
+            shadow.refs[entry]++;
+            held.push_back(entry);
+        }
+        // Keep about 40 references, dropped in random order.
+        while(held.size() > 40){
+            size_t j = rng() % held.size();
+            uint32_t entry = held[j];
+            textureCacheRelease(&c, entry, fence);
+            shadow.refs[entry]--;
+            shadow.lastUse[entry] = fence;
+            held[j] = held.back();
+            held.pop_back();
+        }
+        // Two frames in flight.
+        textureCacheTrim(&c, fence > 2 ? fence - 2 : 0);
+        collectEvicted(&c, &shadow);
+        textureCacheEvictionsReleased(&c);
+        shadow.checked = 0;
+
+        uint64_t bytes = 0;
+        for(uint32_t i = 0; i < c.capacity; i++){
+            const TextureCacheEntry* e = &c.entries[i];
+            if(e->live){
+                bytes += e->desc.bytes;
+                refMismatches += e->refCount != shadow.refs[i];
+                lost += textureCacheLookup(&c, e->hash, &e->desc) != i;
+            }
+        }
+        byteMismatches += bytes != c.residentBytes;
+    }
+    CHECK(wrongImage == 0);
+    CHECK(refMismatches == 0);
+    CHECK(shadow.evictedHeld == 0);
+    CHECK(shadow.evictedEarly == 0);
+    CHECK(byteMismatches == 0);
+    CHECK(lost == 0);
+    CHECK(refused == c.stats.full);
+    // The workload has to exercise the cache for any of this to mean much.
+    CHECK(c.stats.evictions > 1000 && c.stats.revived > 1000 && c.stats.dedupBytes > 0);
+    // Only the 40 held and the few released in the last two frames can keep it over.
+    CHECK(c.stats.peakBytes <= c.budgetBytes + (256ull * 256 * 4) * 48);
+    textureCachePrintStats(&c, stdout);
+
+    for(uint32_t entry : held){
+        textureCacheRelease(&c, entry, 20001);
+    }
+    for(uint32_t i = 0; i < c.capacity; i++){
+        if(c.entries[i].live){
+            delete (int*)c.entries[i].resource;
+            shadow.live--;
+        }
+    }
+    CHECK(shadow.live == 0);
+    textureCacheDestroy(&c);
+}
+
+int main(){
+    testPolicy();
+    testHash();
+    testRandom();
+    return checkReport("texture_cache_test");
+}
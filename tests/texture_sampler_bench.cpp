@@ -0,0 +1,114 @@
+// Texels per second for texture_sampler.h: every filter, address mode and
+// layout, sampling a 1024x1024 mipped texture along perspective spans of a
+// tilted 900x500 quad whose uvs run past the edges. Output texels are the
+// filtered values, one per pixel; fetched texels count every tap the filter
+// reads, 4 for bilinear and 4 or 8 for trilinear depending on the lod. The two
+// layouts have to produce the same frames. Build with
+// CXXFLAGS="-std=c++11 -O2 -mno-avx2" to time the 8-lane scalar path instead
+// of AVX2.
+
+#include "texture_sampler.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+static const uint32_t TextureSize = 1024;
+static const int FrameWidth = 900;
+static const int FrameHeight = 500;
+static const int Frames = 2;
+
+static void rowSpan(int frame, int y, SamplerSpan* span){
+    // Rows further up are further away: smaller 1/w, more texels per pixel.
+    float depth = 1.0f + 3.0f * (float)y / FrameHeight;
+    span->oneOverW = 1.0f / depth;
+    span->uOverW = (0.1f * frame - 0.2f) * span->oneOverW;
+    span->vOverW = ((float)y / FrameHeight * 2.0f - 0.3f) * span->oneOverW;
+    span->stepOneOverW = 0.0f;
+    span->stepUOverW = 1.5f / FrameWidth * span->oneOverW;
+    span->stepVOverW = 0.2f / FrameWidth * span->oneOverW;
+}
+
+// Taps per pixel of a row. 1/w is constant along these spans, so the lod
+// textureSampleSpan derives is the same for the whole row.
+static int rowTaps(const SamplerTexture* tex, const SamplerDesc* desc, const SamplerSpan* span){
+    if(desc->filter == SAMPLER_FILTER_POINT){
+        return 1;
+    }
+    if(desc->filter == SAMPLER_FILTER_BILINEAR){
+        return 4;
+    }
+    float footprint = fmaxf(fabsf(span->stepUOverW / span->oneOverW) * tex->width, fabsf(span->stepVOverW / span->oneOverW) * tex->height);
+    float lod = footprint > 0.0f ? log2f(footprint) : 0.0f;
+    float maxLevel = (float)(tex->mipCount - 1);
+    lod = lod < 0.0f ? 0.0f : (lod > maxLevel ? maxLevel : lod);
+    return lod > (float)(uint32_t)lod && lod < maxLevel ? 8 : 4;
+}
+
+int main(){
+    uint8_t* pixels = (uint8_t*)malloc((size_t)TextureSize * TextureSize * 4);
+    for(uint32_t i = 0; i < TextureSize * TextureSize * 4; i++){
+        pixels[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    float* rgba = (float*)malloc(FrameWidth * 4 * sizeof(float));
+
+    static const SamplerFilter filters[] = { SAMPLER_FILTER_POINT, SAMPLER_FILTER_BILINEAR, SAMPLER_FILTER_TRILINEAR };
+    static const char* filterNames[] = { "point", "bilinear", "trilinear" };
+    static const SamplerAddress addresses[] = { SAMPLER_ADDRESS_WRAP, SAMPLER_ADDRESS_CLAMP, SAMPLER_ADDRESS_BORDER };
+    static const char* addressNames[] = { "wrap", "clamp", "border" };
+    static const char* layoutNames[] = { "linear", "tiled 4x4" };
+#if defined(__AVX2__)
+    printf("texture_sampler_bench: AVX2\n");
+#elif defined(__ARM_NEON)
+    printf("texture_sampler_bench: NEON\n");
+#else
+    printf("texture_sampler_bench: scalar\n");
+#endif
+    SamplerTexture textures[2];
+    for(int layout = 0; layout < 2; layout++){
+        if(!samplerTextureCreate(&textures[layout], TextureSize, TextureSize, pixels, TextureSize * 4, (SamplerLayout)layout, true)){
+            return 1;
+        }
+    }
+    int mismatches = 0;
+    for(int f = 0; f < 3; f++){
+        for(int a = 0; a < 3; a++){
+            SamplerDesc desc;
+            samplerDescInit(&desc, filters[f], addresses[a], SAMPLER_BORDER_TRANSPARENT_BLACK);
+            double checksums[2];
+            for(int layout = 0; layout < 2; layout++){
+                const SamplerTexture* tex = &textures[layout];
+                double checksum = 0.0;
+                uint64_t texels = 0;
+                uint64_t fetched = 0;
+                auto start = std::chrono::steady_clock::now();
+                for(int frame = 0; frame < Frames; frame++){
+                    for(int y = 0; y < FrameHeight; y++){
+                        SamplerSpan span;
+                        rowSpan(frame, y, &span);
+                        textureSampleSpan(tex, &desc, &span, FrameWidth, rgba);
+                        for(int i = 0; i < FrameWidth * 4; i++){
+                            checksum += rgba[i];
+                        }
+                        texels += FrameWidth;
+                        fetched += (uint64_t)FrameWidth * rowTaps(tex, &desc, &span);
+                    }
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                checksums[layout] = checksum;
+                printf("  %-9s %-6s %-9s %8.1f Mtexels/s out %8.1f Mtexels/s fetched  %6.2f ms per 900x500 frame\n", filterNames[f],
+                       addressNames[a], layoutNames[layout], texels / seconds * 1e-6, fetched / seconds * 1e-6, seconds * 1000.0 / Frames);
+            }
+            if(checksums[0] != checksums[1]){
+                printf("  %s %s: layouts differ (checksums %.6f and %.6f)\n", filterNames[f], addressNames[a], checksums[0], checksums[1]);
+                mismatches++;
+            }
+        }
+    }
+    for(int layout = 0; layout < 2; layout++){
+        samplerTextureDestroy(&textures[layout]);
+    }
+    free(rgba);
+    free(pixels);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+// texture_sampler.h against a scalar double precision reference: point
+// sampling with the demo's transparent black border, bilinear and trilinear
+// filtering under wrap, clamp and border addressing, samples right on the
+// edges, and the tiled layout giving the same results as the linear one. The
+// Makefile also builds it without AVX2 so the plain 8-lane path is checked.
+
+#include "texture_sampler.h"
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include "check.h"
+
+// Odd sizes, so the 4x4 tiles and the mip levels don't divide evenly.
+static const uint32_t TextureWidth = 37;
+static const uint32_t TextureHeight = 21;
+static const float Tolerance = 1e-4f;
+
+struct Reference {
+    // Row-major RGBA8 per mip level, built independently of samplerTextureCreate.
+    std::vector<std::vector<uint32_t> > levels;
+    std::vector<uint32_t> widths;
+    std::vector<uint32_t> heights;
+};
+
+static void referenceCreate(Reference* ref, const uint8_t* pixels, bool buildMips){
+    uint32_t w = TextureWidth;
+    uint32_t h = TextureHeight;
+    std::vector<uint32_t> level(w * h);
+    memcpy(level.data(), pixels, level.size() * 4);
+    for(;;){
+        ref->levels.push_back(level);
+        ref->widths.push_back(w);
+        ref->heights.push_back(h);
+        if(!buildMips || (w == 1 && h == 1)){
+            break;
+        }
+        uint32_t nw = w > 1 ? w / 2 : 1;
+        uint32_t nh = h > 1 ? h / 2 : 1;
+        std::vector<uint32_t> next(nw * nh);
+        for(uint32_t y = 0; y < nh; y++){
+            for(uint32_t x = 0; x < nw; x++){
+                uint32_t texel = 0;
+                for(int c = 0; c < 32; c += 8){
+                    uint32_t sum = 2;
+                    for(uint32_t dy = 0; dy < 2; dy++){
+                        for(uint32_t dx = 0; dx < 2; dx++){
+                            uint32_t sx = x * 2 + dx < w ? x * 2 + dx : w - 1;
+                            uint32_t sy = y * 2 + dy < h ? y * 2 + dy : h - 1;
+                            sum += (level[sy * w + sx] >> c) & 0xFF;
+                        }
+                    }
+                    texel |= (sum / 4) << c;
+                }
+                next[y * nw + x] = texel;
+            }
+        }
+        level.swap(next);
+        w = nw;
+        h = nh;
+    }
+}
+
+// -1 for a coordinate outside the texture under border addressing.
+static int referenceAddress(int c, int size, SamplerAddress mode){
+    if(mode == SAMPLER_ADDRESS_WRAP){
+        return ((c % size) + size) % size;
+    }
+    if(mode == SAMPLER_ADDRESS_CLAMP){
+        return c < 0 ? 0 : (c >= size ? size - 1 : c);
+    }
+    return c < 0 || c >= size ? -1 : c;
+}
+
+static void referenceFetch(const Reference* ref, const SamplerDesc* desc, uint32_t level, int x, int y, double* rgba){
+    int ax = referenceAddress(x, (int)ref->widths[level], desc->addressU);
+    int ay = referenceAddress(y, (int)ref->heights[level], desc->addressV);
+    uint32_t texel = ax < 0 || ay < 0 ? desc->borderColor : ref->levels[level][ay * ref->widths[level] + ax];
+    for(int c = 0; c < 4; c++){
+        rgba[c] = ((texel >> (c * 8)) & 0xFF) / 255.0;
+    }
+}
+
+static void referenceSampleLevel(const Reference* ref, const SamplerDesc* desc, uint32_t level, double u, double v, bool linear, double* rgba){
+    // Texel coordinates in float like the hardware's, filtering in double.
+    double x = (float)u * (float)ref->widths[level];
+    double y = (float)v * (float)ref->heights[level];
+    if(!linear){
+        referenceFetch(ref, desc, level, (int)floor(x), (int)floor(y), rgba);
+        return;
+    }
+    x -= 0.5;
+    y -= 0.5;
+    int x0 = (int)floor(x);
+    int y0 = (int)floor(y);
+    double fx = x - x0;
+    double fy = y - y0;
+    double t00[4], t10[4], t01[4], t11[4];
+    referenceFetch(ref, desc, level, x0, y0, t00);
+    referenceFetch(ref, desc, level, x0 + 1, y0, t10);
+    referenceFetch(ref, desc, level, x0, y0 + 1, t01);
+    referenceFetch(ref, desc, level, x0 + 1, y0 + 1, t11);
+    for(int c = 0; c < 4; c++){
+        double top = t00[c] + (t10[c] - t00[c]) * fx;
+        double bottom = t01[c] + (t11[c] - t01[c]) * fx;
+        rgba[c] = top + (bottom - top) * fy;
+    }
+}
+
+static void referenceSample(const Reference* ref, const SamplerDesc* desc, double u, double v, double lod, double* rgba){
+    double maxLevel = (double)(ref->levels.size() - 1);
+    lod += desc->mipLodBias;
+    lod = lod < desc->minLod ? desc->minLod : (lod > desc->maxLod ? desc->maxLod : lod);
+    lod = lod < 0.0 ? 0.0 : (lod > maxLevel ? maxLevel : lod);
+    if(desc->filter == SAMPLER_FILTER_TRILINEAR){
+        uint32_t level0 = (uint32_t)lod;
+        double t = lod - level0;
+        referenceSampleLevel(ref, desc, level0, u, v, true, rgba);
+        if(t > 0.0 && level0 < maxLevel){
+            double next[4];
+            referenceSampleLevel(ref, desc, level0 + 1, u, v, true, next);
+            for(int c = 0; c < 4; c++){
+                rgba[c] += (next[c] - rgba[c]) * t;
+            }
+        }
+    }else{
+        referenceSampleLevel(ref, desc, (uint32_t)(lod + 0.5), u, v, desc->filter == SAMPLER_FILTER_BILINEAR, rgba);
+    }
+}
+
+struct Textures {
+    SamplerTexture linear;
+    SamplerTexture tiled;
+    Reference ref;
+};
+
+static bool texturesCreate(Textures* t, const uint8_t* pixels, bool buildMips){
+    referenceCreate(&t->ref, pixels, buildMips);
+    return samplerTextureCreate(&t->linear, TextureWidth, TextureHeight, pixels, TextureWidth * 4, SAMPLER_LAYOUT_LINEAR, buildMips) &&
+           samplerTextureCreate(&t->tiled, TextureWidth, TextureHeight, pixels, TextureWidth * 4, SAMPLER_LAYOUT_TILED_4X4, buildMips);
+}
+
+static void texturesDestroy(Textures* t){
+    samplerTextureDestroy(&t->linear);
+    samplerTextureDestroy(&t->tiled);
+}
+
+// Samples 8 uvs on both layouts and checks them against the reference; the
+// layouts have to agree exactly. Returns the largest error.
+static float checkBatch(const Textures* t, const SamplerDesc* desc, const float* u, const float* v, float lod){
+    SamplerResult8 linear, tiled;
+    textureSample8(&t->linear, desc, u, v, lod, &linear);
+    textureSample8(&t->tiled, desc, u, v, lod, &tiled);
+    CHECK(memcmp(&linear, &tiled, sizeof(linear)) == 0);
+    float maxError = 0.0f;
+    for(int l = 0; l < 8; l++){
+        double expected[4];
+        referenceSample(&t->ref, desc, u[l], v[l], lod, expected);
+        const float got[4] = { linear.r[l], linear.g[l], linear.b[l], linear.a[l] };
+        for(int c = 0; c < 4; c++){
+            float error = (float)fabs(got[c] - expected[c]);
+            maxError = error > maxError ? error : maxError;
+        }
+    }
+    return maxError;
+}
+
+static float checkRandom(const Textures* t, const SamplerDesc* desc, float lo, float hi, float maxLod, std::mt19937* rng){
+    std::uniform_real_distribution<float> uv(lo, hi);
+    std::uniform_real_distribution<float> lodDist(-1.0f, maxLod);
+    float maxError = 0.0f;
+    for(int batch = 0; batch < 2000; batch++){
+        float u[8], v[8];
+        for(int l = 0; l < 8; l++){
+            u[l] = uv(*rng);
+            v[l] = uv(*rng);
+        }
+        float error = checkBatch(t, desc, u, v, maxLod > 0.0f ? lodDist(*rng) : 0.0f);
+        maxError = error > maxError ? error : maxError;
+    }
+    return maxError;
+}
+
+static void testPointBorder(const uint8_t* pixels, std::mt19937* rng){
+    // The demo's static sampler.
+    Textures t;
+    CHECK(texturesCreate(&t, pixels, false));
+    SamplerDesc desc;
+    samplerDescInit(&desc, SAMPLER_FILTER_POINT, SAMPLER_ADDRESS_BORDER, SAMPLER_BORDER_TRANSPARENT_BLACK);
+    CHECK(checkRandom(&t, &desc, -0.5f, 1.5f, 0.0f, rng) < Tolerance);
+
+    // Just outside every edge is transparent black, just inside is the edge texel.
+    const float eps = 1e-4f;
+    float u[8] = { -eps, 1.0f + eps, 0.5f, 0.5f, eps, 1.0f - eps, 0.5f, 0.5f };
+    float v[8] = { 0.5f, 0.5f, -eps, 1.0f + eps, 0.5f, 0.5f, eps, 1.0f - eps };
+    SamplerResult8 result;
+    textureSample8(&t.linear, &desc, u, v, 0.0f, &result);
+    for(int l = 0; l < 4; l++){
+        CHECK(result.r[l] == 0.0f && result.g[l] == 0.0f && result.b[l] == 0.0f && result.a[l] == 0.0f);
+    }
+    uint32_t edges[4] = {
+        t.ref.levels[0][(TextureHeight / 2) * TextureWidth], t.ref.levels[0][(TextureHeight / 2) * TextureWidth + TextureWidth - 1],
+        t.ref.levels[0][TextureWidth / 2], t.ref.levels[0][(TextureHeight - 1) * TextureWidth + TextureWidth / 2],
+    };
+    for(int l = 0; l < 4; l++){
+        CHECK(fabsf(result.r[4 + l] - (edges[l] & 0xFF) / 255.0f) < Tolerance);
+        CHECK(fabsf(result.a[4 + l] - (edges[l] >> 24) / 255.0f) < Tolerance);
+    }
+    texturesDestroy(&t);
+}
+
+static void testBilinear(const uint8_t* pixels, std::mt19937* rng){
+    Textures t;
+    CHECK(texturesCreate(&t, pixels, false));
+    static const SamplerAddress modes[] = { SAMPLER_ADDRESS_WRAP, SAMPLER_ADDRESS_CLAMP, SAMPLER_ADDRESS_BORDER };
+    for(int m = 0; m < 3; m++){
+        SamplerDesc desc;
+        samplerDescInit(&desc, SAMPLER_FILTER_BILINEAR, modes[m], SAMPLER_BORDER_OPAQUE_WHITE);
+        CHECK(checkRandom(&t, &desc, -1.5f, 2.5f, 0.0f, rng) < Tolerance);
+
+        // Texel centres and the edges themselves, where the filter reaches
+        // half a texel past the texture.
+        float u[8] = { 0.0f, 1.0f, 0.5f / TextureWidth, 1.0f - 0.5f / TextureWidth, 0.0f, 1.0f, 0.25f / TextureWidth, 1.0f };
+        float v[8] = { 0.0f, 1.0f, 0.5f / TextureHeight, 1.0f - 0.5f / TextureHeight, 1.0f, 0.0f, 0.5f, 0.25f / TextureHeight };
+        CHECK(checkBatch(&t, &desc, u, v, 0.0f) < Tolerance);
+    }
+
+    // Wrap blends the first and last columns at u = 0, clamp doesn't.
+    SamplerDesc wrap, clamp;
+    samplerDescInit(&wrap, SAMPLER_FILTER_BILINEAR, SAMPLER_ADDRESS_WRAP, SAMPLER_BORDER_TRANSPARENT_BLACK);
+    samplerDescInit(&clamp, SAMPLER_FILTER_BILINEAR, SAMPLER_ADDRESS_CLAMP, SAMPLER_BORDER_TRANSPARENT_BLACK);
+    float u[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    float v[8];
+    for(int l = 0; l < 8; l++){
+        v[l] = (l * 2 + 1) * 0.5f / TextureHeight;
+    }
+    SamplerResult8 wrapped, clamped;
+    textureSample8(&t.linear, &wrap, u, v, 0.0f, &wrapped);
+    textureSample8(&t.linear, &clamp, u, v, 0.0f, &clamped);
+    for(int l = 0; l < 8; l++){
+        uint32_t first = t.ref.levels[0][l * TextureWidth];
+        uint32_t last = t.ref.levels[0][l * TextureWidth + TextureWidth - 1];
+        CHECK(fabsf(clamped.r[l] - (first & 0xFF) / 255.0f) < Tolerance);
+        CHECK(fabsf(wrapped.r[l] - ((first & 0xFF) + (last & 0xFF)) / 510.0f) < Tolerance);
+    }
+    texturesDestroy(&t);
+}
+
+static void testTrilinear(const uint8_t* pixels, std::mt19937* rng){
+    Textures t;
+    CHECK(texturesCreate(&t, pixels, true));
+    CHECK(t.linear.mipCount == t.ref.levels.size() && t.tiled.mipCount == t.ref.levels.size());
+    // The box filtered chain itself, through point samples at each level's texel centres.
+    SamplerDesc point;
+    samplerDescInit(&point, SAMPLER_FILTER_POINT, SAMPLER_ADDRESS_CLAMP, SAMPLER_BORDER_TRANSPARENT_BLACK);
+    for(uint32_t level = 0; level < t.linear.mipCount; level++){
+        uint32_t w = t.ref.widths[level];
+        uint32_t h = t.ref.heights[level];
+        for(uint32_t i = 0; i < w * h; i += 8){
+            float u[8], v[8];
+            for(int l = 0; l < 8; l++){
+                uint32_t texel = (i + l) % (w * h);
+                u[l] = (texel % w + 0.5f) / w;
+                v[l] = (texel / w + 0.5f) / h;
+            }
+            CHECK(checkBatch(&t, &point, u, v, (float)level) < Tolerance);
+        }
+    }
+
+    static const SamplerAddress modes[] = { SAMPLER_ADDRESS_WRAP, SAMPLER_ADDRESS_CLAMP, SAMPLER_ADDRESS_BORDER };
+    for(int m = 0; m < 3; m++){
+        SamplerDesc desc;
+        samplerDescInit(&desc, SAMPLER_FILTER_TRILINEAR, modes[m], SAMPLER_BORDER_OPAQUE_BLACK);
+        CHECK(checkRandom(&t, &desc, -1.5f, 2.5f, (float)t.linear.mipCount + 1.0f, rng) < Tolerance);
+        // Bias and lod clamps are applied before the level is picked.
+        desc.mipLodBias = 0.75f;
+        desc.minLod = 0.5f;
+        desc.maxLod = 2.25f;
+        CHECK(checkRandom(&t, &desc, -1.5f, 2.5f, (float)t.linear.mipCount + 1.0f, rng) < Tolerance);
+    }
+    texturesDestroy(&t);
+}
+
+int main(){
+    std::mt19937 rng(29);
+    std::vector<uint8_t> pixels(TextureWidth * TextureHeight * 4);
+    for(size_t i = 0; i < pixels.size(); i++){
+        pixels[i] = (uint8_t)rng();
+    }
+    testPointBorder(pixels.data(), &rng);
+    testBilinear(pixels.data(), &rng);
+    testTrilinear(pixels.data(), &rng);
+#if defined(__AVX2__)
+    return checkReport("texture_sampler_test (AVX2)");
+#elif defined(__ARM_NEON)
+    return checkReport("texture_sampler_test (NEON)");
+#else
+    return checkReport("texture_sampler_test (scalar)");
+#endif
+}
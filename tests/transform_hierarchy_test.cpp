@@ -0,0 +1,169 @@
+// transform_hierarchy.h: world matrices against a double precision reference
+// through rounds of partial updates on a random hierarchy, with parents both
+// in earlier batches and in the same batch, and quads and instances against
+// the matrices they are written from.
+
+#include "transform_hierarchy.h"
+
+#include <vector>
+
+#include "check.h"
+
+static const uint32_t Count = 10007;
+
+struct Reference {
+    float x, y, rotation, scaleX, scaleY;
+    int32_t parent;
+    double m[6];
+};
+
+static void referenceUpdate(std::vector<Reference>* nodes){
+    for(size_t i = 0; i < nodes->size(); i++){
+        Reference* n = &(*nodes)[i];
+        double c = cos(n->rotation), s = sin(n->rotation);
+        double la = c * n->scaleX, lb = s * n->scaleX, lc = -s * n->scaleY, ld = c * n->scaleY;
+        if(n->parent == TransformNoParent){
+            double m[6] = { la, lb, lc, ld, n->x, n->y };
+            memcpy(n->m, m, sizeof(m));
+            continue;
+        }
+        const double* p = (*nodes)[n->parent].m;
+        n->m[0] = p[0] * la + p[2] * lb;
+        n->m[1] = p[1] * la + p[3] * lb;
+        n->m[2] = p[0] * lc + p[2] * ld;
+        n->m[3] = p[1] * lc + p[3] * ld;
+        n->m[4] = p[0] * n->x + p[2] * n->y + p[4];
+        n->m[5] = p[1] * n->x + p[3] * n->y + p[5];
+    }
+}
+
+static double maxError(const TransformHierarchy* h, const std::vector<Reference>& nodes){
+    double worst = 0.0;
+    for(uint32_t i = 0; i < h->count; i++){
+        float m[6] = { h->a[i], h->b[i], h->c[i], h->d[i], h->tx[i], h->ty[i] };
+        for(int j = 0; j < 6; j++){
+            double e = fabs(m[j] - nodes[i].m[j]) / (1.0 + fabs(nodes[i].m[j]));
+            worst = e > worst ? e : worst;
+        }
+    }
+    return worst;
+}
+
+static void testCreate(){
+    TransformHierarchy h;
+    CHECK(transformHierarchyInit(&h, 2));
+    CHECK(transformCreate(&h, 0) == UINT32_MAX);
+    CHECK(transformCreate(&h, TransformNoParent) == 0);
+    CHECK(transformCreate(&h, 1) == UINT32_MAX);
+    CHECK(transformCreate(&h, 0) == 1);
+    CHECK(transformCreate(&h, 0) == UINT32_MAX);
+    transformUpdate(&h);
+    CHECK(h.a[1] == 1.0f && h.b[1] == 0.0f && h.c[1] == 0.0f && h.d[1] == 1.0f && h.tx[1] == 0.0f && h.ty[1] == 0.0f);
+    transformHierarchyDestroy(&h);
+}
+
+static void testReference(){
+    srand(3);
+    TransformHierarchy h;
+    CHECK(transformHierarchyInit(&h, Count));
+    std::vector<Reference> nodes;
+    for(uint32_t i = 0; i < Count; i++){
+        // A third are roots; the rest hang off one of the first 40, anything
+        // before them, or often the one just before, which lands in the same batch.
+        int32_t parent = TransformNoParent;
+        if(i >= 10 && rand() % 3 != 0){
+            parent = rand() % 4 == 0 ? (int32_t)i - 1 : rand() % (i < 40 || rand() % 2 ? i : 40);
+        }
+        uint32_t id = transformCreate(&h, parent);
+        CHECK(id == i);
+        Reference n = { rand() % 100 / 50.0f - 1.0f, rand() % 100 / 50.0f - 1.0f, rand() % 628 / 100.0f,
+                        0.9f + rand() % 20 / 100.0f, 0.9f + rand() % 20 / 100.0f, parent, {} };
+        transformSetLocal(&h, id, n.x, n.y, n.rotation, n.scaleX, n.scaleY);
+        nodes.push_back(n);
+    }
+    transformUpdate(&h);
+    referenceUpdate(&nodes);
+    CHECK(maxError(&h, nodes) < 1e-5);
+    CHECK(h.stats.scalarBatches > 0);
+
+    for(int round = 0; round < 20; round++){
+        for(int k = 0; k < 50; k++){
+            uint32_t i = rand() % Count;
+            Reference* n = &nodes[i];
+            n->x += 0.01f;
+            if(k % 5 == 0){
+                transformSetPosition(&h, i, n->x, n->y);
+            }else{
+                n->rotation += 0.1f;
+                transformSetLocal(&h, i, n->x, n->y, n->rotation, n->scaleX, n->scaleY);
+            }
+        }
+        uint64_t before = h.stats.transformsUpdated;
+        transformUpdate(&h);
+        referenceUpdate(&nodes);
+        CHECK(maxError(&h, nodes) < 1e-5);
+        // Descendants come along, but far from everything is recomputed.
+        uint64_t updated = h.stats.transformsUpdated - before;
+        CHECK(updated >= 40 && updated < Count);
+        CHECK(h.firstDirty == UINT32_MAX);
+    }
+
+    // An update with nothing dirty does nothing.
+    uint64_t updates = h.stats.updates;
+    transformUpdate(&h);
+    CHECK(h.stats.updates == updates);
+
+    // Quads: every corner is the matrix applied to the unit quad's corner, and
+    // picking by ids gives the same vertices as the contiguous run.
+    std::vector<TransformVertex> all((size_t)Count * 6);
+    transformWriteQuads(&h, 0, 0, Count, all.data());
+    static const float corners[6][4] = { { -0.5f, -0.5f, 0.0f, 1.0f }, { -0.5f, 0.5f, 0.0f, 0.0f }, { 0.5f, 0.5f, 1.0f, 0.0f },
+                                         { 0.5f, 0.5f, 1.0f, 0.0f }, { 0.5f, -0.5f, 1.0f, 1.0f }, { -0.5f, -0.5f, 0.0f, 1.0f } };
+    bool quadsMatch = true;
+    for(uint32_t i = 0; i < Count; i++){
+        const double* m = nodes[i].m;
+        for(int j = 0; j < 6; j++){
+            const TransformVertex* v = &all[(size_t)i * 6 + j];
+            double x = m[0] * corners[j][0] + m[2] * corners[j][1] + m[4];
+            double y = m[1] * corners[j][0] + m[3] * corners[j][1] + m[5];
+            quadsMatch &= fabs(v->x - x) < 1e-4 * (1.0 + fabs(x)) && fabs(v->y - y) < 1e-4 * (1.0 + fabs(y));
+            quadsMatch &= v->u == corners[j][2] && v->v == corners[j][3];
+        }
+    }
+    CHECK(quadsMatch);
+    CHECK(h.stats.quadsWritten == Count);
+
+    std::vector<uint32_t> ids;
+    for(uint32_t i = 0; i < Count; i += 3){
+        ids.push_back(Count - 1 - i);
+    }
+    std::vector<TransformVertex> picked(ids.size() * 6);
+    transformWriteQuads(&h, ids.data(), 0, (uint32_t)ids.size(), picked.data());
+    bool idsMatch = true;
+    for(size_t k = 0; k < ids.size(); k++){
+        idsMatch &= memcmp(&picked[k * 6], &all[(size_t)ids[k] * 6], 6 * sizeof(TransformVertex)) == 0;
+    }
+    CHECK(idsMatch);
+
+    // A run not starting at 0 and not a whole number of batches.
+    std::vector<TransformVertex> run(13 * 6);
+    transformWriteQuads(&h, 0, 101, 13, run.data());
+    CHECK(memcmp(run.data(), &all[101 * 6], run.size() * sizeof(TransformVertex)) == 0);
+
+    std::vector<TransformInstance> instances(ids.size());
+    transformWriteInstances(&h, ids.data(), 0, (uint32_t)ids.size(), instances.data());
+    bool instancesMatch = true;
+    for(size_t k = 0; k < ids.size(); k++){
+        uint32_t i = ids[k];
+        const TransformInstance* t = &instances[k];
+        instancesMatch &= t->a == h.a[i] && t->b == h.b[i] && t->c == h.c[i] && t->d == h.d[i] && t->tx == h.tx[i] && t->ty == h.ty[i];
+    }
+    CHECK(instancesMatch);
+    transformHierarchyDestroy(&h);
+}
+
+int main(){
+    testCreate();
+    testReference();
+    return checkReport("transform_hierarchy_test");
+}
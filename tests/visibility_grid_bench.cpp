@@ -0,0 +1,96 @@
+// Update and query cost of visibility_grid.h for 100k to 1M sprites spread
+// over a 16384x16384 world with 64 pixel cells. Each frame a tenth of the
+// sprites move, one in a thousand is bigger than a cell, and a 900x500
+// viewport is queried at a random position. The brute force row culls every
+// sprite with visibilityCullBatch for comparison.
+
+#include "visibility_grid.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+static const float WorldSize = 16384.0f;
+static const int Frames = 50;
+
+static float random(float lo, float hi){
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run(uint32_t count){
+    VisibilityGrid g;
+    if(!visibilityGridInit(&g, 0.0f, 0.0f, WorldSize, WorldSize, 64.0f, count)){
+        return;
+    }
+    std::vector<float> minX(count), minY(count), maxX(count), maxY(count);
+    std::vector<uint32_t> ids(count), visible(count);
+    srand(2);
+    for(uint32_t i = 0; i < count; i++){
+        float size = i % 1000 == 0 ? random(100.0f, 400.0f) : random(4.0f, 48.0f);
+        minX[i] = random(0.0f, WorldSize);
+        minY[i] = random(0.0f, WorldSize);
+        maxX[i] = minX[i] + size;
+        maxY[i] = minY[i] + size;
+        ids[i] = i;
+    }
+    double start = now();
+    for(uint32_t i = 0; i < count; i++){
+        visibilityGridUpdate(&g, i, minX[i], minY[i], maxX[i], maxY[i]);
+    }
+    double insertSeconds = now() - start;
+
+    double updateSeconds = 0.0;
+    double querySeconds = 0.0;
+    double bruteSeconds = 0.0;
+    uint64_t updates = 0;
+    uint64_t found = 0;
+    for(int frame = 0; frame < Frames; frame++){
+        for(uint32_t i = frame % 10; i < count; i += 10){
+            float dx = random(-8.0f, 8.0f);
+            float dy = random(-8.0f, 8.0f);
+            minX[i] += dx;
+            maxX[i] += dx;
+            minY[i] += dy;
+            maxY[i] += dy;
+        }
+        start = now();
+        for(uint32_t i = frame % 10; i < count; i += 10){
+            visibilityGridUpdate(&g, i, minX[i], minY[i], maxX[i], maxY[i]);
+            updates++;
+        }
+        updateSeconds += now() - start;
+
+        float viewMinX = random(0.0f, WorldSize - 900.0f);
+        float viewMinY = random(0.0f, WorldSize - 500.0f);
+        start = now();
+        uint32_t n = visibilityGridQuery(&g, viewMinX, viewMinY, viewMinX + 900.0f, viewMinY + 500.0f, visible.data());
+        querySeconds += now() - start;
+        found += n;
+
+        start = now();
+        uint32_t brute = visibilityCullBatch(ids.data(), minX.data(), minY.data(), maxX.data(), maxY.data(), count, viewMinX, viewMinY,
+                                             viewMinX + 900.0f, viewMinY + 500.0f, visible.data());
+        bruteSeconds += now() - start;
+        if(brute != n){
+            printf("  query found %u, brute force %u\n", n, brute);
+        }
+    }
+    printf("  %7u sprites: insert %6.1f Mupdates/s, move %6.1f Mupdates/s, query %7.1f us (%4.0f visible), brute force %8.1f us\n", count,
+           count / insertSeconds * 1e-6, updates / updateSeconds * 1e-6, querySeconds / Frames * 1e6, (double)found / Frames,
+           bruteSeconds / Frames * 1e6);
+    visibilityGridDestroy(&g);
+}
+
+int main(){
+    printf("visibility_grid_bench: %d frames, 900x500 view\n", Frames);
+    run(100000);
+    run(250000);
+    run(500000);
+    run(1000000);
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Query results of visibility_grid.h against brute force over random
+// inserts, moves, resizes and removals, including objects larger than a cell.
+
+#include "visibility_grid.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "check.h"
+
+static const uint32_t Objects = 20000;
+
+static float random(float lo, float hi){
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+int main(){
+    VisibilityGrid g;
+    CHECK(visibilityGridInit(&g, 0.0f, 0.0f, 900.0f, 500.0f, 64.0f, Objects));
+    // minX, minY, maxX, maxY per object, minX = 1e30 when not in the grid.
+    std::vector<float> bounds(Objects * 4, 1e30f);
+    srand(1);
+    for(int round = 0; round < 40; round++){
+        for(uint32_t i = 0; i < Objects; i++){
+            if(round > 0 && i % 3 != (uint32_t)round % 3){
+                continue;
+            }
+            if(round > 0 && i % 7 == 0){
+                visibilityGridRemove(&g, i);
+                bounds[i * 4] = 1e30f;
+                continue;
+            }
+            // Every 50th object is sometimes far bigger than a cell.
+            bool large = i % 50 == 0 && round % 2 == 0;
+            float x = random(-300.0f, 1200.0f);
+            float y = random(-300.0f, 800.0f);
+            float w = large ? random(100.0f, 600.0f) : random(1.0f, 64.0f);
+            float h = large ? random(1.0f, 300.0f) : random(1.0f, 64.0f);
+            bounds[i * 4] = x;
+            bounds[i * 4 + 1] = y;
+            bounds[i * 4 + 2] = x + w;
+            bounds[i * 4 + 3] = y + h;
+            CHECK(visibilityGridUpdate(&g, i, x, y, x + w, y + h));
+            CHECK((g.objectCell[i] == g.overflowCell) == (w > 64.0f || h > 64.0f));
+        }
+
+        for(int query = 0; query < 8; query++){
+            float viewMinX = random(-400.0f, 1000.0f);
+            float viewMinY = random(-400.0f, 600.0f);
+            float viewMaxX = viewMinX + random(0.0f, 900.0f);
+            float viewMaxY = viewMinY + random(0.0f, 500.0f);
+            std::vector<uint32_t> visible(Objects);
+            visible.resize(visibilityGridQuery(&g, viewMinX, viewMinY, viewMaxX, viewMaxY, visible.data()));
+            std::sort(visible.begin(), visible.end());
+            std::vector<uint32_t> expected;
+            for(uint32_t i = 0; i < Objects; i++){
+                const float* b = &bounds[i * 4];
+                if(b[0] != 1e30f && b[2] >= viewMinX && b[0] <= viewMaxX && b[3] >= viewMinY && b[1] <= viewMaxY){
+                    expected.push_back(i);
+                }
+            }
+            CHECK(visible == expected);
+        }
+    }
+
+    // No cell holds anything sticking out by more than half a cell.
+    for(uint32_t c = 0; c < g.overflowCell; c++){
+        CHECK(g.cells[c].maxHalfWidth <= 32.0f && g.cells[c].maxHalfHeight <= 32.0f);
+    }
+    visibilityGridDestroy(&g);
+    return checkReport("visibility_grid_test");
+}
@@ -0,0 +1,90 @@
+// worker_pool.h: every thread of a run gets called once with its index, runs
+// can wait on each other inside, and callers on several threads take turns.
+
+#include "worker_pool.h"
+
+#include <atomic>
+#include <thread>
+
+#include "check.h"
+
+struct RunCheck {
+    std::atomic<int> calls[WorkerPoolMaxThreads];
+    std::atomic<int> arrived;
+    int numThreads;
+    std::atomic<int> badCounts;
+};
+
+static void countCalls(void* context, int thread, int numThreads){
+    RunCheck* c = (RunCheck*)context;
+    c->calls[thread]++;
+    c->badCounts += numThreads != c->numThreads ? 1 : 0;
+}
+
+// Spins until every thread of the run has arrived, which only returns if they all run at once.
+static void meet(void* context, int thread, int numThreads){
+    RunCheck* c = (RunCheck*)context;
+    c->arrived++;
+    while(c->arrived.load() < numThreads){
+        std::this_thread::yield();
+    }
+}
+
+static void reset(RunCheck* c, int numThreads){
+    for(int t = 0; t < WorkerPoolMaxThreads; t++){
+        c->calls[t] = 0;
+    }
+    c->arrived = 0;
+    c->numThreads = numThreads;
+    c->badCounts = 0;
+}
+
+static void testRuns(WorkerPool* pool){
+    RunCheck c;
+    int size = workerPoolThreads(pool);
+    for(int round = 0; round < 200; round++){
+        int asked = 1 + round % (size + 2);
+        int expected = asked > size ? size : asked;
+        reset(&c, expected);
+        workerPoolRun(pool, asked, countCalls, &c);
+        for(int t = 0; t < WorkerPoolMaxThreads; t++){
+            CHECK(c.calls[t] == (t < expected ? 1 : 0));
+        }
+        CHECK(c.badCounts == 0);
+        reset(&c, expected);
+        workerPoolRun(pool, asked, meet, &c);
+        CHECK(c.arrived == expected);
+    }
+}
+
+static void submitMany(WorkerPool* pool, std::atomic<int>* total){
+    RunCheck c;
+    for(int round = 0; round < 100; round++){
+        reset(&c, 3);
+        workerPoolRun(pool, 3, countCalls, &c);
+        *total += c.calls[0] + c.calls[1] + c.calls[2];
+    }
+}
+
+int main(){
+    testRuns(0);
+    WorkerPool pool;
+    workerPoolInit(&pool, 1);
+    testRuns(&pool);
+    CHECK(pool.runs == 0);
+    workerPoolDestroy(&pool);
+
+    workerPoolInit(&pool, 4);
+    testRuns(&pool);
+    std::atomic<int> total(0);
+    std::thread other(submitMany, &pool, &total);
+    submitMany(&pool, &total);
+    other.join();
+    CHECK(total == 2 * 100 * 3);
+    workerPoolDestroy(&pool);
+
+    // Destroying a pool that never ran anything.
+    workerPoolInit(&pool, 8);
+    workerPoolDestroy(&pool);
+    return checkReport("worker_pool_test");
+}
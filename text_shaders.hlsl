@@ -0,0 +1,37 @@
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+    float4 color : COLOR;
+};
+
+Texture2D g_atlas : register(t0);
+SamplerState g_sampler : register(s0);
+
+// One instance per glyph, the six vertices of its quad come from the vertex id.
+PSInput VSMain(uint vertexId : SV_VertexID, float4 rect : RECT, float4 uvRect : TEXCOORD, float4 color : COLOR)
+{
+    static const float2 corners[6] = {
+        float2(0.0, 1.0), float2(0.0, 0.0), float2(1.0, 0.0),
+        float2(1.0, 0.0), float2(1.0, 1.0), float2(0.0, 1.0)
+    };
+    float2 corner = corners[vertexId];
+
+    PSInput result;
+
+    result.position = float4(lerp(rect.xy, rect.zw, corner), 0.0, 1.0);
+    result.uv = lerp(uvRect.xy, uvRect.zw, corner);
+    result.color = color;
+
+    return result;
+}
+
+// The atlas holds signed distance, 0.5 on the outline. Smoothing over one
+// screen pixel keeps edges sharp at any scale.
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    float distance = g_atlas.Sample(g_sampler, input.uv).r;
+    float width = fwidth(distance) * 0.5;
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    return float4(input.color.rgb, input.color.a * alpha);
+}
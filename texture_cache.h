@@ -0,0 +1,367 @@
+#pragma once
+
+// Texture residency cache. Textures are keyed by a 64 bit hash of their
+// decoded pixels, or of their source path and load parameters when the
+// caller wants to skip decoding, so everything showing the same image shares
+// one resource and one descriptor. Users hold references; a texture nobody
+// references stays resident in case it comes back, and unreferenced textures
+// are evicted least recently released first once resident memory is over the
+// budget. Textures still referenced are never evicted, the budget can be
+// overrun by them and that is counted in the stats.
+//
+// Only bookkeeping lives here. The D3D12 side creates the resource when an
+// acquire reports a new entry and hands it over with textureCacheSetResource;
+// evicted resources and descriptors end up in the evicted list, which it
+// releases before calling textureCacheEvictionsReleased. A texture is only
+// evicted once the fence of the frame that last used it has completed, so the
+// list can be released straight away.
+//
+// Hashes are trusted: two images with the same 64 bit hash, size and format
+// are taken to be the same.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t TextureCacheInvalid = 0xFFFFFFFF;
+
+struct TextureCacheDesc {
+    uint32_t width;
+    uint32_t height;
+    // DXGI_FORMAT or whatever the renderer uses, only compared.
+    uint32_t format;
+    // Video memory the texture takes, mips and alignment included.
+    uint64_t bytes;
+};
+
+struct TextureCacheEntry {
+    uint64_t hash;
+    TextureCacheDesc desc;
+    void* resource;
+    uint32_t descriptor;
+    uint32_t refCount;
+    // Fence of the last frame that used it, set when the last reference goes.
+    uint64_t lastFence;
+    // Unreferenced entries only: more and less recently released neighbours.
+    uint32_t prev;
+    uint32_t next;
+    bool live;
+};
+
+struct TextureCacheEvicted {
+    void* resource;
+    uint32_t descriptor;
+};
+
+struct TextureCacheStats {
+    uint64_t acquires;
+    uint64_t hits;
+    // Hits on textures nobody referenced any more, which would have been reloaded without the cache.
+    uint64_t revived;
+    uint64_t created;
+    uint64_t createdBytes;
+    // Bytes that hits didn't have to upload and store again.
+    uint64_t dedupBytes;
+    uint64_t evictions;
+    uint64_t evictedBytes;
+    // Trims that couldn't get under the budget, because of references or frames in flight.
+    uint64_t overBudget;
+    // Inserts refused because every entry was referenced or in flight.
+    uint64_t full;
+    uint64_t peakBytes;
+};
+
+struct TextureCache {
+    uint32_t capacity;
+    TextureCacheEntry* entries;
+    uint32_t* freeEntries;
+    uint32_t numFree;
+    // Open addressing hash -> entry + 1, 0 is empty.
+    uint32_t* table;
+    uint32_t tableMask;
+    // Most and least recently released unreferenced entry.
+    uint32_t head;
+    uint32_t tail;
+
+    uint64_t budgetBytes;
+    uint64_t residentBytes;
+    uint64_t completedFence;
+
+    TextureCacheEvicted* evicted;
+    uint32_t numEvicted;
+
+    TextureCacheStats stats;
+};
+
+inline uint64_t textureCacheMix(uint64_t v){
+    v ^= v >> 31;
+    v *= 0x7FB5D329728EA185ull;
+    v ^= v >> 27;
+    v *= 0x81DADEF4BC2DD44Dull;
+    v ^= v >> 33;
+    return v;
+}
+
+// Hashes size bytes. Four independent lanes of 8 bytes keep the multiplies
+// from waiting on each other, which matters for megabytes of pixels.
+inline uint64_t textureCacheHash(const void* data, size_t size, uint64_t seed){
+    const uint8_t* p = (const uint8_t*)data;
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h[4] = { seed, seed ^ prime, seed + prime, seed - prime };
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32){
+        for(int l = 0; l < 4; l++){
+            uint64_t v;
+            memcpy(&v, p + i + l * 8, 8);
+            h[l] = (h[l] ^ v) * prime;
+            h[l] ^= h[l] >> 29;
+        }
+    }
+    uint64_t tail[4] = { 0, 0, 0, 0 };
+    memcpy(tail, p + i, size - i);
+    uint64_t r = size;
+    for(int l = 0; l < 4; l++){
+        r = textureCacheMix(r ^ h[l] ^ textureCacheMix(tail[l] + l));
+    }
+    return r;
+}
+
+// Hashes rows of rowBytes pixels, pitch bytes apart, so padding at the end
+// of rows doesn't change the hash. The size and format are part of it.
+inline uint64_t textureCacheHashPixels(const TextureCacheDesc* desc, const void* pixels, uint32_t rowBytes, uint32_t pitch){
+    uint64_t h = textureCacheMix(((uint64_t)desc->width << 32 | desc->height) ^ textureCacheMix(desc->format));
+    for(uint32_t y = 0; y < desc->height; y++){
+        h = textureCacheHash((const uint8_t*)pixels + (size_t)y * pitch, rowBytes, h);
+    }
+    return h;
+}
+
+// Key for a texture loaded from path with the given load parameters, for
+// finding it without decoding.
+inline uint64_t textureCacheHashKey(const char* path, const void* params, size_t paramsSize){
+    return textureCacheHash(path, strlen(path), textureCacheHash(params, paramsSize, 0x6A09E667F3BCC909ull));
+}
+
+inline bool textureCacheInit(TextureCache* c, uint32_t capacity, uint64_t budgetBytes){
+    memset(c, 0, sizeof(*c));
+    uint32_t tableSize = 16;
+    while(tableSize < capacity * 2){
+        tableSize *= 2;
+    }
+    c->capacity = capacity;
+    c->tableMask = tableSize - 1;
+    c->budgetBytes = budgetBytes;
+    c->head = TextureCacheInvalid;
+    c->tail = TextureCacheInvalid;
+    c->entries = (TextureCacheEntry*)calloc(capacity, sizeof(TextureCacheEntry));
+    c->freeEntries = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    c->table = (uint32_t*)calloc(tableSize, sizeof(uint32_t));
+    c->evicted = (TextureCacheEvicted*)malloc(capacity * sizeof(TextureCacheEvicted));
+    if(!c->entries || !c->freeEntries || !c->table || !c->evicted){
+        return false;
+    }
+    // Handed out lowest first.
+    for(uint32_t i = 0; i < capacity; i++){
+        c->freeEntries[i] = capacity - 1 - i;
+    }
+    c->numFree = capacity;
+    return true;
+}
+
+// The caller releases the resources of the entries still live first.
+inline void textureCacheDestroy(TextureCache* c){
+    free(c->entries);
+    free(c->freeEntries);
+    free(c->table);
+    free(c->evicted);
+    memset(c, 0, sizeof(*c));
+}
+
+inline uint32_t textureCacheLookup(const TextureCache* c, uint64_t hash, const TextureCacheDesc* desc){
+    for(uint32_t i = (uint32_t)hash & c->tableMask;; i = (i + 1) & c->tableMask){
+        uint32_t slot = c->table[i];
+        if(slot == 0){
+            return TextureCacheInvalid;
+        }
+        const TextureCacheEntry* e = &c->entries[slot - 1];
+        if(e->hash == hash && (!desc || (e->desc.width == desc->width && e->desc.height == desc->height && e->desc.format == desc->format))){
+            return slot - 1;
+        }
+    }
+}
+
+inline void textureCacheTableInsert(TextureCache* c, uint64_t hash, uint32_t entry){
+    uint32_t i = (uint32_t)hash & c->tableMask;
+    while(c->table[i] != 0){
+        i = (i + 1) & c->tableMask;
+    }
+    c->table[i] = entry + 1;
+}
+
+// Backward shift deletion, as in the glyph atlas.
+inline void textureCacheTableRemove(TextureCache* c, uint32_t entry){
+    uint32_t i = (uint32_t)c->entries[entry].hash & c->tableMask;
+    while(c->table[i] != entry + 1){
+        i = (i + 1) & c->tableMask;
+    }
+    for(uint32_t j = (i + 1) & c->tableMask; c->table[j] != 0; j = (j + 1) & c->tableMask){
+        uint32_t home = (uint32_t)c->entries[c->table[j] - 1].hash & c->tableMask;
+        if(((j - home) & c->tableMask) >= ((j - i) & c->tableMask)){
+            c->table[i] = c->table[j];
+            i = j;
+        }
+    }
+    c->table[i] = 0;
+}
+
+inline void textureCacheUnlink(TextureCache* c, uint32_t entry){
+    TextureCacheEntry* e = &c->entries[entry];
+    if(e->prev != TextureCacheInvalid){
+        c->entries[e->prev].next = e->next;
+    }else{
+        c->head = e->next;
+    }
+    if(e->next != TextureCacheInvalid){
+        c->entries[e->next].prev = e->prev;
+    }else{
+        c->tail = e->prev;
+    }
+}
+
+// Evicts the least recently released texture if its last frame is done.
+inline bool textureCacheEvictOne(TextureCache* c){
+    uint32_t entry = c->tail;
+    if(entry == TextureCacheInvalid || c->entries[entry].lastFence > c->completedFence || c->numEvicted == c->capacity){
+        return false;
+    }
+    TextureCacheEntry* e = &c->entries[entry];
+    textureCacheUnlink(c, entry);
+    textureCacheTableRemove(c, entry);
+    TextureCacheEvicted* ev = &c->evicted[c->numEvicted++];
+    ev->resource = e->resource;
+    ev->descriptor = e->descriptor;
+    c->residentBytes -= e->desc.bytes;
+    c->stats.evictions++;
+    c->stats.evictedBytes += e->desc.bytes;
+    e->live = false;
+    c->freeEntries[c->numFree++] = entry;
+    return true;
+}
+
+// Adds a reference to a resident texture with this hash, TextureCacheInvalid
+// if there is none. desc may be null when the hash is a path key.
+inline uint32_t textureCacheFind(TextureCache* c, uint64_t hash, const TextureCacheDesc* desc){
+    c->stats.acquires++;
+    uint32_t entry = textureCacheLookup(c, hash, desc);
+    if(entry == TextureCacheInvalid){
+        return TextureCacheInvalid;
+    }
+    TextureCacheEntry* e = &c->entries[entry];
+    if(e->refCount++ == 0){
+        textureCacheUnlink(c, entry);
+        c->stats.revived++;
+    }
+    c->stats.hits++;
+    c->stats.dedupBytes += e->desc.bytes;
+    return entry;
+}
+
+// Adds a texture that missed, with one reference. Makes room under the budget
+// first; returns TextureCacheInvalid if every entry is taken by textures in
+// use. The caller creates the resource and calls textureCacheSetResource.
+inline uint32_t textureCacheInsert(TextureCache* c, uint64_t hash, const TextureCacheDesc* desc){
+    while(c->residentBytes + desc->bytes > c->budgetBytes && textureCacheEvictOne(c)){
+    }
+    if(c->numFree == 0 && !textureCacheEvictOne(c)){
+        c->stats.full++;
+        return TextureCacheInvalid;
+    }
+    uint32_t entry = c->freeEntries[--c->numFree];
+    TextureCacheEntry* e = &c->entries[entry];
+    e->hash = hash;
+    e->desc = *desc;
+    e->resource = 0;
+    e->descriptor = TextureCacheInvalid;
+    e->refCount = 1;
+    e->lastFence = 0;
+    e->prev = TextureCacheInvalid;
+    e->next = TextureCacheInvalid;
+    e->live = true;
+    textureCacheTableInsert(c, hash, entry);
+    c->residentBytes += desc->bytes;
+    c->stats.created++;
+    c->stats.createdBytes += desc->bytes;
+    c->stats.peakBytes = c->residentBytes > c->stats.peakBytes ? c->residentBytes : c->stats.peakBytes;
+    if(c->residentBytes > c->budgetBytes){
+        c->stats.overBudget++;
+    }
+    return entry;
+}
+
+// Hashes the pixels and returns the texture holding them with a reference
+// added, inserting it if needed. created says whether the caller has to
+// create and upload the resource.
+inline uint32_t textureCacheAcquire(TextureCache* c, const TextureCacheDesc* desc, const void* pixels, uint32_t rowBytes, uint32_t pitch, bool* created){
+    uint64_t hash = textureCacheHashPixels(desc, pixels, rowBytes, pitch);
+    uint32_t entry = textureCacheFind(c, hash, desc);
+    *created = entry == TextureCacheInvalid;
+    return *created ? textureCacheInsert(c, hash, desc) : entry;
+}
+
+inline void textureCacheSetResource(TextureCache* c, uint32_t entry, void* resource, uint32_t descriptor){
+    c->entries[entry].resource = resource;
+    c->entries[entry].descriptor = descriptor;
+}
+
+inline const TextureCacheEntry* textureCacheGet(const TextureCache* c, uint32_t entry){
+    return &c->entries[entry];
+}
+
+inline void textureCacheAddRef(TextureCache* c, uint32_t entry){
+    c->entries[entry].refCount++;
+}
+
+// Drops a reference. fence is the one signalled after the last frame that
+// may have sampled the texture.
+inline void textureCacheRelease(TextureCache* c, uint32_t entry, uint64_t fence){
+    TextureCacheEntry* e = &c->entries[entry];
+    e->lastFence = fence > e->lastFence ? fence : e->lastFence;
+    if(--e->refCount > 0){
+        return;
+    }
+    e->prev = TextureCacheInvalid;
+    e->next = c->head;
+    if(c->head != TextureCacheInvalid){
+        c->entries[c->head].prev = entry;
+    }else{
+        c->tail = entry;
+    }
+    c->head = entry;
+}
+
+// Once per frame: evicts down to the budget what the GPU is done with.
+inline void textureCacheTrim(TextureCache* c, uint64_t completedFence){
+    c->completedFence = completedFence;
+    while(c->residentBytes > c->budgetBytes && textureCacheEvictOne(c)){
+    }
+    if(c->residentBytes > c->budgetBytes){
+        c->stats.overBudget++;
+    }
+}
+
+// The caller has released everything in the evicted list.
+inline void textureCacheEvictionsReleased(TextureCache* c){
+    c->numEvicted = 0;
+}
+
+inline void textureCachePrintStats(const TextureCache* c, FILE* out){
+    const TextureCacheStats* s = &c->stats;
+    uint32_t resident = c->capacity - c->numFree;
+    fprintf(out, "texture cache: %u textures, %llu of %llu bytes budget resident (peak %llu), %llu acquires, %llu hits (%llu revived), "
+                 "%llu bytes deduplicated, %llu created (%llu bytes), %llu evicted (%llu bytes), %llu trims over budget, %llu refused\n",
+            resident, (unsigned long long)c->residentBytes, (unsigned long long)c->budgetBytes, (unsigned long long)s->peakBytes,
+            (unsigned long long)s->acquires, (unsigned long long)s->hits, (unsigned long long)s->revived, (unsigned long long)s->dedupBytes,
+            (unsigned long long)s->created, (unsigned long long)s->createdBytes, (unsigned long long)s->evictions,
+            (unsigned long long)s->evictedBytes, (unsigned long long)s->overBudget, (unsigned long long)s->full);
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+// CPU version of Texture2D::Sample for checking textured output off the GPU.
+// Covers point, bilinear and trilinear filtering with wrap, clamp and border
+// addressing on RGBA8 textures stored row-major or in 4x4 texel tiles (one
+// 64 byte cache line per tile). Pixels are processed 8 at a time: the same
+// kernel is built on AVX2, on NEON (two 4-wide halves, scalar gathers) or on
+// plain 8-lane loops when neither is available.
+//
+// The textured quad demo's static sampler is
+//     samplerDescInit(&desc, SAMPLER_FILTER_POINT, SAMPLER_ADDRESS_BORDER, SAMPLER_BORDER_TRANSPARENT_BLACK);
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const int SamplerMaxMips = 16;
+
+// Values match D3D12_FILTER, D3D12_TEXTURE_ADDRESS_MODE and D3D12_STATIC_BORDER_COLOR.
+enum SamplerFilter {
+    SAMPLER_FILTER_POINT = 0,
+    SAMPLER_FILTER_BILINEAR = 0x14,
+    SAMPLER_FILTER_TRILINEAR = 0x15,
+};
+
+enum SamplerAddress {
+    SAMPLER_ADDRESS_WRAP = 1,
+    SAMPLER_ADDRESS_CLAMP = 3,
+    SAMPLER_ADDRESS_BORDER = 4,
+};
+
+enum SamplerBorder {
+    SAMPLER_BORDER_TRANSPARENT_BLACK = 0,
+    SAMPLER_BORDER_OPAQUE_BLACK = 1,
+    SAMPLER_BORDER_OPAQUE_WHITE = 2,
+};
+
+enum SamplerLayout {
+    SAMPLER_LAYOUT_LINEAR,
+    SAMPLER_LAYOUT_TILED_4X4,
+};
+
+struct SamplerDesc {
+    SamplerFilter filter;
+    SamplerAddress addressU;
+    SamplerAddress addressV;
+    // Packed like the texels, r in the low byte.
+    uint32_t borderColor;
+    float mipLodBias;
+    float minLod;
+    float maxLod;
+};
+
+struct SamplerTexture {
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    SamplerLayout layout;
+    uint32_t* texels;
+    uint32_t mipOffset[SamplerMaxMips];
+    uint32_t mipWidth[SamplerMaxMips];
+    uint32_t mipHeight[SamplerMaxMips];
+    uint32_t tilesPerRow[SamplerMaxMips];
+};
+
+// 8 filtered pixels, one array per channel, values in 0..1.
+struct SamplerResult8 {
+    float r[8];
+    float g[8];
+    float b[8];
+    float a[8];
+};
+
+// Perspective-correct interpolants along a horizontal span: u/w, v/w and 1/w
+// at the first pixel and their step per pixel.
+struct SamplerSpan {
+    float uOverW;
+    float vOverW;
+    float oneOverW;
+    float stepUOverW;
+    float stepVOverW;
+    float stepOneOverW;
+};
+
+inline void samplerDescInit(SamplerDesc* desc, SamplerFilter filter, SamplerAddress address, SamplerBorder border){
+    static const uint32_t borderColors[] = { 0x00000000, 0xFF000000, 0xFFFFFFFF };
+    desc->filter = filter;
+    desc->addressU = address;
+    desc->addressV = address;
+    desc->borderColor = borderColors[border];
+    desc->mipLodBias = 0.0f;
+    desc->minLod = 0.0f;
+    desc->maxLod = 3.402823466e+38f;
+}
+
+inline uint32_t samplerTexelIndex(const SamplerTexture* tex, uint32_t level, uint32_t x, uint32_t y){
+    if(tex->layout == SAMPLER_LAYOUT_LINEAR){
+        return y * tex->mipWidth[level] + x;
+    }
+    return ((y >> 2) * tex->tilesPerRow[level] + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3);
+}
+
+// Copies RGBA8 pixels into the requested layout and optionally builds a box
+// filtered mip chain. Returns false if the allocation fails or the chain has
+// more texels than the 32-bit gather indices reach.
+inline bool samplerTextureCreate(SamplerTexture* tex, uint32_t width, uint32_t height, const uint8_t* pixels, uint32_t rowPitch, SamplerLayout layout, bool buildMips){
+    tex->width = width;
+    tex->height = height;
+    tex->layout = layout;
+    tex->mipCount = 0;
+    tex->texels = 0;
+    size_t total = 0;
+    uint32_t w = width;
+    uint32_t h = height;
+    for(;;){
+        uint32_t level = tex->mipCount++;
+        tex->mipWidth[level] = w;
+        tex->mipHeight[level] = h;
+        tex->tilesPerRow[level] = (w + 3) / 4;
+        tex->mipOffset[level] = (uint32_t)total;
+        total += layout == SAMPLER_LAYOUT_LINEAR ? (size_t)w * h : (size_t)tex->tilesPerRow[level] * ((h + 3) / 4) * 16;
+        if(!buildMips || (w == 1 && h == 1) || tex->mipCount == SamplerMaxMips){
+            break;
+        }
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    if(total > INT32_MAX){
+        return false;
+    }
+    tex->texels = (uint32_t*)calloc(total, sizeof(uint32_t));
+    if(!tex->texels){
+        return false;
+    }
+
+    uint32_t* base = tex->texels;
+    for(uint32_t y = 0; y < height; y++){
+        for(uint32_t x = 0; x < width; x++){
+            uint32_t texel;
+            memcpy(&texel, pixels + (size_t)y * rowPitch + (size_t)x * 4, 4);
+            base[samplerTexelIndex(tex, 0, x, y)] = texel;
+        }
+    }
+    for(uint32_t level = 1; level < tex->mipCount; level++){
+        const uint32_t* src = tex->texels + tex->mipOffset[level - 1];
+        uint32_t* dst = tex->texels + tex->mipOffset[level];
+        uint32_t srcW = tex->mipWidth[level - 1];
+        uint32_t srcH = tex->mipHeight[level - 1];
+        for(uint32_t y = 0; y < tex->mipHeight[level]; y++){
+            for(uint32_t x = 0; x < tex->mipWidth[level]; x++){
+                uint32_t x0 = x * 2, x1 = x * 2 + 1 < srcW ? x * 2 + 1 : x * 2;
+                uint32_t y0 = y * 2, y1 = y * 2 + 1 < srcH ? y * 2 + 1 : y * 2;
+                uint32_t taps[4] = {
+                    src[samplerTexelIndex(tex, level - 1, x0, y0)], src[samplerTexelIndex(tex, level - 1, x1, y0)],
+                    src[samplerTexelIndex(tex, level - 1, x0, y1)], src[samplerTexelIndex(tex, level - 1, x1, y1)],
+                };
+                uint32_t texel = 0;
+                for(int c = 0; c < 32; c += 8){
+                    uint32_t sum = 2;
+                    for(int t = 0; t < 4; t++){
+                        sum += (taps[t] >> c) & 0xFF;
+                    }
+                    texel |= (sum / 4) << c;
+                }
+                dst[samplerTexelIndex(tex, level, x, y)] = texel;
+            }
+        }
+    }
+    return true;
+}
+
+inline void samplerTextureDestroy(SamplerTexture* tex){
+    free(tex->texels);
+    tex->texels = 0;
+}
+
+// 8-lane vector wrappers. Masks are all-ones/all-zeros integer lanes.
+#if defined(__AVX2__)
+
+struct SamplerF { __m256 v; };
+struct SamplerI { __m256i v; };
+
+inline SamplerF samplerSet(float x){ SamplerF r = { _mm256_set1_ps(x) }; return r; }
+inline SamplerI samplerSetI(int32_t x){ SamplerI r = { _mm256_set1_epi32(x) }; return r; }
+inline SamplerF samplerLoad(const float* p){ SamplerF r = { _mm256_loadu_ps(p) }; return r; }
+inline void samplerStore(float* p, SamplerF a){ _mm256_storeu_ps(p, a.v); }
+inline SamplerF samplerAdd(SamplerF a, SamplerF b){ SamplerF r = { _mm256_add_ps(a.v, b.v) }; return r; }
+inline SamplerF samplerSub(SamplerF a, SamplerF b){ SamplerF r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+inline SamplerF samplerMul(SamplerF a, SamplerF b){ SamplerF r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+inline SamplerF samplerMin(SamplerF a, SamplerF b){ SamplerF r = { _mm256_min_ps(a.v, b.v) }; return r; }
+inline SamplerF samplerMax(SamplerF a, SamplerF b){ SamplerF r = { _mm256_max_ps(a.v, b.v) }; return r; }
+inline SamplerF samplerFloor(SamplerF a){ SamplerF r = { _mm256_floor_ps(a.v) }; return r; }
+inline SamplerI samplerToInt(SamplerF a){ SamplerI r = { _mm256_cvttps_epi32(a.v) }; return r; }
+inline SamplerF samplerToFloat(SamplerI a){ SamplerF r = { _mm256_cvtepi32_ps(a.v) }; return r; }
+inline SamplerI samplerAddI(SamplerI a, SamplerI b){ SamplerI r = { _mm256_add_epi32(a.v, b.v) }; return r; }
+inline SamplerI samplerMulI(SamplerI a, SamplerI b){ SamplerI r = { _mm256_mullo_epi32(a.v, b.v) }; return r; }
+inline SamplerI samplerAndI(SamplerI a, SamplerI b){ SamplerI r = { _mm256_and_si256(a.v, b.v) }; return r; }
+inline SamplerI samplerShrI(SamplerI a, int n){ SamplerI r = { _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)) }; return r; }
+inline SamplerI samplerInside(SamplerF a, SamplerF lo, SamplerF hi){
+    __m256 m = _mm256_and_ps(_mm256_cmp_ps(a.v, lo.v, _CMP_GE_OQ), _mm256_cmp_ps(a.v, hi.v, _CMP_LT_OQ));
+    SamplerI r = { _mm256_castps_si256(m) };
+    return r;
+}
+inline SamplerI samplerGather(const uint32_t* base, SamplerI index, SamplerI mask, SamplerI fallback){
+    SamplerI r = { _mm256_mask_i32gather_epi32(fallback.v, (const int*)base, index.v, mask.v, 4) };
+    return r;
+}
+
+#elif defined(__ARM_NEON)
+
+struct SamplerF { float32x4_t lo, hi; };
+struct SamplerI { uint32x4_t lo, hi; };
+
+inline SamplerF samplerSet(float x){ SamplerF r = { vdupq_n_f32(x), vdupq_n_f32(x) }; return r; }
+inline SamplerI samplerSetI(int32_t x){ SamplerI r = { vdupq_n_u32((uint32_t)x), vdupq_n_u32((uint32_t)x) }; return r; }
+inline SamplerF samplerLoad(const float* p){ SamplerF r = { vld1q_f32(p), vld1q_f32(p + 4) }; return r; }
+inline void samplerStore(float* p, SamplerF a){ vst1q_f32(p, a.lo); vst1q_f32(p + 4, a.hi); }
+inline SamplerF samplerAdd(SamplerF a, SamplerF b){ SamplerF r = { vaddq_f32(a.lo, b.lo), vaddq_f32(a.hi, b.hi) }; return r; }
+inline SamplerF samplerSub(SamplerF a, SamplerF b){ SamplerF r = { vsubq_f32(a.lo, b.lo), vsubq_f32(a.hi, b.hi) }; return r; }
+inline SamplerF samplerMul(SamplerF a, SamplerF b){ SamplerF r = { vmulq_f32(a.lo, b.lo), vmulq_f32(a.hi, b.hi) }; return r; }
+inline SamplerF samplerMin(SamplerF a, SamplerF b){ SamplerF r = { vminq_f32(a.lo, b.lo), vminq_f32(a.hi, b.hi) }; return r; }
+inline SamplerF samplerMax(SamplerF a, SamplerF b){ SamplerF r = { vmaxq_f32(a.lo, b.lo), vmaxq_f32(a.hi, b.hi) }; return r; }
+inline SamplerF samplerFloor(SamplerF a){ SamplerF r = { vrndmq_f32(a.lo), vrndmq_f32(a.hi) }; return r; }
+inline SamplerI samplerToInt(SamplerF a){
+    SamplerI r = { vreinterpretq_u32_s32(vcvtq_s32_f32(a.lo)), vreinterpretq_u32_s32(vcvtq_s32_f32(a.hi)) };
+    return r;
+}
+inline SamplerF samplerToFloat(SamplerI a){ SamplerF r = { vcvtq_f32_u32(a.lo), vcvtq_f32_u32(a.hi) }; return r; }
+inline SamplerI samplerAddI(SamplerI a, SamplerI b){ SamplerI r = { vaddq_u32(a.lo, b.lo), vaddq_u32(a.hi, b.hi) }; return r; }
+inline SamplerI samplerMulI(SamplerI a, SamplerI b){ SamplerI r = { vmulq_u32(a.lo, b.lo), vmulq_u32(a.hi, b.hi) }; return r; }
+inline SamplerI samplerAndI(SamplerI a, SamplerI b){ SamplerI r = { vandq_u32(a.lo, b.lo), vandq_u32(a.hi, b.hi) }; return r; }
+inline SamplerI samplerShrI(SamplerI a, int n){
+    int32x4_t shift = vdupq_n_s32(-n);
+    SamplerI r = { vshlq_u32(a.lo, shift), vshlq_u32(a.hi, shift) };
+    return r;
+}
+inline SamplerI samplerInside(SamplerF a, SamplerF lo, SamplerF hi){
+    SamplerI r = { vandq_u32(vcgeq_f32(a.lo, lo.lo), vcltq_f32(a.lo, hi.lo)), vandq_u32(vcgeq_f32(a.hi, lo.hi), vcltq_f32(a.hi, hi.hi)) };
+    return r;
+}
+inline SamplerI samplerGather(const uint32_t* base, SamplerI index, SamplerI mask, SamplerI fallback){
+    uint32_t i[8], m[8], f[8], out[8];
+    vst1q_u32(i, index.lo); vst1q_u32(i + 4, index.hi);
+    vst1q_u32(m, mask.lo); vst1q_u32(m + 4, mask.hi);
+    vst1q_u32(f, fallback.lo); vst1q_u32(f + 4, fallback.hi);
+    for(int l = 0; l < 8; l++){
+        out[l] = m[l] ? base[i[l]] : f[l];
+    }
+    SamplerI r = { vld1q_u32(out), vld1q_u32(out + 4) };
+    return r;
+}
+
+#else
+
+struct SamplerF { float v[8]; };
+struct SamplerI { uint32_t v[8]; };
+
+#define SAMPLER_LANES(expr) for(int l = 0; l < 8; l++){ expr; }
+inline SamplerF samplerSet(float x){ SamplerF r; SAMPLER_LANES(r.v[l] = x) return r; }
+inline SamplerI samplerSetI(int32_t x){ SamplerI r; SAMPLER_LANES(r.v[l] = (uint32_t)x) return r; }
+inline SamplerF samplerLoad(const float* p){ SamplerF r; SAMPLER_LANES(r.v[l] = p[l]) return r; }
+inline void samplerStore(float* p, SamplerF a){ SAMPLER_LANES(p[l] = a.v[l]) }
+inline SamplerF samplerAdd(SamplerF a, SamplerF b){ SamplerF r; SAMPLER_LANES(r.v[l] = a.v[l] + b.v[l]) return r; }
+inline SamplerF samplerSub(SamplerF a, SamplerF b){ SamplerF r; SAMPLER_LANES(r.v[l] = a.v[l] - b.v[l]) return r; }
+inline SamplerF samplerMul(SamplerF a, SamplerF b){ SamplerF r; SAMPLER_LANES(r.v[l] = a.v[l] * b.v[l]) return r; }
+inline SamplerF samplerMin(SamplerF a, SamplerF b){ SamplerF r; SAMPLER_LANES(r.v[l] = a.v[l] < b.v[l] ? a.v[l] : b.v[l]) return r; }
+inline SamplerF samplerMax(SamplerF a, SamplerF b){ SamplerF r; SAMPLER_LANES(r.v[l] = a.v[l] > b.v[l] ? a.v[l] : b.v[l]) return r; }
+inline SamplerF samplerFloor(SamplerF a){ SamplerF r; SAMPLER_LANES(r.v[l] = floorf(a.v[l])) return r; }
+inline SamplerI samplerToInt(SamplerF a){ SamplerI r; SAMPLER_LANES(r.v[l] = (uint32_t)(int32_t)a.v[l]) return r; }
+inline SamplerF samplerToFloat(SamplerI a){ SamplerF r; SAMPLER_LANES(r.v[l] = (float)a.v[l]) return r; }
+inline SamplerI samplerAddI(SamplerI a, SamplerI b){ SamplerI r; SAMPLER_LANES(r.v[l] = a.v[l] + b.v[l]) return r; }
+inline SamplerI samplerMulI(SamplerI a, SamplerI b){ SamplerI r; SAMPLER_LANES(r.v[l] = a.v[l] * b.v[l]) return r; }
+inline SamplerI samplerAndI(SamplerI a, SamplerI b){ SamplerI r; SAMPLER_LANES(r.v[l] = a.v[l] & b.v[l]) return r; }
+inline SamplerI samplerShrI(SamplerI a, int n){ SamplerI r; SAMPLER_LANES(r.v[l] = a.v[l] >> n) return r; }
+inline SamplerI samplerInside(SamplerF a, SamplerF lo, SamplerF hi){
+    SamplerI r;
+    SAMPLER_LANES(r.v[l] = (a.v[l] >= lo.v[l] && a.v[l] < hi.v[l]) ? 0xFFFFFFFF : 0)
+    return r;
+}
+inline SamplerI samplerGather(const uint32_t* base, SamplerI index, SamplerI mask, SamplerI fallback){
+    SamplerI r;
+    SAMPLER_LANES(r.v[l] = mask.v[l] ? base[index.v[l]] : fallback.v[l])
+    return r;
+}
+#undef SAMPLER_LANES
+
+#endif
+
+// Texel coordinates (already floored) -> addressed texels, border texels for
+// lanes outside the texture under BORDER addressing.
+inline SamplerI samplerFetch8(const SamplerTexture* tex, const SamplerDesc* desc, uint32_t level, SamplerF x, SamplerF y){
+    float w = (float)tex->mipWidth[level];
+    float h = (float)tex->mipHeight[level];
+    SamplerF zero = samplerSet(0.0f);
+    SamplerF maxX = samplerSet(w - 1.0f);
+    SamplerF maxY = samplerSet(h - 1.0f);
+    SamplerI mask = samplerSetI(-1);
+
+    if(desc->addressU == SAMPLER_ADDRESS_WRAP){
+        x = samplerSub(x, samplerMul(samplerSet(w), samplerFloor(samplerMul(x, samplerSet(1.0f / w)))));
+    }else if(desc->addressU == SAMPLER_ADDRESS_BORDER){
+        mask = samplerInside(x, zero, samplerSet(w));
+    }
+    if(desc->addressV == SAMPLER_ADDRESS_WRAP){
+        y = samplerSub(y, samplerMul(samplerSet(h), samplerFloor(samplerMul(y, samplerSet(1.0f / h)))));
+    }else if(desc->addressV == SAMPLER_ADDRESS_BORDER){
+        mask = samplerAndI(mask, samplerInside(y, zero, samplerSet(h)));
+    }
+    // Clamping also keeps wrapped and masked lanes inside the allocation.
+    SamplerI ix = samplerToInt(samplerMin(samplerMax(x, zero), maxX));
+    SamplerI iy = samplerToInt(samplerMin(samplerMax(y, zero), maxY));
+
+    SamplerI index;
+    if(tex->layout == SAMPLER_LAYOUT_LINEAR){
+        index = samplerAddI(samplerMulI(iy, samplerSetI((int32_t)tex->mipWidth[level])), ix);
+    }else{
+        SamplerI three = samplerSetI(3);
+        SamplerI tile = samplerAddI(samplerMulI(samplerShrI(iy, 2), samplerSetI((int32_t)tex->tilesPerRow[level])), samplerShrI(ix, 2));
+        SamplerI inTile = samplerAddI(samplerMulI(samplerAndI(iy, three), samplerSetI(4)), samplerAndI(ix, three));
+        index = samplerAddI(samplerMulI(tile, samplerSetI(16)), inTile);
+    }
+    return samplerGather(tex->texels + tex->mipOffset[level], index, mask, samplerSetI((int32_t)desc->borderColor));
+}
+
+inline void samplerUnpack8(SamplerI texels, SamplerF* rgba){
+    SamplerI byteMask = samplerSetI(0xFF);
+    SamplerF scale = samplerSet(1.0f / 255.0f);
+    for(int c = 0; c < 4; c++){
+        rgba[c] = samplerMul(samplerToFloat(samplerAndI(samplerShrI(texels, c * 8), byteMask)), scale);
+    }
+}
+
+inline SamplerF samplerLerp(SamplerF a, SamplerF b, SamplerF t){
+    return samplerAdd(a, samplerMul(samplerSub(b, a), t));
+}
+
+inline void samplerSampleLevel8(const SamplerTexture* tex, const SamplerDesc* desc, uint32_t level, SamplerF u, SamplerF v, bool linear, SamplerF* rgba){
+    SamplerF x = samplerMul(u, samplerSet((float)tex->mipWidth[level]));
+    SamplerF y = samplerMul(v, samplerSet((float)tex->mipHeight[level]));
+    if(!linear){
+        samplerUnpack8(samplerFetch8(tex, desc, level, samplerFloor(x), samplerFloor(y)), rgba);
+        return;
+    }
+
+    SamplerF half = samplerSet(0.5f);
+    SamplerF one = samplerSet(1.0f);
+    x = samplerSub(x, half);
+    y = samplerSub(y, half);
+    SamplerF x0 = samplerFloor(x);
+    SamplerF y0 = samplerFloor(y);
+    SamplerF fx = samplerSub(x, x0);
+    SamplerF fy = samplerSub(y, y0);
+    SamplerF x1 = samplerAdd(x0, one);
+    SamplerF y1 = samplerAdd(y0, one);
+
+    SamplerF t00[4], t10[4], t01[4], t11[4];
+    samplerUnpack8(samplerFetch8(tex, desc, level, x0, y0), t00);
+    samplerUnpack8(samplerFetch8(tex, desc, level, x1, y0), t10);
+    samplerUnpack8(samplerFetch8(tex, desc, level, x0, y1), t01);
+    samplerUnpack8(samplerFetch8(tex, desc, level, x1, y1), t11);
+    for(int c = 0; c < 4; c++){
+        rgba[c] = samplerLerp(samplerLerp(t00[c], t10[c], fx), samplerLerp(t01[c], t11[c], fx), fy);
+    }
+}
+
+// Samples 8 pixels at once. lod is log2 of the texel footprint on level 0, as
+// the hardware would derive it from the uv derivatives; it only matters once
+// the texture has mips.
+inline void textureSample8(const SamplerTexture* tex, const SamplerDesc* desc, const float* u, const float* v, float lod, SamplerResult8* out){
+    float maxLevel = (float)(tex->mipCount - 1);
+    lod += desc->mipLodBias;
+    lod = lod < desc->minLod ? desc->minLod : lod;
+    lod = lod > desc->maxLod ? desc->maxLod : lod;
+    lod = lod < 0.0f ? 0.0f : (lod > maxLevel ? maxLevel : lod);
+
+    SamplerF uu = samplerLoad(u);
+    SamplerF vv = samplerLoad(v);
+    SamplerF rgba[4];
+    if(desc->filter == SAMPLER_FILTER_TRILINEAR){
+        uint32_t level0 = (uint32_t)lod;
+        uint32_t level1 = level0 + 1 < tex->mipCount ? level0 + 1 : level0;
+        float t = lod - (float)level0;
+        samplerSampleLevel8(tex, desc, level0, uu, vv, true, rgba);
+        if(t > 0.0f && level1 != level0){
+            SamplerF next[4];
+            samplerSampleLevel8(tex, desc, level1, uu, vv, true, next);
+            for(int c = 0; c < 4; c++){
+                rgba[c] = samplerLerp(rgba[c], next[c], samplerSet(t));
+            }
+        }
+    }else{
+        uint32_t level = (uint32_t)(lod + 0.5f);
+        samplerSampleLevel8(tex, desc, level, uu, vv, desc->filter == SAMPLER_FILTER_BILINEAR, rgba);
+    }
+    samplerStore(out->r, rgba[0]);
+    samplerStore(out->g, rgba[1]);
+    samplerStore(out->b, rgba[2]);
+    samplerStore(out->a, rgba[3]);
+}
+
+// Samples count pixels along a span, interpolating uv perspective-correctly and
+// picking the lod per batch of 8 from the horizontal uv derivatives. Writes
+// interleaved RGBA floats, 4 per pixel.
+inline void textureSampleSpan(const SamplerTexture* tex, const SamplerDesc* desc, const SamplerSpan* span, int count, float* rgba){
+    for(int start = 0; start < count; start += 8){
+        float u[8], v[8];
+        for(int l = 0; l < 8; l++){
+            float i = (float)(start + l);
+            float w = 1.0f / (span->oneOverW + span->stepOneOverW * i);
+            u[l] = (span->uOverW + span->stepUOverW * i) * w;
+            v[l] = (span->vOverW + span->stepVOverW * i) * w;
+        }
+
+        // d(u/w / 1/w)/dx at the middle of the batch.
+        float mid = (float)start + 3.5f;
+        float q = span->oneOverW + span->stepOneOverW * mid;
+        float dudx = (span->stepUOverW * q - (span->uOverW + span->stepUOverW * mid) * span->stepOneOverW) / (q * q);
+        float dvdx = (span->stepVOverW * q - (span->vOverW + span->stepVOverW * mid) * span->stepOneOverW) / (q * q);
+        float footprint = fmaxf(fabsf(dudx) * tex->width, fabsf(dvdx) * tex->height);
+        float lod = footprint > 0.0f ? log2f(footprint) : 0.0f;
+
+        SamplerResult8 result;
+        textureSample8(tex, desc, u, v, lod, &result);
+        int n = count - start < 8 ? count - start : 8;
+        for(int l = 0; l < n; l++){
+            float* out = rgba + (start + l) * 4;
+            out[0] = result.r[l];
+            out[1] = result.g[l];
+            out[2] = result.b[l];
+            out[3] = result.a[l];
+        }
+    }
+}
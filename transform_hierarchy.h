@@ -0,0 +1,383 @@
+#pragma once
+
+// 2D affine transforms for sprites: translation, rotation and scale relative
+// to an optional parent, resolved into world matrices and written out as
+// finished quad vertices or per instance matrices.
+//
+// Everything is kept as structure of arrays so a batch of transforms is one
+// register per component: 16 lanes on AVX-512, 8 on AVX2, 4 on SSE2 and NEON,
+// 8 plain lanes otherwise. A transform's parent always has a lower index, so
+// one pass in index order sees every parent resolved before its children.
+// Setting a local transform marks it dirty; an update spreads the flags to the
+// descendants and recomputes only batches with something dirty in them,
+// starting from the lowest dirty index. Batches whose parents all come from
+// earlier batches are computed wide, with the parent matrices gathered per
+// lane; the rare batch holding a parent of one of its own lanes goes scalar.
+//
+// A world matrix maps local (x, y) to
+//     (a * x + c * y + tx, b * x + d * y + ty).
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const int32_t TransformNoParent = -1;
+// Arrays are padded to this many floats, the widest batch there is.
+static const uint32_t TransformPad = 16;
+
+// Triangle list vertex as the sprite pipeline reads it: position, then uv.
+struct TransformVertex {
+    float x;
+    float y;
+    float u;
+    float v;
+};
+
+// World matrix for pipelines that build the quad in the vertex shader.
+struct TransformInstance {
+    float a;
+    float b;
+    float c;
+    float d;
+    float tx;
+    float ty;
+};
+
+struct TransformStats {
+    uint64_t updates;
+    uint64_t transformsUpdated;
+    uint64_t scalarBatches;
+    uint64_t quadsWritten;
+    double seconds;
+};
+
+struct TransformHierarchy {
+    uint32_t capacity;
+    uint32_t count;
+    // Local transform, the rotation kept as its cosine and sine.
+    float* x;
+    float* y;
+    float* cosR;
+    float* sinR;
+    float* scaleX;
+    float* scaleY;
+    int32_t* parent;
+    uint8_t* dirty;
+    uint32_t firstDirty;
+    // World matrix.
+    float* a;
+    float* b;
+    float* c;
+    float* d;
+    float* tx;
+    float* ty;
+    float* memory;
+    TransformStats stats;
+};
+
+#if defined(__AVX512F__)
+static const int TransformLanes = 16;
+struct TransformF { __m512 v; };
+inline TransformF transformSet(float x){ TransformF r = { _mm512_set1_ps(x) }; return r; }
+inline TransformF transformLoad(const float* p){ TransformF r = { _mm512_loadu_ps(p) }; return r; }
+inline void transformStore(float* p, TransformF a){ _mm512_storeu_ps(p, a.v); }
+inline TransformF transformAdd(TransformF a, TransformF b){ TransformF r = { _mm512_add_ps(a.v, b.v) }; return r; }
+inline TransformF transformSub(TransformF a, TransformF b){ TransformF r = { _mm512_sub_ps(a.v, b.v) }; return r; }
+inline TransformF transformMul(TransformF a, TransformF b){ TransformF r = { _mm512_mul_ps(a.v, b.v) }; return r; }
+#elif defined(__AVX2__)
+static const int TransformLanes = 8;
+struct TransformF { __m256 v; };
+inline TransformF transformSet(float x){ TransformF r = { _mm256_set1_ps(x) }; return r; }
+inline TransformF transformLoad(const float* p){ TransformF r = { _mm256_loadu_ps(p) }; return r; }
+inline void transformStore(float* p, TransformF a){ _mm256_storeu_ps(p, a.v); }
+inline TransformF transformAdd(TransformF a, TransformF b){ TransformF r = { _mm256_add_ps(a.v, b.v) }; return r; }
+inline TransformF transformSub(TransformF a, TransformF b){ TransformF r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+inline TransformF transformMul(TransformF a, TransformF b){ TransformF r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+#elif defined(TRANSFORM_SSE2)
+static const int TransformLanes = 4;
+struct TransformF { __m128 v; };
+inline TransformF transformSet(float x){ TransformF r = { _mm_set1_ps(x) }; return r; }
+inline TransformF transformLoad(const float* p){ TransformF r = { _mm_loadu_ps(p) }; return r; }
+inline void transformStore(float* p, TransformF a){ _mm_storeu_ps(p, a.v); }
+inline TransformF transformAdd(TransformF a, TransformF b){ TransformF r = { _mm_add_ps(a.v, b.v) }; return r; }
+inline TransformF transformSub(TransformF a, TransformF b){ TransformF r = { _mm_sub_ps(a.v, b.v) }; return r; }
+inline TransformF transformMul(TransformF a, TransformF b){ TransformF r = { _mm_mul_ps(a.v, b.v) }; return r; }
+#elif defined(__ARM_NEON)
+static const int TransformLanes = 4;
+struct TransformF { float32x4_t v; };
+inline TransformF transformSet(float x){ TransformF r = { vdupq_n_f32(x) }; return r; }
+inline TransformF transformLoad(const float* p){ TransformF r = { vld1q_f32(p) }; return r; }
+inline void transformStore(float* p, TransformF a){ vst1q_f32(p, a.v); }
+inline TransformF transformAdd(TransformF a, TransformF b){ TransformF r = { vaddq_f32(a.v, b.v) }; return r; }
+inline TransformF transformSub(TransformF a, TransformF b){ TransformF r = { vsubq_f32(a.v, b.v) }; return r; }
+inline TransformF transformMul(TransformF a, TransformF b){ TransformF r = { vmulq_f32(a.v, b.v) }; return r; }
+#else
+static const int TransformLanes = 8;
+struct TransformF { float v[8]; };
+#define TRANSFORM_LANES(expr) for(int l = 0; l < 8; l++){ expr; }
+inline TransformF transformSet(float x){ TransformF r; TRANSFORM_LANES(r.v[l] = x) return r; }
+inline TransformF transformLoad(const float* p){ TransformF r; TRANSFORM_LANES(r.v[l] = p[l]) return r; }
+inline void transformStore(float* p, TransformF a){ TRANSFORM_LANES(p[l] = a.v[l]) }
+inline TransformF transformAdd(TransformF a, TransformF b){ TransformF r; TRANSFORM_LANES(r.v[l] = a.v[l] + b.v[l]) return r; }
+inline TransformF transformSub(TransformF a, TransformF b){ TransformF r; TRANSFORM_LANES(r.v[l] = a.v[l] - b.v[l]) return r; }
+inline TransformF transformMul(TransformF a, TransformF b){ TransformF r; TRANSFORM_LANES(r.v[l] = a.v[l] * b.v[l]) return r; }
+#undef TRANSFORM_LANES
+#endif
+
+inline TransformF transformMulAdd(TransformF a, TransformF b, TransformF c){
+    return transformAdd(transformMul(a, b), c);
+}
+
+inline bool transformHierarchyInit(TransformHierarchy* h, uint32_t capacity){
+    memset(h, 0, sizeof(*h));
+    uint32_t padded = (capacity + TransformPad - 1) / TransformPad * TransformPad;
+    // Twelve float arrays, the parents and the dirty flags, all zeroed so the
+    // padding lanes compute harmless values.
+    h->memory = (float*)calloc((size_t)padded * 14, sizeof(float));
+    if(!h->memory){
+        return false;
+    }
+    float** arrays[] = { &h->x, &h->y, &h->cosR, &h->sinR, &h->scaleX, &h->scaleY, &h->a, &h->b, &h->c, &h->d, &h->tx, &h->ty };
+    for (int i = 0; i < 12; i++){
+        *arrays[i] = h->memory + (size_t)padded * i;
+    }
+    h->parent = (int32_t*)(h->memory + (size_t)padded * 12);
+    h->dirty = (uint8_t*)(h->memory + (size_t)padded * 13);
+    h->capacity = capacity;
+    h->firstDirty = UINT32_MAX;
+    return true;
+}
+
+inline void transformHierarchyDestroy(TransformHierarchy* h){
+    free(h->memory);
+    h->memory = 0;
+}
+
+inline void transformMarkDirty(TransformHierarchy* h, uint32_t id){
+    h->dirty[id] = 1;
+    h->firstDirty = id < h->firstDirty ? id : h->firstDirty;
+}
+
+// Adds an identity transform under parent, which must already exist, or at
+// the root with TransformNoParent. Returns its index, UINT32_MAX when full.
+inline uint32_t transformCreate(TransformHierarchy* h, int32_t parent){
+    if(h->count == h->capacity || parent >= (int32_t)h->count){
+        return UINT32_MAX;
+    }
+    uint32_t id = h->count++;
+    h->x[id] = 0.0f;
+    h->y[id] = 0.0f;
+    h->cosR[id] = 1.0f;
+    h->sinR[id] = 0.0f;
+    h->scaleX[id] = 1.0f;
+    h->scaleY[id] = 1.0f;
+    h->parent[id] = parent;
+    transformMarkDirty(h, id);
+    return id;
+}
+
+inline void transformSetLocal(TransformHierarchy* h, uint32_t id, float x, float y, float rotation, float scaleX, float scaleY){
+    h->x[id] = x;
+    h->y[id] = y;
+    h->cosR[id] = cosf(rotation);
+    h->sinR[id] = sinf(rotation);
+    h->scaleX[id] = scaleX;
+    h->scaleY[id] = scaleY;
+    transformMarkDirty(h, id);
+}
+
+inline void transformSetPosition(TransformHierarchy* h, uint32_t id, float x, float y){
+    h->x[id] = x;
+    h->y[id] = y;
+    transformMarkDirty(h, id);
+}
+
+inline void transformUpdateOne(TransformHierarchy* h, uint32_t i){
+    float la = h->cosR[i] * h->scaleX[i];
+    float lb = h->sinR[i] * h->scaleX[i];
+    float lc = -h->sinR[i] * h->scaleY[i];
+    float ld = h->cosR[i] * h->scaleY[i];
+    int32_t p = h->parent[i];
+    if(p == TransformNoParent){
+        h->a[i] = la; h->b[i] = lb; h->c[i] = lc; h->d[i] = ld;
+        h->tx[i] = h->x[i];
+        h->ty[i] = h->y[i];
+        return;
+    }
+    float pa = h->a[p], pb = h->b[p], pc = h->c[p], pd = h->d[p];
+    h->a[i] = pa * la + pc * lb;
+    h->b[i] = pb * la + pd * lb;
+    h->c[i] = pa * lc + pc * ld;
+    h->d[i] = pb * lc + pd * ld;
+    h->tx[i] = pa * h->x[i] + pc * h->y[i] + h->tx[p];
+    h->ty[i] = pb * h->x[i] + pd * h->y[i] + h->ty[p];
+}
+
+// Recomputes the world matrices of everything dirty and their descendants.
+inline void transformUpdate(TransformHierarchy* h){
+    if(h->firstDirty >= h->count){
+        h->firstDirty = UINT32_MAX;
+        return;
+    }
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    uint32_t first = h->firstDirty / TransformLanes * TransformLanes;
+
+    // Parents come first, so one pass carries the flags down any depth.
+    for (uint32_t i = h->firstDirty; i < h->count; i++){
+        int32_t p = h->parent[i];
+        h->dirty[i] |= p != TransformNoParent ? h->dirty[p] : 0;
+    }
+
+    uint64_t updated = 0;
+    for (uint32_t start = first; start < h->count; start += TransformLanes){
+        uint32_t end = start + TransformLanes < h->count ? start + TransformLanes : h->count;
+        bool anyDirty = false;
+        bool anyParent = false;
+        bool parentInBatch = false;
+        for (uint32_t i = start; i < end; i++){
+            anyDirty |= h->dirty[i] != 0;
+            anyParent |= h->parent[i] != TransformNoParent;
+            parentInBatch |= h->parent[i] >= (int32_t)start;
+        }
+        if(!anyDirty){
+            continue;
+        }
+        if(parentInBatch){
+            for (uint32_t i = start; i < end; i++){
+                if(h->dirty[i]){
+                    transformUpdateOne(h, i);
+                }
+            }
+            h->stats.scalarBatches++;
+        }else{
+            // Clean lanes are recomputed too, from unchanged inputs to the same result.
+            TransformF sx = transformLoad(h->scaleX + start);
+            TransformF sy = transformLoad(h->scaleY + start);
+            TransformF cr = transformLoad(h->cosR + start);
+            TransformF sr = transformLoad(h->sinR + start);
+            TransformF la = transformMul(cr, sx);
+            TransformF lb = transformMul(sr, sx);
+            TransformF lc = transformSub(transformSet(0.0f), transformMul(sr, sy));
+            TransformF ld = transformMul(cr, sy);
+            TransformF lx = transformLoad(h->x + start);
+            TransformF ly = transformLoad(h->y + start);
+            if(!anyParent){
+                transformStore(h->a + start, la);
+                transformStore(h->b + start, lb);
+                transformStore(h->c + start, lc);
+                transformStore(h->d + start, ld);
+                transformStore(h->tx + start, lx);
+                transformStore(h->ty + start, ly);
+            }else{
+                float parent[6][TransformLanes];
+                for (int l = 0; l < TransformLanes; l++){
+                    int32_t p = start + l < end ? h->parent[start + l] : TransformNoParent;
+                    if(p == TransformNoParent){
+                        parent[0][l] = 1.0f; parent[1][l] = 0.0f; parent[2][l] = 0.0f;
+                        parent[3][l] = 1.0f; parent[4][l] = 0.0f; parent[5][l] = 0.0f;
+                    }else{
+                        parent[0][l] = h->a[p]; parent[1][l] = h->b[p]; parent[2][l] = h->c[p];
+                        parent[3][l] = h->d[p]; parent[4][l] = h->tx[p]; parent[5][l] = h->ty[p];
+                    }
+                }
+                TransformF pa = transformLoad(parent[0]);
+                TransformF pb = transformLoad(parent[1]);
+                TransformF pc = transformLoad(parent[2]);
+                TransformF pd = transformLoad(parent[3]);
+                transformStore(h->a + start, transformMulAdd(pa, la, transformMul(pc, lb)));
+                transformStore(h->b + start, transformMulAdd(pb, la, transformMul(pd, lb)));
+                transformStore(h->c + start, transformMulAdd(pa, lc, transformMul(pc, ld)));
+                transformStore(h->d + start, transformMulAdd(pb, lc, transformMul(pd, ld)));
+                transformStore(h->tx + start, transformMulAdd(pa, lx, transformMulAdd(pc, ly, transformLoad(parent[4]))));
+                transformStore(h->ty + start, transformMulAdd(pb, lx, transformMulAdd(pd, ly, transformLoad(parent[5]))));
+            }
+        }
+        for (uint32_t i = start; i < end; i++){
+            updated += h->dirty[i];
+            h->dirty[i] = 0;
+        }
+    }
+    h->firstDirty = UINT32_MAX;
+    h->stats.updates++;
+    h->stats.transformsUpdated += updated;
+    h->stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+}
+
+// Writes the unit quad (-0.5..0.5 on both axes) of count transforms as two
+// triangles each, 6 vertices in the order of the sprite geometry, uv 0,0 at
+// the top left. ids picks the transforms, or 0 for first, first + 1 and so on.
+// out is written front to back only, so it can be write combined memory.
+inline void transformWriteQuads(TransformHierarchy* h, const uint32_t* ids, uint32_t first, uint32_t count, TransformVertex* out){
+    const TransformF half = transformSet(0.5f);
+    for (uint32_t start = 0; start < count; start += TransformLanes){
+        uint32_t n = count - start < (uint32_t)TransformLanes ? count - start : (uint32_t)TransformLanes;
+        TransformF a, b, c, d, tx, ty;
+        if(ids || n < (uint32_t)TransformLanes){
+            float m[6][TransformLanes] = {};
+            for (uint32_t l = 0; l < n; l++){
+                uint32_t i = ids ? ids[start + l] : first + start + l;
+                m[0][l] = h->a[i]; m[1][l] = h->b[i]; m[2][l] = h->c[i];
+                m[3][l] = h->d[i]; m[4][l] = h->tx[i]; m[5][l] = h->ty[i];
+            }
+            a = transformLoad(m[0]); b = transformLoad(m[1]); c = transformLoad(m[2]);
+            d = transformLoad(m[3]); tx = transformLoad(m[4]); ty = transformLoad(m[5]);
+        }else{
+            uint32_t i = first + start;
+            a = transformLoad(h->a + i); b = transformLoad(h->b + i); c = transformLoad(h->c + i);
+            d = transformLoad(h->d + i); tx = transformLoad(h->tx + i); ty = transformLoad(h->ty + i);
+        }
+        // Half axes; corners are the center plus or minus each.
+        TransformF ax = transformMul(a, half), ay = transformMul(b, half);
+        TransformF cx = transformMul(c, half), cy = transformMul(d, half);
+        float corners[8][TransformLanes];
+        // (-0.5, -0.5), (-0.5, 0.5), (0.5, 0.5), (0.5, -0.5)
+        transformStore(corners[0], transformSub(transformSub(tx, ax), cx));
+        transformStore(corners[1], transformSub(transformSub(ty, ay), cy));
+        transformStore(corners[2], transformAdd(transformSub(tx, ax), cx));
+        transformStore(corners[3], transformAdd(transformSub(ty, ay), cy));
+        transformStore(corners[4], transformAdd(transformAdd(tx, ax), cx));
+        transformStore(corners[5], transformAdd(transformAdd(ty, ay), cy));
+        transformStore(corners[6], transformSub(transformAdd(tx, ax), cx));
+        transformStore(corners[7], transformSub(transformAdd(ty, ay), cy));
+        for (uint32_t l = 0; l < n; l++){
+            TransformVertex* v = out + (size_t)(start + l) * 6;
+            TransformVertex v0 = { corners[0][l], corners[1][l], 0.0f, 1.0f };
+            TransformVertex v1 = { corners[2][l], corners[3][l], 0.0f, 0.0f };
+            TransformVertex v2 = { corners[4][l], corners[5][l], 1.0f, 0.0f };
+            TransformVertex v3 = { corners[6][l], corners[7][l], 1.0f, 1.0f };
+            v[0] = v0; v[1] = v1; v[2] = v2;
+            v[3] = v2; v[4] = v3; v[5] = v0;
+        }
+    }
+    h->stats.quadsWritten += count;
+}
+
+// Writes the world matrices of count transforms, picked as in transformWriteQuads.
+inline void transformWriteInstances(const TransformHierarchy* h, const uint32_t* ids, uint32_t first, uint32_t count, TransformInstance* out){
+    for (uint32_t k = 0; k < count; k++){
+        uint32_t i = ids ? ids[k] : first + k;
+        TransformInstance instance = { h->a[i], h->b[i], h->c[i], h->d[i], h->tx[i], h->ty[i] };
+        out[k] = instance;
+    }
+}
+
+inline void transformPrintStats(const TransformHierarchy* h, FILE* out){
+    const TransformStats* s = &h->stats;
+    double ms = s->seconds * 1000.0;
+    fprintf(out, "transforms: %u in use, %llu updates, %.0f transforms/ms (%.3f ms/update), %llu scalar batches, %llu quads written\n",
+            h->count, (unsigned long long)s->updates, ms > 0.0 ? s->transformsUpdated / ms : 0.0, s->updates ? ms / s->updates : 0.0,
+            (unsigned long long)s->scalarBatches, (unsigned long long)s->quadsWritten);
+}
@@ -0,0 +1,49 @@
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD;
+};
+
+Texture2D g_scene : register(t0);
+SamplerState g_sampler : register(s0);
+
+// Rendered part of the scene target: uv scale from the back buffer and the
+// clamp half a texel inside it, so filtering never reads past what was drawn.
+// g_tapOffset is a quarter pixel when the rendered part is larger than the
+// back buffer and zero otherwise. Filled by dynResUpscaleConstants.
+cbuffer UpscaleConstants : register(b0)
+{
+    float2 g_uvScale;
+    float2 g_uvMin;
+    float2 g_uvMax;
+    float2 g_tapOffset;
+};
+
+// One triangle covering the screen, built from the vertex id.
+PSInput VSMain(uint vertexId : SV_VertexID)
+{
+    float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+
+    PSInput result;
+
+    result.position = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+    result.uv = uv;
+
+    return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    float2 uv = input.uv * g_uvScale;
+    if (g_tapOffset.x == 0.0)
+    {
+        return g_scene.Sample(g_sampler, clamp(uv, g_uvMin, g_uvMax));
+    }
+
+    // Downsampling: four taps a quarter pixel from the centre cover the pixel's footprint.
+    float4 sum = g_scene.Sample(g_sampler, clamp(uv + float2(-g_tapOffset.x, -g_tapOffset.y), g_uvMin, g_uvMax));
+    sum += g_scene.Sample(g_sampler, clamp(uv + float2(g_tapOffset.x, -g_tapOffset.y), g_uvMin, g_uvMax));
+    sum += g_scene.Sample(g_sampler, clamp(uv + float2(-g_tapOffset.x, g_tapOffset.y), g_uvMin, g_uvMax));
+    sum += g_scene.Sample(g_sampler, clamp(uv + float2(g_tapOffset.x, g_tapOffset.y), g_uvMin, g_uvMax));
+    return sum * 0.25;
+}
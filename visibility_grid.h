@@ -0,0 +1,294 @@
+#pragma once
+
+// Visibility culling over a loose uniform grid. Every object lives in exactly
+// one cell, picked by the center of its bounds, so moving an object only
+// touches the grid when its center crosses into another cell. Objects larger
+// than a cell go to an overflow list every query tests in full instead, so
+// nothing sticks out of its cell by more than half a cell and a query never
+// has to look further than that past the viewport. Cells also remember the
+// largest half extents they hold to skip cells near the viewport whose
+// objects all stay clear of it. Each cell keeps its objects' bounds in
+// structure-of-arrays form so the viewport test runs over them 8 (AVX2) or
+// 4 (SSE2/NEON) at a time and writes the ids of visible objects out densely.
+// Bounds can be in any 2D space as long as the viewport is in the same one,
+// e.g. pixels of the 900x500 viewport or NDC.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VISIBILITY_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+inline int visibilityBitScan(uint32_t mask){ unsigned long index; _BitScanForward(&index, mask); return (int)index; }
+#else
+inline int visibilityBitScan(uint32_t mask){ return __builtin_ctz(mask); }
+#endif
+
+static const uint32_t VisibilityNoCell = 0xFFFFFFFF;
+
+struct VisibilityCell {
+    uint32_t* ids;
+    float* minX;
+    float* minY;
+    float* maxX;
+    float* maxY;
+    uint32_t count;
+    uint32_t capacity;
+    float maxHalfWidth;
+    float maxHalfHeight;
+};
+
+struct VisibilityGrid {
+    float worldMinX;
+    float worldMinY;
+    float cellSize;
+    float invCellSize;
+    int cellsX;
+    int cellsY;
+    VisibilityCell* cells;
+
+    // cellsX * cellsY cells followed by the overflow list.
+    uint32_t overflowCell;
+
+    uint32_t objectCapacity;
+    uint32_t* objectCell;
+    uint32_t* objectSlot;
+};
+
+// Tests count bounds against the viewport and appends the ids of the ones
+// overlapping it to visible. Returns how many were written.
+inline uint32_t visibilityCullBatch(const uint32_t* ids, const float* minX, const float* minY, const float* maxX, const float* maxY, uint32_t count,
+                                    float viewMinX, float viewMinY, float viewMaxX, float viewMaxY, uint32_t* visible){
+    uint32_t written = 0;
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vMinX = _mm256_set1_ps(viewMinX);
+    const __m256 vMinY = _mm256_set1_ps(viewMinY);
+    const __m256 vMaxX = _mm256_set1_ps(viewMaxX);
+    const __m256 vMaxY = _mm256_set1_ps(viewMaxY);
+    for(; i + 8 <= count; i += 8){
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(maxX + i), vMinX, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_loadu_ps(minX + i), vMaxX, _CMP_LE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_loadu_ps(maxY + i), vMinY, _CMP_GE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_loadu_ps(minY + i), vMaxY, _CMP_LE_OQ));
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+        while(mask){
+            visible[written++] = ids[i + visibilityBitScan(mask)];
+            mask &= mask - 1;
+        }
+    }
+#elif defined(VISIBILITY_SSE2)
+    const __m128 vMinX = _mm_set1_ps(viewMinX);
+    const __m128 vMinY = _mm_set1_ps(viewMinY);
+    const __m128 vMaxX = _mm_set1_ps(viewMaxX);
+    const __m128 vMaxY = _mm_set1_ps(viewMaxY);
+    for(; i + 4 <= count; i += 4){
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(maxX + i), vMinX), _mm_cmple_ps(_mm_loadu_ps(minX + i), vMaxX));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_loadu_ps(maxY + i), vMinY));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_loadu_ps(minY + i), vMaxY));
+        uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+        while(mask){
+            visible[written++] = ids[i + visibilityBitScan(mask)];
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vMinX = vdupq_n_f32(viewMinX);
+    const float32x4_t vMinY = vdupq_n_f32(viewMinY);
+    const float32x4_t vMaxX = vdupq_n_f32(viewMaxX);
+    const float32x4_t vMaxY = vdupq_n_f32(viewMaxY);
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    for(; i + 4 <= count; i += 4){
+        uint32x4_t inside = vandq_u32(vcgeq_f32(vld1q_f32(maxX + i), vMinX), vcleq_f32(vld1q_f32(minX + i), vMaxX));
+        inside = vandq_u32(inside, vcgeq_f32(vld1q_f32(maxY + i), vMinY));
+        inside = vandq_u32(inside, vcleq_f32(vld1q_f32(minY + i), vMaxY));
+        uint32_t mask = vaddvq_u32(vandq_u32(inside, bits));
+        while(mask){
+            visible[written++] = ids[i + visibilityBitScan(mask)];
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; i < count; i++){
+        if(maxX[i] >= viewMinX && minX[i] <= viewMaxX && maxY[i] >= viewMinY && minY[i] <= viewMaxY){
+            visible[written++] = ids[i];
+        }
+    }
+    return written;
+}
+
+// Objects are addressed by caller chosen ids below objectCapacity. Bounds
+// outside the world rect are fine, they end up in the border cells.
+inline bool visibilityGridInit(VisibilityGrid* g, float worldMinX, float worldMinY, float worldMaxX, float worldMaxY, float cellSize, uint32_t objectCapacity){
+    g->worldMinX = worldMinX;
+    g->worldMinY = worldMinY;
+    g->cellSize = cellSize;
+    g->invCellSize = 1.0f / cellSize;
+    g->cellsX = (int)((worldMaxX - worldMinX) * g->invCellSize) + 1;
+    g->cellsY = (int)((worldMaxY - worldMinY) * g->invCellSize) + 1;
+    g->overflowCell = (uint32_t)(g->cellsX * g->cellsY);
+    g->cells = (VisibilityCell*)calloc((size_t)g->overflowCell + 1, sizeof(VisibilityCell));
+    g->objectCapacity = objectCapacity;
+    g->objectCell = (uint32_t*)malloc(objectCapacity * sizeof(uint32_t));
+    g->objectSlot = (uint32_t*)malloc(objectCapacity * sizeof(uint32_t));
+    if(!g->cells || !g->objectCell || !g->objectSlot){
+        return false;
+    }
+    for(uint32_t i = 0; i < objectCapacity; i++){
+        g->objectCell[i] = VisibilityNoCell;
+    }
+    return true;
+}
+
+inline void visibilityGridDestroy(VisibilityGrid* g){
+    for(uint32_t i = 0; i <= g->overflowCell; i++){
+        free(g->cells[i].ids);
+        free(g->cells[i].minX);
+        free(g->cells[i].minY);
+        free(g->cells[i].maxX);
+        free(g->cells[i].maxY);
+    }
+    free(g->cells);
+    free(g->objectCell);
+    free(g->objectSlot);
+    g->cells = 0;
+}
+
+inline int visibilityCellCoord(float value, float origin, float invCellSize, int cells){
+    int c = (int)((value - origin) * invCellSize);
+    return c < 0 ? 0 : (c >= cells ? cells - 1 : c);
+}
+
+inline uint32_t visibilityGridCellOf(const VisibilityGrid* g, float minX, float minY, float maxX, float maxY){
+    if(maxX - minX > g->cellSize || maxY - minY > g->cellSize){
+        return g->overflowCell;
+    }
+    int cx = visibilityCellCoord((minX + maxX) * 0.5f, g->worldMinX, g->invCellSize, g->cellsX);
+    int cy = visibilityCellCoord((minY + maxY) * 0.5f, g->worldMinY, g->invCellSize, g->cellsY);
+    return (uint32_t)(cy * g->cellsX + cx);
+}
+
+inline bool visibilityCellGrow(VisibilityCell* cell){
+    uint32_t capacity = cell->capacity ? cell->capacity * 2 : 16;
+    // Arrays that did grow are kept on failure, capacity only moves once all of them have.
+    uint32_t* ids = (uint32_t*)realloc(cell->ids, capacity * sizeof(uint32_t));
+    if(!ids) return false;
+    cell->ids = ids;
+    float** arrays[4] = { &cell->minX, &cell->minY, &cell->maxX, &cell->maxY };
+    for(int a = 0; a < 4; a++){
+        float* grown = (float*)realloc(*arrays[a], capacity * sizeof(float));
+        if(!grown) return false;
+        *arrays[a] = grown;
+    }
+    cell->capacity = capacity;
+    return true;
+}
+
+inline void visibilityCellWrite(VisibilityCell* cell, uint32_t slot, float minX, float minY, float maxX, float maxY){
+    cell->minX[slot] = minX;
+    cell->minY[slot] = minY;
+    cell->maxX[slot] = maxX;
+    cell->maxY[slot] = maxY;
+    float halfWidth = (maxX - minX) * 0.5f;
+    float halfHeight = (maxY - minY) * 0.5f;
+    if(halfWidth > cell->maxHalfWidth) cell->maxHalfWidth = halfWidth;
+    if(halfHeight > cell->maxHalfHeight) cell->maxHalfHeight = halfHeight;
+}
+
+inline void visibilityGridUnlink(VisibilityGrid* g, uint32_t id){
+    VisibilityCell* cell = &g->cells[g->objectCell[id]];
+    uint32_t slot = g->objectSlot[id];
+    uint32_t last = --cell->count;
+    if(slot != last){
+        uint32_t moved = cell->ids[last];
+        cell->ids[slot] = moved;
+        cell->minX[slot] = cell->minX[last];
+        cell->minY[slot] = cell->minY[last];
+        cell->maxX[slot] = cell->maxX[last];
+        cell->maxY[slot] = cell->maxY[last];
+        g->objectSlot[moved] = slot;
+    }
+    if(cell->count == 0){
+        cell->maxHalfWidth = 0.0f;
+        cell->maxHalfHeight = 0.0f;
+    }
+    g->objectCell[id] = VisibilityNoCell;
+}
+
+inline bool visibilityGridLink(VisibilityGrid* g, uint32_t id, uint32_t cellIndex, float minX, float minY, float maxX, float maxY){
+    VisibilityCell* cell = &g->cells[cellIndex];
+    if(cell->count == cell->capacity && !visibilityCellGrow(cell)){
+        return false;
+    }
+    uint32_t slot = cell->count++;
+    cell->ids[slot] = id;
+    visibilityCellWrite(cell, slot, minX, minY, maxX, maxY);
+    g->objectCell[id] = cellIndex;
+    g->objectSlot[id] = slot;
+    return true;
+}
+
+// Inserts or moves an object. Staying in the same cell is a plain overwrite of its bounds.
+inline bool visibilityGridUpdate(VisibilityGrid* g, uint32_t id, float minX, float minY, float maxX, float maxY){
+    if(id >= g->objectCapacity){
+        return false;
+    }
+    uint32_t cellIndex = visibilityGridCellOf(g, minX, minY, maxX, maxY);
+    uint32_t current = g->objectCell[id];
+    if(current == cellIndex){
+        visibilityCellWrite(&g->cells[cellIndex], g->objectSlot[id], minX, minY, maxX, maxY);
+        return true;
+    }
+    if(current != VisibilityNoCell){
+        visibilityGridUnlink(g, id);
+    }
+    return visibilityGridLink(g, id, cellIndex, minX, minY, maxX, maxY);
+}
+
+inline void visibilityGridRemove(VisibilityGrid* g, uint32_t id){
+    if(id < g->objectCapacity && g->objectCell[id] != VisibilityNoCell){
+        visibilityGridUnlink(g, id);
+    }
+}
+
+// Writes the ids of every object overlapping the viewport to visible, which
+// must have room for all objects in the grid. Returns the count.
+inline uint32_t visibilityGridQuery(const VisibilityGrid* g, float viewMinX, float viewMinY, float viewMaxX, float viewMaxY, uint32_t* visible){
+    // Objects in the grid stick out of their cell by at most half a cell.
+    float pad = g->cellSize * 0.5f;
+    int x0 = visibilityCellCoord(viewMinX - pad, g->worldMinX, g->invCellSize, g->cellsX);
+    int y0 = visibilityCellCoord(viewMinY - pad, g->worldMinY, g->invCellSize, g->cellsY);
+    int x1 = visibilityCellCoord(viewMaxX + pad, g->worldMinX, g->invCellSize, g->cellsX);
+    int y1 = visibilityCellCoord(viewMaxY + pad, g->worldMinY, g->invCellSize, g->cellsY);
+    const VisibilityCell* overflow = &g->cells[g->overflowCell];
+    uint32_t written = visibilityCullBatch(overflow->ids, overflow->minX, overflow->minY, overflow->maxX, overflow->maxY, overflow->count,
+                                           viewMinX, viewMinY, viewMaxX, viewMaxY, visible);
+    for(int cy = y0; cy <= y1; cy++){
+        for(int cx = x0; cx <= x1; cx++){
+            const VisibilityCell* cell = &g->cells[cy * g->cellsX + cx];
+            if(cell->count == 0){
+                continue;
+            }
+            // Border cells also hold everything beyond the world rect, so they can't be bounded.
+            float cellMinX = g->worldMinX + cx * g->cellSize - cell->maxHalfWidth;
+            float cellMinY = g->worldMinY + cy * g->cellSize - cell->maxHalfHeight;
+            float cellMaxX = cellMinX + g->cellSize + 2.0f * cell->maxHalfWidth;
+            float cellMaxY = cellMinY + g->cellSize + 2.0f * cell->maxHalfHeight;
+            bool border = cx == 0 || cy == 0 || cx == g->cellsX - 1 || cy == g->cellsY - 1;
+            if(!border && (cellMaxX < viewMinX || cellMinX > viewMaxX || cellMaxY < viewMinY || cellMinY > viewMaxY)){
+                continue;
+            }
+            written += visibilityCullBatch(cell->ids, cell->minX, cell->minY, cell->maxX, cell->maxY, cell->count,
+                                           viewMinX, viewMinY, viewMaxX, viewMaxY, visible + written);
+        }
+    }
+    return written;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+// Worker pool: threads started once and parked on a condition variable, so
+// modules that split per frame work across threads (draw sorting, glyph
+// distance fields, particles, occlusion) don't pay for creating and joining
+// threads every call. One pool is meant to be shared by all of them.
+//
+// workerPoolRun hands the same function to threads 0..n-1, the calling thread
+// being thread 0, and returns once all of them are done. Every thread of a run
+// is running at the same time, so the function may wait on the others, as the
+// draw queue's radix passes do. Runs from different threads take turns; a run
+// must not start another run on the same pool.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static const int WorkerPoolMaxThreads = 16;
+
+typedef void (*WorkerPoolFn)(void* context, int thread, int numThreads);
+
+struct WorkerPool {
+    // Counting the thread calling workerPoolRun.
+    int numThreads;
+    std::thread threads[WorkerPoolMaxThreads];
+
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    WorkerPoolFn fn;
+    void* context;
+    int runThreads;
+    int busy;
+    uint64_t generation;
+    bool quit;
+
+    uint64_t runs;
+    uint64_t inlineRuns;
+};
+
+inline void workerPoolThread(WorkerPool* p, int thread){
+    std::unique_lock<std::mutex> lock(p->mutex);
+    // Generation is 0 until the first run, which this thread must not miss.
+    uint64_t seen = 0;
+    for(;;){
+        p->wake.wait(lock, [&]{ return p->quit || (p->generation != seen && thread < p->runThreads); });
+        if(p->quit){
+            return;
+        }
+        seen = p->generation;
+        WorkerPoolFn fn = p->fn;
+        void* context = p->context;
+        int numThreads = p->runThreads;
+        lock.unlock();
+        fn(context, thread, numThreads);
+        lock.lock();
+        if(--p->busy == 0){
+            p->done.notify_one();
+        }
+    }
+}
+
+// Starts numThreads - 1 threads; 1 or less makes every run execute on the caller.
+inline bool workerPoolInit(WorkerPool* p, int numThreads){
+    p->numThreads = numThreads < 1 ? 1 : (numThreads > WorkerPoolMaxThreads ? WorkerPoolMaxThreads : numThreads);
+    p->fn = 0;
+    p->context = 0;
+    p->runThreads = 0;
+    p->busy = 0;
+    p->generation = 0;
+    p->quit = false;
+    p->runs = 0;
+    p->inlineRuns = 0;
+    for(int t = 1; t < p->numThreads; t++){
+        p->threads[t] = std::thread(workerPoolThread, p, t);
+    }
+    return true;
+}
+
+inline void workerPoolDestroy(WorkerPool* p){
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->quit = true;
+    }
+    p->wake.notify_all();
+    for(int t = 1; t < p->numThreads; t++){
+        p->threads[t].join();
+    }
+    p->numThreads = 1;
+}
+
+// Threads a run may use; a null pool has just the caller.
+inline int workerPoolThreads(const WorkerPool* p){
+    return p ? p->numThreads : 1;
+}
+
+// Calls fn(context, t, n) for t in 0..n-1, n being numThreads capped at the
+// pool's size, and returns when every call has. A null pool runs fn inline.
+inline void workerPoolRun(WorkerPool* p, int numThreads, WorkerPoolFn fn, void* context){
+    int limit = workerPoolThreads(p);
+    numThreads = numThreads < 1 ? 1 : (numThreads > limit ? limit : numThreads);
+    if(numThreads == 1){
+        if(p){
+            std::lock_guard<std::mutex> lock(p->mutex);
+            p->inlineRuns++;
+        }
+        fn(context, 0, 1);
+        return;
+    }
+    std::lock_guard<std::mutex> run(p->runMutex);
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->fn = fn;
+        p->context = context;
+        p->runThreads = numThreads;
+        p->busy = numThreads - 1;
+        p->generation++;
+        p->runs++;
+    }
+    p->wake.notify_all();
+    fn(context, 0, numThreads);
+    std::unique_lock<std::mutex> lock(p->mutex);
+    p->done.wait(lock, [&]{ return p->busy == 0; });
+}
+
+inline void workerPoolPrintStats(const WorkerPool* p, FILE* out){
+    fprintf(out, "worker pool: %d threads, %llu parallel runs, %llu run on the caller alone\n", p->numThreads,
+            (unsigned long long)p->runs, (unsigned long long)p->inlineRuns);
+}